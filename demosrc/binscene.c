@@ -0,0 +1,707 @@
+/*
+ * binscene.c - reading and writing Tachyon binary scene (.tbs) files
+ *
+ *  $Id$
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tachyon.h"  /* Tachyon ray tracer API */
+#include "parse.h"    /* scene file parser, shares the texture namespace */
+#include "binscene.h" /* self protos */
+
+void * rt_mmap_readonly(const char *, size_t *); /* proto */
+void rt_munmap(void *, size_t); /* proto */
+
+#define TBS_PAD(x) (((x) + 7) & ~((unsigned long long) 7))
+
+/*
+ * Writer state.  Textures are identified by the pointer the parser got
+ * back from rt_texture(), which is mapped to a section index with a small
+ * open addressed hash table.  Consecutive spheres are accumulated and
+ * written out as a single sphere array section.
+ */
+typedef struct {
+  FILE * ofp;                /**< output file                           */
+  tbs_header hdr;            /**< header, rewritten when closing         */
+  int numtex;                /**< next texture section index             */
+  void ** texkeys;           /**< texture pointer hash table keys        */
+  unsigned int * texvals;    /**< texture section indices                */
+  int texsize;               /**< hash table size, power of two          */
+  int numspheres;            /**< pending spheres                        */
+  int maxspheres;
+  float * sctr;
+  float * srad;
+  unsigned int * stex;
+  int err;                   /**< sticky write error                     */
+} tbswriter;
+
+
+static unsigned int texhash(const void * tex, int size) {
+  unsigned long key = (unsigned long) tex;
+  key ^= key >> 17;
+  key *= 0x9e3779b1UL;
+  return (unsigned int) (key >> 7) & (size - 1);
+}
+
+static int texmap_insert(tbswriter * tbs, void * tex, unsigned int idx) {
+  unsigned int h;
+
+  /* keep the table at most half full */
+  if (2 * tbs->numtex >= tbs->texsize) {
+    void ** oldkeys = tbs->texkeys;
+    unsigned int * oldvals = tbs->texvals;
+    int oldsize = tbs->texsize;
+    int i;
+
+    tbs->texsize = (oldsize > 0) ? 2 * oldsize : 1024;
+    tbs->texkeys = (void **) calloc(tbs->texsize, sizeof(void *));
+    tbs->texvals = (unsigned int *) calloc(tbs->texsize, sizeof(unsigned int));
+    if (tbs->texkeys == NULL || tbs->texvals == NULL)
+      return PARSEALLOCERR;
+
+    for (i=0; i<oldsize; i++) {
+      if (oldkeys[i] != NULL) {
+        h = texhash(oldkeys[i], tbs->texsize);
+        while (tbs->texkeys[h] != NULL)
+          h = (h + 1) & (tbs->texsize - 1);
+        tbs->texkeys[h] = oldkeys[i];
+        tbs->texvals[h] = oldvals[i];
+      }
+    }
+    free(oldkeys);
+    free(oldvals);
+  }
+
+  h = texhash(tex, tbs->texsize);
+  while (tbs->texkeys[h] != NULL && tbs->texkeys[h] != tex)
+    h = (h + 1) & (tbs->texsize - 1);
+  tbs->texkeys[h] = tex;
+  tbs->texvals[h] = idx;
+
+  return PARSENOERR;
+}
+
+static int texmap_lookup(tbswriter * tbs, void * tex, unsigned int * idx) {
+  unsigned int h = texhash(tex, tbs->texsize);
+
+  while (tbs->texkeys[h] != NULL) {
+    if (tbs->texkeys[h] == tex) {
+      *idx = tbs->texvals[h];
+      return PARSENOERR;
+    }
+    h = (h + 1) & (tbs->texsize - 1);
+  }
+
+  printf("Binary scene writer: reference to an unknown texture\n");
+  return PARSEBADSYNTAX;
+}
+
+
+static void write_bytes(tbswriter * tbs, const void * data, size_t len) {
+  if (len > 0 && fwrite(data, 1, len, tbs->ofp) != len)
+    tbs->err = PARSEBADFILE;
+}
+
+static void write_section(tbswriter * tbs, unsigned int type,
+                          unsigned int count, unsigned int aux,
+                          unsigned int flags, unsigned long long len) {
+  tbs_section sect;
+
+  memset(&sect, 0, sizeof(sect));
+  sect.type = type;
+  sect.count = count;
+  sect.aux = aux;
+  sect.flags = flags;
+  sect.size = TBS_PAD(len);
+  write_bytes(tbs, &sect, sizeof(sect));
+  tbs->hdr.numsections++;
+}
+
+static void write_padding(tbswriter * tbs, unsigned long long len) {
+  static const char zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  write_bytes(tbs, zeros, (size_t) (TBS_PAD(len) - len));
+}
+
+
+/* write out any pending spheres as a single sphere array section */
+static int flush_spheres(tbswriter * tbs) {
+  unsigned long long len;
+  int n = tbs->numspheres;
+
+  if (n == 0)
+    return tbs->err;
+
+  len = (unsigned long long) n * (3 * sizeof(float) + sizeof(float) +
+                                  sizeof(unsigned int));
+  write_section(tbs, TBS_SECT_SPHERES, n, 0, 0, len);
+  write_bytes(tbs, tbs->sctr, n * 3 * sizeof(float));
+  write_bytes(tbs, tbs->srad, n * sizeof(float));
+  write_bytes(tbs, tbs->stex, n * sizeof(unsigned int));
+  write_padding(tbs, len);
+  tbs->numspheres = 0;
+
+  return tbs->err;
+}
+
+
+void * tbs_create(const char * filename, int xres, int yres, void * deftex) {
+  tbswriter * tbs;
+
+  tbs = (tbswriter *) calloc(1, sizeof(tbswriter));
+  if (tbs == NULL)
+    return NULL;
+
+  tbs->ofp = fopen(filename, "wb");
+  if (tbs->ofp == NULL) {
+    free(tbs);
+    return NULL;
+  }
+
+  memcpy(tbs->hdr.magic, TBS_MAGIC, sizeof(tbs->hdr.magic));
+  tbs->hdr.version = TBS_VERSION;
+  tbs->hdr.endian = TBS_ENDIAN;
+  tbs->hdr.xres = xres;
+  tbs->hdr.yres = yres;
+  write_bytes(tbs, &tbs->hdr, sizeof(tbs->hdr));
+
+  tbs->numtex = TBS_DEFAULT_TEXTURE + 1;
+  if (texmap_insert(tbs, deftex, TBS_DEFAULT_TEXTURE) != PARSENOERR) {
+    tbs_close(tbs);
+    return NULL;
+  }
+
+  return tbs;
+}
+
+
+int tbs_script(void * voidtbs, const char * text, size_t len) {
+  tbswriter * tbs = (tbswriter *) voidtbs;
+  static const char endscene[] = "\nEND_SCENE\n";
+  size_t i;
+
+  /* don't bother writing out blank space between typed sections */
+  for (i=0; i<len; i++) {
+    if (text[i] != ' ' && text[i] != '\t' && text[i] != '\n' && text[i] != '\r')
+      break;
+  }
+  if (i == len)
+    return tbs->err;
+
+  flush_spheres(tbs);
+  write_section(tbs, TBS_SECT_SCRIPT, 0, 0, 0, len + sizeof(endscene) - 1);
+  write_bytes(tbs, text, len);
+  write_bytes(tbs, endscene, sizeof(endscene) - 1);
+  write_padding(tbs, len + sizeof(endscene) - 1);
+
+  return tbs->err;
+}
+
+
+int tbs_texture_def(void * voidtbs, void * tex, const tbs_texture * td) {
+  tbswriter * tbs = (tbswriter *) voidtbs;
+  int rc;
+
+  write_section(tbs, TBS_SECT_TEXTURE, 1, 0, 0, sizeof(tbs_texture));
+  write_bytes(tbs, td, sizeof(tbs_texture));
+  write_padding(tbs, sizeof(tbs_texture));
+
+  rc = texmap_insert(tbs, tex, tbs->numtex);
+  tbs->numtex++;
+
+  return rc | tbs->err;
+}
+
+
+int tbs_texname(void * voidtbs, void * tex, const char * name) {
+  tbswriter * tbs = (tbswriter *) voidtbs;
+  unsigned int idx;
+  size_t len = strlen(name) + 1;
+  int rc;
+
+  if ((rc = texmap_lookup(tbs, tex, &idx)) != PARSENOERR)
+    return rc;
+
+  write_section(tbs, TBS_SECT_TEXNAME, 1, idx, 0, len);
+  write_bytes(tbs, name, len);
+  write_padding(tbs, len);
+
+  return tbs->err;
+}
+
+
+int tbs_light_def(void * voidtbs, const tbs_light * ld) {
+  tbswriter * tbs = (tbswriter *) voidtbs;
+
+  flush_spheres(tbs);
+  write_section(tbs, TBS_SECT_LIGHT, 1, 0, 0, sizeof(tbs_light));
+  write_bytes(tbs, ld, sizeof(tbs_light));
+  write_padding(tbs, sizeof(tbs_light));
+
+  return tbs->err;
+}
+
+
+int tbs_sphere(void * voidtbs, void * tex, const float * ctr, float rad) {
+  tbswriter * tbs = (tbswriter *) voidtbs;
+  unsigned int idx;
+  int n = tbs->numspheres;
+  int rc;
+
+  if ((rc = texmap_lookup(tbs, tex, &idx)) != PARSENOERR)
+    return rc;
+
+  if (n >= tbs->maxspheres) {
+    int newsize = (tbs->maxspheres > 0) ? 2 * tbs->maxspheres : 4096;
+    float * newctr = (float *) realloc(tbs->sctr, newsize * 3 * sizeof(float));
+    float * newrad;
+    unsigned int * newtex;
+
+    if (newctr == NULL)
+      return PARSEALLOCERR;
+    tbs->sctr = newctr;
+    newrad = (float *) realloc(tbs->srad, newsize * sizeof(float));
+    if (newrad == NULL)
+      return PARSEALLOCERR;
+    tbs->srad = newrad;
+    newtex = (unsigned int *) realloc(tbs->stex, newsize * sizeof(unsigned int));
+    if (newtex == NULL)
+      return PARSEALLOCERR;
+    tbs->stex = newtex;
+    tbs->maxspheres = newsize;
+  }
+
+  tbs->sctr[n*3    ] = ctr[0];
+  tbs->sctr[n*3 + 1] = ctr[1];
+  tbs->sctr[n*3 + 2] = ctr[2];
+  tbs->srad[n] = rad;
+  tbs->stex[n] = idx;
+  tbs->numspheres++;
+
+  return PARSENOERR;
+}
+
+
+int tbs_spherearray(void * voidtbs, void * tex, int count, const float * ctr,
+                    const float * rad) {
+  tbswriter * tbs = (tbswriter *) voidtbs;
+  unsigned long long len = (unsigned long long) count * 4 * sizeof(float);
+  unsigned int idx;
+  int rc;
+
+  if ((rc = texmap_lookup(tbs, tex, &idx)) != PARSENOERR)
+    return rc;
+
+  flush_spheres(tbs);
+  write_section(tbs, TBS_SECT_SPHEREARRAY, count, idx, 0, len);
+  write_bytes(tbs, ctr, count * 3 * sizeof(float));
+  write_bytes(tbs, rad, count * sizeof(float));
+  write_padding(tbs, len);
+
+  return tbs->err;
+}
+
+
+int tbs_vertexarray(void * voidtbs, int numverts, const float * v,
+                    const float * n, const float * c) {
+  tbswriter * tbs = (tbswriter *) voidtbs;
+  unsigned long long len;
+  size_t arraysz = numverts * 3 * sizeof(float);
+
+  flush_spheres(tbs);
+  len = ((c != NULL) ? 3 : 2) * (unsigned long long) arraysz;
+  write_section(tbs, TBS_SECT_VERTEXARRAY, numverts, 0,
+                (c != NULL) ? TBS_VERTEX_COLORS : 0, len);
+  write_bytes(tbs, v, arraysz);
+  write_bytes(tbs, n, arraysz);
+  if (c != NULL)
+    write_bytes(tbs, c, arraysz);
+  write_padding(tbs, len);
+
+  return tbs->err;
+}
+
+
+int tbs_facets(void * voidtbs, int type, void * tex, int newtex,
+               int count, const int * facets) {
+  tbswriter * tbs = (tbswriter *) voidtbs;
+  unsigned long long len = (unsigned long long) count * sizeof(int);
+  unsigned int idx;
+  int rc;
+
+  if ((rc = texmap_lookup(tbs, tex, &idx)) != PARSENOERR)
+    return rc;
+
+  write_section(tbs, type, count, idx, (newtex) ? TBS_FACETS_NEWTEX : 0, len);
+  write_bytes(tbs, facets, count * sizeof(int));
+  write_padding(tbs, len);
+
+  return tbs->err;
+}
+
+
+int tbs_close(void * voidtbs) {
+  tbswriter * tbs = (tbswriter *) voidtbs;
+  int rc;
+
+  flush_spheres(tbs);
+
+  /* go back and fill in the final section count */
+  if (fseek(tbs->ofp, 0, SEEK_SET) == 0)
+    write_bytes(tbs, &tbs->hdr, sizeof(tbs->hdr));
+  else
+    tbs->err = PARSEBADFILE;
+
+  if (fclose(tbs->ofp))
+    tbs->err = PARSEBADFILE;
+
+  rc = tbs->err;
+  free(tbs->texkeys);
+  free(tbs->texvals);
+  free(tbs->sctr);
+  free(tbs->srad);
+  free(tbs->stex);
+  free(tbs);
+
+  return rc;
+}
+
+
+/*
+ * Reader state.  The most recent vertex array section stays current
+ * until the next one, and is referenced by the index buffers that follow.
+ */
+typedef struct {
+  void * ctx;                /**< parser context, owns texture names    */
+  void ** textable;          /**< textures, indexed by section order    */
+  int numtex;
+  int maxtex;
+  int numverts;              /**< current vertex array                  */
+  const float * v;
+  const float * n;
+  const float * c;
+} tbsreader;
+
+
+static unsigned int read_texture(tbsreader * tr, SceneHandle scene,
+                                 const tbs_texture * td) {
+  apitexture tex;
+  void * voidtex;
+
+  memset(&tex, 0, sizeof(tex));
+  tex.ambient = td->ambient;
+  tex.diffuse = td->diffuse;
+  tex.specular = td->specular;
+  tex.opacity = td->opacity;
+  tex.col.r = td->col[0];
+  tex.col.g = td->col[1];
+  tex.col.b = td->col[2];
+  tex.texturefunc = td->texturefunc;
+  tex.ctr.x = td->ctr[0];     tex.ctr.y = td->ctr[1];     tex.ctr.z = td->ctr[2];
+  tex.rot.x = td->rot[0];     tex.rot.y = td->rot[1];     tex.rot.z = td->rot[2];
+  tex.scale.x = td->scale[0]; tex.scale.y = td->scale[1]; tex.scale.z = td->scale[2];
+  tex.uaxs.x = td->uaxs[0];   tex.uaxs.y = td->uaxs[1];   tex.uaxs.z = td->uaxs[2];
+  tex.vaxs.x = td->vaxs[0];   tex.vaxs.y = td->vaxs[1];   tex.vaxs.z = td->vaxs[2];
+  tex.waxs.x = td->waxs[0];   tex.waxs.y = td->waxs[1];   tex.waxs.z = td->waxs[2];
+  memcpy(tex.imap, td->imap, sizeof(tex.imap));
+  tex.imap[sizeof(tex.imap) - 1] = '\0';
+
+  voidtex = rt_texture(scene, &tex);
+  rt_tex_phong(voidtex, td->phong, td->phongexp, td->phongtype);
+  rt_tex_transmode(voidtex, td->transmode);
+  rt_tex_outline(voidtex, td->outline, td->outlinewidth);
+  voidtex = rt_texture_intern(scene, voidtex);
+
+  if (tr->numtex >= tr->maxtex) {
+    int newsize = 2 * tr->maxtex;
+    void ** newtable = (void **) realloc(tr->textable, newsize * sizeof(void *));
+    if (newtable == NULL)
+      return PARSEALLOCERR;
+    tr->textable = newtable;
+    tr->maxtex = newsize;
+  }
+  tr->textable[tr->numtex] = voidtex;
+  tr->numtex++;
+
+  return PARSENOERR;
+}
+
+
+static void read_light(SceneHandle scene, const tbs_light * ld) {
+  apitexture tex;
+  void * li = NULL;
+
+  memset(&tex, 0, sizeof(apitexture));
+  tex.col.r = ld->col[0];
+  tex.col.g = ld->col[1];
+  tex.col.b = ld->col[2];
+
+  switch (ld->type) {
+    case TBS_LIGHT_POINT:
+      li = rt_light(scene, rt_texture(scene, &tex),
+                    rt_vector(ld->ctr[0], ld->ctr[1], ld->ctr[2]), ld->rad);
+      break;
+
+    case TBS_LIGHT_DIRECTIONAL:
+      rt_directional_light(scene, rt_texture(scene, &tex),
+                           rt_vector(ld->dir[0], ld->dir[1], ld->dir[2]));
+      break;
+
+    case TBS_LIGHT_SPOT:
+      li = rt_spotlight(scene, rt_texture(scene, &tex),
+                        rt_vector(ld->ctr[0], ld->ctr[1], ld->ctr[2]), ld->rad,
+                        rt_vector(ld->dir[0], ld->dir[1], ld->dir[2]),
+                        ld->start, ld->end);
+      break;
+  }
+
+  if (li != NULL && ld->attenuation)
+    rt_light_attenuation(li, ld->kc, ld->kl, ld->kq);
+}
+
+
+static unsigned int read_facets(tbsreader * tr, SceneHandle scene,
+                                const tbs_section * sect, const int * facets) {
+  int stripaddr[2][3] = { {0, 1, 2}, {1, 0, 2} };
+  int t, numtri;
+  void * tex = tr->textable[sect->aux];
+  const float * v = tr->v;
+  const float * n = tr->n;
+  const float * c = tr->c;
+
+  if (sect->type == TBS_SECT_TRIMESH)
+    numtri = sect->count / 3;
+  else
+    numtri = (sect->count > 2) ? sect->count - 2 : 0;
+
+  /* vertex colored triangles all share one texture */
+  if (c != NULL)
+    tex = rt_texture_copy_vcstri(scene, tex);
+
+  for (t=0; t<numtri; t++) {
+    int v0, v1, v2;
+
+    if (sect->type == TBS_SECT_TRIMESH) {
+      v0 = facets[t*3    ];
+      v1 = facets[t*3 + 1];
+      v2 = facets[t*3 + 2];
+    } else {
+      /* fix the winding order of every other strip triangle */
+      v0 = facets[t + stripaddr[t & 0x01][0]];
+      v1 = facets[t + stripaddr[t & 0x01][1]];
+      v2 = facets[t + stripaddr[t & 0x01][2]];
+    }
+
+    if ((v0 < 0) || (v0 >= tr->numverts) ||
+        (v1 < 0) || (v1 >= tr->numverts) ||
+        (v2 < 0) || (v2 >= tr->numverts)) {
+      printf("Binary scene: invalid vertex index in triangle %d\n", t);
+      return PARSEBADSYNTAX;
+    }
+    v0 *= 3;
+    v1 *= 3;
+    v2 *= 3;
+
+    if (c != NULL) {
+      rt_vcstri3fv(scene, tex, &v[v0], &v[v1], &v[v2],
+                   &n[v0], &n[v1], &n[v2], &c[v0], &c[v1], &c[v2]);
+    } else {
+      rt_stri3fv(scene, tex, &v[v0], &v[v1], &v[v2],
+                 &n[v0], &n[v1], &n[v2]);
+    }
+  }
+
+  return PARSENOERR;
+}
+
+
+static unsigned int read_section(tbsreader * tr, SceneHandle scene,
+                                 const tbs_section * sect,
+                                 const char * data) {
+  unsigned long long sz = sect->size;
+  unsigned int i;
+
+  switch (sect->type) {
+    case TBS_SECT_SCRIPT:
+      return readmodel_stream(tr->ctx, data, (size_t) sz, scene);
+
+    case TBS_SECT_TEXTURE:
+      if (sz < sizeof(tbs_texture))
+        return PARSEBADSYNTAX;
+      return read_texture(tr, scene, (const tbs_texture *) data);
+
+    case TBS_SECT_TEXNAME:
+      if (sect->aux >= (unsigned int) tr->numtex ||
+          sz == 0 || memchr(data, '\0', (size_t) sz) == NULL)
+        return PARSEBADSYNTAX;
+      return readmodel_addtexture(tr->ctx, tr->textable[sect->aux], data);
+
+    case TBS_SECT_LIGHT:
+      if (sz < sizeof(tbs_light))
+        return PARSEBADSYNTAX;
+      read_light(scene, (const tbs_light *) data);
+      return PARSENOERR;
+
+    case TBS_SECT_SPHERES: {
+      const float * ctr = (const float *) data;
+      const float * rad = ctr + 3 * (size_t) sect->count;
+      const unsigned int * tex = (const unsigned int *) (rad + sect->count);
+
+      if (sz < (unsigned long long) sect->count * 5 * sizeof(float))
+        return PARSEBADSYNTAX;
+
+      for (i=0; i<sect->count; i++) {
+        if (tex[i] >= (unsigned int) tr->numtex)
+          return PARSEBADSYNTAX;
+        rt_sphere3fv(scene, tr->textable[tex[i]], &ctr[i*3], rad[i]);
+      }
+      return PARSENOERR;
+    }
+
+    case TBS_SECT_SPHEREARRAY: {
+      const float * ctr = (const float *) data;
+
+      if (sz < (unsigned long long) sect->count * 4 * sizeof(float) ||
+          sect->aux >= (unsigned int) tr->numtex)
+        return PARSEBADSYNTAX;
+
+      /* same as a sphere array in a scene file, straight from the file */
+      readmodel_spheres(scene, tr->textable[sect->aux], sect->count,
+                        ctr, ctr + 3 * (size_t) sect->count);
+      return PARSENOERR;
+    }
+
+    case TBS_SECT_VERTEXARRAY: {
+      int ncomp = (sect->flags & TBS_VERTEX_COLORS) ? 3 : 2;
+      size_t arraysz = 3 * (size_t) sect->count;
+
+      if (sz < (unsigned long long) ncomp * arraysz * sizeof(float))
+        return PARSEBADSYNTAX;
+
+      /* vertex data is used in place, straight from the file mapping */
+      tr->numverts = sect->count;
+      tr->v = (const float *) data;
+      tr->n = tr->v + arraysz;
+      tr->c = (ncomp == 3) ? tr->n + arraysz : NULL;
+      return PARSENOERR;
+    }
+
+    case TBS_SECT_TRIMESH:
+    case TBS_SECT_TRISTRIP:
+      if (sz < (unsigned long long) sect->count * sizeof(int) ||
+          sect->aux >= (unsigned int) tr->numtex)
+        return PARSEBADSYNTAX;
+      return read_facets(tr, scene, sect, (const int *) data);
+  }
+
+  /* skip sections we don't know about */
+  return PARSENOERR;
+}
+
+
+/*
+ * Read a binary scene held in memory, which must be 8 byte aligned.
+ * The name is only used in error messages.
+ */
+unsigned int readbinmodel_buffer(const char * filename, const void * data,
+                                 size_t len, SceneHandle scene) {
+  const char * buf = (const char *) data;
+  const tbs_header * hdr;
+  tbsreader tr;
+  size_t ofs;
+  unsigned int i, rc;
+
+  hdr = (const tbs_header *) buf;
+  if (len < sizeof(tbs_header) ||
+      memcmp(hdr->magic, TBS_MAGIC, sizeof(hdr->magic)) ||
+      hdr->version != TBS_VERSION || hdr->endian != TBS_ENDIAN) {
+    printf("Binary scene: %s is not a compatible .tbs file\n", filename);
+    return PARSEBADSYNTAX;
+  }
+
+  rt_outputfile(scene, "outfile.tga");
+  rt_resolution(scene, hdr->xres, hdr->yres);
+  rt_verbose(scene, 0);
+
+  memset(&tr, 0, sizeof(tr));
+  tr.ctx = readmodel_begin(filename, scene);
+  tr.maxtex = 1024;
+  tr.textable = (void **) malloc(tr.maxtex * sizeof(void *));
+  if (tr.ctx == NULL || tr.textable == NULL) {
+    if (tr.ctx != NULL)
+      readmodel_end(tr.ctx, scene);
+    free(tr.textable);
+    return PARSEALLOCERR;
+  }
+  tr.textable[TBS_DEFAULT_TEXTURE] = readmodel_deftexture(tr.ctx);
+  tr.numtex = TBS_DEFAULT_TEXTURE + 1;
+
+  rc = PARSENOERR;
+  ofs = sizeof(tbs_header);
+  for (i=0; i<hdr->numsections && rc == PARSENOERR; i++) {
+    tbs_section sect;
+
+    if (len - ofs < sizeof(tbs_section)) {
+      rc = PARSEEOF;
+      break;
+    }
+    memcpy(&sect, buf + ofs, sizeof(sect));
+    ofs += sizeof(tbs_section);
+    if (sect.size > len - ofs) {
+      rc = PARSEEOF;
+      break;
+    }
+
+    rc = read_section(&tr, scene, &sect, buf + ofs);
+    ofs += (size_t) sect.size;
+  }
+
+  readmodel_end(tr.ctx, scene);
+  free(tr.textable);
+
+  return rc;
+}
+
+unsigned int readbinmodel(const char * filename, SceneHandle scene) {
+  void * mapaddr;
+  char * buf;
+  size_t len;
+  unsigned int rc;
+
+  /* map the whole file when possible, otherwise read it into memory */
+  len = 0;
+  buf = NULL;
+  mapaddr = rt_mmap_readonly(filename, &len);
+  if (mapaddr != NULL) {
+    buf = (char *) mapaddr;
+  } else {
+    FILE * ifp = fopen(filename, "rb");
+    long flen;
+
+    if (ifp == NULL)
+      return PARSEBADFILE;
+    fseek(ifp, 0, SEEK_END);
+    flen = ftell(ifp);
+    fseek(ifp, 0, SEEK_SET);
+    if (flen > 0)
+      buf = (char *) malloc(flen);
+    if (buf == NULL || fread(buf, 1, flen, ifp) != (size_t) flen) {
+      free(buf);
+      fclose(ifp);
+      return PARSEBADFILE;
+    }
+    fclose(ifp);
+    len = flen;
+  }
+
+  rc = readbinmodel_buffer(filename, buf, len, scene);
+
+  if (mapaddr != NULL)
+    rt_munmap(mapaddr, len);
+  else
+    free(buf);
+
+  return rc;
+}
@@ -0,0 +1,109 @@
+/*
+ * binscene.h - definitions for the Tachyon binary scene (.tbs) format
+ *
+ *  $Id$
+ */
+
+/*
+ * A binary scene file is a header followed by a sequence of sections,
+ * which are processed in file order.  Each section begins with a
+ * tbs_section record, followed by 'size' bytes of payload.  Payloads are
+ * padded to a multiple of 8 bytes, so that every array in a memory mapped
+ * file is suitably aligned to be handed straight to the rt_xxx3fv() calls.
+ * All values are stored in the byte order of the machine that wrote the
+ * file, and readers reject files with a foreign byte order.
+ *
+ * Bulk geometry, textures, and lights are stored in typed sections.
+ * Everything else (camera, shader modes, cylinders, etc.) is kept as
+ * ASCII scene text in script sections, which are run through the
+ * regular scene file parser.
+ */
+
+#define TBS_MAGIC       "TACHYTBS"
+#define TBS_VERSION     1
+#define TBS_ENDIAN      0x01020304
+
+#define TBS_SECT_SCRIPT      1  /**< ASCII scene text, ends with END_SCENE */
+#define TBS_SECT_TEXTURE     2  /**< one tbs_texture record                */
+#define TBS_SECT_TEXNAME     3  /**< name for texture 'aux', nul terminated */
+#define TBS_SECT_LIGHT       4  /**< one tbs_light record                  */
+#define TBS_SECT_SPHERES     5  /**< centers[3n], radii[n], textures[n]    */
+#define TBS_SECT_VERTEXARRAY 6  /**< coords[3n], normals[3n], colors[3n]   */
+#define TBS_SECT_TRIMESH     7  /**< int indices[3n] into last vertex array */
+#define TBS_SECT_TRISTRIP    8  /**< int indices[n] into last vertex array  */
+#define TBS_SECT_SPHEREARRAY 9  /**< centers[3n], radii[n], texture 'aux'  */
+
+#define TBS_VERTEX_COLORS    1  /**< vertex array has per-vertex colors    */
+#define TBS_FACETS_NEWTEX    1  /**< texture is unused so far, ignored     */
+
+#define TBS_LIGHT_POINT       0
+#define TBS_LIGHT_DIRECTIONAL 1
+#define TBS_LIGHT_SPOT        2
+
+/*
+ * Texture index 0 always refers to the parser's default texture,
+ * texture sections are numbered from 1 in the order they appear.
+ */
+#define TBS_DEFAULT_TEXTURE  0
+
+typedef struct {
+  char magic[8];                /**< TBS_MAGIC, not nul terminated        */
+  unsigned int version;         /**< TBS_VERSION                          */
+  unsigned int endian;          /**< TBS_ENDIAN in writer's byte order    */
+  int xres;                     /**< image resolution from the scene file */
+  int yres;
+  unsigned int numsections;     /**< number of sections following         */
+  unsigned int reserved;
+} tbs_header;
+
+typedef struct {
+  unsigned int type;            /**< TBS_SECT_xxx                         */
+  unsigned int count;           /**< number of elements in the payload    */
+  unsigned int aux;             /**< texture index, where applicable      */
+  unsigned int flags;           /**< section specific flags               */
+  unsigned long long size;      /**< payload size in bytes, padded        */
+} tbs_section;
+
+typedef struct {
+  float ambient, diffuse, specular, opacity;
+  float col[3];
+  int texturefunc;
+  float ctr[3], rot[3], scale[3];
+  float uaxs[3], vaxs[3], waxs[3];
+  float phong, phongexp;
+  int phongtype;
+  int transmode;
+  float outline, outlinewidth;
+  char imap[96];
+} tbs_texture;
+
+typedef struct {
+  int type;                     /**< TBS_LIGHT_xxx                        */
+  int attenuation;              /**< nonzero if attenuation is set        */
+  float ctr[3];
+  float rad;
+  float dir[3];
+  float start, end;             /**< spotlight falloff angles             */
+  float kc, kl, kq;             /**< attenuation factors                  */
+  float col[3];
+} tbs_light;
+
+/* reading */
+unsigned int readbinmodel(const char * filename, SceneHandle scene);
+unsigned int readbinmodel_buffer(const char * filename, const void * data,
+                                 size_t len, SceneHandle scene);
+
+/* writing, used by the scene file converter in parse.c */
+void * tbs_create(const char * filename, int xres, int yres, void * deftex);
+int tbs_script(void * voidtbs, const char * text, size_t len);
+int tbs_texture_def(void * voidtbs, void * tex, const tbs_texture * td);
+int tbs_texname(void * voidtbs, void * tex, const char * name);
+int tbs_light_def(void * voidtbs, const tbs_light * ld);
+int tbs_sphere(void * voidtbs, void * tex, const float * ctr, float rad);
+int tbs_spherearray(void * voidtbs, void * tex, int count, const float * ctr,
+                    const float * rad);
+int tbs_vertexarray(void * voidtbs, int numverts, const float * v,
+                    const float * n, const float * c);
+int tbs_facets(void * voidtbs, int type, void * tex, int newtex,
+               int count, const int * facets);
+int tbs_close(void * voidtbs);
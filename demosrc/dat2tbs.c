@@ -0,0 +1,33 @@
+/* dat2tbs.c
+ * This file contains a converter from Tachyon ASCII scene files to the
+ * binary .tbs scene format, which loads much faster for large models.
+ *
+ *  $Id$
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "tachyon.h"
+#include "parse.h"
+
+int main(int argc, char **argv) {
+  unsigned int rc;
+
+  if (argc != 3) {
+    printf("usage: %s infile.dat outfile.tbs\n", argv[0]);
+    return -1;
+  }
+
+  rt_initialize(&argc, &argv);
+
+  rc = convertmodel(argv[1], argv[2]);
+  if (rc != PARSENOERR) {
+    printf("Failed to convert %s, parser error code %u\n", argv[1], rc);
+    remove(argv[2]);
+  }
+
+  rt_finalize();
+
+  return (rc == PARSENOERR) ? 0 : -1;
+}
@@ -45,12 +45,16 @@ static void printusage(char **argv) {
   printf("Message Options:\n");
   printf("  +V verbose messages on \n");
   printf("  -V verbose messages off **\n");
+  printf("  -stats            (print ray and intersection statistics)\n");
+  printf("  -costmap filename (save a false color image of per-pixel cost)\n");
   printf("\n");
   printf("Speed Tuning Options:\n");
   printf("  -raydepth xxx     (maximum ray recursion depth\n");
   printf("  -numthreads xxx   (** default is auto-determined)\n");
+  printf("  -numa off|pin|replicate  (pin threads to CPUs, copy grids per node)\n");
   printf("  -nobounding\n");
   printf("  -boundthresh xxx  (** default threshold is 16)\n");
+  printf("  -volbricks        store volumes in bricked, Morton-ordered layout\n");
   printf("\n");
   printf("Shading Options:\n");
   printf("  -fullshade    best quality rendering (and slowest) **\n");
@@ -119,8 +123,16 @@ static void printusage(char **argv) {
   printf("  -format PPM     24-bit PPM          (uncompressed)\n");
   printf("  -format PPM48   48-bit PPM          (uncompressed)\n");
   printf("  -format PSD48   48-bit PSD          (uncompressed)\n");
+  printf("  -format PFM     96-bit float PFM    (uncompressed, HDR)\n");
+  printf("  -format EXR     48-bit half OpenEXR (uncompressed, HDR)\n");
   printf("  -format RGB     24-bit SGI RGB      (uncompressed)\n");
   printf("  -format TARGA   24-bit Targa        (uncompressed) **\n");
+  printf("  -tiledoutput rows  render and write the image in bands of rows,\n");
+  printf("                     for images too large to fit in memory\n");
+  printf("  -checkpoint secs   save progress to a .ckpt file next to the output\n");
+  printf("                     every secs seconds, and resume from it if it's\n");
+  printf("                     there, for frames of animations and bands of\n");
+  printf("                     tiled output\n");
   printf("\n");
   printf("Animation Related Options:\n");
   printf("  -camfile filename.cam  Animate using file of camera positions.\n");
@@ -142,6 +154,7 @@ static void initoptions(argoptions * opt) {
   opt->xsize = 0;
   opt->ysize = 0;
   opt->verbosemode = -1;
+  opt->renderstats = -1;
   opt->ray_maxdepth = -1;
   opt->aa_maxsamples = -1;
   opt->boundmode = -1; 
@@ -154,9 +167,11 @@ static void initoptions(argoptions * opt) {
   opt->shadow_filtering = -1;
   opt->fogmode = -1;
   opt->normalfixupmode = -1;
+  opt->volumelayout = -1;
   opt->imgprocess = -1;
   opt->imggamma = 1.0;
   opt->numthreads = -1;
+  opt->numamode = -1;
   opt->nosave = -1;
   opt->rescale_lights = 1.0;
   opt->auto_skylight = 0.0;
@@ -167,14 +182,25 @@ static void initoptions(argoptions * opt) {
   opt->cropyres = 0;
   opt->cropxstart = 0;
   opt->cropystart = 0;
+  opt->tilerows = 0;
+  opt->ckptinterval = -1.0f;
 }
 
 /* process options that affect scene generation */
 int presceneoptions(argoptions * opt, SceneHandle scene) {
+  /* the parser and image map loader use the scene's threads too */
+  if (opt->numthreads != -1) {
+    rt_set_numthreads(scene, opt->numthreads);
+  }
+
   if (opt->normalfixupmode != -1) {
     rt_normal_fixup_mode(scene, opt->normalfixupmode);
   }
 
+  if (opt->volumelayout != -1) {
+    rt_volume_layout(scene, opt->volumelayout);
+  }
+
   return 0;
 }
 
@@ -198,6 +224,10 @@ int postsceneoptions(argoptions * opt, SceneHandle scene) {
     }
   }
 
+  if (opt->tilerows > 0) {
+    rt_tiled_output(scene, opt->tilerows);
+  }
+
   if (opt->useoutfilename == -1) {
     if (opt->usecamfile != -1) {
       strcpy(opt->outfilename, "cam.%04d");
@@ -236,6 +266,14 @@ int postsceneoptions(argoptions * opt, SceneHandle scene) {
         strcat(opt->outfilename, ".ppm");
         break;  
 
+      case RT_FORMAT_PFM:
+        strcat(opt->outfilename, ".pfm");
+        break;  
+
+      case RT_FORMAT_EXR:
+        strcat(opt->outfilename, ".exr");
+        break;  
+
       case RT_FORMAT_TARGA:
                    default:
         strcat(opt->outfilename, ".tga");
@@ -247,6 +285,13 @@ int postsceneoptions(argoptions * opt, SceneHandle scene) {
     strcpy(opt->outfilename, "\0");
   }
 
+  if (opt->ckptinterval >= 0.0f && opt->outfilename[0] != '\0') {
+    /* one checkpoint for the whole run, named after the output file */
+    char ckptname[FILENAME_MAX];
+    sprintf(ckptname, "%.*s.ckpt", FILENAME_MAX - 6, opt->outfilename);
+    rt_checkpoint(scene, ckptname, opt->ckptinterval);
+  }
+
   if (opt->rescale_lights < 1.0) {
     /* rescale all lights by supplied scaling factor */
     rt_rescale_lights(scene, opt->rescale_lights);
@@ -301,6 +346,14 @@ int postsceneoptions(argoptions * opt, SceneHandle scene) {
     rt_verbose(scene, 0);
   }  
 
+  if (opt->renderstats == 1) {
+    rt_render_stats_mode(scene, 1);
+  }
+
+  if (opt->costmapfile[0] != '\0') {
+    rt_render_costmap(scene, opt->costmapfile);
+  }
+
   if (opt->ray_maxdepth != -1) {
     rt_camera_raydepth(scene, opt->ray_maxdepth);
   } 
@@ -341,8 +394,8 @@ int postsceneoptions(argoptions * opt, SceneHandle scene) {
     rt_fog_rendering_mode(scene, opt->fogmode);
   }
 
-  if (opt->numthreads != -1) {
-    rt_set_numthreads(scene, opt->numthreads);
+  if (opt->numamode != -1) {
+    rt_numa_mode(scene, opt->numamode);
   }
 
   return 0;
@@ -358,6 +411,18 @@ static int getparm(int argc, char **argv, int num, argoptions * opt, int node) {
     sscanf(argv[num + 1], "%d", &opt->numthreads);
     return 2;
   }
+  if (!strcmp(argv[num], "-numa")) {
+    char tmp[1024];
+    sscanf(argv[num + 1], "%s", tmp);
+    if (!strcmp(tmp, "off")) {
+      opt->numamode = RT_NUMA_OFF;
+    } else if (!strcmp(tmp, "pin")) {
+      opt->numamode = RT_NUMA_PIN;
+    } else if (!strcmp(tmp, "replicate")) {
+      opt->numamode = RT_NUMA_REPLICATE;
+    }
+    return 2;
+  }
   if (!strcmp(argv[num], "-camfile")) {
     opt->usecamfile = 1;
     sscanf(argv[num + 1], "%s", &opt->camfilename[0]);
@@ -393,6 +458,16 @@ static int getparm(int argc, char **argv, int num, argoptions * opt, int node) {
     opt->verbosemode = 0;
     return 1;
   }
+  if (!strcmp(argv[num], "-stats")) {
+    /* count rays and intersection tests while rendering */
+    opt->renderstats = 1;
+    return 1;
+  }
+  if (!strcmp(argv[num], "-costmap")) {
+    /* save the per-pixel rendering cost as an image */
+    sscanf(argv[num + 1], "%s", &opt->costmapfile[0]);
+    return 2;
+  }
   if (!strcmp(argv[num], "+V")) {
     /* turn verbose messages on */
     opt->verbosemode = 1;
@@ -403,6 +478,11 @@ static int getparm(int argc, char **argv, int num, argoptions * opt, int node) {
     opt->boundmode = RT_BOUNDING_DISABLED;
     return 1;
   }
+  if (!strcmp(argv[num], "-volbricks")) {
+    /* store volume data in cache-friendly bricks */
+    opt->volumelayout = RT_VOLUME_LAYOUT_BRICKED;
+    return 1;
+  }
   if (!strcmp(argv[num], "-boundthresh")) {
     /* set automatic bounding threshold control value */
     sscanf(argv[num + 1], "%d", &opt->boundthresh);
@@ -511,6 +591,14 @@ static int getparm(int argc, char **argv, int num, argoptions * opt, int node) {
     sscanf(argv[num + 4], "%d", &opt->cropystart);
     return 5;
   }
+  if (!strcmp(argv[num], "-tiledoutput")) {
+    sscanf(argv[num + 1], "%d", &opt->tilerows);
+    return 2;
+  }
+  if (!strcmp(argv[num], "-checkpoint")) {
+    sscanf(argv[num + 1], "%f", &opt->ckptinterval);
+    return 2;
+  }
   if (!strcmp(argv[num], "-clamp")) {
     opt->imgprocess = 0; /* clamp pixel values */
     return 1;
@@ -538,6 +626,10 @@ static int getparm(int argc, char **argv, int num, argoptions * opt, int node) {
       opt->outimageformat = RT_FORMAT_PPM;
     } else if (!compare(str, "PSD48")) {
       opt->outimageformat = RT_FORMAT_PSD48;
+    } else if (!compare(str, "PFM")) {
+      opt->outimageformat = RT_FORMAT_PFM;
+    } else if (!compare(str, "EXR")) {
+      opt->outimageformat = RT_FORMAT_EXR;
     } else if (!compare(str, "RGB")) {
       opt->outimageformat = RT_FORMAT_SGIRGB;
 #if defined(USEJPEG)
@@ -11,6 +11,8 @@ typedef struct {
   char outfilename[FILENAME_MAX];   /**< name of output image file */
   int outimageformat;               /**< format of output image */
   int verbosemode;                  /**< verbose flags */
+  int renderstats;                  /**< print ray and intersection counts */
+  char costmapfile[FILENAME_MAX];   /**< per-pixel cost image filename */
   int ray_maxdepth;                 /**< maximum ray recursion depth */
   int aa_maxsamples;                /**< antialiasing setting */
   int boundmode;                    /**< bounding mode */
@@ -24,10 +26,12 @@ typedef struct {
   int shadow_filtering;             /**< transparent surface shadowing mode */
   int fogmode;                      /**< fog rendering mode */
   int numthreads;                   /**< explicit number of threads to use */
+  int numamode;                     /**< thread pinning and grid copies */
   int nosave;                       /**< don't write output image to disk */
   int xsize;                        /**< override default image x resolution */
   int ysize;                        /**< override default image y resolution */
   int normalfixupmode;              /**< override normal fixup mode */
+  int volumelayout;                 /**< voxel storage layout for volumes */
   int imgprocess;                   /**< image post processing flags */
   float imggamma;                   /**< image gamma correction factor */
   float rescale_lights;             /**< direct lighting rescaling factor */
@@ -41,6 +45,8 @@ typedef struct {
   int cropyres;
   int cropxstart;
   int cropystart;
+  int tilerows;                     /**< rows per band for tiled output */
+  float ckptinterval;               /**< seconds between checkpoints, or -1 */
 } argoptions;
 
 int getargs(int argc, char **argv, argoptions * opt, int node);
@@ -0,0 +1,329 @@
+/* isectbench.c
+ * This file contains microbenchmarks for the primitive intersection
+ * kernels, which test large batches of random rays against random
+ * primitives through each object's intersect method, with rays aimed to
+ * mostly hit or mostly miss, and report the time per test.  The kernels
+ * are compiled with the library's flt type, so build the library with
+ * and without -DUSESINGLEFLT (see Make-config) to compare the single and
+ * double precision versions.
+ *
+ *  $Id$
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#define TACHYON_INTERNAL 1  /* the kernels work on the library's own types */
+#include "tachyon.h"
+#include "macros.h"
+#include "vector.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "cylinder.h"
+#include "ring.h"
+#include "quadric.h"
+#include "box.h"
+#include "grid.h"
+
+#define NUMPRIMS   4096    /* primitives per kernel                    */
+#define NUMTESTS   65536   /* ray/primitive pairs per pass             */
+#define MINTIME    0.25    /* seconds to run each kernel for, at least */
+
+typedef struct {
+  object * obj;
+  vector hit;      /**< a point on the primitive                */
+  flt size;        /**< rough radius of the primitive           */
+} benchprim;
+
+typedef struct {
+  vector o, d;     /**< ray origin and direction                */
+  int prim;        /**< primitive the ray is tested against     */
+} benchray;
+
+typedef void (* isectfunc)(const void *, void *);
+
+typedef struct {
+  const char * name;
+  int kind;
+} benchkernel;
+
+#define K_NULL      0
+#define K_SPHERE    1
+#define K_TRI       2
+#define K_CYLINDER  3
+#define K_FCYLINDER 4
+#define K_RING      5
+#define K_QUADRIC   6
+#define K_BOX       7
+#define K_GRIDBOUNDS 8
+
+static const benchkernel kernels[] = {
+  { "overhead",   K_NULL },
+  { "sphere",     K_SPHERE },
+  { "tri",        K_TRI },
+  { "cylinder",   K_CYLINDER },
+  { "fcylinder",  K_FCYLINDER },
+  { "ring",       K_RING },
+  { "quadric",    K_QUADRIC },
+  { "box",        K_BOX },
+  { "gridbounds", K_GRIDBOUNDS }
+};
+
+#define NUMKERNELS ((int) (sizeof(kernels) / sizeof(benchkernel)))
+
+static unsigned int seed = 31337;
+
+static flt randflt(void) {
+  return (flt) (rt_rand(&seed) / RT_RAND_MAX);
+}
+
+/* uniformly distributed random unit vector */
+static vector randdir(void) {
+  vector v;
+  flt len;
+
+  do {
+    v.x = 2.0 * randflt() - 1.0;
+    v.y = 2.0 * randflt() - 1.0;
+    v.z = 2.0 * randflt() - 1.0;
+    len = VDot(&v, &v);
+  } while (len > 1.0 || len < 0.01);
+  VNorm(&v);
+
+  return v;
+}
+
+static vector vaddscaled(vector a, flt s, vector b) {
+  vector v;
+  v.x = a.x + s * b.x;
+  v.y = a.y + s * b.y;
+  v.z = a.z + s * b.z;
+  return v;
+}
+
+/* counts the valid hits of a test in the ray's intersection count */
+static void counthit(flt t, const object * obj, ray * ry) {
+  if (t > EPSILON && t < ry->maxdist)
+    ry->intstruct.num++;
+}
+
+static void nullisect(const void * obj, void * ry) {
+}
+
+static void gridbounds(const void * obj, void * voidry) {
+  ray * ry = (ray *) voidry;
+  flt tnear, tfar;
+
+  if (grid_bounds_test((const object *) obj, ry, &tnear, &tfar))
+    ry->add_intersection(tnear, (const object *) obj, ry);
+}
+
+/* make a random primitive of the given kind, near the origin */
+static void makeprim(scenedef * scene, int kind, benchprim * p) {
+  vector ctr, axis, v0, v1, v2;
+  flt size = 0.5 + 0.5 * randflt();
+
+  ctr.x = 20.0 * randflt() - 10.0;
+  ctr.y = 20.0 * randflt() - 10.0;
+  ctr.z = 20.0 * randflt() - 10.0;
+  axis = randdir();
+
+  p->size = size;
+  p->hit = ctr;
+
+  switch (kind) {
+    case K_NULL:
+    case K_SPHERE:
+      p->obj = newsphere(scene, NULL, ctr, size);
+      break;
+
+    case K_TRI:
+      /* retry the rare degenerate triangle */
+      do {
+        v0 = vaddscaled(ctr, size, randdir());
+        v1 = vaddscaled(ctr, size, randdir());
+        v2 = vaddscaled(ctr, size, randdir());
+        p->obj = newtri(scene, NULL, v0, v1, v2);
+      } while (p->obj == NULL);
+      p->hit.x = (v0.x + v1.x + v2.x) / 3.0;
+      p->hit.y = (v0.y + v1.y + v2.y) / 3.0;
+      p->hit.z = (v0.z + v1.z + v2.z) / 3.0;
+      break;
+
+    case K_CYLINDER:
+      p->obj = newcylinder(scene, NULL, ctr, axis, 0.5 * size);
+      break;
+
+    case K_FCYLINDER:
+      VScale(&axis, 2.0 * size);
+      p->obj = newfcylinder(scene, NULL, ctr, axis, 0.5 * size);
+      p->hit = vaddscaled(ctr, 0.5, axis);
+      break;
+
+    case K_RING: {
+      /* aim at the middle of the ring, rather than its hole */
+      vector dir = randdir(), inplane;
+      VCross(&axis, &dir, &inplane);
+      VNorm(&inplane);
+      p->obj = newring(scene, NULL, ctr, axis, 0.5 * size, size);
+      p->hit = vaddscaled(ctr, 0.75 * size, inplane);
+      break;
+    }
+
+    case K_QUADRIC: {
+      /* an ellipsoid, with the sphere's radius along the x axis */
+      quadric * q = newquadric();
+      q->ctr = ctr;
+      q->mat.a = 1.0;
+      q->mat.e = 2.0;
+      q->mat.h = 4.0;
+      q->mat.j = -size * size;
+      p->obj = (object *) q;
+      p->size = size * 0.5;
+      break;
+    }
+
+    case K_BOX:
+    case K_GRIDBOUNDS:
+      v0.x = ctr.x - 0.3 * size - 0.4 * size * randflt();
+      v0.y = ctr.y - 0.3 * size - 0.4 * size * randflt();
+      v0.z = ctr.z - 0.3 * size - 0.4 * size * randflt();
+      v1.x = 2.0 * ctr.x - v0.x;
+      v1.y = 2.0 * ctr.y - v0.y;
+      v1.z = 2.0 * ctr.z - v0.z;
+      if (kind == K_BOX)
+        p->obj = (object *) newbox(NULL, v0, v1);
+      else
+        p->obj = newgrid(scene, 1, 1, 1, v0, v1);
+      break;
+  }
+}
+
+/*
+ * Aim a ray from a random point around a primitive, either at the
+ * primitive's hit point with a little jitter, or well to one side of it.
+ */
+static void makeray(const benchprim * p, int prim, int hitheavy,
+                    benchray * r) {
+  vector target, view, side;
+
+  r->o = vaddscaled(p->hit, 20.0, randdir());
+
+  if (hitheavy) {
+    target = vaddscaled(p->hit, 0.05 * p->size, randdir());
+  } else {
+    /* offset the target perpendicular to the line of sight */
+    VSub(&p->hit, &r->o, &view);
+    do {
+      vector dir = randdir();
+      VCross(&view, &dir, &side);
+    } while (VLength(&side) < 0.1);
+    VNorm(&side);
+    target = vaddscaled(p->hit, 3.0 * p->size, side);
+  }
+
+  VSub(&target, &r->o, &r->d);
+  VNorm(&r->d);
+  r->prim = prim;
+}
+
+/*
+ * Run one kernel over a batch of rays for at least MINTIME seconds,
+ * returning the time per test in ns, and the fraction of tests that hit.
+ */
+static double runkernel(isectfunc isect, benchprim * prims,
+                        const benchray * rays, double * hitrate) {
+  rt_timerhandle timer;
+  ray ry;
+  double t = 0.0;
+  long passes = 0, hits = 0;
+  int i;
+
+  memset(&ry, 0, sizeof(ry));
+  ry.add_intersection = counthit;
+  ry.maxdist = FHUGE;
+  ry.flags = RT_RAY_PRIMARY;
+
+  timer = rt_timer_create();
+  rt_timer_start(timer);
+  do {
+    hits = 0;
+    for (i=0; i<NUMTESTS; i++) {
+      ry.o = rays[i].o;
+      ry.d = rays[i].d;
+      ry.intstruct.num = 0;
+      isect(prims[rays[i].prim].obj, &ry);
+      hits += (ry.intstruct.num > 0);
+    }
+    passes++;
+    t = rt_timer_timenow(timer);
+  } while (t < MINTIME || passes < 2);
+  rt_timer_destroy(timer);
+
+  *hitrate = hits / (double) NUMTESTS;
+  return 1.0e9 * t / ((double) passes * NUMTESTS);
+}
+
+int main(int argc, char **argv) {
+  SceneHandle scene;
+  benchprim * prims;
+  benchray * hitrays, * missrays;
+  int k, i;
+
+  rt_initialize(&argc, &argv);
+  scene = rt_newscene();
+
+  prims = (benchprim *) malloc(NUMPRIMS * sizeof(benchprim));
+  hitrays = (benchray *) malloc(NUMTESTS * sizeof(benchray));
+  missrays = (benchray *) malloc(NUMTESTS * sizeof(benchray));
+
+  printf("  %s precision, %d primitives, %d tests per pass\n",
+         (sizeof(flt) == sizeof(float)) ? "single" : "double",
+         NUMPRIMS, NUMTESTS);
+  printf("  %-12s %12s %6s %12s %6s\n", "kernel", "hit-heavy", "hits",
+         "miss-heavy", "hits");
+
+  for (k=0; k<NUMKERNELS; k++) {
+    isectfunc isect;
+    double hitns, missns, hitrate, missrate;
+
+    for (i=0; i<NUMPRIMS; i++)
+      makeprim((scenedef *) scene, kernels[k].kind, &prims[i]);
+
+    /* rays visit the primitives in a random order */
+    for (i=0; i<NUMTESTS; i++) {
+      int prim = rt_rand(&seed) % NUMPRIMS;
+      makeray(&prims[prim], prim, 1, &hitrays[i]);
+      makeray(&prims[prim], prim, 0, &missrays[i]);
+    }
+
+    if (kernels[k].kind == K_NULL)
+      isect = nullisect;
+    else if (kernels[k].kind == K_GRIDBOUNDS)
+      isect = gridbounds;
+    else
+      isect = prims[0].obj->methods->intersect;
+
+    hitns = runkernel(isect, prims, hitrays, &hitrate);
+    missns = runkernel(isect, prims, missrays, &missrate);
+
+    printf("  %-12s %9.2f ns %5.1f%% %9.2f ns %5.1f%%\n", kernels[k].name,
+           hitns, 100.0 * hitrate, missns, 100.0 * missrate);
+
+    /* objects that aren't allocated from the scene are freed here */
+    if (kernels[k].kind == K_QUADRIC || kernels[k].kind == K_BOX) {
+      for (i=0; i<NUMPRIMS; i++)
+        prims[i].obj->methods->freeobj(prims[i].obj);
+    }
+  }
+
+  free(missrays);
+  free(hitrays);
+  free(prims);
+  rt_deletescene(scene);
+  rt_finalize();
+
+  return 0;
+}
@@ -0,0 +1,106 @@
+/* loadbench.c
+ * This file contains a benchmark program for scene loading, which
+ * compares the time taken to build a scene from an ASCII scene file
+ * with the time taken to build it from the equivalent binary .tbs file.
+ *
+ *  $Id$
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "tachyon.h"
+#include "parse.h"
+#include "binscene.h"
+
+int rt_mynode(void); /* proto */
+
+#define TBSFILE "loadbench.tbs"
+#define NUMRUNS 3
+
+static long filesize(const char *filename) {
+  FILE * fp = fopen(filename, "rb");
+  long sz = -1;
+
+  if (fp != NULL) {
+    fseek(fp, 0, SEEK_END);
+    sz = ftell(fp);
+    fclose(fp);
+  }
+
+  return sz;
+}
+
+/* load a scene, returning the best time of several runs */
+static double loadscene(const char *filename, int binary) {
+  rt_timerhandle timer;
+  SceneHandle scene;
+  double t, best = -1.0;
+  unsigned int rc;
+  int i;
+
+  timer = rt_timer_create();
+  for (i=0; i<NUMRUNS; i++) {
+    scene = rt_newscene();
+    rt_timer_start(timer);
+    if (binary)
+      rc = readbinmodel(filename, scene);
+    else 
+      rc = readmodel(filename, scene);
+    rt_timer_stop(timer);
+    rt_deletescene(scene);
+
+    if (rc != PARSENOERR) {
+      printf("Failed to load %s, parser error code %u\n", filename, rc);
+      best = -1.0;
+      break;
+    }
+
+    t = rt_timer_time(timer);
+    if (best < 0.0 || t < best)
+      best = t;
+  }
+  rt_timer_destroy(timer);
+
+  return best;
+}
+
+int main(int argc, char **argv) {
+  rt_timerhandle timer;
+  double tconv, tascii, tbin;
+
+  if (argc != 2) {
+    printf("usage: %s scenefile.dat\n", argv[0]);
+    return -1;
+  }
+
+  rt_initialize(&argc, &argv);
+
+  timer = rt_timer_create();
+  rt_timer_start(timer);
+  if (convertmodel(argv[1], TBSFILE) != PARSENOERR) {
+    printf("Failed to convert %s to binary form\n", argv[1]);
+    rt_finalize();
+    return -1;
+  }
+  rt_timer_stop(timer);
+  tconv = rt_timer_time(timer);
+  rt_timer_destroy(timer);
+
+  tascii = loadscene(argv[1], 0);
+  tbin = loadscene(TBSFILE, 1);
+
+  if (rt_mynode() == 0 && tascii >= 0.0 && tbin >= 0.0) {
+    printf("Scene %s\n", argv[1]);
+    printf("  format      size (bytes)   load time\n");
+    printf("  ASCII     %14ld   %8.4fs\n", filesize(argv[1]), tascii);
+    printf("  binary    %14ld   %8.4fs\n", filesize(TBSFILE), tbin);
+    printf("  conversion time %8.4fs, load speedup %6.2fx\n", 
+           tconv, tascii / tbin);
+  }
+
+  remove(TBSFILE);
+  rt_finalize();
+
+  return 0;
+}
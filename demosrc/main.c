@@ -12,6 +12,7 @@
 #include "tachyon.h"    /* The Tachyon ray tracing library API */
 #include "getargs.h"    /* command line argument/option parsing */
 #include "parse.h"      /* Support for my own scene file format */
+#include "binscene.h"   /* Support for binary Tachyon scene files */
 #include "nffparse.h"   /* Support for NFF files, as in SPD */
 #include "ac3dparse.h"  /* Support for AC3D files */
 #include "mgfparse.h"   /* Support for MGF files */
@@ -484,6 +485,7 @@ static int animate_scene(argoptions opt, SceneHandle scene, int node) {
     floatvec cv, cu, cc;
     apivector cmv, cmu, cmc;
     int frameno=0;
+    int startframe;
     int done=0;
     float fps;
     rt_timerhandle fpstimer;
@@ -495,6 +497,11 @@ static int animate_scene(argoptions opt, SceneHandle scene, int node) {
     if (node == 0)
       printf("Running Camera File: %s\n", opt.camfilename);
 
+    /* frames finished by an earlier, interrupted run are skipped */
+    startframe = rt_checkpoint_frames(scene);
+    if (startframe > 0 && node == 0)
+      printf("Resuming animation at frame %d\n", startframe);
+
     fpstimer=rt_timer_create();
     animationtimer=rt_timer_create();
 
@@ -504,6 +511,11 @@ static int animate_scene(argoptions opt, SceneHandle scene, int node) {
       fscanf(camfp, "%f %f %f  %f %f %f  %f %f %f",
         &cv.x, &cv.y, &cv.z, &cu.x, &cu.y, &cu.z, &cc.x, &cc.y, &cc.z);
 
+      if (frameno < startframe) {
+        frameno++;
+        continue;
+      }
+
       cmv.x = cv.x; cmv.y = cv.y; cmv.z = cv.z;
       cmu.x = cu.x; cmu.y = cu.y; cmu.z = cu.z;
       cmc.x = cc.x; cmc.y = cc.y; cmc.z = cc.z;
@@ -533,6 +545,7 @@ static int animate_scene(argoptions opt, SceneHandle scene, int node) {
       rt_outputfile(scene, outfilename);
       rt_camera_position(scene, cmc, cmv, cmu);
 
+      rt_checkpoint_set_frame(scene, frameno);
       rt_renderscene(scene);
 
       if (dh != NULL) {
@@ -544,7 +557,9 @@ static int animate_scene(argoptions opt, SceneHandle scene, int node) {
       frameno++;
     } 
     rt_timer_stop(animationtimer);
-    fps = frameno / (float) rt_timer_time(animationtimer);
+    if (!done)
+      rt_checkpoint_finish(scene); /* all of the frames are finished */
+    fps = (frameno - startframe) / (float) rt_timer_time(animationtimer);
     if (node == 0) {
       printf("\rCompleted animation of %d frames                            \n", frameno);
       printf("Animation Time: %10.4f seconds  (Averaged %7.4f FPS)\n", 
@@ -643,6 +658,10 @@ int main(int argc, char **argv) {
                     !strcmp(filename+len-4, ".NFF"))) {
       rc = ParseNFF(filename, scene); /* must be an NFF file */
     }
+    else if (len > 4 && (!strcmp(filename+len-4, ".tbs") ||
+                         !strcmp(filename+len-4, ".TBS"))) {
+      rc = readbinmodel(filename, scene); /* Tachyon binary scene file */
+    }
     else if (len > 3 && (!strcmp(filename+len-3, ".ac") ||
                          !strcmp(filename+len-3, ".AC"))) {
       rc = ParseAC3D(filename, scene); /* Must be an AC3D file */
@@ -704,7 +723,10 @@ int main(int argc, char **argv) {
         rt_outputfile(scene, multioutfilename);
       }
 
+      rt_checkpoint_set_frame(scene, fileindex);
       rt_renderscene(scene); /* Render a single frame */
+      if (fileindex+1 == opt.numfiles)
+        rt_checkpoint_finish(scene); /* all of the scene files are done */
     }
 
     rt_deletescene(scene);   /* free the scene, get ready for next one */
@@ -8,9 +8,11 @@
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <ctype.h> /* needed for toupper(), macro.. */
 
 #include "tachyon.h"  /* Tachyon ray tracer API */
+#include "threads.h"  /* threads for parsing large blocks */
 
 #ifdef USELIBMGF
 #include "mgfparse.h" /* MGF parser code */
@@ -20,7 +22,7 @@
 #include "parse.h" /* self protos */
 #undef PARSE_INTERNAL
 
-#define ERROR_READBUF_SIZE 65536
+#include "binscene.h" /* binary scene file writer */
 
 /*
  * a is unknown compared string, b must be upper case already...)
@@ -42,6 +44,493 @@ static int stringcmp(const char * a, const char * b) {
   return 0;
 }
 
+/*
+ * Scene text tokenizer.  Scene files are mapped or read into memory in
+ * one piece, and tokens are scanned directly from the buffer, rather than
+ * by going through stdio a character at a time.  pscanf() accepts the 
+ * subset of scanf() formats used by the parser (%s, %d, %f, and white
+ * space), and follows the same conventions for its return value.  Every
+ * %s must give the most characters its buffer holds as a field width,
+ * as in %254s, longer tokens are truncated to fit, and skipped entirely.
+ */
+void * rt_mmap_readonly(const char *, size_t *); /* proto */
+void rt_munmap(void *, size_t); /* proto */
+
+#define ISSPACE(c) ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+#define ISDIGIT(c) ((c) >= '0' && (c) <= '9')
+
+static errcode OpenParseFile(parsefile * pf, const char * filename) {
+  memset(pf, 0, sizeof(parsefile));
+
+  pf->mapaddr = rt_mmap_readonly(filename, &pf->maplen);
+  if (pf->mapaddr != NULL) {
+    pf->text = (const char *) pf->mapaddr;
+    pf->end = pf->text + pf->maplen;
+  } else {
+    FILE * ifp;
+    size_t len, sz;
+
+    ifp = fopen(filename, "rb");
+    if (ifp == NULL)
+      return PARSEBADFILE;
+
+    /* files that can't be mapped may not be seekable either */
+    len = 0;
+    sz = 65536;
+    pf->buf = (char *) malloc(sz);
+    while (pf->buf != NULL) {
+      char * newbuf;
+
+      len += fread(pf->buf + len, 1, sz - len, ifp);
+      if (len < sz)
+        break;
+
+      sz *= 2;
+      newbuf = (char *) realloc(pf->buf, sz);
+      if (newbuf == NULL)
+        free(pf->buf);
+      pf->buf = newbuf;
+    }
+    fclose(ifp);
+
+    if (pf->buf == NULL) 
+      return PARSEALLOCERR;
+
+    pf->text = pf->buf;
+    pf->end = pf->text + len;
+  }
+  pf->pos = pf->text;
+
+  return PARSENOERR;
+}
+
+static void CloseParseFile(parsefile * pf) {
+  if (pf->mapaddr != NULL)
+    rt_munmap(pf->mapaddr, pf->maplen);
+  free(pf->buf);
+  memset(pf, 0, sizeof(parsefile));
+}
+
+static const char * SkipSpace(const char * s, const char * end) {
+  while (s < end && ISSPACE(*s))
+    s++;
+  return s;
+}
+
+/* 
+ * Convert a decimal number to a float, with the same result strtof() 
+ * would give.  Numbers with few enough significant digits and a small
+ * exponent are computed exactly in double precision and then rounded to 
+ * float, anything else is handed to strtof().  Returns the end of the 
+ * number, or s if there is no number there.
+ */
+static const char * ScanFloat(const char * s, const char * end, float * f) {
+  static const double pow10[] = { 
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  const char * p = s;
+  unsigned long long mant = 0;
+  int neg = 0, ndigits = 0, nsig = 0, exp10 = 0, hard = 0;
+  char tmp[64];
+  char * tend;
+  int len;
+
+  if (p < end && (*p == '-' || *p == '+')) {
+    neg = (*p == '-');
+    p++;
+  }
+  for (; p < end && ISDIGIT(*p); p++, ndigits++) {
+    if (mant != 0 || *p != '0') {
+      mant = mant * 10 + (*p - '0');
+      nsig++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && ISDIGIT(*p); p++, ndigits++) {
+      if (mant != 0 || *p != '0') {
+        mant = mant * 10 + (*p - '0');
+        nsig++;
+      }
+      exp10--;
+    }
+  }
+  if (ndigits > 0 && p < end && (*p == 'e' || *p == 'E')) {
+    const char * e = p + 1;
+    int eneg = 0, eval = 0;
+
+    if (e < end && (*e == '-' || *e == '+')) {
+      eneg = (*e == '-');
+      e++;
+    }
+    if (e < end && ISDIGIT(*e)) {
+      for (; e < end && ISDIGIT(*e); e++) {
+        if (eval < 10000)
+          eval = eval * 10 + (*e - '0');
+      }
+      exp10 += (eneg) ? -eval : eval;
+      p = e;
+    } else {
+      hard = 1; /* malformed exponent, let strtof() decide */
+    }
+  }
+
+  if (!hard && ndigits > 0 && nsig <= 15 && exp10 >= -22 && exp10 <= 22 &&
+      (p == end || ISSPACE(*p))) {
+    double d = (double) mant;
+    union { double d; unsigned long long u; } bits;
+
+    d = (exp10 < 0) ? d / pow10[-exp10] : d * pow10[exp10];
+
+    /* 
+     * Rounding the exact double to float gives the correctly rounded
+     * result, unless the double lies exactly halfway between two floats
+     */
+    bits.d = d;
+    if ((bits.u & 0x1fffffffULL) != 0x10000000ULL) {
+      *f = (float) ((neg) ? -d : d);
+      return p;
+    }
+  }
+
+  /* hard cases: long mantissas, large exponents, inf, nan, hex, etc */
+  for (len=0; s+len < end && !ISSPACE(s[len]) && len < (int) sizeof(tmp)-1; len++)
+    tmp[len] = s[len];
+  tmp[len] = '\0';
+
+  *f = strtof(tmp, &tend);
+  return s + (tend - tmp);
+}
+
+static const char * ScanInt(const char * s, const char * end, int * i) {
+  const char * p = s;
+  int neg = 0, val = 0;
+
+  if (p < end && (*p == '-' || *p == '+')) {
+    neg = (*p == '-');
+    p++;
+  }
+  if (p == end || !ISDIGIT(*p))
+    return s;
+
+  for (; p < end && ISDIGIT(*p); p++) 
+    val = val * 10 + (*p - '0');
+
+  *i = (neg) ? -val : val;
+  return p;
+}
+
+static int pscanf(parsehandle * ph, const char * fmt, ...) {
+  parsefile * pf = &ph->in;
+  const char * p = pf->pos;
+  const char * end = pf->end;
+  const char * next;
+  int count = 0, width;
+  va_list ap;
+
+  va_start(ap, fmt);
+  for (; *fmt != '\0'; fmt++) {
+    if (ISSPACE(*fmt)) {
+      p = SkipSpace(p, end);
+      continue;
+    }
+
+    /* all conversions skip leading white space */
+    p = SkipSpace(p, end);
+    if (p == end) {
+      if (count == 0)
+        count = EOF;
+      break;
+    }
+
+    fmt++;
+    for (width=0; ISDIGIT(*fmt); fmt++)
+      width = width * 10 + (*fmt - '0');
+
+    if (*fmt == 's') {
+      char * str = va_arg(ap, char *);
+      const char * tokend = p;
+      while (tokend < end && !ISSPACE(*tokend)) 
+        tokend++;
+      if (tokend - p < width)
+        width = (int) (tokend - p);
+      memcpy(str, p, width);
+      str[width] = '\0';
+      p = tokend;
+    } else if (*fmt == 'f') {
+      next = ScanFloat(p, end, va_arg(ap, float *));
+      if (next == p)
+        break;
+      p = next;
+    } else if (*fmt == 'd') {
+      next = ScanInt(p, end, va_arg(ap, int *));
+      if (next == p)
+        break;
+      p = next;
+    } else {
+      break;
+    }
+    count++;
+  }
+  va_end(ap);
+
+  pf->pos = p;
+  return count;
+}
+
+/* skip the rest of the current line, for comments */
+static void SkipLine(parsehandle * ph) {
+  const char * p;
+
+  p = (const char *) memchr(ph->in.pos, '\n', ph->in.end - ph->in.pos);
+  ph->in.pos = (p != NULL) ? p + 1 : ph->in.end;
+}
+
+/*
+ * Large numeric blocks in vertex and sphere arrays are converted by
+ * several threads.  A quick serial pass finds the first token of every 
+ * PARSE_CHUNK_TOKENS tokens, and the chunks in between are then converted 
+ * in parallel.  Blocks containing anything but well formed numbers are 
+ * left to the regular serial code, so errors are handled as they always 
+ * have been.
+ */
+#define PARSE_CHUNK_TOKENS       16384 /* tokens converted per work unit */
+#define PARSE_PARALLEL_TOKENS    65536 /* smallest block split up        */
+#define PARSE_CHUNK_OBJECTS       4096 /* objects created per work unit  */
+#define PARSE_PARALLEL_OBJECTS   16384 /* smallest object batch split up */
+
+typedef struct {
+  const char ** chunks;  /* first token of each chunk, and end of block */
+  int numtokens;         /* number of tokens in the block              */
+  float * f;             /* converted floats, or NULL                   */
+  int * i;               /* converted ints, or NULL                     */
+} blockparms;
+
+static void * ParseBlockThread(void * voidparms) {
+  blockparms * bp;
+  rt_tasktile_t tile;
+  int c, t, tend;
+
+  rt_threadlaunch_getdata(voidparms, (void **) &bp);
+  while (rt_threadlaunch_next_tile(voidparms, 1, &tile) != RT_SCHED_DONE) {
+    for (c=tile.start; c<tile.end; c++) {
+      const char * p = bp->chunks[c];
+      const char * end = bp->chunks[c + 1];
+      const char * next;
+
+      tend = (c + 1) * PARSE_CHUNK_TOKENS;
+      if (tend > bp->numtokens) 
+        tend = bp->numtokens;
+
+      for (t=c*PARSE_CHUNK_TOKENS; t<tend; t++) {
+        p = SkipSpace(p, end);
+        if (bp->f != NULL)
+          next = ScanFloat(p, end, &bp->f[t]);
+        else 
+          next = ScanInt(p, end, &bp->i[t]);
+
+        if (next == p || (next < end && !ISSPACE(*next))) {
+          rt_threadlaunch_setfatalerror(voidparms); /* not a number */
+          return NULL;
+        }
+        p = next;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/* 
+ * Convert the next count numbers into f or i with the scene's threads,
+ * returning 1 on success, or 0 if the block is small or irregular and 
+ * should be parsed serially.
+ */
+static int ParseNumberBlock(parsehandle * ph, SceneHandle scene,
+                            float * f, int * i, int count) {
+  const char * p = ph->in.pos;
+  const char * end = ph->in.end;
+  blockparms bp;
+  rt_tasktile_t tile;
+  int numthreads = rt_get_numthreads(scene);
+  int numchunks, t;
+
+  if (count < PARSE_PARALLEL_TOKENS || numthreads < 2)
+    return 0;
+
+  numchunks = (count + PARSE_CHUNK_TOKENS - 1) / PARSE_CHUNK_TOKENS;
+  bp.chunks = (const char **) malloc((numchunks + 1) * sizeof(char *));
+  if (bp.chunks == NULL)
+    return 0;
+
+  for (t=0; t<count; t++) {
+    p = SkipSpace(p, end);
+    if (p == end) {
+      free((void *) bp.chunks);
+      return 0;
+    }
+    if ((t % PARSE_CHUNK_TOKENS) == 0)
+      bp.chunks[t / PARSE_CHUNK_TOKENS] = p;
+    while (p < end && !ISSPACE(*p))
+      p++;
+  }
+  bp.chunks[numchunks] = p;
+  bp.numtokens = count;
+  bp.f = f;
+  bp.i = i;
+
+  tile.start = 0;
+  tile.end = numchunks;
+  t = rt_threadlaunch(numthreads, &bp, ParseBlockThread, &tile);
+  free((void *) bp.chunks);
+
+  if (t != 0)
+    return 0;
+
+  ph->in.pos = p;
+  return 1;
+}
+
+typedef struct {
+  SceneHandle scene;
+  void * tex;            /* texture for all of the objects             */
+  int strip;             /* facets form a triangle strip, not a mesh   */
+  const int * facets;    /* vertex indices                             */
+  const float * v;       /* vertex or sphere centers                   */
+  const float * n;       /* vertex normals                             */
+  const float * c;       /* vertex colors, or NULL                     */
+  const float * r;       /* sphere radii                               */
+} objparms;
+
+static void GetFacet(const int * facets, int strip, int t, int * vi) {
+  static const int stripaddr[2][3] = { {0, 1, 2}, {1, 0, 2} };
+
+  if (strip) {
+    vi[0] = facets[t + stripaddr[t & 0x01][0]];
+    vi[1] = facets[t + stripaddr[t & 0x01][1]];
+    vi[2] = facets[t + stripaddr[t & 0x01][2]];
+  } else {
+    vi[0] = facets[t*3    ];
+    vi[1] = facets[t*3 + 1];
+    vi[2] = facets[t*3 + 2];
+  }
+}
+
+static void * MakeTrianglesThread(void * voidparms) {
+  objparms * op;
+  rt_tasktile_t tile;
+  int t, vi[3];
+
+  rt_threadlaunch_getdata(voidparms, (void **) &op);
+  while (rt_threadlaunch_next_tile(voidparms, PARSE_CHUNK_OBJECTS, &tile) != RT_SCHED_DONE) {
+    for (t=tile.start; t<tile.end; t++) {
+      const float * v = op->v;
+      const float * n = op->n;
+      const float * c = op->c;
+
+      GetFacet(op->facets, op->strip, t, vi);
+      vi[0] *= 3;
+      vi[1] *= 3;
+      vi[2] *= 3;
+
+      if (c != NULL) {
+        rt_vcstri3fv(op->scene, op->tex, &v[vi[0]], &v[vi[1]], &v[vi[2]],
+                     &n[vi[0]], &n[vi[1]], &n[vi[2]], 
+                     &c[vi[0]], &c[vi[1]], &c[vi[2]]);
+      } else {
+        rt_stri3fv(op->scene, op->tex, &v[vi[0]], &v[vi[1]], &v[vi[2]],
+                   &n[vi[0]], &n[vi[1]], &n[vi[2]]);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Create the triangles of a large mesh or strip in parallel, up to the 
+ * first one with an invalid vertex index, returning the number created.
+ * Small batches are left to the caller, and nothing is created for them.
+ */
+static int MakeTriangles(SceneHandle scene, void * tex, int strip, const int * facets, int numtri, 
+                         int vertexcount, const float * v, 
+                         const float * n, const float * c) {
+  objparms op;
+  rt_tasktile_t tile;
+  int numthreads = rt_get_numthreads(scene);
+  int t, vi[3];
+
+  if (numtri < PARSE_PARALLEL_OBJECTS || numthreads < 2)
+    return 0;
+
+  for (t=0; t<numtri; t++) {
+    GetFacet(facets, strip, t, vi);
+    if (vi[0] < 0 || vi[0] >= vertexcount ||
+        vi[1] < 0 || vi[1] >= vertexcount ||
+        vi[2] < 0 || vi[2] >= vertexcount)
+      break;
+  }
+  numtri = t;
+  if (numtri < PARSE_PARALLEL_OBJECTS)
+    return 0;
+
+  memset(&op, 0, sizeof(op));
+  op.scene = scene;
+  op.tex = tex;
+  op.strip = strip;
+  op.facets = facets;
+  op.v = v;
+  op.n = n;
+  op.c = c;
+
+  tile.start = 0;
+  tile.end = numtri;
+  rt_threadlaunch(numthreads, &op, MakeTrianglesThread, &tile);
+
+  return numtri;
+}
+
+static void * MakeSpheresThread(void * voidparms) {
+  objparms * op;
+  rt_tasktile_t tile;
+  int i;
+
+  rt_threadlaunch_getdata(voidparms, (void **) &op);
+  while (rt_threadlaunch_next_tile(voidparms, PARSE_CHUNK_OBJECTS, &tile) != RT_SCHED_DONE) {
+    for (i=tile.start; i<tile.end; i++) {
+      rt_sphere3fv(op->scene, op->tex, &op->v[i*3], op->r[i]);
+    }
+  }
+
+  return NULL;
+}
+
+/* create spheres, in parallel for large batches */
+static void MakeSpheres(SceneHandle scene, void * tex, int count,
+                        const float * ctr, const float * rad) {
+  objparms op;
+  rt_tasktile_t tile;
+  int numthreads = rt_get_numthreads(scene);
+  int i;
+
+  if (count < PARSE_PARALLEL_OBJECTS || numthreads < 2) {
+    for (i=0; i<count; i++) {
+      rt_sphere3fv(scene, tex, &ctr[i*3], rad[i]);
+    }
+    return;
+  }
+
+  memset(&op, 0, sizeof(op));
+  op.scene = scene;
+  op.tex = tex;
+  op.v = ctr;
+  op.r = rad;
+
+  tile.start = 0;
+  tile.end = count;
+  rt_threadlaunch(numthreads, &op, MakeSpheresThread, &tile);
+}
+
 static void reset_tex_table(parsehandle * ph, SceneHandle scene) {
   apitexture apitex;
   
@@ -168,31 +657,17 @@ static void Trans3d(apivector * trans, apivector * vec) {
 
 static void PrintSyntaxError(parsehandle * ph, 
                              const char * string, const char * found) {
-  long streampos, readsize;
-  long i, j, linecount;
-  char cbuf[ERROR_READBUF_SIZE];
+  long streampos, linecount;
+  const char * c;
 
-  streampos = ftell(ph->ifp);
+  streampos = ph->in.pos - ph->in.text;
 
   /* count lines up to approximate position where error occured */ 
-  fseek(ph->ifp, 0, SEEK_SET); 
-
-  i=0;
   linecount=0;
-  while (i < streampos) {
-    if ((streampos - i) > ERROR_READBUF_SIZE) {
-      readsize = ERROR_READBUF_SIZE;
-    } else {
-      readsize = streampos - i;
+  for (c=ph->in.text; c<ph->in.pos; c++) {
+    if (*c == '\n') {
+      linecount++;
     }
-
-    fread(cbuf, readsize, 1, ph->ifp);
-    i+=readsize;
-    for (j=0; j<readsize; j++) {
-      if (cbuf[j] == '\n') {
-        linecount++;
-      }
-    } 
   }
 
   printf("Parse Error:\n");
@@ -202,14 +677,12 @@ static void PrintSyntaxError(parsehandle * ph,
   printf("   Error occured at or prior to file offset %ld, line %ld\n",
          streampos, linecount);
   printf("   Error position is only approximate, but should be close\n\n");
-
-  fseek(ph->ifp, streampos, SEEK_SET); /* return to previous offset */
 }
 
 static errcode GetString(parsehandle * ph, const char * string) {
   char data[255];
 
-  fscanf(ph->ifp, "%s", data);
+  pscanf(ph, "%254s", data);
   if (stringcmp(data, string) != 0) {
     PrintSyntaxError(ph, string, data);
     return PARSEBADSYNTAX;
@@ -218,47 +691,127 @@ static errcode GetString(parsehandle * ph, const char * string) {
   return PARSENOERR;
 }
 
+/* skip comment blocks, and search for BEGIN_SCENE */
+static errcode FindSceneStart(parsehandle * ph) {
+  char tmp[256];
+
+  while (pscanf(ph, "%255s", tmp) == 1) {
+    if (!stringcmp(tmp, "BEGIN_SCENE")) {
+      return PARSENOERR;
+    } else if (!stringcmp(tmp, "#")) {
+      SkipLine(ph); /* eat comment text */
+    } else {
+      break;
+    }
+  }
+
+  return PARSEBADSYNTAX;
+}
+
+/* parse a whole scene from the text already set up in ph->in */
+static unsigned int ParseScene(parsehandle * ph, SceneHandle scene) {
+  errcode rc;
+
+  reset_tex_table(ph, scene); 
+
+  rc = PARSENOERR;
+
+  if (FindSceneStart(ph) != PARSENOERR) {
+    free_tex_table(ph, scene);
+    return PARSEBADSYNTAX;
+  }
+
+  rc |= GetScenedefs(ph, scene); 
+  
+  if (rc == PARSENOERR) {
+    ph->numobjectsparsed=0;
+    while ((rc = GetObject(ph, scene)) == PARSENOERR) {
+      ph->numobjectsparsed++;
+    } 
+  
+    if (rc == PARSEEOF)
+      rc = PARSENOERR;
+  }
+
+  free_tex_table(ph, scene);
+
+  return rc;
+}
+
 unsigned int readmodel(const char * modelfile, SceneHandle scene) {
   parsehandle ph;
   errcode rc;
-  int done;
 
   memset(&ph, 0, sizeof(ph));
   ph.transmode = RT_TRANS_ORIG;
   ph.filename = modelfile;
-  ph.ifp=fopen(modelfile, "r");
-  if (ph.ifp == NULL) {
+  if (OpenParseFile(&ph.in, modelfile) != PARSENOERR) {
     return PARSEBADFILE;
   }
 
-  reset_tex_table(&ph, scene); 
+  rc = ParseScene(&ph, scene);
 
-  rc = PARSENOERR;
+  CloseParseFile(&ph.in);
 
-  /* skip comment blocks, and search for BEGIN_SCENE */
-  done = 0;
-  while (!done) {
-    char tmp[256];
-    fscanf(ph.ifp, "%s", tmp);
+  return rc;
+}
 
-    if (!stringcmp(tmp, "BEGIN_SCENE")) {
-      done=1;
-    } else if (!stringcmp(tmp, "#")) {
-      int c;
-      while (1) {
-        c=fgetc(ph.ifp);
-        if (c == EOF || c == '\n') /* eat comment text */
-          break;
-      }
-    } else {
-      fclose(ph.ifp);
-      return PARSEBADSYNTAX;
+/* 
+ * Parse a scene held in memory, such as one received over a socket.
+ * The name is only used in error messages.
+ */
+unsigned int readmodel_buffer(const char * name, const char * text, 
+                              size_t len, SceneHandle scene) {
+  parsehandle ph;
+
+  memset(&ph, 0, sizeof(ph));
+  ph.transmode = RT_TRANS_ORIG;
+  ph.filename = name;
+  ph.in.text = text;
+  ph.in.pos = text;
+  ph.in.end = text + len;
+
+  return ParseScene(&ph, scene);
+}
+
+/*
+ * Parse a scene into a binary .tbs file.  Textures, lights, spheres, and
+ * vertex arrays are captured into typed sections, while the text of all
+ * other statements is copied through into script sections.  The scene
+ * is still built normally, in a scratch scene, so that the parser has
+ * real texture handles to track and can report errors the same way.
+ */
+unsigned int convertmodel(const char * modelfile, const char * binfile) {
+  parsehandle ph;
+  SceneHandle scene;
+  errcode rc;
+  int xres, yres;
+
+  memset(&ph, 0, sizeof(ph));
+  ph.transmode = RT_TRANS_ORIG;
+  ph.filename = modelfile;
+  if (OpenParseFile(&ph.in, modelfile) != PARSENOERR) {
+    return PARSEBADFILE;
+  }
+
+  scene = rt_newscene();
+  reset_tex_table(&ph, scene); 
+
+  rc = FindSceneStart(&ph);
+  if (rc == PARSENOERR)
+    rc = GetScenedefs(&ph, scene); 
+
+  if (rc == PARSENOERR) {
+    rt_get_resolution(scene, &xres, &yres);
+    ph.tbs = tbs_create(binfile, xres, yres, ph.defaulttex.tex);
+    if (ph.tbs == NULL) {
+      printf("Failed to create binary scene file %s\n", binfile);
+      rc = PARSEBADFILE;
     }
   }
 
-  rc |= GetScenedefs(&ph, scene); 
-  
   if (rc == PARSENOERR) {
+    ph.tbsscript = ph.in.pos - ph.in.text;
     ph.numobjectsparsed=0;
     while ((rc = GetObject(&ph, scene)) == PARSENOERR) {
       ph.numobjectsparsed++;
@@ -268,17 +821,144 @@ unsigned int readmodel(const char * modelfile, SceneHandle scene) {
       rc = PARSENOERR;
   }
 
-  fclose(ph.ifp);
+  if (ph.tbs != NULL)
+    rc |= tbs_close(ph.tbs);
+
+  CloseParseFile(&ph.in);
 
   free_tex_table(&ph, scene);
+  rt_deletescene(scene);
+
+  return rc;
+}
+
+void * readmodel_begin(const char * filename, SceneHandle scene) {
+  parsehandle * ph;
+
+  ph = (parsehandle *) calloc(1, sizeof(parsehandle));
+  if (ph == NULL)
+    return NULL;
+
+  ph->transmode = RT_TRANS_ORIG;
+  ph->filename = filename;
+  reset_tex_table(ph, scene); 
+
+  return ph;
+}
+
+/* parse objects from text, up to the next END_SCENE or the end of text */
+unsigned int readmodel_stream(void * voidph, const char * text, size_t len,
+                              SceneHandle scene) {
+  parsehandle * ph = (parsehandle *) voidph;
+  errcode rc;
+
+  memset(&ph->in, 0, sizeof(parsefile));
+  ph->in.text = text;
+  ph->in.pos = text;
+  ph->in.end = text + len;
+  while ((rc = GetObject(ph, scene)) == PARSENOERR) {
+    ph->numobjectsparsed++;
+  } 
+  memset(&ph->in, 0, sizeof(parsefile));
+
+  if (rc == PARSEEOF)
+    rc = PARSENOERR;
 
   return rc;
 }
 
+void * readmodel_deftexture(void * voidph) {
+  parsehandle * ph = (parsehandle *) voidph;
+  return ph->defaulttex.tex;
+}
+
+unsigned int readmodel_addtexture(void * voidph, void * tex, const char * name) {
+  return add_texture((parsehandle *) voidph, tex, name);
+}
+
+void readmodel_spheres(SceneHandle scene, void * tex, int count,
+                       const float * ctr, const float * rad) {
+  MakeSpheres(scene, tex, count, ctr, rad);
+}
+
+void readmodel_end(void * voidph, SceneHandle scene) {
+  parsehandle * ph = (parsehandle *) voidph;
+
+  free_tex_table(ph, scene);
+  free(ph);
+}
+
+/* statements that are written to typed sections when converting */
+static int TBSCaptured(const char * objtype) {
+  return (!stringcmp(objtype, "SPHERE") ||
+          !stringcmp(objtype, "SPHEREARRAY") ||
+          !stringcmp(objtype, "VERTEXARRAY") ||
+          !stringcmp(objtype, "TEXDEF") ||
+          !stringcmp(objtype, "TEXALIAS") ||
+          !stringcmp(objtype, "LIGHT") ||
+          !stringcmp(objtype, "DIRECTIONAL_LIGHT") ||
+          !stringcmp(objtype, "SPOTLIGHT") ||
+          !stringcmp(objtype, "INCLUDE"));
+}
+
+/* copy pending scene text up to file offset end into a script section */
+static errcode TBSFlushScript(parsehandle * ph, long end) {
+  long len = end - ph->tbsscript;
+  errcode rc;
+
+  if (len <= 0)
+    return PARSENOERR;
+
+  rc = tbs_script(ph->tbs, ph->in.text + ph->tbsscript, len);
+
+  ph->tbsscript = end;
+  return rc;
+}
+
+static errcode TBSCaptureObject(parsehandle * ph, SceneHandle scene,
+                                const char * objtype, long objstart) {
+  errcode rc;
+
+  rc = TBSFlushScript(ph, objstart);
+  if (rc != PARSENOERR)
+    return rc;
+
+  if (!stringcmp(objtype, "INCLUDE")) {
+    /* included files are converted inline, with their own script text */
+    char includefile[FILENAME_MAX];
+    pscanf(ph, "%255s", includefile);
+    rc = ReadIncludeFile(ph, includefile, scene);
+  } else {
+    ph->tbscapture = 1;
+    if (!stringcmp(objtype, "SPHERE")) {
+      rc = GetSphere(ph, scene);
+    } else if (!stringcmp(objtype, "SPHEREARRAY")) {
+      rc = GetSphereArray(ph, scene);
+    } else if (!stringcmp(objtype, "VERTEXARRAY")) {
+      rc = GetVertexArray(ph, scene);
+    } else if (!stringcmp(objtype, "TEXDEF")) {
+      rc = GetTexDef(ph, scene);
+    } else if (!stringcmp(objtype, "TEXALIAS")) {
+      rc = GetTexAlias(ph);
+    } else if (!stringcmp(objtype, "LIGHT")) {
+      rc = GetLight(ph, scene);
+    } else if (!stringcmp(objtype, "DIRECTIONAL_LIGHT")) {
+      rc = GetDirLight(ph, scene);
+    } else if (!stringcmp(objtype, "SPOTLIGHT")) {
+      rc = GetSpotLight(ph, scene);
+    }
+    ph->tbscapture = 0;
+  }
+
+  ph->tbsscript = ph->in.pos - ph->in.text;
+  return rc;
+}
+
 static errcode ReadIncludeFile(parsehandle * ph, const char * includefile, SceneHandle scene) {
   errcode rc;
   const char * oldfilename = ph->filename;
-  FILE * oldfp = ph->ifp;
+  parsefile oldin = ph->in;
+  long oldscript = ph->tbsscript;
 
   if (strcmp(includefile, ph->filename) == 0) {
     printf("Warning: possible self-recursive include of file %s\n", 
@@ -286,25 +966,26 @@ static errcode ReadIncludeFile(parsehandle * ph, const char * includefile, Scene
   }
 
   ph->filename=includefile;
-  ph->ifp=fopen(includefile, "r");
-  if (ph->ifp == NULL) {
+  if (OpenParseFile(&ph->in, includefile) != PARSENOERR) {
     printf("Parser failed trying to open file: %s\n", includefile);
 
     /* restore old file pointers etc */
     ph->filename=oldfilename;
-    ph->ifp = oldfp;
+    ph->in = oldin;
 
     return PARSEBADSUBFILE;
   }
 
+  ph->tbsscript = 0;
   while ((rc = GetObject(ph, scene)) == PARSENOERR) {
     ph->numobjectsparsed++;
   } 
-  fclose(ph->ifp);
+  CloseParseFile(&ph->in);
 
   /* restore old file pointers etc */
   ph->filename=oldfilename;
-  ph->ifp = oldfp;
+  ph->in = oldin;
+  ph->tbsscript = oldscript;
   
   if (rc == PARSEEOF){
     rc = PARSENOERR;
@@ -318,7 +999,7 @@ static errcode GetScenedefs(parsehandle * ph, SceneHandle scene) {
   errcode rc = PARSENOERR;
 
   rc |= GetString(ph, "RESOLUTION");
-  fscanf(ph->ifp, "%d %d", &xres, &yres);
+  pscanf(ph, "%d %d", &xres, &yres);
 
   rt_outputfile(scene, "outfile.tga");
   rt_resolution(scene, xres, yres);
@@ -331,7 +1012,7 @@ static errcode GetShaderMode(parsehandle * ph, SceneHandle scene) {
   errcode rc = PARSENOERR;
   char data[255];
 
-  fscanf(ph->ifp, "%s", data);
+  pscanf(ph, "%254s", data);
   if (!stringcmp(data, "FULL")) {
     rt_shadermode(scene, RT_SHADER_FULL);
   } else if (!stringcmp(data, "MEDIUM")) {
@@ -346,7 +1027,7 @@ static errcode GetShaderMode(parsehandle * ph, SceneHandle scene) {
   }
 
   while (rc == PARSENOERR) {
-    fscanf(ph->ifp, "%s", data);
+    pscanf(ph, "%254s", data);
     if (!stringcmp(data, "END_SHADER_MODE")) {
       return rc;
     } else if (!stringcmp(data, "SHADOW_FILTER_ON")) {
@@ -355,7 +1036,7 @@ static errcode GetShaderMode(parsehandle * ph, SceneHandle scene) {
       rt_shadow_filtering(scene, 0);
     } else if (!stringcmp(data, "TRANS_MAX_SURFACES")) {
       int transmaxsurf;
-      fscanf(ph->ifp, "%d", &transmaxsurf);
+      pscanf(ph, "%d", &transmaxsurf);
       rt_trans_max_surfaces(scene, transmaxsurf);
     } else if (!stringcmp(data, "TRANS_ORIG")) {
       ph->transmode = RT_TRANS_ORIG;       /* reset to standard mode */
@@ -374,13 +1055,13 @@ static errcode GetShaderMode(parsehandle * ph, SceneHandle scene) {
       apicolor aoambient;
 
       rc |= GetString(ph, "AMBIENT_COLOR");
-      fscanf(ph->ifp, "%f %f %f", &aoambient.r, &aoambient.g, &aoambient.b);
+      pscanf(ph, "%f %f %f", &aoambient.r, &aoambient.g, &aoambient.b);
 
       rc |= GetString(ph, "RESCALE_DIRECT");
-      fscanf(ph->ifp, "%f", &aodirect);
+      pscanf(ph, "%f", &aodirect);
 
       rc |= GetString(ph, "SAMPLES");
-      fscanf(ph->ifp, "%d", &aosamples);
+      pscanf(ph, "%d", &aosamples);
 
       rt_rescale_lights(scene, aodirect);
       rt_ambient_occlusion(scene, aosamples, aoambient);
@@ -401,9 +1082,9 @@ static errcode GetCamera(parsehandle * ph, SceneHandle scene) {
   errcode rc = PARSENOERR;
   char data[255];
 
-  fscanf(ph->ifp, "%s", data);
+  pscanf(ph, "%254s", data);
   if (stringcmp(data, "PROJECTION") == 0) {
-    fscanf(ph->ifp, "%s", data);
+    pscanf(ph, "%254s", data);
     if (stringcmp(data, "FISHEYE") == 0) {
       rt_camera_projection(scene, RT_PROJECTION_FISHEYE);
     } else if (stringcmp(data, "PERSPECTIVE") ==0) {
@@ -412,10 +1093,10 @@ static errcode GetCamera(parsehandle * ph, SceneHandle scene) {
       rt_camera_projection(scene, RT_PROJECTION_PERSPECTIVE_DOF);
 
       rc |= GetString(ph, "FOCALLENGTH");
-      fscanf(ph->ifp, "%f", &a);  
+      pscanf(ph, "%f", &a);  
 
       rc |= GetString(ph, "APERTURE");
-      fscanf(ph->ifp, "%f", &b);  
+      pscanf(ph, "%f", &b);  
 
       rt_camera_dof(scene, a, b);
     } else if (stringcmp(data, "ORTHOGRAPHIC") ==0) {
@@ -423,10 +1104,10 @@ static errcode GetCamera(parsehandle * ph, SceneHandle scene) {
     }
 
     rc |= GetString(ph, "ZOOM");
-    fscanf(ph->ifp, "%f", &a);  
+    pscanf(ph, "%f", &a);  
     zoom=a;
   } else if (stringcmp(data, "ZOOM") == 0) {
-    fscanf(ph->ifp, "%f", &a);
+    pscanf(ph, "%f", &a);
     zoom=a;
   } else {
     rc = PARSEBADSYNTAX;
@@ -434,29 +1115,29 @@ static errcode GetCamera(parsehandle * ph, SceneHandle scene) {
   }
 
   rc |= GetString(ph, "ASPECTRATIO");
-  fscanf(ph->ifp, "%f", &b);  
+  pscanf(ph, "%f", &b);  
   aspectratio=b;
 
   rc |= GetString(ph, "ANTIALIASING");
-  fscanf(ph->ifp, "%d", &antialiasing);
+  pscanf(ph, "%d", &antialiasing);
 
   rc |= GetString(ph, "RAYDEPTH");
-  fscanf(ph->ifp, "%d", &raydepth);
+  pscanf(ph, "%d", &raydepth);
 
   rc |= GetString(ph, "CENTER");
-  fscanf(ph->ifp, "%f %f %f", &a, &b, &c);
+  pscanf(ph, "%f %f %f", &a, &b, &c);
   Ccenter.x = a;
   Ccenter.y = b;
   Ccenter.z = c;
 
   rc |= GetString(ph, "VIEWDIR");
-  fscanf(ph->ifp, "%f %f %f", &a, &b, &c);
+  pscanf(ph, "%f %f %f", &a, &b, &c);
   Cview.x = a;
   Cview.y = b;
   Cview.z = c;
 
   rc |= GetString(ph, "UPDIR");
-  fscanf(ph->ifp, "%f %f %f", &a, &b, &c);
+  pscanf(ph, "%f %f %f", &a, &b, &c);
   Cup.x = a;
   Cup.y = b;
   Cup.z = c;
@@ -464,11 +1145,11 @@ static errcode GetCamera(parsehandle * ph, SceneHandle scene) {
   rt_camera_setup(scene, zoom, aspectratio, antialiasing, raydepth,
                   Ccenter, Cview, Cup);
 
-  fscanf(ph->ifp, "%s", data);
+  pscanf(ph, "%254s", data);
   if (stringcmp(data, "FRUSTUM") == 0) {
-    fscanf(ph->ifp, "%f %f %f %f", &a, &b, &c, &d);
+    pscanf(ph, "%f %f %f %f", &a, &b, &c, &d);
     rt_camera_frustum(scene, a, b, c, d);
-    fscanf(ph->ifp, "%s", data);
+    pscanf(ph, "%254s", data);
     if (stringcmp(data, "END_CAMERA") != 0) {
       rc |= PARSEBADSYNTAX;
       return rc;
@@ -484,10 +1165,19 @@ static errcode GetCamera(parsehandle * ph, SceneHandle scene) {
 
 static errcode GetObject(parsehandle * ph, SceneHandle scene) {
   char objtype[256];
+  long objstart = 0;
+
+  if (ph->tbs != NULL)
+    objstart = ph->in.pos - ph->in.text;
  
-  if (fscanf(ph->ifp, "%s", objtype) == EOF) {
+  if (pscanf(ph, "%255s", objtype) == EOF) {
+    if (ph->tbs != NULL)
+      return TBSFlushScript(ph, ph->in.pos - ph->in.text) | PARSEEOF;
     return PARSEEOF;
   }
+  if (ph->tbs != NULL && TBSCaptured(objtype)) {
+    return TBSCaptureObject(ph, scene, objtype, objstart);
+  }
   if (!stringcmp(objtype, "TRI")) {
     return GetTri(ph, scene);
   }
@@ -503,11 +1193,9 @@ static errcode GetObject(parsehandle * ph, SceneHandle scene) {
   if (!stringcmp(objtype, "SPHERE")) {
     return GetSphere(ph, scene);
   }
-#if 0
   if (!stringcmp(objtype, "SPHEREARRAY")) {
     return GetSphereArray(ph, scene);
   }
-#endif
   if (!stringcmp(objtype, "FCYLINDER")) {
     return GetFCylinder(ph, scene);
   }
@@ -571,12 +1259,8 @@ static errcode GetObject(parsehandle * ph, SceneHandle scene) {
 #endif
   }
   if (!stringcmp(objtype, "#")) {
-    int c;
-    while (1) {
-      c=fgetc(ph->ifp);
-      if (c == EOF || c == '\n')    /* eat comment text */
-        return PARSENOERR;
-    } 
+    SkipLine(ph);    /* eat comment text */
+    return PARSENOERR;
   }
   if (!stringcmp(objtype, "BACKGROUND")) {
     return GetBackGnd(ph, scene);
@@ -589,7 +1273,7 @@ static errcode GetObject(parsehandle * ph, SceneHandle scene) {
   }
   if (!stringcmp(objtype, "INCLUDE")) {
     char includefile[FILENAME_MAX];
-    fscanf(ph->ifp, "%s", includefile);
+    pscanf(ph, "%255s", includefile);
     return ReadIncludeFile(ph, includefile, scene);
   }
   if (!stringcmp(objtype, "START_CLIPGROUP")) {
@@ -599,6 +1283,8 @@ static errcode GetObject(parsehandle * ph, SceneHandle scene) {
     return GetClipGroupEnd(ph, scene);
   }
   if (!stringcmp(objtype, "END_SCENE")) {
+    if (ph->tbs != NULL)
+      return TBSFlushScript(ph, objstart) | PARSEEOF;
     return PARSEEOF; /* end parsing */
   }
 
@@ -609,7 +1295,7 @@ static errcode GetObject(parsehandle * ph, SceneHandle scene) {
 
 static errcode GetInt(parsehandle * ph, int * i) {
   int a;
-  if (fscanf(ph->ifp, "%d", &a) != 1) 
+  if (pscanf(ph, "%d", &a) != 1) 
     return PARSEBADSYNTAX;
 
   *i = a;
@@ -620,7 +1306,7 @@ static errcode GetInt(parsehandle * ph, int * i) {
 static errcode GetVector(parsehandle * ph, apivector * v1) {
   float a, b, c;
  
-  if (fscanf(ph->ifp, "%f %f %f", &a, &b, &c) != 3) 
+  if (pscanf(ph, "%f %f %f", &a, &b, &c) != 3) 
     return PARSEBADSYNTAX;
 
   v1->x=a;
@@ -633,7 +1319,7 @@ static errcode GetVector(parsehandle * ph, apivector * v1) {
 #if 0
 static errcode GetFloat(parsehandle * ph, apiflt * f) {
   float a;
-  if (fscanf(ph->ifp, "%f", &a) != 1) 
+  if (pscanf(ph, "%f", &a) != 1) 
     return PARSEBADSYNTAX;
 
   *f = a;
@@ -647,7 +1333,7 @@ static errcode GetColor(parsehandle * ph, apicolor * c1) {
   int rc; 
 
   rc = GetString(ph, "COLOR"); 
-  fscanf(ph->ifp, "%f %f %f", &r, &g, &b);
+  pscanf(ph, "%f %f %f", &r, &g, &b);
   c1->r=r;
   c1->g=g;
   c1->b=b;
@@ -662,7 +1348,7 @@ static errcode GetImageDef(parsehandle * ph, SceneHandle scene) {
   unsigned char *rgb=NULL;
   int xres=0, yres=0, zres=0;
 
-  fscanf(ph->ifp, "%s", texname);
+  pscanf(ph, "%254s", texname);
 
   rc = GetString(ph, "FORMAT");
   rc |= GetString(ph, "RGB24");
@@ -686,7 +1372,7 @@ static errcode GetImageDef(parsehandle * ph, SceneHandle scene) {
         int addr = ((z*xres*yres) + (y*xres) + x) * 3;
         int n=0;
 
-        fscanf(ph->ifp, "%s", clrstr);
+        pscanf(ph, "%1023s", clrstr);
 
 	/* parse colors stored as triplets of hexadecimal values with   */
         /* either one, two, three, or four nibbles of significant bits, */
@@ -731,7 +1417,7 @@ static errcode GetImageDef(parsehandle * ph, SceneHandle scene) {
   }
 
   if (rc == PARSENOERR) {
-    rt_define_teximage_rgb24(texname, xres, yres, zres, rgb);
+    rt_scene_define_teximage_rgb24(scene, texname, xres, yres, zres, rgb);
   }
 
   return rc;
@@ -739,9 +1425,14 @@ static errcode GetImageDef(parsehandle * ph, SceneHandle scene) {
 
 static errcode GetTexDef(parsehandle * ph, SceneHandle scene) {
   char texname[TEXNAMELEN];
+  void * tex;
 
-  fscanf(ph->ifp, "%s", texname);
-  add_texture(ph, GetTexBody(ph, scene, 0), texname); 
+  pscanf(ph, "%254s", texname);
+  tex = GetTexBody(ph, scene, 0);
+  add_texture(ph, tex, texname); 
+
+  if (ph->tbscapture)
+    return tbs_texname(ph->tbs, tex, texname);
 
   return PARSENOERR;
 }
@@ -749,10 +1440,15 @@ static errcode GetTexDef(parsehandle * ph, SceneHandle scene) {
 static errcode GetTexAlias(parsehandle * ph) {
   char texname[TEXNAMELEN];
   char aliasname[TEXNAMELEN];
+  void * tex;
 
-  fscanf(ph->ifp, "%s", texname);
-  fscanf(ph->ifp, "%s", aliasname);
-  add_texture(ph, find_texture(ph, aliasname), texname); 
+  pscanf(ph, "%254s", texname);
+  pscanf(ph, "%254s", aliasname);
+  tex = find_texture(ph, aliasname);
+  add_texture(ph, tex, texname); 
+
+  if (ph->tbscapture)
+    return tbs_texname(ph->tbs, tex, texname);
 
   return PARSENOERR;
 }
@@ -762,7 +1458,7 @@ static errcode GetTexture(parsehandle * ph, SceneHandle scene, void ** tex) {
   char tmp[255];
   errcode rc = PARSENOERR;
 
-  fscanf(ph->ifp, "%s", tmp);
+  pscanf(ph, "%254s", tmp);
   if (!stringcmp(tmp, "TEXTURE")) {	
     *tex = GetTexBody(ph, scene, 0);
   }
@@ -783,6 +1479,7 @@ void * GetTexBody(parsehandle * ph, SceneHandle scene, int modeflag) {
   void * voidtex; 
   errcode rc;
 
+  memset(&tex, 0, sizeof(tex));
   transmode=RT_TRANS_ORIG;
   outline=0.0f;
   outlinewidth=0.0f;
@@ -791,39 +1488,39 @@ void * GetTexBody(parsehandle * ph, SceneHandle scene, int modeflag) {
   phongtype = RT_PHONG_PLASTIC;
 
   rc = GetString(ph, "AMBIENT");
-  fscanf(ph->ifp, "%f", &a); 
+  pscanf(ph, "%f", &a); 
   tex.ambient=a;
 
   rc |= GetString(ph, "DIFFUSE");
-  fscanf(ph->ifp, "%f", &b);
+  pscanf(ph, "%f", &b);
   tex.diffuse=b;
 
   rc |= GetString(ph, "SPECULAR");
-  fscanf(ph->ifp, "%f", &c);
+  pscanf(ph, "%f", &c);
   tex.specular=c;
 
   rc |= GetString(ph, "OPACITY");
-  fscanf(ph->ifp, "%f", &d);  
+  pscanf(ph, "%f", &d);  
   tex.opacity=d;
 
-  fscanf(ph->ifp, "%s", tmp);
+  pscanf(ph, "%254s", tmp);
   if (!stringcmp(tmp, "TRANSMODE")) {
-    fscanf(ph->ifp, "%s", tmp);
+    pscanf(ph, "%254s", tmp);
     if (!stringcmp(tmp, "R3D")) {
       transmode = RT_TRANS_RASTER3D;
     } 
-    fscanf(ph->ifp, "%s", tmp); /* read next item */
+    pscanf(ph, "%254s", tmp); /* read next item */
   }
 
   if (!stringcmp(tmp, "OUTLINE")) {
-    fscanf(ph->ifp, "%f", &outline);
+    pscanf(ph, "%f", &outline);
     GetString(ph, "OUTLINE_WIDTH");
-    fscanf(ph->ifp, "%f", &outlinewidth);
-    fscanf(ph->ifp, "%s", tmp); /* read next item */
+    pscanf(ph, "%f", &outlinewidth);
+    pscanf(ph, "%254s", tmp); /* read next item */
   }
 
   if (!stringcmp(tmp, "PHONG")) {
-    fscanf(ph->ifp, "%s", tmp);
+    pscanf(ph, "%254s", tmp);
     if (!stringcmp(tmp, "METAL")) {
       phongtype = RT_PHONG_METAL;
     }
@@ -834,10 +1531,10 @@ void * GetTexBody(parsehandle * ph, SceneHandle scene, int modeflag) {
       phongtype = RT_PHONG_PLASTIC;
     } 
 
-    fscanf(ph->ifp, "%f", &phong);
+    pscanf(ph, "%f", &phong);
     GetString(ph, "PHONG_SIZE");
-    fscanf(ph->ifp, "%f", &phongexp);
-    fscanf(ph->ifp, "%s", tmp);
+    pscanf(ph, "%f", &phongexp);
+    pscanf(ph, "%254s", tmp);
   } else { 
     /* assume we found "COLOR" otherwise */
   }
@@ -851,7 +1548,7 @@ void * GetTexBody(parsehandle * ph, SceneHandle scene, int modeflag) {
       rc |= PARSEBADSYNTAX;
     }
 
-    fscanf(ph->ifp, "%f %f %f", &a, &b, &c);
+    pscanf(ph, "%f %f %f", &a, &b, &c);
     tex.col.r = a;
     tex.col.g = b;
     tex.col.b = c;
@@ -859,7 +1556,7 @@ void * GetTexBody(parsehandle * ph, SceneHandle scene, int modeflag) {
     rc |= GetString(ph, "TEXFUNC");
 
     /* this really ought to be a string, not a number... */
-    fscanf(ph->ifp, "%d", &tex.texturefunc);
+    pscanf(ph, "%d", &tex.texturefunc);
 
     switch (tex.texturefunc) {
       case RT_TEXTURE_CONSTANT:
@@ -882,7 +1579,7 @@ void * GetTexBody(parsehandle * ph, SceneHandle scene, int modeflag) {
 
       case RT_TEXTURE_CYLINDRICAL_IMAGE:
       case RT_TEXTURE_SPHERICAL_IMAGE:
-        fscanf(ph->ifp, "%s", tex.imap);
+        pscanf(ph, "%95s", tex.imap);
         rc |= GetString(ph, "CENTER");
         rc |= GetVector(ph, &tex.ctr);
         rc |= GetString(ph, "ROTATE");
@@ -892,7 +1589,7 @@ void * GetTexBody(parsehandle * ph, SceneHandle scene, int modeflag) {
         break;
      
       case RT_TEXTURE_PLANAR_IMAGE:
-        fscanf(ph->ifp, "%s", tex.imap);
+        pscanf(ph, "%95s", tex.imap);
         rc |= GetString(ph, "CENTER");
         rc |= GetVector(ph, &tex.ctr);
         rc |= GetString(ph, "ROTATE");
@@ -906,7 +1603,7 @@ void * GetTexBody(parsehandle * ph, SceneHandle scene, int modeflag) {
         break;
 
       case RT_TEXTURE_VOLUME_IMAGE:
-        fscanf(ph->ifp, "%s", tex.imap);
+        pscanf(ph, "%95s", tex.imap);
         rc |= GetString(ph, "CENTER");
         rc |= GetVector(ph, &tex.ctr);
         rc |= GetString(ph, "ROTATE");
@@ -938,9 +1635,67 @@ void * GetTexBody(parsehandle * ph, SceneHandle scene, int modeflag) {
   rt_tex_transmode(voidtex, transmode);
   rt_tex_outline(voidtex, outline, outlinewidth);
 
+  /* scene files often repeat the same texture for many objects */
+  voidtex = rt_texture_intern(scene, voidtex);
+
+  if (ph->tbscapture) {
+    tbs_texture td;
+
+    memset(&td, 0, sizeof(td));
+    td.ambient = tex.ambient;
+    td.diffuse = tex.diffuse;
+    td.specular = tex.specular;
+    td.opacity = tex.opacity;
+    td.col[0] = tex.col.r;  td.col[1] = tex.col.g;  td.col[2] = tex.col.b;
+    td.texturefunc = tex.texturefunc;
+    td.ctr[0] = tex.ctr.x;     td.ctr[1] = tex.ctr.y;     td.ctr[2] = tex.ctr.z;
+    td.rot[0] = tex.rot.x;     td.rot[1] = tex.rot.y;     td.rot[2] = tex.rot.z;
+    td.scale[0] = tex.scale.x; td.scale[1] = tex.scale.y; td.scale[2] = tex.scale.z;
+    td.uaxs[0] = tex.uaxs.x;   td.uaxs[1] = tex.uaxs.y;   td.uaxs[2] = tex.uaxs.z;
+    td.vaxs[0] = tex.vaxs.x;   td.vaxs[1] = tex.vaxs.y;   td.vaxs[2] = tex.vaxs.z;
+    td.waxs[0] = tex.waxs.x;   td.waxs[1] = tex.waxs.y;   td.waxs[2] = tex.waxs.z;
+    td.phong = phong;
+    td.phongexp = phongexp;
+    td.phongtype = phongtype;
+    td.transmode = transmode;
+    td.outline = outline;
+    td.outlinewidth = outlinewidth;
+    memcpy(td.imap, tex.imap, sizeof(td.imap));
+
+    if (tbs_texture_def(ph->tbs, voidtex, &td) != PARSENOERR)
+      return NULL;
+  }
+
   return voidtex;
 }
 
+static errcode TBSCaptureLight(parsehandle * ph, int type, 
+                               const apivector * ctr, apiflt rad,
+                               const apivector * dir, apiflt start, apiflt end,
+                               int attenuation, apiflt Kc, apiflt Kl, apiflt Kq,
+                               const apicolor * col) {
+  tbs_light ld;
+
+  memset(&ld, 0, sizeof(ld));
+  ld.type = type;
+  if (ctr != NULL) {
+    ld.ctr[0] = ctr->x;  ld.ctr[1] = ctr->y;  ld.ctr[2] = ctr->z;
+  }
+  ld.rad = rad;
+  if (dir != NULL) {
+    ld.dir[0] = dir->x;  ld.dir[1] = dir->y;  ld.dir[2] = dir->z;
+  }
+  ld.start = start;
+  ld.end = end;
+  ld.attenuation = attenuation;
+  ld.kc = Kc;
+  ld.kl = Kl;
+  ld.kq = Kq;
+  ld.col[0] = col->r;  ld.col[1] = col->g;  ld.col[2] = col->b;
+
+  return tbs_light_def(ph->tbs, &ld);
+}
+
 static errcode GetDirLight(parsehandle * ph, SceneHandle scene) {
   char tmp[255];
   apivector dir;
@@ -953,13 +1708,17 @@ static errcode GetDirLight(parsehandle * ph, SceneHandle scene) {
   rc = GetString(ph, "DIRECTION"); 
   rc |= GetVector(ph, &dir); 
 
-  fscanf(ph->ifp, "%s", tmp);
+  pscanf(ph, "%254s", tmp);
   if (!stringcmp(tmp, "COLOR")) {
-    fscanf(ph->ifp, "%f %f %f", &r, &g, &b);
+    pscanf(ph, "%f %f %f", &r, &g, &b);
     tex.col.r=r;
     tex.col.g=g;
     tex.col.b=b;
 
+    if (ph->tbscapture)
+      return rc | TBSCaptureLight(ph, TBS_LIGHT_DIRECTIONAL, NULL, 0, &dir,
+                                  0, 0, 0, 0, 0, 0, &tex.col);
+
     rt_directional_light(scene, rt_texture(scene, &tex), dir);
   }
 
@@ -980,16 +1739,20 @@ static errcode GetLight(parsehandle * ph, SceneHandle scene) {
   rc = GetString(ph, "CENTER"); 
   rc |= GetVector(ph, &ctr); 
   rc |= GetString(ph, "RAD");
-  fscanf(ph->ifp, "%f", &a);  /* read in radius */ 
+  pscanf(ph, "%f", &a);  /* read in radius */ 
   rad=a;
 
-  fscanf(ph->ifp, "%s", tmp);
+  pscanf(ph, "%254s", tmp);
   if (!stringcmp(tmp, "COLOR")) {
-    fscanf(ph->ifp, "%f %f %f", &r, &g, &b);
+    pscanf(ph, "%f %f %f", &r, &g, &b);
     tex.col.r=r;
     tex.col.g=g;
     tex.col.b=b;
 
+    if (ph->tbscapture)
+      return rc | TBSCaptureLight(ph, TBS_LIGHT_POINT, &ctr, rad, NULL, 0, 0,
+                                  0, 0, 0, 0, &tex.col);
+
     li = rt_light(scene, rt_texture(scene, &tex), ctr, rad);
   }
   else { 
@@ -997,16 +1760,20 @@ static errcode GetLight(parsehandle * ph, SceneHandle scene) {
       return -1;
 
     rc |= GetString(ph, "CONSTANT");
-    fscanf(ph->ifp, "%f", &a); 
+    pscanf(ph, "%f", &a); 
     Kc=a;
     rc |= GetString(ph, "LINEAR");
-    fscanf(ph->ifp, "%f", &a); 
+    pscanf(ph, "%f", &a); 
     Kl=a;
     rc |= GetString(ph, "QUADRATIC");
-    fscanf(ph->ifp, "%f", &a); 
+    pscanf(ph, "%f", &a); 
     Kq=a;
     rc |= GetColor(ph, &tex.col);
 
+    if (ph->tbscapture)
+      return rc | TBSCaptureLight(ph, TBS_LIGHT_POINT, &ctr, rad, NULL, 0, 0,
+                                  1, Kc, Kl, Kq, &tex.col);
+
     li = rt_light(scene, rt_texture(scene, &tex), ctr, rad);
 
     rt_light_attenuation(li, Kc, Kl, Kq);
@@ -1025,10 +1792,10 @@ static errcode GetSkyLight(parsehandle * ph, SceneHandle scene) {
   ambcol.b = 1.0;
 
   rc = GetString(ph, "NUMSAMPLES");
-  fscanf(ph->ifp, "%d", &numsamples);
+  pscanf(ph, "%d", &numsamples);
 
   rc |= GetString(ph, "COLOR");
-  fscanf(ph->ifp, "%f %f %f", &ambcol.r, &ambcol.g, &ambcol.b);
+  pscanf(ph, "%f %f %f", &ambcol.r, &ambcol.g, &ambcol.b);
 
   rt_ambient_occlusion(scene, numsamples, ambcol);
 
@@ -1051,41 +1818,49 @@ static errcode GetSpotLight(parsehandle * ph, SceneHandle scene) {
   rc = GetString(ph, "CENTER"); 
   rc |= GetVector(ph, &ctr); 
   rc |= GetString(ph,"RAD");
-  fscanf(ph->ifp, "%f", &a);  /* read in radius */ 
+  pscanf(ph, "%f", &a);  /* read in radius */ 
   rad=a;
  
   rc |= GetString(ph, "DIRECTION"); 
   rc |= GetVector(ph, &direction); 
   rc |= GetString(ph, "FALLOFF_START");
-  fscanf(ph->ifp, "%f",&a);
+  pscanf(ph, "%f",&a);
   start=a;
   rc |= GetString(ph, "FALLOFF_END");
-  fscanf(ph->ifp, "%f", &a);
+  pscanf(ph, "%f", &a);
   end=a;
    
-  fscanf(ph->ifp, "%s", tmp);
+  pscanf(ph, "%254s", tmp);
   if (!stringcmp(tmp, "COLOR")) {
-    fscanf(ph->ifp, "%f %f %f", &r, &g, &b);
+    pscanf(ph, "%f %f %f", &r, &g, &b);
     tex.col.r=r;
     tex.col.g=g;
     tex.col.b=b;
 
+    if (ph->tbscapture)
+      return rc | TBSCaptureLight(ph, TBS_LIGHT_SPOT, &ctr, rad, &direction,
+                                  start, end, 0, 0, 0, 0, &tex.col);
+
     li = rt_spotlight(scene, rt_texture(scene, &tex), ctr, rad, direction, start, end);
   } 
   else {
     if (stringcmp(tmp, "ATTENUATION"))
       return -1;
     rc |= GetString(ph, "CONSTANT");
-    fscanf(ph->ifp, "%f", &a);
+    pscanf(ph, "%f", &a);
     Kc=a;
     rc |= GetString(ph, "LINEAR");
-    fscanf(ph->ifp, "%f", &a);
+    pscanf(ph, "%f", &a);
     Kl=a;
     rc |= GetString(ph, "QUADRATIC");
-    fscanf(ph->ifp, "%f", &a);
+    pscanf(ph, "%f", &a);
     Kq=a;
     rc |= GetColor(ph, &tex.col);
 
+    if (ph->tbscapture)
+      return rc | TBSCaptureLight(ph, TBS_LIGHT_SPOT, &ctr, rad, &direction,
+                                  start, end, 1, Kc, Kl, Kq, &tex.col);
+
     li = rt_spotlight(scene, rt_texture(scene, &tex), ctr, rad, direction, start, end);
     rt_light_attenuation(li, Kc, Kl, Kq);
   }
@@ -1100,7 +1875,7 @@ static errcode GetFog(parsehandle * ph, SceneHandle scene) {
   float start, end, density;
   errcode rc = PARSENOERR;
  
-  fscanf(ph->ifp, "%s", tmp); 
+  pscanf(ph, "%254s", tmp); 
   if (!stringcmp(tmp, "LINEAR")) {
     rt_fog_mode(scene, RT_FOG_LINEAR);
   } else if (!stringcmp(tmp, "EXP")) {
@@ -1112,13 +1887,13 @@ static errcode GetFog(parsehandle * ph, SceneHandle scene) {
   }
 
   rc |= GetString(ph, "START");
-  fscanf(ph->ifp, "%f", &start);
+  pscanf(ph, "%f", &start);
 
   rc |= GetString(ph, "END");
-  fscanf(ph->ifp, "%f", &end);
+  pscanf(ph, "%f", &end);
 
   rc |= GetString(ph, "DENSITY");
-  fscanf(ph->ifp, "%f", &density);
+  pscanf(ph, "%f", &density);
 
   rc |= GetColor(ph, &fogcol);
 
@@ -1132,7 +1907,7 @@ static errcode GetBackGnd(parsehandle * ph, SceneHandle scene) {
   float r,g,b;
   apicolor scenebackcol; 
   
-  fscanf(ph->ifp, "%f %f %f", &r, &g, &b);
+  pscanf(ph, "%f %f %f", &r, &g, &b);
 
   scenebackcol.r=r;
   scenebackcol.g=g;
@@ -1149,7 +1924,7 @@ static errcode GetBackGndGradient(parsehandle * ph, SceneHandle scene) {
   float updir[3];
   int rc=0;
 
-  fscanf(ph->ifp, "%s", gradienttype); /* read next array type */
+  pscanf(ph, "%1023s", gradienttype); /* read next array type */
 
   /* read vertex coordinates */
   if (!stringcmp(gradienttype, "SKY_SPHERE")) {
@@ -1163,19 +1938,19 @@ static errcode GetBackGndGradient(parsehandle * ph, SceneHandle scene) {
   }
 
   rc = GetString(ph, "UPDIR");
-  fscanf(ph->ifp, "%f %f %f", &updir[0], &updir[1], &updir[2]);
+  pscanf(ph, "%f %f %f", &updir[0], &updir[1], &updir[2]);
  
   rc |= GetString(ph, "TOPVAL");
-  fscanf(ph->ifp, "%f", &topval);
+  pscanf(ph, "%f", &topval);
 
   rc |= GetString(ph, "BOTTOMVAL");
-  fscanf(ph->ifp, "%f", &botval);
+  pscanf(ph, "%f", &botval);
  
   rc |= GetString(ph, "TOPCOLOR");
-  fscanf(ph->ifp, "%f %f %f", &topcol[0], &topcol[1], &topcol[2]);
+  pscanf(ph, "%f %f %f", &topcol[0], &topcol[1], &topcol[2]);
 
   rc |= GetString(ph, "BOTTOMCOLOR");
-  fscanf(ph->ifp, "%f %f %f", &botcol[0], &botcol[1], &botcol[2]);
+  pscanf(ph, "%f %f %f", &botcol[0], &botcol[1], &botcol[2]);
 
   rt_background_gradient(scene,
                          rt_vector(updir[0], updir[1], updir[2]),
@@ -1198,7 +1973,7 @@ static errcode GetCylinder(parsehandle * ph, SceneHandle scene) {
   rc |= GetString(ph, "AXIS");
   rc |= GetVector(ph, &axis);
   rc |= GetString(ph, "RAD");
-  fscanf(ph->ifp, "%f", &a);
+  pscanf(ph, "%f", &a);
   rad=a;
 
   rc |= GetTexture(ph, scene, &tex);
@@ -1227,7 +2002,7 @@ static errcode GetFCylinder(parsehandle * ph, SceneHandle scene) {
   axis.z=pnt2.z - pnt1.z;
 
   rc |= GetString(ph, "RAD");
-  fscanf(ph->ifp, "%f", &a);
+  pscanf(ph, "%f", &a);
   rad=a;
 
   rc |= GetTexture(ph, scene, &tex);
@@ -1245,7 +2020,7 @@ static errcode GetPolyCylinder(parsehandle * ph, SceneHandle scene) {
   errcode rc;
 
   rc = GetString(ph, "POINTS");
-  fscanf(ph->ifp, "%d", &numpts);
+  pscanf(ph, "%d", &numpts);
 
   temp = (apivector *) malloc(numpts * sizeof(apivector));
 
@@ -1254,7 +2029,7 @@ static errcode GetPolyCylinder(parsehandle * ph, SceneHandle scene) {
   }         
 
   rc |= GetString(ph, "RAD");
-  fscanf(ph->ifp, "%f", &a);
+  pscanf(ph, "%f", &a);
   rad=a;
 
   rc |= GetTexture(ph, scene, &tex);
@@ -1276,11 +2051,19 @@ static errcode GetSphere(parsehandle * ph, SceneHandle scene) {
   rc = GetString(ph, "CENTER");
   rc |= GetVector(ph, &ctr); 
   rc |= GetString(ph, "RAD");
-  fscanf(ph->ifp, "%f", &a); 
+  pscanf(ph, "%f", &a); 
   rad=a;
 
   rc |= GetTexture(ph, scene, &tex); 
  
+  if (ph->tbscapture) {
+    float fctr[3];
+    fctr[0] = ctr.x;
+    fctr[1] = ctr.y;
+    fctr[2] = ctr.z;
+    return rc | tbs_sphere(ph->tbs, tex, fctr, a);
+  }
+
   rt_sphere(scene, tex, ctr, rad);
 
   return rc;
@@ -1315,9 +2098,9 @@ static errcode GetVol(parsehandle * ph, SceneHandle scene) {
   rc |= GetString(ph, "MAX");
   rc |= GetVector(ph, &max);
   rc |= GetString(ph, "DIM");
-  fscanf(ph->ifp, "%d %d %d ", &x, &y, &z);
+  pscanf(ph, "%d %d %d ", &x, &y, &z);
   rc |= GetString(ph, "FILE");
-  fscanf(ph->ifp, "%s", fname);  
+  pscanf(ph, "%254s", fname);  
   rc |= GetTexture(ph, scene, &tex);
  
   rt_scalarvol(scene, tex, min, max, x, y, z, fname, NULL); 
@@ -1353,9 +2136,9 @@ static errcode GetRing(parsehandle * ph, SceneHandle scene) {
   rc |= GetString(ph, "NORMAL");
   rc |= GetVector(ph, &normal);
   rc |= GetString(ph, "INNER");
-  fscanf(ph->ifp, " %f ", &a);
+  pscanf(ph, " %f ", &a);
   rc |= GetString(ph, "OUTER");
-  fscanf(ph->ifp, " %f ", &b);
+  pscanf(ph, " %f ", &b);
   rc |= GetTexture(ph, scene, &tex);
  
   rt_ring(scene, tex, ctr, normal, a, b);
@@ -1441,19 +2224,19 @@ static errcode GetVCSTri(parsehandle * ph, SceneHandle scene) {
   rc |= GetVector(ph, &n2);
 
   rc |= GetString(ph, "C0");
-  fscanf(ph->ifp, "%f %f %f", &a, &b, &c);
+  pscanf(ph, "%f %f %f", &a, &b, &c);
   c0.r = a;
   c0.g = b;
   c0.b = c;
 
   rc |= GetString(ph, "C1");
-  fscanf(ph->ifp, "%f %f %f", &a, &b, &c);
+  pscanf(ph, "%f %f %f", &a, &b, &c);
   c1.r = a;
   c1.g = b;
   c1.b = c;
 
   rc |= GetString(ph, "C2");
-  fscanf(ph->ifp, "%f %f %f", &a, &b, &c);
+  pscanf(ph, "%f %f %f", &a, &b, &c);
   c2.r = a;
   c2.g = b;
   c2.b = c;
@@ -1473,78 +2256,144 @@ static errcode GetSphereArray(parsehandle * ph, SceneHandle scene) {
   void * tex=NULL;
   float * v = NULL;
   float * r = NULL;
-  float * c = NULL;
 
   rc |= GetString(ph, "NUMSPHERES");
   rc |= GetInt(ph, &spherecount);
   if (rc!= PARSENOERR)
     return rc;
+  if (spherecount < 0) {
+    printf("Invalid sphere array count %d\n", spherecount);
+    return PARSEBADSYNTAX;
+  }
 
-  fscanf(ph->ifp, "%s", arraytype); /* read next array type */
+  pscanf(ph, "%1023s", arraytype); /* read next array type */
 
   /* read sphere coordinates */
   if (!stringcmp(arraytype, "CENTERS")) {
     v = (float *) malloc(spherecount * 3 * sizeof(float));
-    for (i=0; i<spherecount * 3; i+=3) {
-      fscanf(ph->ifp, "%f %f %f", &v[i], &v[i+1], &v[i+2]); 
+    if (v == NULL && spherecount > 0)
+      return PARSEALLOCERR;
+    if (!ParseNumberBlock(ph, scene, v, NULL, spherecount * 3)) {
+      for (i=0; i<spherecount * 3; i+=3) {
+        pscanf(ph, "%f %f %f", &v[i], &v[i+1], &v[i+2]); 
+      }
     }
+    pscanf(ph, "%1023s", arraytype); /* read next array type */
   } else {
     printf("Expected sphere array centers block\n");
     return PARSEBADSYNTAX;
   }
 
-  /* use the default texture until we parse a subsequent texture command */
-  tex = ph->defaulttex.tex; 
-  fscanf(ph->ifp, "%s", arraytype); /* read next array type */
-
   /* read sphere radii */
   if (!stringcmp(arraytype, "RADII")) {
     r = (float *) malloc(spherecount * sizeof(float));
-    for (i=0; i<spherecount; i++) {
-      fscanf(ph->ifp, "%f", &r[i]); 
+    if (r == NULL && spherecount > 0) {
+      free(v);
+      return PARSEALLOCERR;
+    }
+    if (!ParseNumberBlock(ph, scene, r, NULL, spherecount)) {
+      for (i=0; i<spherecount; i++) {
+        pscanf(ph, "%f", &r[i]); 
+      }
     }
+    pscanf(ph, "%1023s", arraytype); /* read next array type */
   } else {
+    free(v);
     printf("Expected sphere array radii block\n");
     return PARSEBADSYNTAX;
   }
 
-  /* read sphere colors */
-  if (!stringcmp(arraytype, "COLORS")) {
-    c = (float *) malloc(spherecount * 3 * sizeof(float));
-    for (i=0; i<spherecount * 3; i+=3) {
-      fscanf(ph->ifp, "%f %f %f", &c[i], &c[i+1], &c[i+2]); 
-    }
-  } else {
-    printf("Expected sphere array colors block\n");
-    return PARSEBADSYNTAX;
-  }
+  /* use the default texture unless a texture block follows */
+  tex = ph->defaulttex.tex; 
 
   /* read sphere array texture, same for all spheres */
   if (!stringcmp(arraytype, "TEXTURE")) {
-    /* read in texture to use for all sphere geometry     */
-    /* don't require texture color since it won't be used */
-    /* in the current implementation.                     */
     tex = GetTexBody(ph, scene, 0);
     if (tex == NULL) {
-      printf("Failed to parse vertex array texture block\n");
+      printf("Failed to parse sphere array texture block\n");
       rc |=  PARSEBADSYNTAX;
+    } else {
+      pscanf(ph, "%1023s", arraytype); /* read next array type */
     }
   }
 
-  /* generate the spheres */
+  if (rc == PARSENOERR && stringcmp(arraytype, "END_SPHEREARRAY")) {
+    PrintSyntaxError(ph, "END_SPHEREARRAY", arraytype);
+    rc |= PARSEBADSYNTAX;
+  }
+
+  /* generate the spheres, or write them out when converting */
   if (rc == PARSENOERR) {
-    for (i=0; i<spherecount * 3; i+=3) {
-      rt_sphere3fv(scene, tex, &c[i], r[i]);
-    }
+    if (ph->tbscapture)
+      rc = tbs_spherearray(ph->tbs, tex, spherecount, v, r);
+    else
+      MakeSpheres(scene, tex, spherecount, v, r);
   }
 
+  free(v);
+  free(r);
+
   return rc;
 }
 
 
+/*
+ * Read a triangle strip or mesh index buffer and write it to the binary
+ * scene file, preceded by the vertex array it refers to if necessary.
+ */
+static errcode TBSCaptureFacets(parsehandle * ph, const char * arraytype,
+                                void * tex, int * texusecount, 
+                                int vertexcount, const float * v, 
+                                const float * n, const float * c, 
+                                int * varraywritten) {
+  errcode rc;
+  int type, count, numtri, i;
+  int * facets;
+
+  if (GetInt(ph, &count) != PARSENOERR)
+    return PARSEBADSYNTAX;
+
+  if (!stringcmp(arraytype, "TRIMESH")) {
+    type = TBS_SECT_TRIMESH;
+    numtri = count;
+    count *= 3;
+  } else {
+    type = TBS_SECT_TRISTRIP;
+    numtri = (count > 2) ? count - 2 : 0;
+  }
+
+  facets = (int *) malloc(count * sizeof(int));
+  if (facets == NULL)
+    return PARSEALLOCERR;
+
+  for (i=0; i<count; i++) {
+    pscanf(ph, "%d", &facets[i]); 
+    if (facets[i] < 0 || facets[i] >= vertexcount) {
+      printf("%s error: invalid vertex index %d\n", arraytype, facets[i]);
+      printf("  vertexcount: %d\n", vertexcount);
+      free(facets);
+      return PARSEBADSYNTAX;
+    }
+  }
+
+  rc = PARSENOERR;
+  if (!*varraywritten) {
+    rc = tbs_vertexarray(ph->tbs, vertexcount, v, n, c);
+    *varraywritten = 1;
+  }
+
+  if (rc == PARSENOERR)
+    rc = tbs_facets(ph->tbs, type, tex, (*texusecount == 0), count, facets);
+  *texusecount += numtri;
+
+  free(facets);
+  return rc;
+}
+
 static errcode GetVertexArray(parsehandle * ph, SceneHandle scene) {
   char arraytype[1024];
   int done, i, texusecount;
+  int tbsvarray=0;
   int vertexcount=0;
   errcode rc=PARSENOERR;
   void * tex=NULL;
@@ -1557,15 +2406,17 @@ static errcode GetVertexArray(parsehandle * ph, SceneHandle scene) {
   if (rc!= PARSENOERR)
     return rc;
 
-  fscanf(ph->ifp, "%s", arraytype); /* read next array type */
+  pscanf(ph, "%1023s", arraytype); /* read next array type */
 
   /* read vertex coordinates */
   if (!stringcmp(arraytype, "COORDS")) {
     v = (float *) malloc(vertexcount * 3 * sizeof(float));
-    for (i=0; i<vertexcount * 3; i+=3) {
-      fscanf(ph->ifp, "%f %f %f", &v[i], &v[i+1], &v[i+2]); 
+    if (!ParseNumberBlock(ph, scene, v, NULL, vertexcount * 3)) {
+      for (i=0; i<vertexcount * 3; i+=3) {
+        pscanf(ph, "%f %f %f", &v[i], &v[i+1], &v[i+2]); 
+      }
     }
-    fscanf(ph->ifp, "%s", arraytype); /* read next array type */
+    pscanf(ph, "%1023s", arraytype); /* read next array type */
   } else {
     printf("Expected vertex array coords block\n");
     return PARSEBADSYNTAX;
@@ -1574,10 +2425,12 @@ static errcode GetVertexArray(parsehandle * ph, SceneHandle scene) {
   /* read vertex normals */
   if (!stringcmp(arraytype, "NORMALS")) {
     n = (float *) malloc(vertexcount * 3 * sizeof(float));
-    for (i=0; i<vertexcount * 3; i+=3) {
-      fscanf(ph->ifp, "%f %f %f", &n[i], &n[i+1], &n[i+2]); 
+    if (!ParseNumberBlock(ph, scene, n, NULL, vertexcount * 3)) {
+      for (i=0; i<vertexcount * 3; i+=3) {
+        pscanf(ph, "%f %f %f", &n[i], &n[i+1], &n[i+2]); 
+      }
     }
-    fscanf(ph->ifp, "%s", arraytype); /* read next array type */
+    pscanf(ph, "%1023s", arraytype); /* read next array type */
   } else {
     free(v);
     printf("Expected vertex array normals block\n");
@@ -1594,22 +2447,25 @@ static errcode GetVertexArray(parsehandle * ph, SceneHandle scene) {
     /* read vertex colors */
     if (!stringcmp(arraytype, "COLORS")) {
       c = (float *) malloc(vertexcount * 3 * sizeof(float));
-      for (i=0; i<vertexcount * 3; i+=3) {
-        fscanf(ph->ifp, "%f %f %f", &c[i], &c[i+1], &c[i+2]); 
+      if (!ParseNumberBlock(ph, scene, c, NULL, vertexcount * 3)) {
+        for (i=0; i<vertexcount * 3; i+=3) {
+          pscanf(ph, "%f %f %f", &c[i], &c[i+1], &c[i+2]); 
+        }
       }
+      tbsvarray = 0; /* binary scene vertex array needs rewriting */
 #if 0
     } else if (!stringcmp(arraytype, "TEXCOORDS3")) {
       /* read vertex texture coordinates */
       texmode = 3;
       t = (float *) malloc(vertexcount * 3 * sizeof(float));
       for (i=0; i<vertexcount * 3; i++) {
-        fscanf(ph->ifp, "%f %f %f", &t[i], &t[i+1], &t[i+2]); 
+        pscanf(ph, "%f %f %f", &t[i], &t[i+1], &t[i+2]); 
       }
     } else if (!stringcmp(arraytype, "TEXCOORDS2")) {
       texmode = 2;
       t = (float *) malloc(vertexcount * 2 * sizeof(float));
       for (i=0; i<vertexcount * 3; i++) {
-        fscanf(ph->ifp, "%f %f", &t[i], &t[i+1]); 
+        pscanf(ph, "%f %f", &t[i], &t[i+1]); 
       }
 #endif
     } else if (!stringcmp(arraytype, "TEXTURE")) {
@@ -1623,27 +2479,44 @@ static errcode GetVertexArray(parsehandle * ph, SceneHandle scene) {
         done = 1;
       }
       texusecount=0;
+    } else if (ph->tbscapture && (!stringcmp(arraytype, "TRISTRIP") ||
+                                  !stringcmp(arraytype, "TRIMESH"))) {
+      /* write index buffers to the binary scene file, untessellated */
+      rc |= TBSCaptureFacets(ph, arraytype, tex, &texusecount,
+                             vertexcount, v, n, c, &tbsvarray);
+      if (rc != PARSENOERR)
+        done = 1;
     } else if (!stringcmp(arraytype, "TRISTRIP")) {
       int t;
       int numv=0;
       int stripaddr[2][3] = { {0, 1, 2}, {1, 0, 2} };
       int * facets=NULL;
+      void * vtex;
 
       rc |= GetInt(ph, &numv);
       if (rc!= PARSENOERR)
         return PARSEBADSYNTAX;
 
       facets = (int *) malloc(numv * sizeof(int));
-      for (i=0; i<numv; i++) {
-        fscanf(ph->ifp, "%d", &facets[i]); 
+      if (!ParseNumberBlock(ph, scene, NULL, facets, numv)) {
+        for (i=0; i<numv; i++) {
+          pscanf(ph, "%d", &facets[i]); 
+        }
       }
 
+      /* vertex colored triangles all share one texture */
+      vtex = (c != NULL) ? rt_texture_copy_vcstri(scene, tex) : tex;
+
+      /* long strips are mostly built in parallel, the rest serially */
+      t = MakeTriangles(scene, vtex, 1, facets, numv - 2,
+                        vertexcount, v, n, c);
+
       /* render triangle strips one triangle at a time        */
       /* triangle winding order is:                           */
       /*   v0, v1, v2, then v2, v1, v3, then v2, v3, v4, etc. */
 
       /* loop over all triangles in this triangle strip       */
-      for (t=0; t < (numv - 2); t++) {
+      for (; t < (numv - 2); t++) {
         /* render one triangle, using lookup table to fix winding order */
         int v0 = facets[t + (stripaddr[t & 0x01][0])];
         int v1 = facets[t + (stripaddr[t & 0x01][1])];
@@ -1657,10 +2530,7 @@ static errcode GetVertexArray(parsehandle * ph, SceneHandle scene) {
           v2 *= 3;
 
           if (c != NULL) {
-            if (texusecount > 0)
-              tex = rt_texture_copy_vcstri(scene, tex); /* create a new one */
-
-            rt_vcstri(scene, tex, 
+            rt_vcstri(scene, vtex, 
                       rt_vector(v[v0], v[v0 + 1], v[v0 + 2]),
                       rt_vector(v[v1], v[v1 + 1], v[v1 + 2]),
                       rt_vector(v[v2], v[v2 + 1], v[v2 + 2]),
@@ -1671,7 +2541,7 @@ static errcode GetVertexArray(parsehandle * ph, SceneHandle scene) {
                        rt_color(c[v1], c[v1 + 1], c[v1 + 2]),
                        rt_color(c[v2], c[v2 + 1], c[v2 + 2]));
           } else {
-            rt_stri(scene, tex, 
+            rt_stri(scene, vtex, 
                     rt_vector(v[v0], v[v0 + 1], v[v0 + 2]),
                     rt_vector(v[v1], v[v1 + 1], v[v1 + 2]),
                     rt_vector(v[v2], v[v2 + 1], v[v2 + 2]),
@@ -1687,26 +2557,34 @@ static errcode GetVertexArray(parsehandle * ph, SceneHandle scene) {
           done = 1;
           break;
         }
-
-        texusecount++; /* don't reuse textures */
       }
 
       free(facets);
     } else if (!stringcmp(arraytype, "TRIMESH")) {
       int numfacets=0;
       int * facets;
+      void * vtex;
 
       rc |= GetInt(ph, &numfacets);
       if (rc!= PARSENOERR)
         return PARSEBADSYNTAX;
         
       facets = (int *) malloc(numfacets * 3 * sizeof(int));
-      for (i=0; i<numfacets*3; i+=3) {
-        fscanf(ph->ifp, "%d %d %d", &facets[i], &facets[i+1], &facets[i+2]); 
+      if (!ParseNumberBlock(ph, scene, NULL, facets, numfacets * 3)) {
+        for (i=0; i<numfacets*3; i+=3) {
+          pscanf(ph, "%d %d %d", &facets[i], &facets[i+1], &facets[i+2]); 
+        }
       }
 
+      /* vertex colored triangles all share one texture */
+      vtex = (c != NULL) ? rt_texture_copy_vcstri(scene, tex) : tex;
+
+      /* large meshes are mostly built in parallel, the rest serially */
+      i = MakeTriangles(scene, vtex, 0, facets, numfacets,
+                        vertexcount, v, n, c);
+
       /* loop over all triangles in this mesh */
-      for (i=0; i < numfacets*3; i+=3) {
+      for (i*=3; i < numfacets*3; i+=3) {
         int v0 = facets[i    ];
         int v1 = facets[i + 1];
         int v2 = facets[i + 2];
@@ -1720,9 +2598,7 @@ static errcode GetVertexArray(parsehandle * ph, SceneHandle scene) {
           v2 *= 3;
 
           if (c != NULL) {
-            if (texusecount > 0)
-              tex = rt_texture_copy_vcstri(scene, tex); /* create a new one */
-            rt_vcstri(scene, tex, 
+            rt_vcstri(scene, vtex, 
                       rt_vector(v[v0], v[v0 + 1], v[v0 + 2]),
                       rt_vector(v[v1], v[v1 + 1], v[v1 + 2]),
                       rt_vector(v[v2], v[v2 + 1], v[v2 + 2]),
@@ -1733,7 +2609,7 @@ static errcode GetVertexArray(parsehandle * ph, SceneHandle scene) {
                       rt_color(c[v1], c[v1 + 1], c[v1 + 2]),
                       rt_color(c[v2], c[v2 + 1], c[v2 + 2]));
           } else {
-            rt_stri(scene, tex, 
+            rt_stri(scene, vtex, 
                     rt_vector(v[v0], v[v0 + 1], v[v0 + 2]),
                     rt_vector(v[v1], v[v1 + 1], v[v1 + 2]),
                     rt_vector(v[v2], v[v2 + 1], v[v2 + 2]),
@@ -1749,8 +2625,6 @@ static errcode GetVertexArray(parsehandle * ph, SceneHandle scene) {
           done = 1;
           break;
         }
-
-        texusecount++; /* don't reuse textures */
       }
 
       free(facets);
@@ -1763,7 +2637,7 @@ static errcode GetVertexArray(parsehandle * ph, SceneHandle scene) {
     }
 
     if (!done) {
-      fscanf(ph->ifp, "%s", arraytype); /* read next array type */
+      pscanf(ph, "%1023s", arraytype); /* read next array type */
     }
   }  
 
@@ -1787,10 +2661,10 @@ static errcode GetLandScape(parsehandle * ph, SceneHandle scene) {
   errcode rc;
 
   rc = GetString(ph, "RES");
-  fscanf(ph->ifp, "%d %d", &m, &n);
+  pscanf(ph, "%d %d", &m, &n);
 
   rc |= GetString(ph, "SCALE");
-  fscanf(ph->ifp, "%f %f", &a, &b);   
+  pscanf(ph, "%f %f", &a, &b);   
   wx=a;
   wy=b;
 
@@ -1807,7 +2681,8 @@ static errcode GetLandScape(parsehandle * ph, SceneHandle scene) {
 static errcode GetTPolyFile(parsehandle * ph, SceneHandle scene) {
   void * tex;
   char ifname[255];
-  FILE *ifp;
+  const char * oldfilename;
+  parsefile oldin;
   int v;
   RotMat RotA;
   errcode rc=0;
@@ -1832,21 +2707,24 @@ static errcode GetTPolyFile(parsehandle * ph, SceneHandle scene) {
   rc |= GetVector(ph, &ctr);
 
   rc |= GetString(ph, "FILE");
-  fscanf(ph->ifp, "%s", ifname);
+  pscanf(ph, "%254s", ifname);
 
   rc |= GetTexture(ph, scene, &tex);
 
-  if ((ifp=fopen(ifname, "r")) == NULL) {
+  /* polygons are read from the tpoly file, in place of the scene file */
+  oldfilename = ph->filename;
+  oldin = ph->in;
+  if (OpenParseFile(&ph->in, ifname) != PARSENOERR) {
     printf("Can't open data file %s for input!! Aborting...\n", ifname);
+    ph->in = oldin;
     return PARSEBADSUBFILE;
   }
+  ph->filename = ifname;
 
-  while (!feof(ifp)) {
-    fscanf(ifp, "%d", &v);
+  while (pscanf(ph, "%d", &v) == 1) {
     if (v != 3) { break; }
 
     totalpolys++;
-    v=0; 
      
     rc |= GetVector(ph, &v0);
     rc |= GetVector(ph, &v1);
@@ -1867,7 +2745,9 @@ static errcode GetTPolyFile(parsehandle * ph, SceneHandle scene) {
     rt_tri(scene, tex, v1, v0, v2);
   }
 
-  fclose(ifp);
+  CloseParseFile(&ph->in);
+  ph->filename = oldfilename;
+  ph->in = oldin;
 
   return rc;
 }
@@ -1876,7 +2756,7 @@ static errcode GetTPolyFile(parsehandle * ph, SceneHandle scene) {
 static errcode GetClipGroup(parsehandle * ph, SceneHandle scene) {
   char objtype[256];
 
-  if (fscanf(ph->ifp, "%s", objtype) == EOF) {
+  if (pscanf(ph, "%255s", objtype) == EOF) {
     return PARSEEOF;
   }
 
@@ -1884,13 +2764,13 @@ static errcode GetClipGroup(parsehandle * ph, SceneHandle scene) {
     int numplanes, i; 
     float * planes;
 
-    if (fscanf(ph->ifp, "%d", &numplanes) != 1)
+    if (pscanf(ph, "%d", &numplanes) != 1)
       return PARSEBADSYNTAX;
 
     planes = (float *) malloc(numplanes * 4 * sizeof(float));
 
     for (i=0; i<(numplanes * 4); i++) {
-      if (fscanf(ph->ifp, "%f", &planes[i]) != 1)
+      if (pscanf(ph, "%f", &planes[i]) != 1)
         return PARSEBADSYNTAX;
     } 
 
@@ -1914,7 +2794,7 @@ static errcode GetClipGroupEnd(parsehandle * ph, SceneHandle scene) {
 static errcode GetMGFFile(parsehandle * ph, SceneHandle scene) {
   char ifname[255];
 
-  fscanf(ph->ifp, "%s", ifname); /* get MGF filename */
+  pscanf(ph, "%254s", ifname); /* get MGF filename */
   if (ParseMGF(ifname, scene, 0) == MGF_NOERR)
     return PARSENOERR;
   
@@ -12,6 +12,21 @@
 #define PARSEALLOCERR    16
  
 unsigned int readmodel(const char *, SceneHandle);
+unsigned int readmodel_buffer(const char * name, const char * text, 
+                              size_t len, SceneHandle);
+
+/* scene file conversion to the binary .tbs format */
+unsigned int convertmodel(const char * modelfile, const char * binfile);
+
+/* incremental parsing of scene text, used by the binary scene reader */
+void * readmodel_begin(const char * filename, SceneHandle);
+unsigned int readmodel_stream(void * voidph, const char * text, size_t len,
+                              SceneHandle);
+void * readmodel_deftexture(void * voidph);
+unsigned int readmodel_addtexture(void * voidph, void * tex, const char *);
+void readmodel_spheres(SceneHandle, void * tex, int count, const float * ctr,
+                       const float * rad);
+void readmodel_end(void * voidph, SceneHandle);
 
 #ifdef PARSE_INTERNAL
 #define TEXNAMELEN 255
@@ -22,7 +37,16 @@ typedef struct {
 } texentry;
 
 typedef struct {
-  FILE * ifp;            /* current input file pointer */
+  const char * text;     /* start of scene text                     */
+  const char * pos;      /* current parse position                  */
+  const char * end;      /* end of scene text                       */
+  void * mapaddr;        /* file mapping, if the text is mapped     */
+  size_t maplen;         /* length of the file mapping              */
+  char * buf;            /* heap buffer, if the text was read in    */
+} parsefile;
+
+typedef struct {
+  parsefile in;          /* text of current input file */
   const char * filename; /* filename of current input file */
   texentry *textable;    /* texture lookup table */
   texentry defaulttex;   /* The default texture when a lookup fails */
@@ -31,6 +55,9 @@ typedef struct {
   int numobjectsparsed;  /* total number of objects parsed so far   */
   rt_hash_t texhash;     /* hash table for texture name lookup      */
   int transmode;         /* transparency rendering mode flags       */
+  void * tbs;            /* binary scene writer, when converting    */
+  int tbscapture;        /* write objects to tbs rather than scene  */
+  long tbsscript;        /* start of pending script text in file    */
 } parsehandle;  
 
 typedef struct {
@@ -41,6 +68,18 @@ typedef struct {
 
 typedef unsigned int errcode;
 
+/* scene text tokenizer */
+static errcode OpenParseFile(parsefile *, const char *);
+static void CloseParseFile(parsefile *);
+static int pscanf(parsehandle *, const char *, ...);
+static void SkipLine(parsehandle *);
+static int ParseNumberBlock(parsehandle *, SceneHandle, float *, int *, int);
+
+/* parallel object creation for large arrays */
+static int MakeTriangles(SceneHandle, void *, int, const int *, int,
+                         int, const float *, const float *, const float *);
+static void MakeSpheres(SceneHandle, void *, int, const float *, const float *);
+
 /* texture lookup table code */
 static void reset_tex_table(parsehandle *, SceneHandle);
 static void free_tex_table(parsehandle *, SceneHandle);
@@ -49,6 +88,7 @@ static void * find_texture(parsehandle *, const char *);
 
 /* scene file parsing code */
 static errcode GetString(parsehandle *, const char *);
+static errcode FindSceneStart(parsehandle *);
 static errcode GetScenedefs(parsehandle *, SceneHandle);
 static errcode GetCamera(parsehandle *, SceneHandle);
 static errcode GetColor(parsehandle *, apicolor *);
@@ -85,6 +125,15 @@ static errcode GetObject(parsehandle *, SceneHandle);
 static errcode ReadIncludeFile(parsehandle *, const char *, SceneHandle);
 static errcode GetClipGroup(parsehandle * ph, SceneHandle scene);
 static errcode GetClipGroupEnd(parsehandle * ph, SceneHandle scene);
+static int TBSCaptured(const char *);
+static errcode TBSFlushScript(parsehandle *, long);
+static errcode TBSCaptureObject(parsehandle *, SceneHandle, const char *, long);
+static errcode TBSCaptureFacets(parsehandle *, const char *, void *, int *,
+                                int, const float *, const float *, 
+                                const float *, int *);
+static errcode TBSCaptureLight(parsehandle *, int, const apivector *, apiflt,
+                               const apivector *, apiflt, apiflt,
+                               int, apiflt, apiflt, apiflt, const apicolor *);
 
 #ifdef USELIBMGF
 static errcode GetMGFFile(parsehandle *, SceneHandle);
@@ -138,6 +187,11 @@ ROT
 SCALARVOL
 SCAPE
 SPHERE
+SPHEREARRAY
+  NUMSPHERES
+  CENTERS
+  RADII
+  END_SPHEREARRAY
 SPOTLIGHT
 START_CLIPGROUP
 STRI
@@ -0,0 +1,195 @@
+/* parsebench.c
+ * This file contains a benchmark program for the ASCII scene file parser,
+ * which measures parsing throughput for a large synthetic scene of
+ * spheres and a vertex array mesh, and for any scene files given on the
+ * command line, such as the contents of the scenes directory.
+ *
+ *  $Id$
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "tachyon.h"
+#include "parse.h"
+
+int rt_mynode(void); /* proto */
+
+#define SYNTHFILE "parsebench.dat"
+#define NUMRUNS 3
+
+/* 
+ * write a scene with numspheres random spheres, the same number again
+ * in a sphere array, and a gridsz^2 vertex array mesh 
+ */
+static int makescene(const char *filename, int numspheres, int gridsz) {
+  FILE * ofp;
+  unsigned int seed = 31337;
+  int i, x, y;
+
+  ofp = fopen(filename, "w");
+  if (ofp == NULL)
+    return -1;
+
+  fprintf(ofp, "BEGIN_SCENE\n");
+  fprintf(ofp, "RESOLUTION 256 256\n");
+  fprintf(ofp, "CAMERA\n  ZOOM 1.0 ASPECTRATIO 1.0 ANTIALIASING 0 RAYDEPTH 4\n");
+  fprintf(ofp, "  CENTER 0 0 -12 VIEWDIR 0 0 1 UPDIR 0 1 0\nEND_CAMERA\n");
+  fprintf(ofp, "LIGHT CENTER 4 4 -10 RAD 0.1 COLOR 1 1 1\n");
+  fprintf(ofp, "TEXDEF red AMBIENT 0.1 DIFFUSE 0.8 SPECULAR 0.2 OPACITY 1.0\n");
+  fprintf(ofp, "  PHONG PLASTIC 0.5 PHONG_SIZE 40 COLOR 1 0.2 0.2 TEXFUNC 0\n");
+
+  for (i=0; i<numspheres; i++) {
+    float cx = 8.0f * (rt_rand(&seed) / RT_RAND_MAX) - 4.0f;
+    float cy = 8.0f * (rt_rand(&seed) / RT_RAND_MAX) - 4.0f;
+    float cz = 8.0f * (rt_rand(&seed) / RT_RAND_MAX);
+    float r = 0.01f + 0.04f * (rt_rand(&seed) / RT_RAND_MAX);
+    fprintf(ofp, "SPHERE CENTER %f %f %f RAD %f red\n", cx, cy, cz, r);
+  }
+
+  fprintf(ofp, "SPHEREARRAY NUMSPHERES %d\nCENTERS\n", numspheres);
+  for (i=0; i<numspheres; i++) {
+    float cx = 8.0f * (rt_rand(&seed) / RT_RAND_MAX) - 4.0f;
+    float cy = 8.0f * (rt_rand(&seed) / RT_RAND_MAX) - 4.0f;
+    float cz = 8.0f * (rt_rand(&seed) / RT_RAND_MAX);
+    fprintf(ofp, "%f %f %f\n", cx, cy, cz);
+  }
+  fprintf(ofp, "RADII\n");
+  for (i=0; i<numspheres; i++) {
+    fprintf(ofp, "%f\n", 0.01f + 0.04f * (rt_rand(&seed) / RT_RAND_MAX));
+  }
+  fprintf(ofp, "TEXTURE AMBIENT 0.1 DIFFUSE 0.8 SPECULAR 0.2 OPACITY 1\n");
+  fprintf(ofp, "  COLOR 0.2 0.2 1 TEXFUNC 0\nEND_SPHEREARRAY\n");
+
+  fprintf(ofp, "VERTEXARRAY NUMVERTS %d\nCOORDS\n", gridsz * gridsz);
+  for (y=0; y<gridsz; y++) {
+    for (x=0; x<gridsz; x++) {
+      float u = x / (gridsz - 1.0f);
+      float v = y / (gridsz - 1.0f);
+      fprintf(ofp, "%f %f %f\n", 8.0f*u - 4.0f, 8.0f*v - 4.0f,
+              8.0f + 0.5f * sinf(u * 12.0f) * cosf(v * 12.0f));
+    }
+  }
+  fprintf(ofp, "NORMALS\n");
+  for (i=0; i<gridsz*gridsz; i++)
+    fprintf(ofp, "0 0 -1\n");
+  fprintf(ofp, "COLORS\n");
+  for (y=0; y<gridsz; y++) {
+    for (x=0; x<gridsz; x++) {
+      fprintf(ofp, "%f %f 0.5\n", x / (float) gridsz, y / (float) gridsz);
+    }
+  }
+  fprintf(ofp, "TEXTURE AMBIENT 0.1 DIFFUSE 0.7 SPECULAR 0 OPACITY 1\n");
+  fprintf(ofp, "  COLOR 1 1 1 TEXFUNC 0\n");
+  fprintf(ofp, "TRIMESH %d\n", 2 * (gridsz-1) * (gridsz-1));
+  for (y=0; y<gridsz-1; y++) {
+    for (x=0; x<gridsz-1; x++) {
+      int v0 = y*gridsz + x;
+      fprintf(ofp, "%d %d %d %d %d %d\n", v0, v0 + 1, v0 + gridsz, 
+              v0 + 1, v0 + gridsz + 1, v0 + gridsz);
+    }
+  }
+  fprintf(ofp, "END_VERTEXARRAY\nEND_SCENE\n");
+
+  if (ferror(ofp)) {
+    fclose(ofp);
+    return -1;
+  }
+  fclose(ofp);
+
+  return 0;
+}
+
+static long filesize(const char *filename) {
+  FILE * fp = fopen(filename, "rb");
+  long sz = -1;
+
+  if (fp != NULL) {
+    fseek(fp, 0, SEEK_END);
+    sz = ftell(fp);
+    fclose(fp);
+  }
+
+  return sz;
+}
+
+/* parse a scene, returning the best time of several runs */
+static double parsescene(const char *filename) {
+  rt_timerhandle timer;
+  SceneHandle scene;
+  double t, best = -1.0;
+  unsigned int rc;
+  int i;
+
+  timer = rt_timer_create();
+  for (i=0; i<NUMRUNS; i++) {
+    scene = rt_newscene();
+    rt_timer_start(timer);
+    rc = readmodel(filename, scene);
+    rt_timer_stop(timer);
+    rt_deletescene(scene);
+
+    if (rc != PARSENOERR) {
+      best = -1.0;
+      break;
+    }
+
+    t = rt_timer_time(timer);
+    if (best < 0.0 || t < best)
+      best = t;
+  }
+  rt_timer_destroy(timer);
+
+  return best;
+}
+
+static void report(const char *filename, double *totalbytes, double *totaltime) {
+  double t = parsescene(filename);
+  long sz = filesize(filename);
+
+  if (rt_mynode() != 0)
+    return;
+
+  if (t < 0.0) {
+    printf("  %-24s   parser error, skipped\n", filename);
+    return;
+  }
+
+  printf("  %-24s %12ld %9.4fs %9.2f MB/s\n", filename, sz, t,
+         (t > 0.0) ? sz / (t * 1024.0 * 1024.0) : 0.0);
+  *totalbytes += sz;
+  *totaltime += t;
+}
+
+int main(int argc, char **argv) {
+  double totalbytes = 0.0, totaltime = 0.0;
+  int i;
+
+  rt_initialize(&argc, &argv);
+
+  if (makescene(SYNTHFILE, 200000, 400)) {
+    printf("Failed to write synthetic scene %s\n", SYNTHFILE);
+    rt_finalize();
+    return -1;
+  }
+
+  if (rt_mynode() == 0) {
+    printf("  scene file                     bytes     parse    throughput\n");
+  }
+
+  report(SYNTHFILE, &totalbytes, &totaltime);
+  for (i=1; i<argc; i++) {
+    report(argv[i], &totalbytes, &totaltime);
+  }
+
+  if (rt_mynode() == 0 && totaltime > 0.0) {
+    printf("  %-24s %12.0f %9.4fs %9.2f MB/s\n", "total", totalbytes,
+           totaltime, totalbytes / (totaltime * 1024.0 * 1024.0));
+  }
+
+  remove(SYNTHFILE);
+  rt_finalize();
+
+  return 0;
+}
@@ -0,0 +1,252 @@
+/* renderclient.c
+ * This file contains a simple client for the render daemon in renderd.c.
+ * It sends a scene file to the daemon, optionally several times to
+ * measure cached render performance, and saves the returned image.
+ *
+ *  $Id$
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tachyon.h"
+#include "binscene.h"
+#include "renderd.h"
+
+#if defined(_MSC_VER) || defined(WIN32)
+
+int main(int argc, char **argv) {
+  printf("The render client requires UNIX-domain sockets, unsupported here.\n");
+  return -1;
+}
+
+#else
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static int readall(int fd, void * buf, size_t len) {
+  char * p = (char *) buf;
+
+  while (len > 0) {
+    ssize_t rc = read(fd, p, len);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc <= 0)
+      return -1;
+    p += rc;
+    len -= rc;
+  }
+
+  return 0;
+}
+
+static int writeall(int fd, const void * buf, size_t len) {
+  const char * p = (const char *) buf;
+
+  while (len > 0) {
+    ssize_t rc = write(fd, p, len);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc <= 0)
+      return -1;
+    p += rc;
+    len -= rc;
+  }
+
+  return 0;
+}
+
+static char * loadfile(const char * filename, size_t * len) {
+  FILE * ifp;
+  char * buf;
+  long flen;
+
+  ifp = fopen(filename, "rb");
+  if (ifp == NULL)
+    return NULL;
+
+  fseek(ifp, 0, SEEK_END);
+  flen = ftell(ifp);
+  fseek(ifp, 0, SEEK_SET);
+  buf = (flen > 0) ? (char *) malloc(flen) : NULL;
+  if (buf == NULL || fread(buf, 1, flen, ifp) != (size_t) flen) {
+    free(buf);
+    fclose(ifp);
+    return NULL;
+  }
+  fclose(ifp);
+
+  *len = flen;
+  return buf;
+}
+
+static int connect_socket(const char * path) {
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path))
+    return -1;
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  if (connect(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static void usage(const char * name) {
+  printf("usage: %s socketpath scenefile [options]\n", name);
+  printf("  -res X Y         image resolution, default from the scene file\n");
+  printf("  -camera cx cy cz vx vy vz ux uy uz\n");
+  printf("                   camera center, view and up directions\n");
+  printf("  -zoom Z          camera zoom factor\n");
+  printf("  -raw             request raw RGB data rather than a PPM image\n");
+  printf("  -count N         render N times, resending only the scene hash\n");
+  printf("  -o filename      save the image, default renderclient.ppm\n");
+}
+
+int main(int argc, char **argv) {
+  rnd_request req;
+  rnd_reply reply;
+  rt_timerhandle timer;
+  const char * outname = "renderclient.ppm";
+  unsigned char * img = NULL;
+  char * data;
+  size_t len;
+  int i, fd, count = 1, rc = 0;
+
+  if (argc < 3) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  memset(&req, 0, sizeof(req));
+  memset(&reply, 0, sizeof(reply));
+  memcpy(req.magic, RND_MAGIC, sizeof(req.magic));
+  req.version = RND_VERSION;
+  req.imageformat = RND_IMAGE_PPM;
+
+  for (i=3; i<argc; i++) {
+    if (!strcmp(argv[i], "-res") && i+2 < argc) {
+      req.xres = atoi(argv[++i]);
+      req.yres = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-camera") && i+9 < argc) {
+      int j;
+      for (j=0; j<3; j++)
+        req.center[j] = (float) atof(argv[++i]);
+      for (j=0; j<3; j++)
+        req.viewdir[j] = (float) atof(argv[++i]);
+      for (j=0; j<3; j++)
+        req.updir[j] = (float) atof(argv[++i]);
+      req.flags |= RND_FLAG_CAMERA;
+    } else if (!strcmp(argv[i], "-zoom") && i+1 < argc) {
+      req.zoom = (float) atof(argv[++i]);
+      req.flags |= RND_FLAG_ZOOM;
+    } else if (!strcmp(argv[i], "-raw")) {
+      req.imageformat = RND_IMAGE_RGB24;
+    } else if (!strcmp(argv[i], "-count") && i+1 < argc) {
+      count = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-o") && i+1 < argc) {
+      outname = argv[++i];
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  data = loadfile(argv[2], &len);
+  if (data == NULL) {
+    printf("Failed to read scene file %s\n", argv[2]);
+    return -1;
+  }
+  req.sceneformat = (len >= 8 && !memcmp(data, TBS_MAGIC, 8)) ?
+                    RND_SCENE_TBS : RND_SCENE_DAT;
+
+  signal(SIGPIPE, SIG_IGN); /* the daemon hangs up on a refused scene */
+  fd = connect_socket(argv[1]);
+  if (fd < 0) {
+    printf("Failed to connect to render daemon at %s\n", argv[1]);
+    free(data);
+    return -1;
+  }
+
+  timer = rt_timer_create();
+  for (i=0; i<count && rc == 0; i++) {
+    /* the scene is only sent again if the daemon no longer has it */
+    req.scenelen = (i == 0 || reply.status == RND_NOTCACHED) ? len : 0;
+    req.scenehash = (req.scenelen == 0) ? reply.scenehash : 0;
+
+    rt_timer_start(timer);
+    if (writeall(fd, &req, sizeof(req))) {
+      printf("Lost connection to render daemon\n");
+      rc = -1;
+      break;
+    }
+    /* a refused scene is cut off, but the daemon's reply is still read */
+    if (req.scenelen > 0)
+      writeall(fd, data, len);
+    if (readall(fd, &reply, sizeof(reply))) {
+      printf("Lost connection to render daemon\n");
+      rc = -1;
+      break;
+    }
+
+    free(img);
+    img = (reply.imagelen > 0) ? (unsigned char *) malloc(reply.imagelen) : NULL;
+    if (reply.imagelen > 0 &&
+        (img == NULL || readall(fd, img, (size_t) reply.imagelen))) {
+      printf("Failed to receive image from render daemon\n");
+      rc = -1;
+      break;
+    }
+    rt_timer_stop(timer);
+
+    if (reply.status == RND_NOTCACHED) {
+      count++; /* retry with the scene data */
+      continue;
+    }
+    if (reply.status != RND_OK) {
+      printf("Render daemon returned error status %u\n", reply.status);
+      rc = -1;
+      break;
+    }
+
+    printf("  request %3d: %s %dx%d %10.4fs\n", i,
+           reply.cached ? "cached" : "loaded", reply.xres, reply.yres,
+           rt_timer_time(timer));
+  }
+  rt_timer_destroy(timer);
+  close(fd);
+
+  if (rc == 0 && img != NULL) {
+    FILE * ofp = fopen(outname, "wb");
+    if (ofp == NULL || fwrite(img, 1, (size_t) reply.imagelen, ofp) !=
+        (size_t) reply.imagelen) {
+      printf("Failed to write image %s\n", outname);
+      rc = -1;
+    }
+    if (ofp != NULL)
+      fclose(ofp);
+  }
+
+  free(img);
+  free(data);
+
+  return rc;
+}
+
+#endif
@@ -0,0 +1,480 @@
+/* renderd.c
+ * This file contains a render daemon, which accepts scenes and camera
+ * parameters over a UNIX-domain socket and sends back rendered images.
+ * Parsed scenes are kept in a small cache along with their grids and
+ * render threads, so repeated renders of the same scene only pay for
+ * the ray tracing itself.  The protocol is described in renderd.h,
+ * and renderclient.c is a simple client for it.
+ *
+ *  $Id$
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tachyon.h"
+#include "parse.h"
+#include "binscene.h"
+#include "renderd.h"
+
+#if defined(_MSC_VER) || defined(WIN32)
+
+int main(int argc, char **argv) {
+  printf("The render daemon requires UNIX-domain sockets, unsupported here.\n");
+  return -1;
+}
+
+#else
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define DEFAULT_CACHESIZE 8
+#define DEFAULT_MAXSCENE  256     /* largest scene accepted, in megabytes */
+
+typedef struct {
+  unsigned long long hash;      /* hash of scene data and format, 0 if free */
+  SceneHandle scene;
+  int xres, yres;               /* resolution given in the scene file    */
+  int imgxres, imgyres;         /* resolution of the image buffer        */
+  unsigned char * img;
+  apivector center, viewdir, updir, rightdir; /* camera from scene file  */
+  flt zoom;
+  int camchanged;               /* camera differs from the scene file    */
+  unsigned long lastuse;
+} sceneentry;
+
+typedef struct {
+  sceneentry * entries;
+  int numentries;
+  unsigned long clock;
+  int numthreads;
+  int verbose;
+  unsigned long long maxscenelen; /* largest scene data accepted, bytes  */
+} scenecache;
+
+static volatile sig_atomic_t quitflag = 0;
+
+static void quit_handler(int sig) {
+  quitflag = 1;
+}
+
+static int readall(int fd, void * buf, size_t len) {
+  char * p = (char *) buf;
+
+  while (len > 0) {
+    ssize_t rc = read(fd, p, len);
+    if (rc < 0 && errno == EINTR && !quitflag)
+      continue;
+    if (rc <= 0)
+      return -1;
+    p += rc;
+    len -= rc;
+  }
+
+  return 0;
+}
+
+static int writeall(int fd, const void * buf, size_t len) {
+  const char * p = (const char *) buf;
+
+  while (len > 0) {
+    ssize_t rc = write(fd, p, len);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc <= 0)
+      return -1;
+    p += rc;
+    len -= rc;
+  }
+
+  return 0;
+}
+
+/* 64-bit FNV-1a hash of the scene data, mixed with the scene format */
+static unsigned long long scene_hash(const char * data, size_t len,
+                                     unsigned int format) {
+  unsigned long long h = 14695981039346656037ULL;
+  size_t i;
+
+  for (i=0; i<len; i++) {
+    h ^= (unsigned char) data[i];
+    h *= 1099511628211ULL;
+  }
+  h ^= format;
+  h *= 1099511628211ULL;
+
+  return (h != 0) ? h : 1;
+}
+
+static void free_entry(sceneentry * e) {
+  if (e->scene != NULL)
+    rt_deletescene(e->scene);
+  free(e->img);
+  memset(e, 0, sizeof(sceneentry));
+}
+
+static sceneentry * find_entry(scenecache * cache, unsigned long long hash) {
+  int i;
+
+  for (i=0; i<cache->numentries; i++) {
+    if (cache->entries[i].hash == hash)
+      return &cache->entries[i];
+  }
+
+  return NULL;
+}
+
+/* parse a scene into the least recently used cache entry */
+static int load_entry(scenecache * cache, unsigned long long hash,
+                      unsigned int format, const char * data, size_t len,
+                      sceneentry ** entry) {
+  sceneentry * e;
+  unsigned int rc;
+  int i;
+
+  e = &cache->entries[0];
+  for (i=1; i<cache->numentries; i++) {
+    if (cache->entries[i].lastuse < e->lastuse)
+      e = &cache->entries[i];
+  }
+  free_entry(e);
+
+  e->scene = rt_newscene();
+  if (e->scene == NULL)
+    return RND_ALLOCERR;
+
+  /* the parser and image map loader use the scene's threads too */
+  if (cache->numthreads > 0)
+    rt_set_numthreads(e->scene, cache->numthreads);
+
+  if (format == RND_SCENE_TBS)
+    rc = readbinmodel_buffer("renderd.tbs", data, len, e->scene);
+  else
+    rc = readmodel_buffer("renderd.dat", data, len, e->scene);
+
+  if (rc != PARSENOERR) {
+    if (cache->verbose)
+      printf("renderd: scene %016llx failed to parse, error code %u\n",
+             hash, rc);
+    free_entry(e);
+    return (rc & PARSEALLOCERR) ? RND_ALLOCERR : RND_PARSEERR;
+  }
+
+  /* images go to memory only, the daemon does its own encoding */
+  rt_outputfile(e->scene, "");
+  rt_verbose(e->scene, 0);
+
+  rt_get_resolution(e->scene, &e->xres, &e->yres);
+  rt_get_camera_position(e->scene, &e->center, &e->viewdir,
+                         &e->updir, &e->rightdir);
+  e->zoom = rt_get_camera_zoom(e->scene);
+  e->hash = hash;
+  *entry = e;
+
+  return RND_OK;
+}
+
+/* render an image of a cached scene into a newly allocated reply buffer */
+static int render_entry(scenecache * cache, sceneentry * e,
+                        const rnd_request * req, rnd_reply * reply,
+                        unsigned char ** imgbuf) {
+  unsigned char * buf;
+  size_t hdrlen, rowlen;
+  char hdr[64];
+  int xres, yres, y;
+
+  xres = (req->xres > 0) ? req->xres : e->xres;
+  yres = (req->yres > 0) ? req->yres : e->yres;
+  if (xres <= 0 || yres <= 0 || xres > 32768 || yres > 32768)
+    return RND_BADREQUEST;
+
+  /* the grid and threads are kept, unless the image size changes */
+  if (xres != e->imgxres || yres != e->imgyres) {
+    unsigned char * img = (unsigned char *) malloc((size_t) xres * yres * 3);
+    if (img == NULL)
+      return RND_ALLOCERR;
+    free(e->img);
+    e->img = img;
+    e->imgxres = xres;
+    e->imgyres = yres;
+    rt_resolution(e->scene, xres, yres);
+    rt_rawimage_rgb24(e->scene, e->img);
+  }
+
+  /* restore the scene file camera only if a previous request moved it */
+  if (req->flags & (RND_FLAG_CAMERA | RND_FLAG_ZOOM)) {
+    if (e->camchanged) {
+      rt_camera_position(e->scene, e->center, e->viewdir, e->updir);
+      rt_camera_zoom(e->scene, e->zoom);
+    }
+    if (req->flags & RND_FLAG_CAMERA)
+      rt_camera_position3fv(e->scene, req->center, req->viewdir, req->updir);
+    if (req->flags & RND_FLAG_ZOOM)
+      rt_camera_zoom(e->scene, req->zoom);
+    e->camchanged = 1;
+  } else if (e->camchanged) {
+    rt_camera_position(e->scene, e->center, e->viewdir, e->updir);
+    rt_camera_zoom(e->scene, e->zoom);
+    e->camchanged = 0;
+  }
+
+  rt_renderscene(e->scene);
+  e->lastuse = ++cache->clock;
+
+  rowlen = (size_t) xres * 3;
+  hdrlen = 0;
+  if (req->imageformat == RND_IMAGE_PPM) {
+    sprintf(hdr, "P6\n%d %d\n255\n", xres, yres);
+    hdrlen = strlen(hdr);
+  }
+
+  buf = (unsigned char *) malloc(hdrlen + rowlen * yres);
+  if (buf == NULL)
+    return RND_ALLOCERR;
+
+  if (req->imageformat == RND_IMAGE_PPM) {
+    memcpy(buf, hdr, hdrlen);
+    for (y=0; y<yres; y++) {
+      memcpy(buf + hdrlen + y*rowlen, e->img + (yres - y - 1)*rowlen, rowlen);
+    }
+  } else {
+    memcpy(buf, e->img, rowlen * yres);
+  }
+
+  reply->xres = xres;
+  reply->yres = yres;
+  reply->imagelen = hdrlen + rowlen * yres;
+  *imgbuf = buf;
+
+  return RND_OK;
+}
+
+static int send_reply(int fd, rnd_reply * reply, const unsigned char * img) {
+  if (writeall(fd, reply, sizeof(rnd_reply)))
+    return -1;
+  if (reply->imagelen > 0 && writeall(fd, img, (size_t) reply->imagelen))
+    return -1;
+
+  return 0;
+}
+
+/*
+ * serve requests on a connection until the client closes it, returns
+ * nonzero if the connection has to be dropped because of a bad request
+ */
+static int serve_request(scenecache * cache, int fd) {
+  rnd_request req;
+  rnd_reply reply;
+  sceneentry * e;
+  unsigned char * img = NULL;
+  char * data = NULL;
+  rt_timerhandle timer;
+  double parsetime = 0.0;
+  int rc;
+
+  if (readall(fd, &req, sizeof(req)))
+    return -1;
+
+  memset(&reply, 0, sizeof(reply));
+  memcpy(reply.magic, RND_MAGIC, sizeof(reply.magic));
+
+  if (memcmp(req.magic, RND_MAGIC, sizeof(req.magic)) ||
+      req.version != RND_VERSION ||
+      req.sceneformat > RND_SCENE_TBS || req.imageformat > RND_IMAGE_RGB24 ||
+      req.scenelen != (size_t) req.scenelen ||
+      req.scenelen > cache->maxscenelen) {
+    reply.status = RND_BADREQUEST;
+    send_reply(fd, &reply, NULL);
+    return -1;
+  }
+
+  timer = rt_timer_create();
+  e = NULL;
+  if (req.scenelen > 0) {
+    /* malloc alignment is sufficient for binary scenes */
+    data = (char *) malloc((size_t) req.scenelen);
+    if (data == NULL) {
+      reply.status = RND_ALLOCERR;
+      send_reply(fd, &reply, NULL);
+      rt_timer_destroy(timer);
+      return -1;
+    }
+    if (readall(fd, data, (size_t) req.scenelen)) {
+      free(data);
+      rt_timer_destroy(timer);
+      return -1;
+    }
+
+    reply.scenehash = scene_hash(data, (size_t) req.scenelen, req.sceneformat);
+    e = find_entry(cache, reply.scenehash);
+    if (e == NULL) {
+      rt_timer_start(timer);
+      rc = load_entry(cache, reply.scenehash, req.sceneformat, data,
+                      (size_t) req.scenelen, &e);
+      rt_timer_stop(timer);
+      parsetime = rt_timer_time(timer);
+    } else {
+      reply.cached = 1;
+      rc = RND_OK;
+    }
+    free(data);
+  } else {
+    reply.scenehash = req.scenehash;
+    e = find_entry(cache, req.scenehash);
+    reply.cached = 1;
+    rc = (e != NULL) ? RND_OK : RND_NOTCACHED;
+  }
+
+  if (rc == RND_OK) {
+    rt_timer_start(timer);
+    rc = render_entry(cache, e, &req, &reply, &img);
+    rt_timer_stop(timer);
+  }
+
+  if (cache->verbose) {
+    printf("renderd: scene %016llx %s %dx%d, status %d, "
+           "parse %.4fs, render %.4fs\n", reply.scenehash,
+           reply.cached ? "cached" : "loaded", reply.xres, reply.yres, rc,
+           parsetime, (rc == RND_OK) ? rt_timer_time(timer) : 0.0);
+    fflush(stdout);
+  }
+  rt_timer_destroy(timer);
+
+  reply.status = rc;
+  rc = send_reply(fd, &reply, img);
+  free(img);
+
+  return rc;
+}
+
+static int open_socket(const char * path) {
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    printf("renderd: socket path %s is too long\n", path);
+    return -1;
+  }
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("renderd: socket");
+    return -1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path); /* remove a stale socket left by a previous daemon */
+
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(fd, 16)) {
+    perror("renderd: bind");
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static void usage(const char * name) {
+  printf("usage: %s [-numthreads N] [-cache N] [-maxscene MB] [-v] socketpath\n",
+         name);
+  printf("  -numthreads N   render threads per cached scene\n");
+  printf("  -cache N        number of parsed scenes to keep, default %d\n",
+         DEFAULT_CACHESIZE);
+  printf("  -maxscene MB    largest scene accepted, default %d MB\n",
+         DEFAULT_MAXSCENE);
+  printf("  -v              print a line for every request\n");
+  printf("Scene files that include other files or load image maps resolve\n");
+  printf("those names relative to the daemon's working directory.\n");
+}
+
+int main(int argc, char **argv) {
+  struct sigaction sa;
+  scenecache cache;
+  const char * path = NULL;
+  int i, lfd;
+
+  memset(&cache, 0, sizeof(cache));
+  cache.numentries = DEFAULT_CACHESIZE;
+  cache.maxscenelen = DEFAULT_MAXSCENE * 1048576ULL;
+
+  for (i=1; i<argc; i++) {
+    if (!strcmp(argv[i], "-numthreads") && i+1 < argc) {
+      cache.numthreads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-cache") && i+1 < argc) {
+      cache.numentries = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-maxscene") && i+1 < argc) {
+      cache.maxscenelen = strtoul(argv[++i], NULL, 10) * 1048576ULL;
+    } else if (!strcmp(argv[i], "-v")) {
+      cache.verbose = 1;
+    } else if (argv[i][0] != '-' && path == NULL) {
+      path = argv[i];
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (path == NULL || cache.numentries < 1 || cache.maxscenelen == 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  rt_initialize(&argc, &argv);
+
+  cache.entries = (sceneentry *) calloc(cache.numentries, sizeof(sceneentry));
+  lfd = (cache.entries != NULL) ? open_socket(path) : -1;
+  if (lfd < 0) {
+    free(cache.entries);
+    rt_finalize();
+    return -1;
+  }
+
+  /* a client going away must not take the daemon with it */
+  signal(SIGPIPE, SIG_IGN);
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = quit_handler;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  if (cache.verbose) {
+    printf("renderd: listening on %s, caching %d scenes\n",
+           path, cache.numentries);
+    fflush(stdout);
+  }
+
+  /* connections are served one at a time, each render uses all threads */
+  while (!quitflag) {
+    int fd = accept(lfd, NULL, NULL);
+    if (fd < 0) {
+      if (errno != EINTR)
+        perror("renderd: accept");
+      continue;
+    }
+
+    while (!quitflag && serve_request(&cache, fd) == 0)
+      ;
+
+    close(fd);
+  }
+
+  close(lfd);
+  unlink(path);
+
+  for (i=0; i<cache.numentries; i++)
+    free_entry(&cache.entries[i]);
+  free(cache.entries);
+
+  rt_finalize();
+
+  return 0;
+}
+
+#endif
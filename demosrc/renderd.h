@@ -0,0 +1,67 @@
+/*
+ * renderd.h - protocol definitions for the Tachyon render daemon
+ *
+ *  $Id$
+ */
+
+/*
+ * A client connects to the daemon's UNIX-domain socket and sends any
+ * number of requests over the connection, reading one reply after each.
+ * A request is an rnd_request header followed by 'scenelen' bytes of
+ * scene data, either ASCII scene text or a binary .tbs scene.  A reply
+ * is an rnd_reply header followed by 'imagelen' bytes of image data.
+ *
+ * Parsed scenes are cached by the daemon, keyed by a hash of the scene
+ * data, along with their grids and render threads.  A client that has
+ * already sent a scene once may send a request with a zero 'scenelen'
+ * and the 'scenehash' from a previous reply, to render from the cached
+ * scene without sending the data again.  If the scene has since been
+ * evicted from the cache, the reply status is RND_NOTCACHED and the
+ * client must resend the scene data.
+ *
+ * All values are in the byte order of the local machine.
+ */
+
+#define RND_MAGIC          "TACHYRND"
+#define RND_VERSION        1
+
+#define RND_SCENE_DAT      0  /**< ASCII scene file text                  */
+#define RND_SCENE_TBS      1  /**< binary .tbs scene                      */
+
+#define RND_IMAGE_PPM      0  /**< P6 PPM file, top row first             */
+#define RND_IMAGE_RGB24    1  /**< raw RGB bytes, bottom row first        */
+
+#define RND_FLAG_CAMERA    1  /**< use the camera position in the request */
+#define RND_FLAG_ZOOM      2  /**< use the camera zoom in the request     */
+
+#define RND_OK             0  /**< image follows                          */
+#define RND_BADREQUEST     1  /**< malformed or unsupported request       */
+#define RND_NOTCACHED      2  /**< scene hash unknown, resend the scene   */
+#define RND_PARSEERR       3  /**< scene data failed to parse             */
+#define RND_ALLOCERR       4  /**< out of memory                          */
+
+typedef struct {
+  char magic[8];                /**< RND_MAGIC, not nul terminated        */
+  unsigned int version;         /**< RND_VERSION                          */
+  unsigned int sceneformat;     /**< RND_SCENE_xxx                        */
+  unsigned int imageformat;     /**< RND_IMAGE_xxx                        */
+  unsigned int flags;           /**< RND_FLAG_xxx                         */
+  int xres;                     /**< image resolution, 0 for the scene's  */
+  int yres;
+  float center[3];              /**< camera position, RND_FLAG_CAMERA     */
+  float viewdir[3];
+  float updir[3];
+  float zoom;                   /**< camera zoom, RND_FLAG_ZOOM           */
+  unsigned long long scenehash; /**< hash of a cached scene if no data    */
+  unsigned long long scenelen;  /**< bytes of scene data following        */
+} rnd_request;
+
+typedef struct {
+  char magic[8];                /**< RND_MAGIC, not nul terminated        */
+  unsigned int status;          /**< RND_xxx status code                  */
+  unsigned int cached;          /**< nonzero if the scene was cached      */
+  int xres;                     /**< resolution of the returned image     */
+  int yres;
+  unsigned long long scenehash; /**< hash for reusing the cached scene    */
+  unsigned long long imagelen;  /**< bytes of image data following        */
+} rnd_reply;
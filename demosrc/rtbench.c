@@ -0,0 +1,586 @@
+/* rtbench.c
+ * This file contains the driver for the standard benchmark suite, which
+ * renders a fixed set of scene files and synthetic stress scenes at fixed
+ * resolutions, thread counts, and antialiasing and ambient occlusion
+ * settings.  For each case it reports the parse, preprocessing, ray
+ * tracing, and image I/O times, the ray throughput, and the peak memory
+ * use, as CSV or JSON.  It can also compare two CSV result files and
+ * flag the cases that got slower by more than a noise threshold.
+ *
+ *  $Id$
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tachyon.h"
+#include "threads.h"
+#include "parse.h"
+
+#if !defined(_MSC_VER) && !defined(WIN32)
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#define BENCHRUSAGE 1
+#if !defined(MPI)
+#define BENCHFORK 1   /* run each case in its own process */
+#endif
+#endif
+
+#define BENCHIMAGE        "rtbench.ppm"
+#define DEFAULT_REPS      3
+#define DEFAULT_THRESHOLD 5.0   /* percent */
+#define MINTIME           0.01  /* times shorter than this are just noise */
+
+/* scene sources */
+#define BENCH_FILE      0  /**< scene file from the scene directory    */
+#define BENCH_SPHERES   1  /**< random spheres, 1M at full scale       */
+#define BENCH_TRIS      2  /**< height field mesh, 10M at full scale   */
+#define BENCH_TRANSP    3  /**< stack of 64 transparent layers         */
+
+typedef struct {
+  const char * name;
+  const char * scenefile;
+  int source;              /**< BENCH_xxx                            */
+  int xres, yres;
+  int threads;             /**< 0 uses all processors                */
+  int aasamples;
+  int aosamples;           /**< 0 leaves ambient occlusion as is     */
+} benchcase;
+
+typedef struct {
+  int ok;
+  int threads;
+  double parse, preproc, trace, io;
+  double rays;
+  long peakrss;            /**< KB, 0 if unknown                     */
+} benchresult;
+
+static const benchcase suite[] = {
+  { "teapot-1t",    "teapot.dat",      BENCH_FILE,    512, 512, 1, 0,  0 },
+  { "teapot",       "teapot.dat",      BENCH_FILE,    512, 512, 0, 0,  0 },
+  { "balls-aa4",    "balls.dat",       BENCH_FILE,    512, 512, 0, 4,  0 },
+  { "lattice",      "lattice.dat",     BENCH_FILE,    512, 512, 0, 0,  0 },
+  { "dna",          "dna.dat",         BENCH_FILE,    512, 512, 0, 0,  0 },
+  { "trypsin4pti",  "trypsin4pti.dat", BENCH_FILE,    512, 512, 0, 0,  0 },
+  { "820spheres-ao","820spheres.dat",  BENCH_FILE,    512, 512, 0, 0,  8 },
+  { "spheres1m",    NULL,              BENCH_SPHERES, 512, 512, 0, 0,  0 },
+  { "tris10m",      NULL,              BENCH_TRIS,    512, 512, 0, 0,  0 },
+  { "transp64",     NULL,              BENCH_TRANSP,  256, 256, 0, 0,  0 }
+};
+
+#define NUMCASES ((int) (sizeof(suite) / sizeof(benchcase)))
+
+static void quietmsg(void * data, int level, char * msg) {
+}
+
+static void quietprogress(void * data, int percent) {
+}
+
+static void * maketex(SceneHandle scene, float r, float g, float b,
+                      float opacity) {
+  apitexture tex;
+
+  memset(&tex, 0, sizeof(tex));
+  tex.col = rt_color(r, g, b);
+  tex.ambient = 0.1;
+  tex.diffuse = 0.7;
+  tex.specular = 0.0;
+  tex.opacity = opacity;
+  tex.scale = rt_vector(1.0, 1.0, 1.0);
+  tex.texturefunc = RT_TEXTURE_CONSTANT;
+
+  return rt_texture(scene, &tex);
+}
+
+/* camera, light, and resolution shared by the synthetic scenes */
+static void synthsetup(SceneHandle scene, const benchcase * bc) {
+  rt_resolution(scene, bc->xres, bc->yres);
+  rt_camera_setup(scene, 1.0, 1.0, 0, 8, rt_vector(0.0, 0.0, -12.0),
+                  rt_vector(0.0, 0.0, 1.0), rt_vector(0.0, 1.0, 0.0));
+  rt_light(scene, maketex(scene, 1.0f, 1.0f, 1.0f, 1.0f),
+           rt_vector(4.0, 6.0, -10.0), 0.1);
+}
+
+static void synthspheres(SceneHandle scene, double scale) {
+  unsigned int seed = 31337;
+  void * tex = maketex(scene, 1.0f, 0.3f, 0.2f, 1.0f);
+  long i, n = (long) (1000000 * scale);
+
+  for (i=0; i<n; i++) {
+    float cx = 8.0f * (rt_rand(&seed) / RT_RAND_MAX) - 4.0f;
+    float cy = 8.0f * (rt_rand(&seed) / RT_RAND_MAX) - 4.0f;
+    float cz = 8.0f * (rt_rand(&seed) / RT_RAND_MAX);
+    float r = 0.005f + 0.02f * (rt_rand(&seed) / RT_RAND_MAX);
+    rt_sphere(scene, tex, rt_vector(cx, cy, cz), r);
+  }
+}
+
+static void synthtris(SceneHandle scene, double scale) {
+  void * tex = maketex(scene, 0.8f, 0.8f, 1.0f, 1.0f);
+  int x, y, gridsz;
+
+  /* a gridsz^2 height field has 2 * (gridsz-1)^2 triangles */
+  gridsz = (int) sqrt(10000000 * scale / 2.0) + 1;
+  if (gridsz < 2)
+    gridsz = 2;
+
+  for (y=0; y<gridsz-1; y++) {
+    for (x=0; x<gridsz-1; x++) {
+      apivector v[4];
+      int i;
+
+      for (i=0; i<4; i++) {
+        float u = (x + (i & 1)) / (gridsz - 1.0f);
+        float w = (y + (i >> 1)) / (gridsz - 1.0f);
+        v[i] = rt_vector(8.0f*u - 4.0f, 8.0f*w - 4.0f,
+                         4.0f + 0.5f * sinf(u * 40.0f) * cosf(w * 40.0f));
+      }
+      rt_tri(scene, tex, v[0], v[1], v[2]);
+      rt_tri(scene, tex, v[1], v[3], v[2]);
+    }
+  }
+}
+
+static void synthtransp(SceneHandle scene) {
+  void * tex = maketex(scene, 0.3f, 0.6f, 1.0f, 0.1f);
+  void * back = maketex(scene, 1.0f, 1.0f, 1.0f, 1.0f);
+  int i;
+
+  /* each layer takes a level of recursion */
+  rt_camera_raydepth(scene, 80);
+
+  for (i=0; i<64; i++) {
+    flt z = i * 0.1;
+    rt_tri(scene, tex, rt_vector(-4, -4, z), rt_vector(4, -4, z),
+           rt_vector(-4, 4, z));
+    rt_tri(scene, tex, rt_vector(4, -4, z), rt_vector(4, 4, z),
+           rt_vector(-4, 4, z));
+  }
+  rt_sphere(scene, back, rt_vector(0.0, 0.0, 8.0), 2.0);
+}
+
+static long peakrss(void) {
+#if defined(BENCHRUSAGE)
+  struct rusage ru;
+
+  if (getrusage(RUSAGE_SELF, &ru))
+    return 0;
+#if defined(__APPLE__)
+  return ru.ru_maxrss / 1024;   /* bytes */
+#else
+  return ru.ru_maxrss;          /* KB */
+#endif
+#else
+  return 0;
+#endif
+}
+
+static int mboxmode = RT_MBOX_AUTO; /* grid mailbox scheme for all cases */
+
+/*
+ * Load and render one case several times, keeping the best ray tracing
+ * and I/O times.  Preprocessing only happens for the first rendering.
+ * Statistics are off while timing, so the ray count comes from one more
+ * rendering afterwards.
+ */
+static void runcase(const benchcase * bc, const char * scenedir,
+                    double scale, int reps, benchresult * res) {
+  SceneHandle scene;
+  rt_timerhandle timer;
+  rt_render_stats stats;
+  double preproc, trace, io;
+  int i;
+
+  memset(res, 0, sizeof(benchresult));
+
+  scene = rt_newscene();
+  rt_scene_ui_callbacks(scene, quietmsg, quietprogress, NULL);
+  if (bc->threads > 0)
+    rt_set_numthreads(scene, bc->threads);
+
+  timer = rt_timer_create();
+  rt_timer_start(timer);
+  if (bc->source == BENCH_FILE) {
+    char filename[FILENAME_MAX];
+
+    sprintf(filename, "%.900s/%.100s", scenedir, bc->scenefile);
+    if (readmodel(filename, scene) != PARSENOERR) {
+      rt_timer_destroy(timer);
+      rt_deletescene(scene);
+      return;
+    }
+    rt_resolution(scene, bc->xres, bc->yres);
+  } else {
+    synthsetup(scene, bc);
+    if (bc->source == BENCH_SPHERES)
+      synthspheres(scene, scale);
+    else if (bc->source == BENCH_TRIS)
+      synthtris(scene, scale);
+    else
+      synthtransp(scene);
+  }
+  rt_timer_stop(timer);
+  res->parse = rt_timer_time(timer);
+  rt_timer_destroy(timer);
+
+  if (bc->aasamples > 0)
+    rt_aa_maxsamples(scene, bc->aasamples);
+  if (bc->aosamples > 0)
+    rt_ambient_occlusion(scene, bc->aosamples, rt_color(1.0, 1.0, 1.0));
+
+  rt_outputfile(scene, BENCHIMAGE);
+  rt_outputformat(scene, RT_FORMAT_PPM);
+  rt_mailbox_mode(scene, mboxmode);
+
+  for (i=0; i<reps; i++) {
+    rt_renderscene(scene);
+    rt_get_render_times(scene, &preproc, &trace, &io);
+    if (i == 0) {
+      res->preproc = preproc;
+      res->trace = trace;
+      res->io = io;
+    } else {
+      if (trace < res->trace)
+        res->trace = trace;
+      if (io < res->io)
+        res->io = io;
+    }
+  }
+
+  /* the rays are counted in an extra, untimed rendering */
+  rt_render_stats_mode(scene, 1);
+  rt_renderscene(scene);
+  rt_get_render_stats(scene, &stats);
+  res->rays = (double) stats.primaryrays + stats.shadowrays + stats.aorays +
+              stats.reflectionrays + stats.transmissionrays;
+  rt_deletescene(scene);
+  remove(BENCHIMAGE);
+
+#if defined(THR)
+  res->threads = (bc->threads > 0) ? bc->threads : rt_thread_numprocessors();
+#else
+  res->threads = 1;
+#endif
+  res->peakrss = peakrss();
+  res->ok = 1;
+}
+
+/*
+ * Run a case in a child process where possible, so that the peak memory
+ * use is that of the case alone, and a crash only loses that case.
+ */
+static void runisolated(const benchcase * bc, const char * scenedir,
+                        double scale, int reps, benchresult * res) {
+#if defined(BENCHFORK)
+  int fds[2], status;
+  pid_t pid;
+
+  memset(res, 0, sizeof(benchresult));
+  if (pipe(fds)) {
+    runcase(bc, scenedir, scale, reps, res);
+    return;
+  }
+
+  fflush(stdout);
+  pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    runcase(bc, scenedir, scale, reps, res);
+    if (write(fds[1], res, sizeof(benchresult)) != sizeof(benchresult))
+      _exit(1);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  if (pid < 0 || read(fds[0], res, sizeof(benchresult)) != sizeof(benchresult))
+    res->ok = 0;
+  close(fds[0]);
+  if (pid > 0)
+    waitpid(pid, &status, 0);
+#else
+  runcase(bc, scenedir, scale, reps, res);
+#endif
+}
+
+static void printheader(FILE * ofp, int json) {
+  if (json)
+    fprintf(ofp, "[\n");
+  else
+    fprintf(ofp, "case,scene,xres,yres,threads,aasamples,aosamples,"
+            "parse_s,preproc_s,trace_s,io_s,rays,mrays_s,peakrss_kb\n");
+}
+
+static void printresult(FILE * ofp, int json, int first,
+                        const benchcase * bc, const benchresult * res) {
+  const char * scenename = (bc->scenefile != NULL) ? bc->scenefile : "synthetic";
+  double mrays = (res->trace > 0.0) ? res->rays / (res->trace * 1.0e6) : 0.0;
+
+  if (json) {
+    fprintf(ofp, "%s  { \"case\": \"%s\", \"scene\": \"%s\", "
+            "\"xres\": %d, \"yres\": %d, \"threads\": %d, "
+            "\"aasamples\": %d, \"aosamples\": %d, \"ok\": %s,\n"
+            "    \"parse_s\": %.6f, \"preproc_s\": %.6f, \"trace_s\": %.6f, "
+            "\"io_s\": %.6f,\n    \"rays\": %.0f, \"mrays_s\": %.4f, "
+            "\"peakrss_kb\": %ld }",
+            first ? "" : ",\n", bc->name, scenename, bc->xres, bc->yres,
+            res->threads, bc->aasamples, bc->aosamples,
+            res->ok ? "true" : "false", res->parse, res->preproc,
+            res->trace, res->io, res->rays, mrays, res->peakrss);
+  } else if (res->ok) {
+    fprintf(ofp, "%s,%s,%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%.0f,%.4f,%ld\n",
+            bc->name, scenename, bc->xres, bc->yres, res->threads,
+            bc->aasamples, bc->aosamples, res->parse, res->preproc,
+            res->trace, res->io, res->rays, mrays, res->peakrss);
+  }
+  fflush(ofp);
+}
+
+static void printfooter(FILE * ofp, int json) {
+  if (json)
+    fprintf(ofp, "\n]\n");
+}
+
+/* the fields of one CSV result line used for comparisons */
+typedef struct {
+  char name[64];
+  double preproc, trace;
+  long peakrss;
+} csvresult;
+
+static int readcsv(const char * filename, csvresult ** results) {
+  FILE * ifp;
+  char line[1024];
+  csvresult * res = NULL;
+  int num = 0, max = 0;
+
+  ifp = fopen(filename, "r");
+  if (ifp == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), ifp) != NULL) {
+    csvresult r;
+    double parse, io, rays, mrays;
+    int xres, yres, threads, aa, ao;
+    char scenename[256];
+
+    if (sscanf(line, "%63[^,],%255[^,],%d,%d,%d,%d,%d,%lf,%lf,%lf,%lf,%lf,%lf,%ld",
+               r.name, scenename, &xres, &yres, &threads, &aa, &ao, &parse,
+               &r.preproc, &r.trace, &io, &rays, &mrays, &r.peakrss) != 14)
+      continue;  /* header or malformed line */
+
+    if (num == max) {
+      csvresult * tmp;
+      max = (max == 0) ? 16 : max * 2;
+      tmp = (csvresult *) realloc(res, max * sizeof(csvresult));
+      if (tmp == NULL)
+        break;
+      res = tmp;
+    }
+    res[num++] = r;
+  }
+  fclose(ifp);
+
+  *results = res;
+  return num;
+}
+
+/* percentage change, ignoring changes to times too short to measure */
+static double change(double base, double cur, double mintime) {
+  if (base < mintime && cur < mintime)
+    return 0.0;
+  if (base <= 0.0)
+    return 100.0;
+  return 100.0 * (cur - base) / base;
+}
+
+static int compare(const char * basefile, const char * curfile,
+                   double threshold) {
+  csvresult * base = NULL, * cur = NULL;
+  int numbase, numcur, i, j, regressions = 0;
+
+  numbase = readcsv(basefile, &base);
+  numcur = readcsv(curfile, &cur);
+  if (numbase < 0 || numcur < 0) {
+    printf("Failed to read benchmark results %s\n",
+           (numbase < 0) ? basefile : curfile);
+    free(base);
+    free(cur);
+    return -1;
+  }
+
+  printf("  %-16s %10s %10s %8s %8s %8s\n", "case", "base", "current",
+         "trace", "preproc", "rss");
+  for (i=0; i<numcur; i++) {
+    double dtrace, dpre, drss;
+    int bad;
+
+    for (j=0; j<numbase; j++) {
+      if (!strcmp(base[j].name, cur[i].name))
+        break;
+    }
+    if (j == numbase) {
+      printf("  %-16s %10s %9.4fs   (new case)\n", cur[i].name, "",
+             cur[i].trace);
+      continue;
+    }
+
+    dtrace = change(base[j].trace, cur[i].trace, MINTIME);
+    dpre = change(base[j].preproc, cur[i].preproc, MINTIME);
+    drss = change((double) base[j].peakrss, (double) cur[i].peakrss, 1.0);
+    bad = (dtrace > threshold || dpre > threshold || drss > threshold);
+    regressions += bad;
+
+    printf("  %-16s %9.4fs %9.4fs %+7.1f%% %+7.1f%% %+7.1f%%%s\n",
+           cur[i].name, base[j].trace, cur[i].trace, dtrace, dpre, drss,
+           bad ? "  REGRESSION" : "");
+  }
+
+  printf("  %d of %d cases regressed by more than %.1f%%\n",
+         regressions, numcur, threshold);
+
+  free(base);
+  free(cur);
+  return (regressions > 0) ? 1 : 0;
+}
+
+static void usage(const char * name) {
+  printf("usage: %s [options]\n", name);
+  printf("       %s -compare base.csv current.csv [-threshold pct]\n", name);
+  printf("  -scenedir dir     directory holding the scene files, default .\n");
+  printf("  -o filename       write results to a file instead of stdout\n");
+  printf("  -json             write JSON instead of CSV\n");
+  printf("  -reps N           renderings per case, default %d\n", DEFAULT_REPS);
+  printf("  -scale F          scale the synthetic scene sizes, default 1\n");
+  printf("  -nostress         skip the synthetic stress scenes\n");
+  printf("  -case name        only run the named case, may be repeated\n");
+  printf("  -mbox mode        grid mailboxes: auto (default), array, hashed\n");
+  printf("  -threshold pct    regression threshold, default %.1f%%\n",
+         DEFAULT_THRESHOLD);
+}
+
+static int selected(const char * name, char ** only, int numonly) {
+  int i;
+
+  if (numonly == 0)
+    return 1;
+
+  for (i=0; i<numonly; i++) {
+    if (!strcmp(only[i], name))
+      return 1;
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const char * scenedir = ".";
+  const char * outname = NULL;
+  const char * basefile = NULL, * curfile = NULL;
+  char ** only;
+  double scale = 1.0, threshold = DEFAULT_THRESHOLD;
+  int json = 0, reps = DEFAULT_REPS, stress = 1, numonly = 0;
+  int i, first;
+  FILE * ofp = stdout;
+
+  only = (char **) malloc(argc * sizeof(char *));
+
+  for (i=1; i<argc; i++) {
+    if (!strcmp(argv[i], "-scenedir") && i+1 < argc) {
+      scenedir = argv[++i];
+    } else if (!strcmp(argv[i], "-o") && i+1 < argc) {
+      outname = argv[++i];
+    } else if (!strcmp(argv[i], "-json")) {
+      json = 1;
+    } else if (!strcmp(argv[i], "-reps") && i+1 < argc) {
+      reps = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-scale") && i+1 < argc) {
+      scale = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-nostress")) {
+      stress = 0;
+    } else if (!strcmp(argv[i], "-case") && i+1 < argc) {
+      only[numonly++] = argv[++i];
+    } else if (!strcmp(argv[i], "-mbox") && i+1 < argc &&
+               (!strcmp(argv[i+1], "auto") || !strcmp(argv[i+1], "array") ||
+                !strcmp(argv[i+1], "hashed"))) {
+      i++;
+      if (!strcmp(argv[i], "array"))
+        mboxmode = RT_MBOX_ARRAY;
+      else if (!strcmp(argv[i], "hashed"))
+        mboxmode = RT_MBOX_HASHED;
+      else
+        mboxmode = RT_MBOX_AUTO;
+    } else if (!strcmp(argv[i], "-threshold") && i+1 < argc) {
+      threshold = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-compare") && i+2 < argc) {
+      basefile = argv[++i];
+      curfile = argv[++i];
+    } else {
+      usage(argv[0]);
+      free(only);
+      return -1;
+    }
+  }
+
+  if (basefile != NULL) {
+    free(only);
+    return compare(basefile, curfile, threshold);
+  }
+
+  if (reps < 1)
+    reps = 1;
+
+  if (outname != NULL) {
+    ofp = fopen(outname, "w");
+    if (ofp == NULL) {
+      printf("Failed to open %s for writing\n", outname);
+      free(only);
+      return -1;
+    }
+  }
+
+  rt_initialize(&argc, &argv);
+
+  printheader(ofp, json);
+  first = 1;
+  for (i=0; i<NUMCASES; i++) {
+    const benchcase * bc = &suite[i];
+    benchresult res;
+
+    if (!selected(bc->name, only, numonly))
+      continue;
+    if (!stress && bc->source != BENCH_FILE)
+      continue;
+
+    if (ofp != stdout) {
+      printf("  %-16s ", bc->name);
+      fflush(stdout);
+    }
+
+    runisolated(bc, scenedir, scale, reps, &res);
+    printresult(ofp, json, first, bc, &res);
+    first = 0;
+
+    if (ofp != stdout) {
+      if (res.ok)
+        printf("%9.4fs %9.2f Mrays/s %8ld KB\n", res.trace,
+               (res.trace > 0.0) ? res.rays / (res.trace * 1.0e6) : 0.0,
+               res.peakrss);
+      else
+        printf("failed\n");
+    }
+  }
+  printfooter(ofp, json);
+
+  if (ofp != stdout)
+    fclose(ofp);
+
+  rt_finalize();
+  free(only);
+
+  return 0;
+}
@@ -0,0 +1,162 @@
+/* volbench.c
+ * This file contains a benchmark program for the volume renderer, which
+ * compares the linear and bricked voxel storage layouts when rendering
+ * a synthetic scalar volume from a range of viewing directions.
+ *
+ *  $Id$
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tachyon.h"
+
+int rt_mynode(void); /* proto */
+
+#define VOLFILE "volbench.raw"
+
+typedef struct {
+  const char * name;
+  apivector dir;        /* direction the camera looks along */
+  apivector up;         /* camera up vector */
+} viewdef;
+
+static viewdef views[] = {
+  { "+X",      {  1.0,  0.0,  0.0 }, { 0.0, 1.0, 0.0 } },
+  { "-X",      { -1.0,  0.0,  0.0 }, { 0.0, 1.0, 0.0 } },
+  { "+Y",      {  0.0,  1.0,  0.0 }, { 0.0, 0.0, 1.0 } },
+  { "-Y",      {  0.0, -1.0,  0.0 }, { 0.0, 0.0, 1.0 } },
+  { "+Z",      {  0.0,  0.0,  1.0 }, { 0.0, 1.0, 0.0 } },
+  { "-Z",      {  0.0,  0.0, -1.0 }, { 0.0, 1.0, 0.0 } },
+  { "oblique", {  0.577, 0.577, 0.577 }, { 0.0, 1.0, 0.0 } }
+};
+#define NUMVIEWS ((int) (sizeof(views) / sizeof(viewdef)))
+
+
+/* write out a volume of noisy concentric shells, with empty corners */
+static int makevolume(const char *filename, int n) {
+  FILE * ofp;
+  unsigned char * slice;
+  int x, y, z;
+
+  ofp = fopen(filename, "wb");
+  if (ofp == NULL)
+    return -1;
+
+  slice = (unsigned char *) malloc(n * n);
+  for (z=0; z<n; z++) {
+    for (y=0; y<n; y++) {
+      for (x=0; x<n; x++) {
+        float dx = (x - n*0.5f) / n;
+        float dy = (y - n*0.5f) / n;
+        float dz = (z - n*0.5f) / n;
+        float r = sqrtf(dx*dx + dy*dy + dz*dz);
+        float v = (r < 0.48f) ? 0.5f + 0.5f * sinf(r * 60.0f) : 0.0f;
+        slice[y*n + x] = (unsigned char) (v * 255.0f * (1.0f - r));
+      }
+    }
+    if (fwrite(slice, n*n, 1, ofp) != 1) {
+      free(slice);
+      fclose(ofp);
+      return -1;
+    }
+  }
+
+  free(slice);
+  fclose(ofp);
+  return 0;
+}
+
+
+static double renderview(int layout, const viewdef *view, int n, int res,
+                         unsigned char *img) {
+  SceneHandle scene;
+  apitexture tex;
+  apivector ctr, min, max;
+  rt_timerhandle timer;
+  double t;
+
+  scene = rt_newscene();
+  rt_outputfile(scene, "");         /* don't write output images */
+  rt_rawimage_rgb24(scene, img);
+  rt_resolution(scene, res, res);
+  rt_verbose(scene, 0);
+  rt_volume_layout(scene, layout);
+
+  ctr.x = -3.0 * view->dir.x;
+  ctr.y = -3.0 * view->dir.y;
+  ctr.z = -3.0 * view->dir.z;
+  rt_camera_setup(scene, 1.0, 1.0, 0, 6, ctr, view->dir, view->up);
+
+  memset(&tex, 0, sizeof(tex));
+  tex.col.r = 1.0; tex.col.g = 1.0; tex.col.b = 1.0;
+  tex.ambient = 1.0;
+  tex.opacity = 8.0;
+  tex.texturefunc = RT_TEXTURE_CONSTANT;
+
+  min.x = -1.0; min.y = -1.0; min.z = -1.0;
+  max.x =  1.0; max.y =  1.0; max.z =  1.0;
+  rt_scalarvol(scene, rt_texture(scene, &tex), min, max, n, n, n,
+               VOLFILE, NULL);
+
+  timer = rt_timer_create();
+  rt_timer_start(timer);
+  rt_renderscene(scene);
+  rt_timer_stop(timer);
+  t = rt_timer_time(timer);
+  rt_timer_destroy(timer);
+
+  rt_deletescene(scene);
+
+  return t;
+}
+
+
+int main(int argc, char **argv) {
+  int n = 256;
+  int res = 512;
+  int i, layout;
+  double t[2][NUMVIEWS];
+  unsigned char * img;
+
+  if (argc > 1)
+    n = atoi(argv[1]);
+  if (argc > 2)
+    res = atoi(argv[2]);
+  if (n < 2 || res < 1) {
+    printf("usage: %s [volume size] [image size]\n", argv[0]);
+    return -1;
+  }
+
+  rt_initialize(&argc, &argv);
+
+  if (makevolume(VOLFILE, n)) {
+    printf("Failed to write benchmark volume %s\n", VOLFILE);
+    return -1;
+  }
+
+  img = (unsigned char *) malloc(res * res * 3);
+
+  for (layout=0; layout<2; layout++) {
+    for (i=0; i<NUMVIEWS; i++) {
+      t[layout][i] = renderview(layout, &views[i], n, res, img);
+    }
+  }
+
+  if (rt_mynode() == 0) {
+    printf("Volume %dx%dx%d, image %dx%d\n", n, n, n, res, res);
+    printf("  view       linear    bricked   speedup\n");
+    for (i=0; i<NUMVIEWS; i++) {
+      printf("  %-8s %8.4fs %8.4fs   %6.2fx\n", views[i].name,
+             t[0][i], t[1][i], t[0][i] / t[1][i]);
+    }
+  }
+
+  free(img);
+  remove(VOLFILE);
+  rt_finalize();
+
+  return 0;
+}
@@ -0,0 +1,140 @@
+/* walkbench.c
+ * This file contains a benchmark program for camera walkthroughs, which
+ * renders the same camera path through a scene file once frame by frame
+ * with rt_renderscene(), and once as a batch with rt_renderscene_keyframes(),
+ * and compares the speed and the resulting images.
+ *
+ *  $Id$
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tachyon.h"
+#include "parse.h"
+
+int rt_mynode(void); /* proto */
+
+#define DEFAULT_FRAMES 32
+
+/*
+ * turn the scene camera around its up direction in small steps,
+ * moving it back and forth along the view direction as it goes
+ */
+static void makepath(SceneHandle scene, int numframes,
+                     rt_camera_keyframe * keys) {
+  float ctr[3], view[3], up[3], right[3];
+  int i, j;
+
+  rt_get_camera_position3fv(scene, ctr, view, up, right);
+
+  for (i=0; i<numframes; i++) {
+    float a = 0.4f * i / numframes;
+    float d = 0.2f * sinf(6.2831853f * i / numframes);
+    float c = cosf(a), s = sinf(a);
+
+    for (j=0; j<3; j++) {
+      keys[i].viewdir[j] = c * view[j] + s * right[j];
+      keys[i].center[j] = ctr[j] + d * keys[i].viewdir[j];
+      keys[i].updir[j] = up[j];
+    }
+    keys[i].zoom = 0.0f;
+  }
+}
+
+int main(int argc, char **argv) {
+  SceneHandle scene;
+  rt_camera_keyframe * keys;
+  unsigned char ** images, ** batch;
+  unsigned char * framebuf;
+  rt_timerhandle timer;
+  double t1, t2;
+  size_t sz;
+  int i, xres, yres, numframes, mismatches;
+
+  if (argc < 2) {
+    printf("usage: %s scenefile [frames]\n", argv[0]);
+    return -1;
+  }
+  numframes = (argc > 2) ? atoi(argv[2]) : DEFAULT_FRAMES;
+  if (numframes < 1)
+    numframes = DEFAULT_FRAMES;
+
+  rt_initialize(&argc, &argv);
+
+  scene = rt_newscene();
+  if (readmodel(argv[1], scene) != PARSENOERR) {
+    printf("Failed to parse scene file %s\n", argv[1]);
+    rt_deletescene(scene);
+    rt_finalize();
+    return -1;
+  }
+  rt_outputfile(scene, "");  /* keep the images in memory only */
+  rt_get_resolution(scene, &xres, &yres);
+  sz = (size_t) xres * yres * 3;
+
+  keys = (rt_camera_keyframe *) malloc(numframes * sizeof(rt_camera_keyframe));
+  images = (unsigned char **) malloc(numframes * sizeof(unsigned char *));
+  framebuf = (unsigned char *) malloc(sz);
+  for (i=0; i<numframes; i++)
+    images[i] = (unsigned char *) malloc(sz);
+  makepath(scene, numframes, keys);
+
+  rt_rawimage_rgb24(scene, framebuf);
+  timer = rt_timer_create();
+
+  /* render one frame to get the scene set up, which is not timed */
+  rt_renderscene(scene);
+
+  /* frame by frame, copying each frame out of the scene's buffer */
+  rt_timer_start(timer);
+  for (i=0; i<numframes; i++) {
+    rt_camera_position3fv(scene, keys[i].center, keys[i].viewdir,
+                          keys[i].updir);
+    rt_renderscene(scene);
+    memcpy(images[i], framebuf, sz);
+  }
+  rt_timer_stop(timer);
+  t1 = rt_timer_time(timer);
+
+  /* the same frames as one batch, compared against the ones above */
+  batch = (unsigned char **) malloc(numframes * sizeof(unsigned char *));
+  for (i=0; i<numframes; i++)
+    batch[i] = (unsigned char *) malloc(sz);
+
+  rt_timer_start(timer);
+  rt_renderscene_keyframes(scene, numframes, keys, (void **) batch);
+  rt_timer_stop(timer);
+  t2 = rt_timer_time(timer);
+
+  mismatches = 0;
+  for (i=0; i<numframes; i++) {
+    if (memcmp(batch[i], images[i], sz))
+      mismatches++;
+    free(batch[i]);
+  }
+  free(batch);
+
+  if (rt_mynode() == 0) {
+    printf("  %d frames of %dx%d\n", numframes, xres, yres);
+    printf("  rt_renderscene():           %9.4fs %9.2f FPS\n",
+           t1, numframes / t1);
+    printf("  rt_renderscene_keyframes(): %9.4fs %9.2f FPS\n",
+           t2, numframes / t2);
+    printf("  %d frames differ\n", mismatches);
+  }
+
+  rt_timer_destroy(timer);
+  rt_deletescene(scene);
+  for (i=0; i<numframes; i++)
+    free(images[i]);
+  free(images);
+  free(framebuf);
+  free(keys);
+
+  rt_finalize();
+
+  return (mismatches == 0) ? 0 : -1;
+}
@@ -40,6 +40,7 @@
 #include "global.h"
 #include "ui.h"
 #include "shade.h"
+#include "checkpoint.h"
 
 apivector rt_vector(flt x, flt y, flt z) {
   apivector v;
@@ -82,6 +83,59 @@ void rt_renderscene(SceneHandle voidscene) {
   renderscene(scene);
 }
 
+void rt_render_stats_mode(SceneHandle voidscene, int onoff) {
+  scenedef * scene = (scenedef *) voidscene;
+  scene->statsmode = (onoff != 0);
+}
+
+void rt_get_render_stats(SceneHandle voidscene, rt_render_stats * stats) {
+  scenedef * scene = (scenedef *) voidscene;
+  *stats = scene->stats;
+}
+
+const char * rt_render_stats_typename(int type) {
+  static const char * names[RT_STATS_NUMTYPES] = {
+    "other", "sphere", "triangle", "stri", "cylinder", "fcylinder", "ring",
+    "plane", "quadric", "box", "volume", "light", "grid"
+  };
+
+  if (type < 0 || type >= RT_STATS_NUMTYPES)
+    return "unknown";
+
+  return names[type];
+}
+
+void rt_get_render_times(SceneHandle voidscene, double * preproc, 
+                         double * trace, double * io) {
+  scenedef * scene = (scenedef *) voidscene;
+  *preproc = scene->preproctime;
+  *trace = scene->tracetime;
+  *io = scene->iotime;
+}
+
+void rt_render_costmap(SceneHandle voidscene, const char * filename) {
+  scenedef * scene = (scenedef *) voidscene;
+  if (filename != NULL && strlen(filename) < sizeof(scene->costmapfile)) 
+    strcpy(scene->costmapfile, filename);
+  else 
+    scene->costmapfile[0] = '\0';
+  scene->scenecheck = 1;
+}
+
+void rt_mailbox_mode(SceneHandle voidscene, int mode) {
+  scenedef * scene = (scenedef *) voidscene;
+  if (mode == RT_MBOX_AUTO || mode == RT_MBOX_ARRAY || mode == RT_MBOX_HASHED) {
+    scene->mboxmode = mode;
+    scene->scenecheck = 1; /* worker threads reallocate their mailboxes */
+  }
+}
+
+void rt_renderscene_keyframes(SceneHandle voidscene, int numframes, 
+                              const rt_camera_keyframe * keys, void ** images) {
+  scenedef * scene = (scenedef *) voidscene;
+  renderscene_keyframes(scene, numframes, keys, images);
+}
+
 void rt_normal_fixup_mode(SceneHandle voidscene, int mode) {
   scenedef * scene = (scenedef *) voidscene;
   switch (mode) {
@@ -270,6 +324,7 @@ void rt_crop_disable(SceneHandle voidscene) {
   scene->imgcrop.yres = 0;
   scene->imgcrop.xstart = 0;
   scene->imgcrop.ystart = 0;
+  scene->scenecheck = 1;    /* the image buffer covers the full image again */
 }
 
 void rt_crop_output(SceneHandle voidscene, int hres, int vres, int sx, int sy) {
@@ -279,6 +334,37 @@ void rt_crop_output(SceneHandle voidscene, int hres, int vres, int sx, int sy) {
   scene->imgcrop.yres = vres;
   scene->imgcrop.xstart = sx;
   scene->imgcrop.ystart = sy;
+  scene->scenecheck = 1;    /* only the crop window is rendered and stored */
+}
+
+void rt_tiled_output(SceneHandle voidscene, int rows) {
+  scenedef * scene = (scenedef *) voidscene;
+  scene->tilerows = (rows > 0) ? rows : 0;
+  scene->scenecheck = 1;    /* the image buffer only holds one band */
+}
+
+void rt_checkpoint(SceneHandle voidscene, const char * filename, float interval) {
+  scenedef * scene = (scenedef *) voidscene;
+  strncpy(scene->ckptfile, (filename != NULL) ? filename : "", 
+          sizeof(scene->ckptfile) - 1);
+  scene->ckptfile[sizeof(scene->ckptfile) - 1] = '\0';
+  scene->ckptinterval = (interval > 0.0f) ? interval : 0.0f;
+  if (scene->ckpttimer == NULL)
+    scene->ckpttimer = rt_timer_create();
+  rt_timer_start(scene->ckpttimer);
+}
+
+int rt_checkpoint_frames(SceneHandle voidscene) {
+  return checkpoint_frames((scenedef *) voidscene);
+}
+
+void rt_checkpoint_set_frame(SceneHandle voidscene, int frame) {
+  scenedef * scene = (scenedef *) voidscene;
+  scene->ckptframe = (frame > 0) ? frame : 0;
+}
+
+void rt_checkpoint_finish(SceneHandle voidscene) {
+  checkpoint_remove((scenedef *) voidscene);
 }
 
 void rt_verbose(SceneHandle voidscene, int v) {
@@ -342,6 +428,19 @@ void rt_set_numthreads(SceneHandle voidscene, int numthreads) {
   scene->scenecheck = 1;
 }
 
+int rt_get_numthreads(SceneHandle voidscene) {
+  scenedef * scene = (scenedef *) voidscene;
+  return scene->numthreads;
+}
+
+void rt_numa_mode(SceneHandle voidscene, int mode) {
+  scenedef * scene = (scenedef *) voidscene;
+  if (mode == RT_NUMA_OFF || mode == RT_NUMA_PIN || mode == RT_NUMA_REPLICATE) {
+    scene->numamode = mode;
+    scene->scenecheck = 1; /* worker threads are recreated and pinned */
+  }
+}
+
 void rt_background(SceneHandle voidscene, apicolor col) {
   scenedef * scene = (scenedef *) voidscene;
   scene->bgtex.background.r = col.r;
@@ -465,14 +564,19 @@ void rt_boundthresh(SceneHandle voidscene, int threshold) {
   }
   else {
     if (rt_mynode() == 0) {
-      rt_ui_message(MSG_0, "Out-of-range automatic bounding threshold.\n");
-      rt_ui_message(MSG_0, "Automatic bounding threshold reset to default.\n");
+      rt_scene_ui_message(scene, MSG_0, "Out-of-range automatic bounding threshold.\n");
+      rt_scene_ui_message(scene, MSG_0, "Automatic bounding threshold reset to default.\n");
     }
     scene->boundthresh = BOUNDTHRESH;
   }
   scene->scenecheck = 1;
 }
 
+void rt_volume_layout(SceneHandle voidscene, int layout) {
+  scenedef * scene = (scenedef *) voidscene;
+  scene->volumelayout = layout;
+}
+
 void rt_shadermode(SceneHandle voidscene, int mode) {
   scenedef * scene = (scenedef *) voidscene;
 
@@ -553,6 +657,7 @@ SceneHandle rt_newscene(void) {
 
   rt_boundmode(voidscene, RT_BOUNDING_ENABLED);   /* spatial subdivision on */
   rt_boundthresh(voidscene, BOUNDTHRESH);         /* default threshold      */
+  rt_volume_layout(voidscene, RT_VOLUME_LAYOUT_LINEAR); /* flat voxel arrays */
   rt_camera_setup(voidscene, 1.0, 1.0, 0, 6,
                   rt_vector(0.0, 0.0, 0.0),
                   rt_vector(0.0, 0.0, 1.0),
@@ -582,8 +687,12 @@ SceneHandle rt_newscene(void) {
   scene->objgroup.boundedobj = NULL;
   scene->objgroup.unboundedobj = NULL;
   scene->objgroup.numobjects = 0;
+  scene->stage = new_scenestage();
 
   scene->texlist = NULL;
+  scene->textable = new_textable();
+  scene->imgcache = NewImageCache();
+  RetainTextures();  /* images defined without a scene outlive it */
   scene->lightlist = NULL;
   scene->cliplist = NULL;
   scene->numlights = 0;
@@ -613,6 +722,12 @@ void rt_deletescene(SceneHandle voidscene) {
       free(scene->img);
     }
 
+    if (scene->costmap != NULL)
+      free(scene->costmap);
+
+    if (scene->ckpttimer != NULL)
+      rt_timer_destroy(scene->ckpttimer);
+
     /* tear down and deallocate persistent rendering threads */
     destroy_render_threads(scene);
 
@@ -620,6 +735,9 @@ void rt_deletescene(SceneHandle voidscene) {
     if (scene->parbuf != NULL)
       rt_delete_scanlinereceives(scene->parbuf);
 
+    /* collect objects and textures that were never rendered */
+    merge_staged_objects(scene);
+
     /* free all lights */
     cur = scene->lightlist;
     while (cur != NULL) {
@@ -651,18 +769,23 @@ void rt_deletescene(SceneHandle voidscene) {
       cur = next;
     }    
 
-    /* free all other textures, MIP Maps, and images */
-    FreeTextures();
+    /* free the scene's image maps, and images defined without a */
+    /* scene if no other scene can use them anymore              */
+    FreeImageCache(scene->imgcache);
+    ReleaseTextures();
     
     free(scene->cpuinfo);
-    free_objects(scene->objgroup.boundedobj);
-    free_objects(scene->objgroup.unboundedobj);
+
+    /* free all objects, grids, and texture copies, along with the */
+    /* memory blocks they were allocated from                      */
+    free_scenestage(scene->stage);
+    free_textable(scene->textable);
 
     free(scene);
   }
 }
 
-void apitextotex(apitexture * apitex, texture * tx) {
+static void apitextotex(scenedef * scene, apitexture * apitex, texture * tx) {
   standard_texture * tex = (standard_texture *) tx;
   tex->img = NULL;
  
@@ -693,22 +816,26 @@ void apitextotex(apitexture * apitex, texture * tx) {
 
     case RT_TEXTURE_CYLINDRICAL_IMAGE: 
       tex->texfunc=(color(*)(const void *, const void *, void *))(image_cyl_texture);
-      tex->img=LoadMIPMap(apitex->imap, 0);
+      tex->img=LoadMIPMap(scene->imgcache, apitex->imap, 0, 
+                          scene->numthreads);
       break;
 
     case RT_TEXTURE_SPHERICAL_IMAGE: 
       tex->texfunc=(color(*)(const void *, const void *, void *))(image_sphere_texture);
-      tex->img=LoadMIPMap(apitex->imap, 0);
+      tex->img=LoadMIPMap(scene->imgcache, apitex->imap, 0, 
+                          scene->numthreads);
       break;
 
     case RT_TEXTURE_PLANAR_IMAGE: 
       tex->texfunc=(color(*)(const void *, const void *, void *))(image_plane_texture);
-      tex->img=LoadMIPMap(apitex->imap, 0);
+      tex->img=LoadMIPMap(scene->imgcache, apitex->imap, 0, 
+                          scene->numthreads);
       break;
 
     case RT_TEXTURE_VOLUME_IMAGE: 
       tex->texfunc=(color(*)(const void *, const void *, void *))(image_volume_texture);
-      tex->img=LoadMIPMap(apitex->imap, 0);
+      tex->img=LoadMIPMap(scene->imgcache, apitex->imap, 0, 
+                          scene->numthreads);
       break;
 
     case RT_TEXTURE_CONSTANT: 
@@ -750,28 +877,37 @@ void apitextotex(apitexture * apitex, texture * tx) {
 void * rt_texture(SceneHandle sc, apitexture * apitex) {
   scenedef * scene = (scenedef *) sc;
   texture * tex;
-  list * lst;
 
   tex = new_standard_texture();
-  apitextotex(apitex, tex); 
+  apitextotex(scene, apitex, tex); 
+
+  /* volumetric image maps use the scene's voxel storage layout */
+  if (apitex->texturefunc == RT_TEXTURE_VOLUME_IMAGE) {
+    mipmap * mip = (mipmap *) ((standard_texture *) tex)->img;
+    if (mip != NULL && mip->images[0]->zres > 1)
+      VolImageLayout(mip->images[0], scene->volumelayout);
+  }
 
   /* add texture to the scene texture list */
-  lst = (list *) malloc(sizeof(list));
-  lst->item = (void *) tex;
-  lst->next = scene->texlist;
-  scene->texlist = lst;
+  stage_texture(scene, tex);
 
   return(tex);
 }
 
 
 void rt_define_teximage_rgb24(const char *name, int xs, int ys, int zs, unsigned char *rgb) {
-  AllocateImageRGB24(name, xs, ys, zs, rgb); 
+  AllocateImageRGB24(NULL, name, xs, ys, zs, rgb); 
+}
+
+void rt_scene_define_teximage_rgb24(SceneHandle voidscene, const char *name, 
+                                    int xs, int ys, int zs, unsigned char *rgb) {
+  scenedef * scene = (scenedef *) voidscene;
+  AllocateImageRGB24(scene->imgcache, name, xs, ys, zs, rgb); 
 }
 
 /* deprecated version used in old revs of VMD */
 void rt_define_image(const char *name, int xs, int ys, int zs, unsigned char *rgb) {
-  AllocateImageRGB24(name, xs, ys, zs, rgb); 
+  AllocateImageRGB24(NULL, name, xs, ys, zs, rgb); 
 }
 
 
@@ -780,34 +916,64 @@ void rt_define_image(const char *name, int xs, int ys, int zs, unsigned char *rg
 /* need multiple instantiations of texture objects for */
 /* correct operation.  Ideally we'd store the object   */
 /* pointer in the intersection record so the texture   */
-/* needn't store this itself                           */
+/* needn't store this itself.  Copies are kept in the  */
+/* scene's memory arena, and are freed with the scene. */
 void * rt_texture_copy_standard(SceneHandle sc, void *oldtex) {
   texture *newtex;
-  newtex = new_standard_texture();
+  newtex = (texture *) scene_alloc((scenedef *) sc, sizeof(standard_texture));
   memcpy(newtex, oldtex, sizeof(standard_texture)); 
   return newtex;
 }
 void * rt_texture_copy_vcstri(SceneHandle sc, void *oldvoidtex) {
-  texture *oldtex = (texture *) oldvoidtex;
-  texture *newtex = new_vcstri_texture();
-
-  /* copy in all of the texture components common to both tex types */
-  newtex->flags = oldtex->flags;
-  newtex->ambient = oldtex->ambient;
-  newtex->diffuse = oldtex->diffuse;
-  newtex->phong = oldtex->phong;
-  newtex->phongexp = oldtex->phongexp;
-  newtex->phongtype = oldtex->phongtype;
-  newtex->specular = oldtex->specular;
-  newtex->opacity = oldtex->opacity;
-  newtex->transmode =  oldtex->transmode;
-  newtex->outline =  oldtex->outline;
-  newtex->outlinewidth =  oldtex->outlinewidth;
+  scenedef * scene = (scenedef *) sc;
+  texture * newtex;
+  int created;
+
+  /* vcstri textures hold no per-triangle data, so they are shared */
+  newtex = textable_intern_vcstri(scene->textable, (texture *) oldvoidtex, 
+                                  &created);
+  if (created)
+    stage_texture(scene, newtex);
    
   return newtex;
 }
 
 
+void * rt_texture_intern(SceneHandle sc, void *voidtex) {
+  scenedef * scene = (scenedef *) sc;
+  texture * shared;
+
+  shared = textable_intern(scene->textable, (texture *) voidtex);
+  if (shared != voidtex && unstage_texture(scene, voidtex))
+    ((texture *) voidtex)->methods->freetex(voidtex);
+
+  return shared;
+}
+
+
+/*
+ * Objects that modify their texture, such as lights and volumes, 
+ * get a private copy of a texture if it is shared.  Shared textures 
+ * only refer to MIP maps owned by the image cache, so the image
+ * pointer can be copied along with everything else.
+ */
+static void * private_texture(scenedef * scene, void * tex) {
+  texture * newtex;
+
+  if (!textable_isshared(scene->textable, (texture *) tex))
+    return tex;
+
+  if (texture_isvcstri((texture *) tex))
+    newtex = new_vcstri_texture();
+  else 
+    newtex = new_standard_texture();
+  memcpy(newtex, tex, texture_memsize((texture *) tex)); 
+  stage_texture(scene, newtex);
+
+  return newtex;
+}
+
+
 void rt_tex_phong(void * voidtex, flt phong, flt phongexp, int type) {
   texture * tex = (texture *) voidtex;
   tex->phong = phong;
@@ -830,52 +996,35 @@ void rt_tex_outline(void * voidtex, flt outline, flt outlinewidth) {
 
 
 static void add_bounded_object(scenedef * scene, object * obj) {
-  object * objtemp;
-
   if (obj == NULL)
     return;
 
-  obj->id = new_objectid(scene);
-  objtemp = scene->objgroup.boundedobj;
-  scene->objgroup.boundedobj = obj;
-  obj->nextobj = objtemp;
-  obj->clip = scene->curclipgroup;
-
   /* XXX Clipping ought to be applied to objects before they */
   /*     are even added to the internal data structures, so  */
   /*     they aren't even considered during rendering.       */
-  
-  scene->scenecheck = 1;
+  obj->clip = scene->curclipgroup;
+
+  /* objects are staged, and merged into the scene at render time */
+  stage_object(scene, obj, 0);
 }
 
 static void add_unbounded_object(scenedef * scene, object * obj) {
-  object * objtemp;
-
   if (obj == NULL)
     return;
 
-  obj->id = new_objectid(scene);
-  objtemp = scene->objgroup.unboundedobj;
-  scene->objgroup.unboundedobj = obj;
-  obj->nextobj = objtemp;
   obj->clip = scene->curclipgroup;
-  scene->scenecheck = 1;
+  stage_object(scene, obj, 1);
 }
 
 
 void * rt_light(SceneHandle voidscene, void * tex, apivector ctr, flt rad) {
   point_light * li;
   scenedef * scene = (scenedef *) voidscene;
-  list * lst;
 
-  li=newpointlight(tex, ctr, rad);
+  li=newpointlight(private_texture(scene, tex), ctr, rad);
 
   /* add light to the scene lightlist */
-  lst = (list *) malloc(sizeof(list));
-  lst->item = (void *) li;
-  lst->next = scene->lightlist;
-  scene->lightlist = lst;
-  scene->numlights++;
+  stage_light(scene, li);
 
   /* add light as an object as well... */
   add_bounded_object((scenedef *) scene, (object *)li);
@@ -894,17 +1043,12 @@ void * rt_light3fv(SceneHandle voidscene, void * tex,
 void * rt_directional_light(SceneHandle voidscene, void * tex, apivector dir) {
   directional_light * li;
   scenedef * scene = (scenedef *) voidscene;
-  list * lst;
 
   VNorm(&dir);
-  li=newdirectionallight(tex, dir);
+  li=newdirectionallight(private_texture(scene, tex), dir);
 
   /* add light to the scene lightlist */
-  lst = (list *) malloc(sizeof(list));
-  lst->item = (void *) li;
-  lst->next = scene->lightlist;
-  scene->lightlist = lst;
-  scene->numlights++;
+  stage_light(scene, li);
 
   /* don't add to the object list since it's at infinity */
   /* XXX must loop over light list and deallocate these  */
@@ -926,19 +1070,15 @@ void * rt_spotlight(SceneHandle voidscene, void * tex, apivector ctr, flt rad,
   flt fallstart, fallend;
   point_light * li;
   scenedef * scene = (scenedef *) voidscene;
-  list * lst;
 
   fallstart = start * 3.1415926 / 180.0;
   fallend   = end   * 3.1415926 / 180.0;
   VNorm(&dir);
-  li = newspotlight(tex, ctr, rad, dir, fallstart, fallend);
+  li = newspotlight(private_texture(scene, tex), ctr, rad, dir, 
+                    fallstart, fallend);
 
   /* add light to the scene lightlist */
-  lst = (list *) malloc(sizeof(list));
-  lst->item = (void *) li;
-  lst->next = scene->lightlist;
-  scene->lightlist = lst;
-  scene->numlights++;
+  stage_light(scene, li);
  
   /* add light as an object as well... */
   add_bounded_object(scene, (object *) li);
@@ -963,7 +1103,8 @@ void rt_light_attenuation(void * vli, flt Kc, flt Kl, flt Kq) {
 void rt_scalarvol(SceneHandle scene, void * tex, apivector min, apivector max,
 	int xs, int ys, int zs, const char * fname, void * voidvol) {
   scalarvol * invol = (scalarvol *) voidvol; 
-  add_bounded_object((scenedef *) scene, (object *) newscalarvol(tex, min, max, xs, ys, zs, fname, invol));
+  tex = private_texture((scenedef *) scene, tex); /* volumes modify it */
+  add_bounded_object((scenedef *) scene, (object *) newscalarvol(tex, min, max, xs, ys, zs, fname, invol, ((scenedef *) scene)->volumelayout));
 }
 
 void rt_extvol(SceneHandle scene, void * tex, apivector min, apivector max, int samples, flt (* evaluator)(flt, flt, flt)) {
@@ -975,7 +1116,8 @@ void rt_box(SceneHandle scene, void * tex, apivector min, apivector max) {
 } 
 
 void rt_cylinder(SceneHandle scene, void * tex, apivector ctr, apivector axis, flt rad) {
-  add_unbounded_object((scenedef *) scene, newcylinder(tex, ctr, axis, rad));
+  add_unbounded_object((scenedef *) scene, 
+                       newcylinder((scenedef *) scene, tex, ctr, axis, rad));
 }
 
 void rt_cylinder3fv(SceneHandle scene, void * tex,
@@ -983,12 +1125,14 @@ void rt_cylinder3fv(SceneHandle scene, void * tex,
   vector vctr, vaxis;
   vctr.x = ctr[0];   vctr.y = ctr[1];   vctr.z = ctr[2];
   vaxis.x = axis[0]; vaxis.y = axis[1]; vaxis.z = axis[2];
-  add_bounded_object((scenedef *) scene, newcylinder(tex, vctr, vaxis, rad));
+  add_bounded_object((scenedef *) scene, 
+                     newcylinder((scenedef *) scene, tex, vctr, vaxis, rad));
 }
 
 
 void rt_fcylinder(SceneHandle scene, void * tex, apivector ctr, apivector axis, flt rad) {
-  add_bounded_object((scenedef *) scene, newfcylinder(tex, ctr, axis, rad));
+  add_bounded_object((scenedef *) scene, 
+                     newfcylinder((scenedef *) scene, tex, ctr, axis, rad));
 }
 
 void rt_fcylinder3fv(SceneHandle scene, void * tex, 
@@ -996,12 +1140,14 @@ void rt_fcylinder3fv(SceneHandle scene, void * tex,
   vector vctr, vaxis;
   vctr.x = ctr[0];   vctr.y = ctr[1];   vctr.z = ctr[2];
   vaxis.x = axis[0]; vaxis.y = axis[1]; vaxis.z = axis[2];
-  add_bounded_object((scenedef *) scene, newfcylinder(tex, vctr, vaxis, rad));
+  add_bounded_object((scenedef *) scene, 
+                     newfcylinder((scenedef *) scene, tex, vctr, vaxis, rad));
 }
 
 
 void rt_plane(SceneHandle scene, void * tex, apivector ctr, apivector norm) {
-  add_unbounded_object((scenedef *) scene, newplane(tex, ctr, norm));
+  add_unbounded_object((scenedef *) scene, 
+                       newplane((scenedef *) scene, tex, ctr, norm));
 } 
 
 void rt_plane3fv(SceneHandle scene, void * tex,
@@ -1009,12 +1155,14 @@ void rt_plane3fv(SceneHandle scene, void * tex,
   vector vctr, vnorm;
   vctr.x = ctr[0];   vctr.y = ctr[1];   vctr.z = ctr[2];
   vnorm.x = norm[0]; vnorm.y = norm[1]; vnorm.z = norm[2];
-  add_unbounded_object((scenedef *) scene, newplane(tex, vctr, vnorm));
+  add_unbounded_object((scenedef *) scene, 
+                       newplane((scenedef *) scene, tex, vctr, vnorm));
 } 
 
 
 void rt_ring(SceneHandle scene, void * tex, apivector ctr, apivector norm, flt inner, flt outer) {
-  add_bounded_object((scenedef *) scene, newring(tex, ctr, norm, inner, outer));
+  add_bounded_object((scenedef *) scene, 
+                     newring((scenedef *) scene, tex, ctr, norm, inner, outer));
 } 
 
 void rt_ring3fv(SceneHandle scene, void * tex,
@@ -1022,25 +1170,28 @@ void rt_ring3fv(SceneHandle scene, void * tex,
   vector vctr, vnorm;
   vctr.x = ctr[0];   vctr.y = ctr[1];   vctr.z = ctr[2];
   vnorm.x = norm[0]; vnorm.y = norm[1]; vnorm.z = norm[2];
-  add_bounded_object((scenedef *) scene, newring(tex, vctr, vnorm, inner, outer));
+  add_bounded_object((scenedef *) scene, 
+                     newring((scenedef *) scene, tex, vctr, vnorm, inner, outer));
 } 
 
 
 void rt_sphere(SceneHandle scene, void * tex, apivector ctr, flt rad) {
-  add_bounded_object((scenedef *) scene, newsphere(tex, ctr, rad));
+  add_bounded_object((scenedef *) scene, 
+                     newsphere((scenedef *) scene, tex, ctr, rad));
 }
 
 void rt_sphere3fv(SceneHandle scene, void * tex, 
                   const float *ctr, float rad) {
   vector vctr;
   vctr.x = ctr[0]; vctr.y = ctr[1]; vctr.z = ctr[2];
-  add_bounded_object((scenedef *) scene, newsphere(tex, vctr, rad));
+  add_bounded_object((scenedef *) scene, 
+                     newsphere((scenedef *) scene, tex, vctr, rad));
 }
 
 
 void rt_tri(SceneHandle voidscene, void * tex, apivector v0, apivector v1, apivector v2) {
   scenedef * scene = (scenedef *) voidscene;
-  object * o = newtri(tex, v0, v1, v2);
+  object * o = newtri(scene, tex, v0, v1, v2);
   /* don't add degenerate triangles */
   if (o != NULL) {
     add_bounded_object(scene, o);
@@ -1058,7 +1209,7 @@ void rt_tri3fv(SceneHandle voidscene, void * tex,
   vv1.x = v1[0]; vv1.y = v1[1]; vv1.z = v1[2]; 
   vv2.x = v2[0]; vv2.y = v2[1]; vv2.z = v2[2];
 
-  o = newtri(tex, vv0, vv1, vv2);
+  o = newtri(scene, tex, vv0, vv1, vv2);
   /* don't add degenerate triangles */
   if (o != NULL) {
     add_bounded_object(scene, o);
@@ -1068,7 +1219,7 @@ void rt_tri3fv(SceneHandle voidscene, void * tex,
 
 void rt_stri(SceneHandle voidscene, void * tex, apivector v0, apivector v1, apivector v2, apivector n0, apivector n1, apivector n2) {
   scenedef * scene = (scenedef *) voidscene;
-  object * o = newstri(tex, v0, v1, v2, n0, n1, n2);
+  object * o = newstri(scene, tex, v0, v1, v2, n0, n1, n2);
   /* don't add degenerate triangles */
   if (o != NULL) {
     if (scene->normalfixupmode)
@@ -1092,7 +1243,7 @@ void rt_stri3fv(SceneHandle voidscene, void * tex,
   vn1.x = n1[0]; vn1.y = n1[1]; vn1.z = n1[2]; 
   vn2.x = n2[0]; vn2.y = n2[1]; vn2.z = n2[2];
 
-  o = newstri(tex, vv0, vv1, vv2, vn0, vn1, vn2);
+  o = newstri(scene, tex, vv0, vv1, vv2, vn0, vn1, vn2);
   /* don't add degenerate triangles */
   if (o != NULL) {
     if (scene->normalfixupmode)
@@ -1107,7 +1258,13 @@ void rt_vcstri(SceneHandle voidscene, void * tex,
                apivector n0, apivector n1, apivector n2, 
                apicolor c0, apicolor c1, apicolor c2) {
   scenedef * scene = (scenedef *) voidscene;
-  object * o = newvcstri(tex, v0, v1, v2, n0, n1, n2, c0, c1, c2);
+  object * o;
+
+  /* vertex colored triangles share a texture with no color of its own */
+  if (!texture_isvcstri((texture *) tex))
+    tex = rt_texture_copy_vcstri(scene, tex);
+
+  o = newvcstri(scene, tex, v0, v1, v2, n0, n1, n2, c0, c1, c2);
   /* don't add degenerate triangles */
   if (o != NULL) {
     if (scene->normalfixupmode)
@@ -1136,7 +1293,10 @@ void rt_vcstri3fv(SceneHandle voidscene, void * tex,
   cc1.r = c1[0]; cc1.g = c1[1]; cc1.b = c1[2]; 
   cc2.r = c2[0]; cc2.g = c2[1]; cc2.b = c2[2];
 
-  o = newvcstri(tex, vv0, vv1, vv2, vn0, vn1, vn2, cc0, cc1, cc2);
+  if (!texture_isvcstri((texture *) tex))
+    tex = rt_texture_copy_vcstri(scene, tex);
+
+  o = newvcstri(scene, tex, vv0, vv1, vv2, vn0, vn1, vn2, cc0, cc1, cc2);
   /* don't add degenerate triangles */
   if (o != NULL) {
     if (scene->normalfixupmode)
@@ -1153,6 +1313,9 @@ void rt_tristripscnv3fv(SceneHandle voidscene, void * tex,
   int stripaddr[2][3] = { {0, 1, 2}, {1, 0, 2} };
   scenedef * scene = (scenedef *) voidscene;
 
+  /* all of the triangles share one vcstri texture */
+  tex = rt_texture_copy_vcstri(scene, tex);
+
   /* render triangle strips one triangle at a time 
    * triangle winding order is:
    *   v0, v1, v2, then v2, v1, v3, then v2, v3, v4, etc.
@@ -1165,19 +1328,8 @@ void rt_tristripscnv3fv(SceneHandle voidscene, void * tex,
       apivector n0, n1, n2;
       apicolor  c0, c1, c2;
       int a0, a1, a2;
-      list * lst;
       object * o;
 
-      /* copy the original input texture to each of the triangles... */
-      /* converting to a vcstri texture if it isn't already          */
-      vcstri_texture * newtex=rt_texture_copy_vcstri(scene, tex);
-  
-      /* add texture to the scene texture list */
-      lst = (list *) malloc(sizeof(list));
-      lst->item = (void *) newtex;
-      lst->next = scene->texlist;
-      scene->texlist = lst;
-
       /* render one triangle, using lookup table to fix winding order */
       a0 = facets[v + (stripaddr[t & 0x01][0])] * 10;
       a1 = facets[v + (stripaddr[t & 0x01][1])] * 10;
@@ -1213,7 +1365,7 @@ void rt_tristripscnv3fv(SceneHandle voidscene, void * tex,
       v2.y = cnv[a2 + 8];
       v2.z = cnv[a2 + 9];
 
-      o = newvcstri(newtex, v0, v1, v2, n0, n1, n2, c0, c1, c2); 
+      o = newvcstri(scene, tex, v0, v1, v2, n0, n1, n2, c0, c1, c2); 
       if (scene->normalfixupmode)
         vcstri_normal_fixup(o, scene->normalfixupmode);
       add_bounded_object((scenedef *) scene, o);
@@ -0,0 +1,134 @@
+/*
+ * arena.c - This file contains a simple block allocator for the many 
+ *           small objects, grid cells, and textures that make up a scene.
+ *
+ *  $Id$
+ */
+
+/*
+ * Memory is handed out sequentially from large blocks, and is only 
+ * returned when the whole arena is freed, which takes one free() per
+ * block rather than one per allocation.  Blocks start small and double
+ * in size, so small scenes don't waste much memory.  Requests that are
+ * large compared to the current block size get a block of their own.
+ * An arena isn't thread-safe, callers must serialize access to it.
+ */
+
+#include <stdlib.h>
+#include "arena.h"
+
+#define ARENA_MINBLOCK  (64 * 1024)           /* size of the first block */
+#define ARENA_MAXBLOCK  (4 * 1024 * 1024)     /* largest regular block   */
+#define ARENA_ALIGN     16                    /* alignment of all memory */
+
+#define ARENA_ROUND(x)  (((x) + (ARENA_ALIGN - 1)) & ~((size_t) ARENA_ALIGN - 1))
+
+typedef struct arenablock_t {
+  struct arenablock_t * next;  /* next (older) block                  */
+  size_t size;                 /* usable bytes in this block          */
+  size_t used;                 /* bytes handed out from this block    */
+} arenablock;
+
+/* block headers are padded so the memory following them is aligned */
+#define ARENA_HEADSZ    ARENA_ROUND(sizeof(arenablock))
+
+typedef struct {
+  arenablock * blocks;         /* current block, followed by older ones */
+  size_t blocksize;            /* size of the next regular block        */
+  size_t allocated;            /* total size of all blocks              */
+  size_t used;                 /* total bytes handed out                */
+} arena;
+
+void * new_arena(void) {
+  arena * a;
+
+  a = (arena *) calloc(1, sizeof(arena));
+  if (a == NULL)
+    return NULL;
+
+  a->blocksize = ARENA_MINBLOCK;
+
+  return a;
+}
+
+void free_arena(void * voida) {
+  arena * a = (arena *) voida;
+  arenablock * cur, * next;
+
+  if (a == NULL)
+    return;
+
+  cur = a->blocks;
+  while (cur != NULL) {
+    next = cur->next;
+    free(cur);
+    cur = next;
+  }
+
+  free(a);
+}
+
+static arenablock * new_block(size_t size) {
+  arenablock * blk;
+
+  blk = (arenablock *) malloc(ARENA_HEADSZ + size);
+  if (blk == NULL)
+    return NULL;
+
+  blk->next = NULL;
+  blk->size = size;
+  blk->used = 0;
+
+  return blk;
+}
+
+void * arena_alloc(void * voida, size_t size) {
+  arena * a = (arena *) voida;
+  arenablock * blk;
+
+  size = ARENA_ROUND(size);
+  blk = a->blocks;
+
+  if (blk == NULL || (blk->size - blk->used) < size) {
+    if (size > a->blocksize / 4) {
+      /* big request, give it a dedicated block behind the current one */
+      blk = new_block(size);
+      if (blk == NULL)
+        return NULL;
+
+      if (a->blocks != NULL) {
+        blk->next = a->blocks->next;
+        a->blocks->next = blk;
+      } else {
+        a->blocks = blk;
+      }
+    } else {
+      blk = new_block(a->blocksize);
+      if (blk == NULL)
+        return NULL;
+
+      blk->next = a->blocks;
+      a->blocks = blk;
+      if (a->blocksize < ARENA_MAXBLOCK)
+        a->blocksize *= 2;
+    }
+
+    a->allocated += blk->size;
+  }
+
+  blk->used += size;
+  a->used += size;
+
+  return ((char *) blk) + ARENA_HEADSZ + blk->used - size;
+}
+
+void arena_stats(void * voida, size_t * allocated, size_t * used) {
+  arena * a = (arena *) voida;
+  *allocated = a->allocated;
+  *used = a->used;
+}
+
+/* free method for objects living in an arena, they go with their arena */
+void arena_nofree(void * p) {
+  (void) p;
+}
@@ -0,0 +1,24 @@
+/*
+ * arena.h - block allocator for scene data that lives as long as its scene
+ *
+ *  $Id$
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void * new_arena(void);
+void free_arena(void *);
+void * arena_alloc(void *, size_t);
+void arena_stats(void *, size_t * allocated, size_t * used);
+void arena_nofree(void *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -30,7 +30,8 @@ static object_methods box_methods = {
   (void (*)(const void *, void *))(box_intersect),
   (void (*)(const void *, const void *, const void *, void *))(box_normal),
   box_bbox, 
-  free 
+  free,
+  RT_STATS_BOX
 };
 
 box * newbox(void * tex, vector min, vector max) {
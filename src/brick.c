@@ -0,0 +1,138 @@
+/* 
+ * brick.c - Voxel storage layouts for volume data
+ *
+ *  $Id$
+ */
+
+/*
+ * Volumes are normally stored as flat arrays with X varying fastest, so 
+ * rays marching along Y or Z touch a new cache line (and often a new page)
+ * on every sample.  The bricked layout stores the volume as 8x8x8 bricks 
+ * of voxels, with the voxels in each brick in Morton (Z-curve) order, so 
+ * that neighboring voxels in every direction are usually close in memory.
+ *
+ * Since a Morton index is just the interleaved bits of the coordinates, 
+ * the byte address of any voxel separates into a sum of one X, one Y, and
+ * one Z term, in both layouts.  We store those terms in per-axis tables,
+ * so samplers compute an address with three table lookups and never need
+ * to know which layout they are using.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define TACHYON_INTERNAL 1
+#include "tachyon.h"
+#include "brick.h"
+
+/* spread the low 3 bits of v apart by two bits, for Morton indexing */
+static size_t morton_spread3(int v) {
+  return (size_t) (( v       & 1) | 
+                   ((v >> 1) & 1) << 3 | 
+                   ((v >> 2) & 1) << 6);
+}
+
+static void brick_counts(int xres, int yres, int zres, 
+                         size_t *nbx, size_t *nby, size_t *nbz) {
+  *nbx = (xres + BRICK_SIZE - 1) >> BRICK_SHIFT;
+  *nby = (yres + BRICK_SIZE - 1) >> BRICK_SHIFT;
+  *nbz = (zres + BRICK_SIZE - 1) >> BRICK_SHIFT;
+}
+
+
+/*
+ * Number of bytes needed to hold a volume in the requested layout.
+ * Bricked volumes are padded out to a whole number of bricks per axis.
+ */
+size_t voxel_storage_size(int xres, int yres, int zres, int ncomp, int layout) {
+  size_t nbx, nby, nbz;
+
+  if (layout == RT_VOLUME_LAYOUT_BRICKED) {
+    brick_counts(xres, yres, zres, &nbx, &nby, &nbz);
+    return nbx * nby * nbz * BRICK_VOXELS * ncomp;
+  } 
+
+  return (size_t) xres * yres * zres * ncomp;
+}
+
+
+/*
+ * Build the per-axis byte offset tables for a volume with ncomp bytes per
+ * voxel.  The table holds xres X offsets, followed by yres Y offsets,
+ * followed by zres Z offsets, for use with VOXEL_ADDR().
+ */
+size_t * voxel_offsets(int xres, int yres, int zres, int ncomp, int layout) {
+  size_t * offs;
+  size_t * yoffs;
+  size_t * zoffs;
+  size_t nbx, nby, nbz;
+  int i;
+
+  offs = (size_t *) malloc((xres + yres + zres) * sizeof(size_t));
+  if (offs == NULL)
+    return NULL;
+
+  yoffs = offs + xres;
+  zoffs = yoffs + yres;
+
+  if (layout == RT_VOLUME_LAYOUT_BRICKED) {
+    size_t bxstride, bystride, bzstride;
+
+    brick_counts(xres, yres, zres, &nbx, &nby, &nbz);
+    bxstride = (size_t) BRICK_VOXELS * ncomp;
+    bystride = bxstride * nbx;
+    bzstride = bystride * nby;
+
+    for (i=0; i<xres; i++) 
+      offs[i]  = (i >> BRICK_SHIFT) * bxstride + 
+                 (morton_spread3(i & (BRICK_SIZE-1))     ) * ncomp;
+    for (i=0; i<yres; i++) 
+      yoffs[i] = (i >> BRICK_SHIFT) * bystride + 
+                 (morton_spread3(i & (BRICK_SIZE-1)) << 1) * ncomp;
+    for (i=0; i<zres; i++) 
+      zoffs[i] = (i >> BRICK_SHIFT) * bzstride + 
+                 (morton_spread3(i & (BRICK_SIZE-1)) << 2) * ncomp;
+  } else {
+    for (i=0; i<xres; i++) 
+      offs[i]  = (size_t) i * ncomp;
+    for (i=0; i<yres; i++) 
+      yoffs[i] = (size_t) i * xres * ncomp;
+    for (i=0; i<zres; i++) 
+      zoffs[i] = (size_t) i * xres * yres * ncomp;
+  }
+
+  return offs;
+}
+
+
+/*
+ * Copy a volume stored in the standard linear layout into a newly 
+ * allocated buffer in the layout described by the offset table.
+ */
+unsigned char * voxel_relayout(int xres, int yres, int zres, int ncomp, 
+                               const size_t * offs, int layout,
+                               const unsigned char * linear) {
+  unsigned char * vox;
+  int x, y, z, c;
+
+  /* padding voxels in partial bricks are never sampled, but zero them */
+  vox = (unsigned char *) calloc(1, voxel_storage_size(xres, yres, zres, 
+                                                       ncomp, layout));
+  if (vox == NULL)
+    return NULL;
+
+  for (z=0; z<zres; z++) {
+    for (y=0; y<yres; y++) {
+      unsigned char * dst = vox + offs[xres + y] + offs[xres + yres + z];
+      for (x=0; x<xres; x++) {
+        for (c=0; c<ncomp; c++) {
+          dst[offs[x] + c] = *linear++;
+        }
+      }
+    }
+  }
+
+  return vox;
+}
@@ -0,0 +1,22 @@
+/* 
+ * brick.h - Voxel storage layouts for volume data
+ *
+ *  $Id$
+ */
+
+#define BRICK_SHIFT   3                  /**< 8x8x8 voxel bricks          */
+#define BRICK_SIZE    (1 << BRICK_SHIFT) /**< voxels along a brick edge   */
+#define BRICK_VOXELS  (BRICK_SIZE * BRICK_SIZE * BRICK_SIZE)
+
+/**
+ * Byte address of voxel (x,y,z) given a per-axis offset table created 
+ * by voxel_offsets().  The same lookup works for any storage layout.
+ */
+#define VOXEL_ADDR(offs, xres, yres, x, y, z) \
+  ((offs)[(x)] + (offs)[(xres) + (y)] + (offs)[(xres) + (yres) + (z)])
+
+size_t * voxel_offsets(int xres, int yres, int zres, int ncomp, int layout);
+size_t voxel_storage_size(int xres, int yres, int zres, int ncomp, int layout);
+unsigned char * voxel_relayout(int xres, int yres, int zres, int ncomp, 
+                               const size_t * offs, int layout,
+                               const unsigned char * linear);
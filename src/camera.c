@@ -18,72 +18,73 @@
 #include "intersect.h"
 
 /* 
- * camera_init()
- *   take camera parameters stored in scene definition and do all 
- *   necessary initialization and whatever pre-calculation can be done. 
+ * camera_setup()
+ *   take the camera parameters and the image size and aspect ratio from
+ *   the scene definition and do all necessary initialization and whatever
+ *   pre-calculation can be done.
  */
-void camera_init(scenedef *scene) {
+void camera_setup(const scenedef *scene, camdef *camera) {
   flt sx, sy;
   vector newupvec;
   vector newviewvec;
   vector newrightvec;
 
   /* recompute the camera vectors */
-  VCross(&scene->camera.upvec, &scene->camera.viewvec, &newrightvec);
+  VCross(&camera->upvec, &camera->viewvec, &newrightvec);
   VNorm(&newrightvec);
 
-  VCross(&scene->camera.viewvec, &newrightvec, &newupvec);
+  VCross(&camera->viewvec, &newrightvec, &newupvec);
   VNorm(&newupvec);
 
-  newviewvec=scene->camera.viewvec;
+  newviewvec=camera->viewvec;
   VNorm(&newviewvec);
-  scene->camera.rightvec=newrightvec;
-  scene->camera.upvec=newupvec;
+  camera->rightvec=newrightvec;
+  camera->upvec=newupvec;
 
   sx = (flt) scene->hres; 
   sy = (flt) scene->vres;
 
   /* calculate the width and height of the image plane in world coords */
   /* given the aspect ratio, image resolution, and zoom factor */
-  scene->camera.px=((sx / sy) / scene->aspectratio) / scene->camera.camzoom;
-  scene->camera.py=1.0 / scene->camera.camzoom;
-  scene->camera.psx = scene->camera.px / sx;
-  scene->camera.psy = scene->camera.py / sy;
-
-  if (scene->camera.frustumcalc == RT_CAMERA_FRUSTUM_AUTO) {
-    scene->camera.left   = -0.5 * scene->camera.px;
-    scene->camera.right  =  0.5 * scene->camera.px;
-    scene->camera.bottom = -0.5 * scene->camera.py;
-    scene->camera.top    =  0.5 * scene->camera.py;
+  camera->px=((sx / sy) / scene->aspectratio) / camera->camzoom;
+  camera->py=1.0 / camera->camzoom;
+  camera->psx = camera->px / sx;
+  camera->psy = camera->py / sy;
+
+  if (camera->frustumcalc == RT_CAMERA_FRUSTUM_AUTO) {
+    camera->left   = -0.5 * camera->px;
+    camera->right  =  0.5 * camera->px;
+    camera->bottom = -0.5 * camera->py;
+    camera->top    =  0.5 * camera->py;
   }
   
   /* setup function pointer for camera ray generation */
-  switch (scene->camera.projection) {
+  switch (camera->projection) {
     case RT_PROJECTION_PERSPECTIVE:
       if (scene->antialiasing > 0) {
-        scene->camera.cam_ray = (color (*)(void *,flt,flt)) cam_aa_perspective_ray;
+        camera->cam_ray = (color (*)(void *,flt,flt)) cam_aa_perspective_ray;
       } else {
-        scene->camera.cam_ray = (color (*)(void *,flt,flt)) cam_perspective_ray;
+        camera->cam_ray = (color (*)(void *,flt,flt)) cam_perspective_ray;
       }
       break;
 
     case RT_PROJECTION_PERSPECTIVE_DOF:
-      scene->camera.cam_ray = (color (*)(void *,flt,flt)) cam_aa_dof_ray;
+      camera->cam_ray = (color (*)(void *,flt,flt)) cam_aa_dof_ray;
       break;
 
     case RT_PROJECTION_ORTHOGRAPHIC:
       if (scene->antialiasing > 0) {
-        scene->camera.cam_ray = (color (*)(void *,flt,flt)) cam_aa_orthographic_ray;
+        camera->cam_ray = (color (*)(void *,flt,flt)) cam_aa_orthographic_ray;
       } else {
-        scene->camera.cam_ray = (color (*)(void *,flt,flt)) cam_orthographic_ray;
+        camera->cam_ray = (color (*)(void *,flt,flt)) cam_orthographic_ray;
       }
       break;
 
     case RT_PROJECTION_FISHEYE:
       if (scene->antialiasing > 0) {
-        scene->camera.cam_ray = (color (*)(void *,flt,flt)) cam_aa_fisheye_ray;
+        camera->cam_ray = (color (*)(void *,flt,flt)) cam_aa_fisheye_ray;
       } else {
-        scene->camera.cam_ray = (color (*)(void *,flt,flt)) cam_fisheye_ray;
+        camera->cam_ray = (color (*)(void *,flt,flt)) cam_fisheye_ray;
       }
       break;
   }
@@ -91,95 +92,126 @@ void camera_init(scenedef *scene) {
 
   /* assuming viewvec is a unit vector, then the center of the */
   /* image plane is the camera center + vievec                 */
-  switch (scene->camera.projection) { 
+  switch (camera->projection) { 
     case RT_PROJECTION_ORTHOGRAPHIC:
-      scene->camera.projcent = scene->camera.center;
+      camera->projcent = camera->center;
 
       /* assuming viewvec is a unit vector, then the lower left    */
       /* corner of the image plane is calculated below             */
-      scene->camera.lowleft.x = scene->camera.projcent.x +
-        (scene->camera.left   * scene->camera.rightvec.x) +
-        (scene->camera.bottom * scene->camera.upvec.x);
-      scene->camera.lowleft.y = scene->camera.projcent.y +
-        (scene->camera.left   * scene->camera.rightvec.y) +
-        (scene->camera.bottom * scene->camera.upvec.y);
-      scene->camera.lowleft.z = scene->camera.projcent.z +
-        (scene->camera.left   * scene->camera.rightvec.z) +
-        (scene->camera.bottom * scene->camera.upvec.z);
+      camera->lowleft.x = camera->projcent.x +
+        (camera->left   * camera->rightvec.x) +
+        (camera->bottom * camera->upvec.x);
+      camera->lowleft.y = camera->projcent.y +
+        (camera->left   * camera->rightvec.y) +
+        (camera->bottom * camera->upvec.y);
+      camera->lowleft.z = camera->projcent.z +
+        (camera->left   * camera->rightvec.z) +
+        (camera->bottom * camera->upvec.z);
       break;
   
     case RT_PROJECTION_PERSPECTIVE_DOF:
-      scene->camera.projcent.x = scene->camera.center.x + 
-                        (scene->camera.focallength * scene->camera.viewvec.x);
-      scene->camera.projcent.y = scene->camera.center.y + 
-                        (scene->camera.focallength * scene->camera.viewvec.y);
-      scene->camera.projcent.z = scene->camera.center.z + 
-                        (scene->camera.focallength * scene->camera.viewvec.z);
+      camera->projcent.x = camera->center.x + 
+                        (camera->focallength * camera->viewvec.x);
+      camera->projcent.y = camera->center.y + 
+                        (camera->focallength * camera->viewvec.y);
+      camera->projcent.z = camera->center.z + 
+                        (camera->focallength * camera->viewvec.z);
 
       /* assuming viewvec is a unit vector, then the lower left    */
       /* corner of the image plane is calculated below             */
-      scene->camera.lowleft.x = scene->camera.projcent.x +
-        (scene->camera.left   * scene->camera.rightvec.x) +
-        (scene->camera.bottom * scene->camera.upvec.x);
-      scene->camera.lowleft.y = scene->camera.projcent.y +
-        (scene->camera.left   * scene->camera.rightvec.y) +
-        (scene->camera.bottom * scene->camera.upvec.y);
-      scene->camera.lowleft.z = scene->camera.projcent.z +
-        (scene->camera.left   * scene->camera.rightvec.z) +
-        (scene->camera.bottom * scene->camera.upvec.z);
+      camera->lowleft.x = camera->projcent.x +
+        (camera->left   * camera->rightvec.x) +
+        (camera->bottom * camera->upvec.x);
+      camera->lowleft.y = camera->projcent.y +
+        (camera->left   * camera->rightvec.y) +
+        (camera->bottom * camera->upvec.y);
+      camera->lowleft.z = camera->projcent.z +
+        (camera->left   * camera->rightvec.z) +
+        (camera->bottom * camera->upvec.z);
       break;
 
     case RT_PROJECTION_FISHEYE:
-      scene->camera.projcent.x = scene->camera.center.x + 
-                        (scene->camera.focallength * scene->camera.viewvec.x);
-      scene->camera.projcent.y = scene->camera.center.y + 
-                        (scene->camera.focallength * scene->camera.viewvec.y);
-      scene->camera.projcent.z = scene->camera.center.z + 
-                        (scene->camera.focallength * scene->camera.viewvec.z);
+      camera->projcent.x = camera->center.x + 
+                        (camera->focallength * camera->viewvec.x);
+      camera->projcent.y = camera->center.y + 
+                        (camera->focallength * camera->viewvec.y);
+      camera->projcent.z = camera->center.z + 
+                        (camera->focallength * camera->viewvec.z);
       break;
 
     case RT_PROJECTION_PERSPECTIVE:
     default:
-      scene->camera.projcent.x = scene->camera.center.x + 
-                        (scene->camera.focallength * scene->camera.viewvec.x);
-      scene->camera.projcent.y = scene->camera.center.y + 
-                        (scene->camera.focallength * scene->camera.viewvec.y);
-      scene->camera.projcent.z = scene->camera.center.z + 
-                        (scene->camera.focallength * scene->camera.viewvec.z);
+      camera->projcent.x = camera->center.x + 
+                        (camera->focallength * camera->viewvec.x);
+      camera->projcent.y = camera->center.y + 
+                        (camera->focallength * camera->viewvec.y);
+      camera->projcent.z = camera->center.z + 
+                        (camera->focallength * camera->viewvec.z);
 
       /* assuming viewvec is a unit vector, then the lower left    */
       /* corner of the image plane is calculated below             */
       /* for normal perspective rays, we are really storing the    */
       /* direction to the lower left, not the lower left itself,   */
       /* since this allows us to eliminate a subtraction per pixel */
-      scene->camera.lowleft.x = scene->camera.projcent.x +
-        (scene->camera.left   * scene->camera.rightvec.x) +
-        (scene->camera.bottom * scene->camera.upvec.x)
-        - scene->camera.center.x;
-      scene->camera.lowleft.y = scene->camera.projcent.y +
-        (scene->camera.left   * scene->camera.rightvec.y) +
-        (scene->camera.bottom * scene->camera.upvec.y)
-        - scene->camera.center.y;
-      scene->camera.lowleft.z = scene->camera.projcent.z +
-        (scene->camera.left   * scene->camera.rightvec.z) +
-        (scene->camera.bottom * scene->camera.upvec.z)
-        - scene->camera.center.z;
+      camera->lowleft.x = camera->projcent.x +
+        (camera->left   * camera->rightvec.x) +
+        (camera->bottom * camera->upvec.x)
+        - camera->center.x;
+      camera->lowleft.y = camera->projcent.y +
+        (camera->left   * camera->rightvec.y) +
+        (camera->bottom * camera->upvec.y)
+        - camera->center.y;
+      camera->lowleft.z = camera->projcent.z +
+        (camera->left   * camera->rightvec.z) +
+        (camera->bottom * camera->upvec.z)
+        - camera->center.z;
       break;
   }
 
   /* size of image plane */
-  scene->camera.px = scene->camera.right - scene->camera.left; 
-  scene->camera.py = scene->camera.top - scene->camera.bottom; 
-  scene->camera.psx = scene->camera.px / scene->hres;
-  scene->camera.psy = scene->camera.py / scene->vres;
-
-  scene->camera.iplaneright.x = scene->camera.px * scene->camera.rightvec.x / sx;
-  scene->camera.iplaneright.y = scene->camera.px * scene->camera.rightvec.y / sx;
-  scene->camera.iplaneright.z = scene->camera.px * scene->camera.rightvec.z / sx;
+  camera->px = camera->right - camera->left; 
+  camera->py = camera->top - camera->bottom; 
+  camera->psx = camera->px / scene->hres;
+  camera->psy = camera->py / scene->vres;
+
+  camera->iplaneright.x = camera->px * camera->rightvec.x / sx;
+  camera->iplaneright.y = camera->px * camera->rightvec.y / sx;
+  camera->iplaneright.z = camera->px * camera->rightvec.z / sx;
   
-  scene->camera.iplaneup.x = scene->camera.py * scene->camera.upvec.x / sy;
-  scene->camera.iplaneup.y = scene->camera.py * scene->camera.upvec.y / sy;
-  scene->camera.iplaneup.z = scene->camera.py * scene->camera.upvec.z / sy;
+  camera->iplaneup.x = camera->py * camera->upvec.x / sy;
+  camera->iplaneup.y = camera->py * camera->upvec.y / sy;
+  camera->iplaneup.z = camera->py * camera->upvec.z / sy;
+}
+
+
+/* 
+ * camera_init()
+ *   initialize the scene's own camera for rendering a frame.
+ */
+void camera_init(scenedef *scene) {
+  camera_setup(scene, &scene->camera);
+}
+
+
+/* 
+ * camera_keyframe()
+ *   set up a copy of the scene camera moved to a keyframe position,
+ *   leaving the scene camera itself untouched.  Each worker thread
+ *   builds its own copy, so threads can be on different frames.
+ */
+void camera_keyframe(const scenedef *scene, const rt_camera_keyframe *key,
+                     camdef *camera) {
+  vector center, viewvec, upvec;
+
+  center.x  = key->center[0];  center.y  = key->center[1];  center.z  = key->center[2];
+  viewvec.x = key->viewdir[0]; viewvec.y = key->viewdir[1]; viewvec.z = key->viewdir[2];
+  upvec.x   = key->updir[0];   upvec.y   = key->updir[1];   upvec.z   = key->updir[2];
+
+  *camera = scene->camera;
+  cameraposition(camera, center, viewvec, upvec);
+  if (key->zoom > 0.0f)
+    camerazoom(camera, key->zoom);
+  camera_setup(scene, camera);
 }
 
 
@@ -189,8 +221,9 @@ void camera_init(scenedef *scene) {
  *   by the current worker thread.  This includes attaching thread-specific
  *   data to this ray.
  */
-void camray_init(scenedef *scene, ray *primary, unsigned long serial, 
-                 unsigned long * mbox, unsigned int randval) {
+void camray_init(scenedef *scene, const camdef *camera, ray *primary, 
+                 unsigned long serial, unsigned long * mbox, 
+                 mboxentry * hashmbox, unsigned int randval) {
   /* setup the right function pointer depending on what features are in use */
   if (scene->flags & RT_SHADE_CLIPPING) {
     primary->add_intersection = add_clipped_intersection;
@@ -200,17 +233,21 @@ void camray_init(scenedef *scene, ray *primary, unsigned long serial,
 
   primary->serial = serial;
   primary->mbox = mbox;
+  primary->hashmbox = hashmbox;
   primary->scene = scene;
+  primary->camera = camera;
+  primary->stats = NULL;                 /* set by the caller if wanted */
+  primary->numanode = -1;                /* set by the caller if pinned */
   primary->depth = scene->raydepth;      /* set to max ray depth      */
   primary->transcnt = scene->transcount; /* set to max trans surf cnt */
   primary->randval = randval;            /* random number seed */
   rng_frand_init(&primary->frng);        /* seed 32-bit FP RNG */
 
   /* orthographic ray direction is always coaxial with view direction */
-  primary->d = scene->camera.viewvec; 
+  primary->d = camera->viewvec; 
 
   /* for perspective rendering without depth of field */
-  primary->o = scene->camera.center;
+  primary->o = camera->center;
 }
 
 
@@ -257,19 +294,19 @@ color cam_aa_dof_ray(ray * ry, flt x, flt y) {
       /* calculate random eye aperture offset */
       float jxy[2];
       jitter_offset2f(&ry->randval, jxy);
-      dx = jxy[0] * ry->scene->camera.aperture * ry->scene->hres; 
-      dy = jxy[1] * ry->scene->camera.aperture * ry->scene->vres; 
+      dx = jxy[0] * ry->camera->aperture * ry->scene->hres; 
+      dy = jxy[1] * ry->camera->aperture * ry->scene->vres; 
 
       /* perturb the eye center by the random aperture offset */
-      ry->o.x = ry->scene->camera.center.x + 
-                dx * ry->scene->camera.iplaneright.x +
-                dy * ry->scene->camera.iplaneup.x;
-      ry->o.y = ry->scene->camera.center.y + 
-                dx * ry->scene->camera.iplaneright.y +
-                dy * ry->scene->camera.iplaneup.y;
-      ry->o.z = ry->scene->camera.center.z + 
-                dx * ry->scene->camera.iplaneright.z +
-                dy * ry->scene->camera.iplaneup.z;
+      ry->o.x = ry->camera->center.x + 
+                dx * ry->camera->iplaneright.x +
+                dy * ry->camera->iplaneup.x;
+      ry->o.y = ry->camera->center.y + 
+                dx * ry->camera->iplaneright.y +
+                dy * ry->camera->iplaneup.y;
+      ry->o.z = ry->camera->center.z + 
+                dx * ry->camera->iplaneright.z +
+                dy * ry->camera->iplaneup.z;
 
       /* shoot the ray, jittering the pixel position in the image plane */
       jitter_offset2f(&ry->randval, jxy);
@@ -335,19 +372,19 @@ color cam_aa_dof_ray(ray * ry, flt x, flt y) {
   for (alias=1; alias <= scene->antialiasing; alias++) {
     float jxy[2];
     jitter_offset2f(&ry->randval, jxy);
-    dx = jxy[0] * ry->scene->camera.aperture * ry->scene->hres; 
-    dy = jxy[1] * ry->scene->camera.aperture * ry->scene->vres; 
+    dx = jxy[0] * ry->camera->aperture * ry->scene->hres; 
+    dy = jxy[1] * ry->camera->aperture * ry->scene->vres; 
 
     /* perturb the eye center by the random aperture offset */
-    ry->o.x = ry->scene->camera.center.x + 
-              dx * ry->scene->camera.iplaneright.x +
-              dy * ry->scene->camera.iplaneup.x;
-    ry->o.y = ry->scene->camera.center.y + 
-              dx * ry->scene->camera.iplaneright.y +
-              dy * ry->scene->camera.iplaneup.y;
-    ry->o.z = ry->scene->camera.center.z + 
-              dx * ry->scene->camera.iplaneright.z +
-              dy * ry->scene->camera.iplaneup.z;
+    ry->o.x = ry->camera->center.x + 
+              dx * ry->camera->iplaneright.x +
+              dy * ry->camera->iplaneup.x;
+    ry->o.y = ry->camera->center.y + 
+              dx * ry->camera->iplaneright.y +
+              dy * ry->camera->iplaneup.y;
+    ry->o.z = ry->camera->center.z + 
+              dx * ry->camera->iplaneright.z +
+              dy * ry->camera->iplaneup.z;
 
     /* shoot the ray, jittering the pixel position in the image plane */
     jitter_offset2f(&ry->randval, jxy);
@@ -380,17 +417,17 @@ color cam_dof_ray(ray * ry, flt x, flt y) {
   /* center of the pel we're calculating:                       */ 
   /* lowerleft + (rightvec * X_distance) + (upvec * Y_distance) */
   /* rdx/y/z are the ray directions (unnormalized)              */
-  rdx = scene->camera.lowleft.x + 
-                (x * scene->camera.iplaneright.x) + 
-                (y * scene->camera.iplaneup.x) - ry->o.x;
+  rdx = ry->camera->lowleft.x + 
+                (x * ry->camera->iplaneright.x) + 
+                (y * ry->camera->iplaneup.x) - ry->o.x;
 
-  rdy = scene->camera.lowleft.y + 
-                (x * scene->camera.iplaneright.y) + 
-                (y * scene->camera.iplaneup.y) - ry->o.y;
+  rdy = ry->camera->lowleft.y + 
+                (x * ry->camera->iplaneright.y) + 
+                (y * ry->camera->iplaneup.y) - ry->o.y;
 
-  rdz = scene->camera.lowleft.z + 
-                (x * scene->camera.iplaneright.z) + 
-                (y * scene->camera.iplaneup.z) - ry->o.z;
+  rdz = ry->camera->lowleft.z + 
+                (x * ry->camera->iplaneright.z) + 
+                (y * ry->camera->iplaneup.z) - ry->o.z;
 
   /* normalize the ray direction vector */
   len = 1.0 / SQRT(rdx*rdx + rdy*rdy + rdz*rdz);
@@ -404,6 +441,7 @@ color cam_dof_ray(ray * ry, flt x, flt y) {
 
   /* camera only generates primary rays */
   ry->flags = RT_RAY_PRIMARY | RT_RAY_REGULAR;  
+  RT_STAT_INC(ry, primaryrays);
 
   ry->serial++;                /* increment the ray serial number */
   intersect_objects(ry);       /* trace the ray */
@@ -457,17 +495,17 @@ color cam_perspective_ray(ray * ry, flt x, flt y) {
   /* center of the pel we're calculating:                       */ 
   /* lowerleft + (rightvec * X_distance) + (upvec * Y_distance) */
   /* rdx/y/z are the ray directions (unnormalized)              */
-  rdx = scene->camera.lowleft.x + 
-                (x * scene->camera.iplaneright.x) + 
-                (y * scene->camera.iplaneup.x);
+  rdx = ry->camera->lowleft.x + 
+                (x * ry->camera->iplaneright.x) + 
+                (y * ry->camera->iplaneup.x);
 
-  rdy = scene->camera.lowleft.y + 
-                (x * scene->camera.iplaneright.y) + 
-                (y * scene->camera.iplaneup.y);
+  rdy = ry->camera->lowleft.y + 
+                (x * ry->camera->iplaneright.y) + 
+                (y * ry->camera->iplaneup.y);
 
-  rdz = scene->camera.lowleft.z + 
-                (x * scene->camera.iplaneright.z) + 
-                (y * scene->camera.iplaneup.z);
+  rdz = ry->camera->lowleft.z + 
+                (x * ry->camera->iplaneright.z) + 
+                (y * ry->camera->iplaneup.z);
 
   /* normalize the ray direction vector */
   len = 1.0 / SQRT(rdx*rdx + rdy*rdy + rdz*rdz);
@@ -481,6 +519,7 @@ color cam_perspective_ray(ray * ry, flt x, flt y) {
 
   /* camera only generates primary rays */
   ry->flags = RT_RAY_PRIMARY | RT_RAY_REGULAR;  
+  RT_STAT_INC(ry, primaryrays);
 
   ry->serial++;                /* increment the ray serial number */
   intersect_objects(ry);       /* trace the ray */
@@ -533,17 +572,17 @@ color cam_orthographic_ray(ray * ry, flt x, flt y) {
   /* starting from the lower left corner of the image plane, we move the   */
   /* center of the pel we're calculating:                       */ 
   /* lowerleft + (rightvec * X_distance) + (upvec * Y_distance) */
-  ry->o.x = scene->camera.lowleft.x + 
-                (x * scene->camera.iplaneright.x) + 
-                (y * scene->camera.iplaneup.x);
+  ry->o.x = ry->camera->lowleft.x + 
+                (x * ry->camera->iplaneright.x) + 
+                (y * ry->camera->iplaneup.x);
 
-  ry->o.y = scene->camera.lowleft.y + 
-                (x * scene->camera.iplaneright.y) + 
-                (y * scene->camera.iplaneup.y);
+  ry->o.y = ry->camera->lowleft.y + 
+                (x * ry->camera->iplaneright.y) + 
+                (y * ry->camera->iplaneup.y);
 
-  ry->o.z = scene->camera.lowleft.z + 
-                (x * scene->camera.iplaneright.z) + 
-                (y * scene->camera.iplaneup.z);
+  ry->o.z = ry->camera->lowleft.z + 
+                (x * ry->camera->iplaneright.z) + 
+                (y * ry->camera->iplaneup.z);
 
   /* initialize ray attributes for a primary ray */
   ry->maxdist = FHUGE;         /* unbounded ray */
@@ -551,6 +590,7 @@ color cam_orthographic_ray(ray * ry, flt x, flt y) {
 
   /* camera only generates primary rays */
   ry->flags = RT_RAY_PRIMARY | RT_RAY_REGULAR;  
+  RT_STAT_INC(ry, primaryrays);
 
   ry->serial++;                /* increment the ray serial number */
   intersect_objects(ry);       /* trace the ray */
@@ -565,20 +605,20 @@ color cam_fisheye_ray(ray * ry, flt x, flt y) {
   flt ax, ay;
   scenedef * scene=ry->scene;
 
-  ax = scene->camera.left   + x * scene->camera.psx;
-  ay = scene->camera.bottom + y * scene->camera.psy;
+  ax = ry->camera->left   + x * ry->camera->psx;
+  ay = ry->camera->bottom + y * ry->camera->psy;
 
-  ry->d.x = COS(ay) * (COS(ax) * scene->camera.viewvec.x + 
-                       SIN(ax) * scene->camera.rightvec.x) +
-            SIN(ay) * scene->camera.upvec.x;
+  ry->d.x = COS(ay) * (COS(ax) * ry->camera->viewvec.x + 
+                       SIN(ax) * ry->camera->rightvec.x) +
+            SIN(ay) * ry->camera->upvec.x;
 
-  ry->d.y = COS(ay) * (COS(ax) * scene->camera.viewvec.y +
-                       SIN(ax) * scene->camera.rightvec.y) +
-            SIN(ay) * scene->camera.upvec.y;
+  ry->d.y = COS(ay) * (COS(ax) * ry->camera->viewvec.y +
+                       SIN(ax) * ry->camera->rightvec.y) +
+            SIN(ay) * ry->camera->upvec.y;
 
-  ry->d.z = COS(ay) * (COS(ax) * scene->camera.viewvec.z +
-                       SIN(ax) * scene->camera.rightvec.z) +
-            SIN(ay) * scene->camera.upvec.z;
+  ry->d.z = COS(ay) * (COS(ax) * ry->camera->viewvec.z +
+                       SIN(ax) * ry->camera->rightvec.z) +
+            SIN(ay) * ry->camera->upvec.z;
         
   /* initialize ray attributes for a primary ray */
   ry->maxdist = FHUGE;         /* unbounded ray */
@@ -586,6 +626,7 @@ color cam_fisheye_ray(ray * ry, flt x, flt y) {
 
   /* camera only generates primary rays */
   ry->flags = RT_RAY_PRIMARY | RT_RAY_REGULAR;  
+  RT_STAT_INC(ry, primaryrays);
 
   ry->serial++;                /* increment the ray serial number */
   intersect_objects(ry);       /* trace the ray */
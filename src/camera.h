@@ -4,8 +4,11 @@
  *  $Id: camera.h,v 1.22 2011/02/14 05:38:48 johns Exp $
  */
 
+void camera_setup(const scenedef *, camdef *);
 void camera_init(scenedef *);
-void camray_init(scenedef *, ray *, unsigned long, unsigned long *, unsigned int);
+void camera_keyframe(const scenedef *, const rt_camera_keyframe *, camdef *);
+void camray_init(scenedef *, const camdef *, ray *, unsigned long, 
+                 unsigned long *, mboxentry *, unsigned int);
 
 void cameradefault(camdef *);
 void cameraprojection(camdef *, int);
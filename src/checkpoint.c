@@ -0,0 +1,201 @@
+/*
+ * checkpoint.c - This file contains the routines for saving the progress
+ *                of long renders, and resuming them after an interruption.
+ *
+ *  $Id$
+ */
+
+/*
+ * A checkpoint is a small text file that records which frames of a
+ * series are finished, and how many bands of the current frame's tiled
+ * image are already in the output file.  It also records the image
+ * layout and formats, so a checkpoint left over from a different render
+ * isn't used.  Only node 0 reads and writes it, and a new checkpoint is
+ * written to a temporary file which then replaces the old one, so an
+ * interruption while saving leaves the previous checkpoint intact.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TACHYON_INTERNAL 1
+#include "tachyon.h"
+#include "macros.h"
+#include "parallel.h"
+#include "imageio.h"
+#include "render.h"
+#include "util.h"
+#include "ui.h"
+#include "checkpoint.h"
+
+#define CKPT_VERSION 2
+
+typedef struct {
+  int hres, vres;             /* full image resolution                 */
+  int xres, yres;             /* output window size                    */
+  int xstart, ystart;         /* output window position                */
+  int bandrows;               /* rows per band, or 0 if not tiled      */
+  int fileformat;             /* RT_FORMAT_xxx of the output file      */
+  int bufformat;              /* RT_IMAGE_BUFFER_xxx of the image      */
+  int frames;                 /* frames of the series finished         */
+  int bands;                  /* bands of the next frame in the file   */
+} ckptinfo;
+
+
+/* the layout of the image being rendered now */
+static void ckpt_describe(const scenedef * scene, ckptinfo * ck) {
+  memset(ck, 0, sizeof(ckptinfo));
+  ck->hres = scene->hres;
+  ck->vres = scene->vres;
+  render_output_window(scene, &ck->xres, &ck->yres, &ck->xstart, &ck->ystart);
+  ck->bandrows = (scene->numtiles > 0) ? scene->tilerows : 0;
+  ck->fileformat = scene->imgfileformat;
+  ck->bufformat = scene->imgbufformat;
+}
+
+static int ckpt_matches(const ckptinfo * a, const ckptinfo * b) {
+  return (a->hres == b->hres && a->vres == b->vres &&
+          a->xres == b->xres && a->yres == b->yres &&
+          a->xstart == b->xstart && a->ystart == b->ystart &&
+          a->fileformat == b->fileformat && a->bufformat == b->bufformat);
+}
+
+static int ckpt_read(const char * filename, ckptinfo * ck) {
+  FILE * ifp;
+  int version = 0, rc;
+
+  ifp = fopen(filename, "r");
+  if (ifp == NULL)
+    return -1;
+
+  rc = fscanf(ifp, "TACHYON CHECKPOINT %d image %d %d %d %d %d %d %d "
+              "format %d %d frames %d bands %d", &version, &ck->hres, 
+              &ck->vres, &ck->xres, &ck->yres, &ck->xstart, &ck->ystart, 
+              &ck->bandrows, &ck->fileformat, &ck->bufformat, 
+              &ck->frames, &ck->bands);
+  fclose(ifp);
+
+  if (rc != 12 || version != CKPT_VERSION || ck->frames < 0 || ck->bands < 0)
+    return -1;
+
+  return 0;
+}
+
+static int ckpt_write(const char * filename, const ckptinfo * ck) {
+  char tmpname[300];
+  FILE * ofp;
+  int rc;
+
+  sprintf(tmpname, "%s.tmp", filename);
+  ofp = fopen(tmpname, "w");
+  if (ofp == NULL)
+    return -1;
+
+  fprintf(ofp, "TACHYON CHECKPOINT %d\n", CKPT_VERSION);
+  fprintf(ofp, "image %d %d %d %d %d %d %d\n", ck->hres, ck->vres,
+          ck->xres, ck->yres, ck->xstart, ck->ystart, ck->bandrows);
+  fprintf(ofp, "format %d %d\n", ck->fileformat, ck->bufformat);
+  fprintf(ofp, "frames %d\n", ck->frames);
+  fprintf(ofp, "bands %d\n", ck->bands);
+  rc = ferror(ofp);
+  if (fclose(ofp) || rc) {
+    remove(tmpname);
+    return -1;
+  }
+
+#if defined(_MSC_VER) || defined(WIN32)
+  remove(filename); /* rename() won't replace an existing file here */
+#endif
+  if (rename(tmpname, filename)) {
+    remove(tmpname);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * The number of frames of a series that earlier runs finished, which
+ * every node gets from node 0.
+ */
+int checkpoint_frames(scenedef * scene) {
+  ckptinfo saved, now;
+  int frames = 0;
+
+  if (scene->ckptfile[0] == '\0')
+    return 0;
+
+  if (scene->mynode == 0) {
+    ckpt_describe(scene, &now);
+    if (ckpt_read(scene->ckptfile, &saved) == 0 && ckpt_matches(&saved, &now))
+      frames = saved.frames;
+  }
+  rt_broadcast_ints(&frames, 1);
+
+  return frames;
+}
+
+
+/*
+ * Where to start rendering the current frame, on node 0: the number of
+ * bands already in the output file, or CKPT_FRAMEDONE if an earlier run
+ * finished the whole frame.  Bands can only be reused if they are the
+ * same size as before.
+ */
+int checkpoint_resume(scenedef * scene) {
+  ckptinfo saved, now;
+
+  if (scene->ckptfile[0] == '\0' || scene->mynode != 0)
+    return 0;
+
+  ckpt_describe(scene, &now);
+  if (ckpt_read(scene->ckptfile, &saved) || !ckpt_matches(&saved, &now))
+    return 0;
+
+  if (saved.frames > scene->ckptframe)
+    return CKPT_FRAMEDONE;
+
+  if (saved.frames == scene->ckptframe && now.bandrows > 0 &&
+      saved.bandrows == now.bandrows)
+    return MYMIN(saved.bands, scene->numtiles);
+
+  return 0;
+}
+
+
+/*
+ * Record the progress so far on node 0, once the checkpoint interval is
+ * up.  The bands written to a tiled image are flushed to the file first.
+ */
+void checkpoint_save(scenedef * scene, int frames, int bands, void * imgfile) {
+  ckptinfo now;
+
+  if (scene->ckptfile[0] == '\0' || scene->mynode != 0)
+    return;
+
+  if (rt_timer_timenow(scene->ckpttimer) < scene->ckptinterval)
+    return;
+
+  ckpt_describe(scene, &now);
+  now.frames = frames;
+  now.bands = bands;
+
+  if ((imgfile != NULL && flushimagebands(imgfile) != IMAGENOERR) ||
+      ckpt_write(scene->ckptfile, &now)) {
+    char msgtxt[512];
+    sprintf(msgtxt, "Warning: Failed to write checkpoint file %.400s",
+            scene->ckptfile);
+    rt_scene_ui_message(scene, MSG_0, msgtxt);
+  }
+
+  rt_timer_start(scene->ckpttimer);
+}
+
+
+/* all done, there's nothing left to resume */
+void checkpoint_remove(scenedef * scene) {
+  if (scene->ckptfile[0] != '\0' && scene->mynode == 0)
+    remove(scene->ckptfile);
+}
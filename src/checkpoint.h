@@ -0,0 +1,12 @@
+/*
+ * checkpoint.h - saving and resuming the progress of long renders
+ *
+ *  $Id$
+ */
+
+#define CKPT_FRAMEDONE -1   /* the frame was finished by an earlier run */
+
+int checkpoint_frames(scenedef * scene);
+int checkpoint_resume(scenedef * scene);
+void checkpoint_save(scenedef * scene, int frames, int bands, void * imgfile);
+void checkpoint_remove(scenedef * scene);
@@ -15,6 +15,7 @@
 #include "vector.h"
 #include "intersect.h"
 #include "util.h"
+#include "arena.h"
 
 #define CYLINDER_PRIVATE 
 #include "cylinder.h"
@@ -23,21 +24,23 @@ static object_methods cylinder_methods = {
   (void (*)(const void *, void *))(cylinder_intersect),
   (void (*)(const void *, const void *, const void *, void *))(cylinder_normal),
   cylinder_bbox, 
-  free 
+  arena_nofree,
+  RT_STATS_CYLINDER
 };
 
 static object_methods fcylinder_methods = {
   (void (*)(const void *, void *))(fcylinder_intersect),
   (void (*)(const void *, const void *, const void *, void *))(cylinder_normal),
   fcylinder_bbox, 
-  free 
+  arena_nofree,
+  RT_STATS_FCYLINDER
 };
 
 
-object * newcylinder(void * tex, vector ctr, vector axis, flt rad) {
+object * newcylinder(scenedef * scene, void * tex, vector ctr, vector axis, flt rad) {
   cylinder * c;
   
-  c=(cylinder *) malloc(sizeof(cylinder));
+  c=(cylinder *) scene_alloc(scene, sizeof(cylinder));
   memset(c, 0, sizeof(cylinder));
   c->methods = &cylinder_methods;
 
@@ -137,10 +140,10 @@ static void cylinder_normal(const cylinder * cyl, const vector * pnt, const ray
   }
 }
 
-object * newfcylinder(void * tex, vector ctr, vector axis, flt rad) {
+object * newfcylinder(scenedef * scene, void * tex, vector ctr, vector axis, flt rad) {
   cylinder * c;
   
-  c=(cylinder *) malloc(sizeof(cylinder));
+  c=(cylinder *) scene_alloc(scene, sizeof(cylinder));
   memset(c, 0, sizeof(cylinder));
   c->methods = &fcylinder_methods;
 
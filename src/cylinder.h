@@ -4,8 +4,8 @@
  *  $Id: cylinder.h,v 1.11 2011/02/05 08:10:11 johns Exp $
  */
 
-object * newcylinder(void *, vector, vector, flt);
-object * newfcylinder(void *, vector, vector, flt);
+object * newcylinder(scenedef *, void *, vector, vector, flt);
+object * newfcylinder(scenedef *, void *, vector, vector, flt);
 
 #ifdef CYLINDER_PRIVATE
 
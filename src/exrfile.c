@@ -0,0 +1,348 @@
+/*
+ *  exrfile.c - This file deals with OpenEXR format image files (writing)
+ *
+ *  $Id$
+ */
+
+/*
+ * Minimal OpenEXR writer that doesn't depend on the OpenEXR libraries.
+ * Images are written as uncompressed single-part scanline files with
+ * half-float R, G, and B channels, one scanline per block.  Since the
+ * blocks are uncompressed, every block has the same size and its file
+ * position can be computed directly, which lets us write the offset table
+ * up front and stream rows straight from the float framebuffer in any order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>  /* SSE2 intrinsics for the half-float conversion */
+#endif
+
+#define TACHYON_INTERNAL 1
+#include "tachyon.h"
+#include "util.h"
+#include "imageio.h" /* error codes etc */
+#include "exrfile.h"
+
+#define EXR_HEADER_MAXSZ 512  /**< plenty of room for our fixed attributes */
+#define EXR_PIXEL_HALF     1  /**< OpenEXR 16-bit half-float channel type   */
+
+typedef struct {
+  FILE * ofp;              /**< output file handle                   */
+  int xres;                /**< image width in pixels                */
+  int yres;                /**< image height in pixels               */
+  long dataofs;            /**< file offset of the first block       */
+  long blocksize;          /**< size of one scanline block in bytes  */
+  long filepos;            /**< current file position                */
+  unsigned short * hrow;   /**< half-float conversion buffer, 1 row  */
+  unsigned char * block;   /**< scanline block output buffer         */
+} exrhandle;
+
+
+/* convert a float to IEEE 754 half, with round-to-nearest-even */
+static unsigned short float_to_half(float fval) {
+  union { float f; unsigned int u; } f, denorm_magic;
+  unsigned int sign;
+  unsigned short h;
+
+  f.f = fval;
+  denorm_magic.u = ((127 - 15) + (23 - 10) + 1) << 23;
+  sign = f.u & 0x80000000u;
+  f.u ^= sign;
+
+  if (f.u >= ((127 + 16) << 23)) {
+    /* result is Inf or NaN, convert NaNs to quiet NaNs */
+    h = (f.u > (255 << 23)) ? 0x7e00 : 0x7c00;
+  } else if (f.u < (113 << 23)) {
+    /* result is subnormal or zero, let the FPU do the rounding */
+    f.f += denorm_magic.f;
+    h = (unsigned short) (f.u - denorm_magic.u);
+  } else {
+    unsigned int mant_odd = (f.u >> 13) & 1;
+    f.u += ((unsigned int) (15 - 127) << 23) + 0xfff; /* rebias, round */
+    f.u += mant_odd;
+    h = (unsigned short) (f.u >> 13);
+  }
+
+  return h | (unsigned short) (sign >> 16);
+}
+
+
+#if defined(__SSE2__)
+/* select a where the mask is set, and b elsewhere */
+static __m128i select_si128(__m128i mask, __m128i a, __m128i b) {
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/* 
+ * convert 4 floats to halfs, with the same integer rounding steps as
+ * float_to_half(), computing all three cases and selecting the right one
+ */
+static __m128i float_to_half4(__m128 fval) {
+  const __m128i denorm_magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+  __m128i f, sign, isnan, isregular, issub, infnan, sub, norm, h;
+
+  f = _mm_castps_si128(fval);
+  sign = _mm_and_si128(f, _mm_set1_epi32((int) 0x80000000u));
+  f = _mm_xor_si128(f, sign);
+
+  /* the sign is clear, so the signed compares work on the bit patterns */
+  isnan = _mm_cmpgt_epi32(f, _mm_set1_epi32(255 << 23));
+  isregular = _mm_cmpgt_epi32(_mm_set1_epi32((127 + 16) << 23), f);
+  issub = _mm_cmpgt_epi32(_mm_set1_epi32(113 << 23), f);
+
+  /* Inf or NaN, converting NaNs to quiet NaNs */
+  infnan = _mm_or_si128(_mm_and_si128(isnan, _mm_set1_epi32(0x0200)),
+                        _mm_set1_epi32(0x7c00));
+
+  /* subnormal or zero, letting the FPU do the rounding */
+  sub = _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(f), 
+                                    _mm_castsi128_ps(denorm_magic)));
+  sub = _mm_sub_epi32(sub, denorm_magic);
+
+  /* normal, rebias and round to nearest even */
+  norm = _mm_add_epi32(f, _mm_set1_epi32((int) (((unsigned int) (15 - 127) << 23) + 0xfff)));
+  norm = _mm_add_epi32(norm, _mm_and_si128(_mm_srli_epi32(f, 13), 
+                                           _mm_set1_epi32(1)));
+  norm = _mm_srli_epi32(norm, 13);
+
+  h = select_si128(isregular, select_si128(issub, sub, norm), infnan);
+  return _mm_or_si128(h, _mm_srli_epi32(sign, 16));
+}
+#endif
+
+
+/* convert an array of floats to halfs */
+static void float_to_half_array(int n, const float *f, unsigned short *h) {
+  int i=0;
+
+#if defined(__SSE2__)
+  for (; i<(n-7); i+=8) {
+    __m128i lo = float_to_half4(_mm_loadu_ps(f + i    ));
+    __m128i hi = float_to_half4(_mm_loadu_ps(f + i + 4));
+
+    /* sign extend the low 16 bits, so the saturating pack keeps them */
+    lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+    hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+    _mm_storeu_si128((__m128i *) (h + i), _mm_packs_epi32(lo, hi));
+  }
+#endif
+  for (; i<n; i++) {
+    h[i] = float_to_half(f[i]);
+  }
+}
+
+
+static unsigned char * put_int32(unsigned char *p, int val) {
+  p[0] = val & 0xff;
+  p[1] = (val >>  8) & 0xff;
+  p[2] = (val >> 16) & 0xff;
+  p[3] = (val >> 24) & 0xff;
+  return p + 4;
+}
+
+
+static unsigned char * put_float(unsigned char *p, float fval) {
+  union { float f; int i; } v;
+  v.f = fval;
+  return put_int32(p, v.i);
+}
+
+
+static unsigned char * put_string(unsigned char *p, const char *str) {
+  int len = strlen(str) + 1;
+  memcpy(p, str, len);
+  return p + len;
+}
+
+
+static unsigned char * put_attr(unsigned char *p, const char *name,
+                                const char *type, int size) {
+  p = put_string(p, name);
+  p = put_string(p, type);
+  return put_int32(p, size);
+}
+
+
+static unsigned char * put_channel(unsigned char *p, const char *name) {
+  p = put_string(p, name);
+  p = put_int32(p, EXR_PIXEL_HALF);  /* pixel type               */
+  *p++ = 0;                          /* pLinear                  */
+  *p++ = 0;                          /* reserved                 */
+  *p++ = 0;
+  *p++ = 0;
+  p = put_int32(p, 1);               /* x sampling               */
+  p = put_int32(p, 1);               /* y sampling               */
+  return p;
+}
+
+
+void * createexrfile(const char *name, int xres, int yres) {
+  unsigned char hdr[EXR_HEADER_MAXSZ];
+  unsigned char ofs[8];
+  unsigned char *p = hdr;
+  exrhandle * exr;
+  long blockpos;
+  int y, i;
+
+  exr = (exrhandle *) calloc(1, sizeof(exrhandle));
+  if (exr == NULL)
+    return NULL;
+
+  exr->ofp = fopen(name, "wb");
+  if (exr->ofp == NULL) {
+    free(exr);
+    return NULL;
+  }
+
+  exr->xres = xres;
+  exr->yres = yres;
+  exr->blocksize = 8 + 3L * 2L * xres; /* y, datasize, B, G, R */
+  exr->hrow = (unsigned short *) malloc(3 * xres * sizeof(unsigned short));
+  exr->block = (unsigned char *) malloc(exr->blocksize);
+  if (exr->hrow == NULL || exr->block == NULL) {
+    closeexrfile(exr);
+    return NULL;
+  }
+
+  p = put_int32(p, 20000630);        /* OpenEXR magic number     */
+  p = put_int32(p, 2);               /* version 2, scanline file */
+
+  /* channels must be listed in alphabetical order */
+  p = put_attr(p, "channels", "chlist", 3 * 18 + 1);
+  p = put_channel(p, "B");
+  p = put_channel(p, "G");
+  p = put_channel(p, "R");
+  *p++ = 0;
+
+  p = put_attr(p, "compression", "compression", 1);
+  *p++ = 0;                          /* NO_COMPRESSION           */
+
+  p = put_attr(p, "dataWindow", "box2i", 16);
+  p = put_int32(p, 0);
+  p = put_int32(p, 0);
+  p = put_int32(p, xres - 1);
+  p = put_int32(p, yres - 1);
+
+  p = put_attr(p, "displayWindow", "box2i", 16);
+  p = put_int32(p, 0);
+  p = put_int32(p, 0);
+  p = put_int32(p, xres - 1);
+  p = put_int32(p, yres - 1);
+
+  p = put_attr(p, "lineOrder", "lineOrder", 1);
+  *p++ = 0;                          /* INCREASING_Y             */
+
+  p = put_attr(p, "pixelAspectRatio", "float", 4);
+  p = put_float(p, 1.0f);
+
+  p = put_attr(p, "screenWindowCenter", "v2f", 8);
+  p = put_float(p, 0.0f);
+  p = put_float(p, 0.0f);
+
+  p = put_attr(p, "screenWindowWidth", "float", 4);
+  p = put_float(p, 1.0f);
+
+  *p++ = 0;                          /* end of header            */
+
+  exr->dataofs = (p - hdr) + 8L * yres;
+  if (fwrite(hdr, 1, p - hdr, exr->ofp) != (size_t) (p - hdr)) {
+    closeexrfile(exr);
+    return NULL;
+  }
+
+  /* all blocks are the same size, so the offset table is known up front */
+  for (y=0; y<yres; y++) {
+    blockpos = exr->dataofs + y * exr->blocksize;
+    for (i=0; i<8; i++) {
+      ofs[i] = (i < (int) sizeof(long)) ? ((blockpos >> (i*8)) & 0xff) : 0;
+    }
+    if (fwrite(ofs, 1, 8, exr->ofp) != 8) {
+      closeexrfile(exr);
+      return NULL;
+    }
+  }
+  exr->filepos = exr->dataofs;
+
+  return exr;
+}
+
+
+/*
+ * Write numrows rows of RGB96F pixels starting at image buffer row starty.
+ * Tachyon image buffers store the bottom row first, whereas OpenEXR
+ * stores the top row first, so rows are flipped on the way out.
+ */
+int writeexrregion(void * voidhandle, int starty, int numrows,
+                   const float *fimg) {
+  exrhandle * exr = (exrhandle *) voidhandle;
+  int xres = exr->xres;
+  int datasize = 3 * 2 * xres;
+  int row, x, c;
+
+  for (row=0; row<numrows; row++) {
+    const float *frow = fimg + 3L * xres * row;
+    int line = exr->yres - 1 - (starty + row);
+    long blockpos = exr->dataofs + line * exr->blocksize;
+    unsigned char *p = exr->block;
+
+    float_to_half_array(3 * xres, frow, exr->hrow);
+
+    p = put_int32(p, line);
+    p = put_int32(p, datasize);
+    for (c=2; c>=0; c--) {           /* B, G, R channel order    */
+      for (x=0; x<xres; x++) {
+        unsigned short h = exr->hrow[3*x + c];
+        *p++ = h & 0xff;
+        *p++ = (h >> 8) & 0xff;
+      }
+    }
+
+    if (blockpos != exr->filepos) {
+      if (fseek(exr->ofp, blockpos, SEEK_SET))
+        return IMAGEWRITEERR;
+    }
+    if (fwrite(exr->block, 1, exr->blocksize, exr->ofp) != exr->blocksize)
+      return IMAGEWRITEERR;
+    exr->filepos = blockpos + exr->blocksize;
+  }
+
+  return IMAGENOERR;
+}
+
+
+int closeexrfile(void * voidhandle) {
+  exrhandle * exr = (exrhandle *) voidhandle;
+  int rc = IMAGENOERR;
+
+  if (exr->ofp != NULL) {
+    if (fclose(exr->ofp))
+      rc = IMAGEWRITEERR;
+  }
+  free(exr->hrow);
+  free(exr->block);
+  free(exr);
+
+  return rc;
+}
+
+
+int writeexr(const char *name, int xres, int yres, const float *fimg) {
+  void * exr;
+  int rc;
+
+  exr = createexrfile(name, xres, yres);
+  if (exr == NULL)
+    return IMAGEBADFILE;
+
+  rc = writeexrregion(exr, 0, yres, fimg);
+  if (closeexrfile(exr) != IMAGENOERR)
+    rc = IMAGEWRITEERR;
+
+  return rc;
+}
+
@@ -0,0 +1,11 @@
+/*
+ *  exrfile.h - This file deals with OpenEXR format image files (writing)
+ *
+ *  $Id$
+ */
+
+void * createexrfile(const char *name, int xres, int yres);
+int writeexrregion(void * voidhandle, int starty, int numrows,
+                   const float *fimg);
+int closeexrfile(void * voidhandle);
+int writeexr(const char *name, int xres, int yres, const float *fimg);
@@ -37,7 +37,8 @@ static object_methods extvol_methods = {
   (void (*)(const void *, void *))(box_intersect),
   (void (*)(const void *, const void *, const void *, void *))(box_normal),
   extvol_bbox, 
-  free 
+  free,
+  RT_STATS_VOLUME
 };
 
 extvol * newextvol(void * voidtex, vector min, vector max, 
@@ -257,6 +258,7 @@ color ext_volume_texture(const vector * hit, const texture * tx, ray * ry) {
     }   
     else { 
       sum=1.0;
+      break; /* opacity has saturated, nothing further can contribute */
     }  
   }
 
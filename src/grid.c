@@ -18,6 +18,7 @@
 #include "util.h"
 #include "ui.h"
 #include "parallel.h"
+#include "arena.h"
 
 #define GRID_PRIVATE
 #include "grid.h"
@@ -31,14 +32,15 @@ static object_methods grid_methods = {
   (void (*)(const void *, void *))(grid_intersect),
   (void (*)(const void *, const void *, const void *, void *))(NULL),
   grid_bbox, 
-  grid_free 
+  arena_nofree,
+  RT_STATS_GRID
 };
 
 object * newgrid(scenedef * scene, int xsize, int ysize, int zsize, vector min, vector max) {
   grid * g;
   int numcells;
 
-  g = (grid *) malloc(sizeof(grid));
+  g = (grid *) scene_alloc(scene, sizeof(grid));
   memset(g, 0, sizeof(grid));  
 
   g->methods = &grid_methods;
@@ -58,7 +60,8 @@ object * newgrid(scenedef * scene, int xsize, int ysize, int zsize, vector min,
   g->voxsize.y /= (flt) g->ysize; 
   g->voxsize.z /= (flt) g->zsize; 
 
-  g->cells = (objectlist **) malloc(numcells * sizeof(objectlist *));
+  g->cells = (objectlist **) scene_alloc(scene, 
+                                         numcells * sizeof(objectlist *));
   memset(g->cells, 0, numcells * sizeof(objectlist *));
 
   return (object *) g;
@@ -73,33 +76,6 @@ static int grid_bbox(void * obj, vector * min, vector * max) {
   return 1;
 }
 
-static void grid_free(void * v) {
-  int i, numvoxels;
-  grid * g = (grid *) v;
-
-  /* loop through all voxels and free the object lists */
-  numvoxels = g->xsize * g->ysize * g->zsize; 
-  for (i=0; i<numvoxels; i++) {
-    objectlist * lcur;
-    objectlist * lnext;
-
-    lcur = g->cells[i];
-    while (lcur != NULL) {
-      lnext = lcur->next;
-      free(lcur);
-      lcur = lnext;
-    }
-  }
-
-  /* free the grid cells */ 
-  free(g->cells);
-
-  /* free all objects on the grid object list */
-  free_objects(g->objects);   
-
-  free(g);
-}
-
 static void globalbound(object ** rootlist, vector * gmin, vector * gmax) {
   vector min, max;
   object * cur;
@@ -207,12 +183,12 @@ static int countobj(object * root) {
   return numobj;
 }
 
-static void gridstats(int xs, int ys, int zs, int numobj) {
+static void gridstats(scenedef * scene, int xs, int ys, int zs, int numobj) {
   char t[256]; /* msgtxt */
   int numcells = xs*ys*zs; 
   sprintf(t, "Grid:  X:%3d  Y:%3d  Z:%3d  Cells:%9d  Obj:%9d  Obj/Cell: %7.3f",
           xs, ys, zs, numcells, numobj, ((float) numobj) / ((float) numcells));
-  rt_ui_message(MSG_0, t);
+  rt_scene_ui_message(scene, MSG_0, t);
 }
 
 int engrid_scene(scenedef * scene, int boundthresh) {
@@ -230,7 +206,7 @@ int engrid_scene(scenedef * scene, int boundthresh) {
 
   if (scene->mynode == 0) {
     sprintf(msgtxt, "Scene contains %d objects.", numobj);
-    rt_ui_message(MSG_0, msgtxt);
+    rt_scene_ui_message(scene, MSG_0, msgtxt);
   }
 
   if (numobj > boundthresh) {
@@ -241,23 +217,23 @@ int engrid_scene(scenedef * scene, int boundthresh) {
       char t[256]; /* msgtxt */
       sprintf(t, "Global bounds: %g %g %g -> %g %g %g", 
               gmin.x, gmin.y, gmin.z, gmax.x, gmax.y, gmax.z);  
-      rt_ui_message(MSG_0, t);
+      rt_scene_ui_message(scene, MSG_0, t);
 
       sprintf(t, "Creating top level grid: X:%d Y:%d Z:%d", 
               numcbrt, numcbrt, numcbrt);
-      rt_ui_message(MSG_0, t);
+      rt_scene_ui_message(scene, MSG_0, t);
     }
 
     g = (grid *) newgrid(scene, numcbrt, numcbrt, numcbrt, gmin, gmax);
-    numsucceeded = engrid_objlist(g, &scene->objgroup.boundedobj);
+    numsucceeded = engrid_objlist(scene, g, &scene->objgroup.boundedobj);
     if (scene->verbosemode && scene->mynode == 0)
-      gridstats(numcbrt, numcbrt, numcbrt, numsucceeded); 
+      gridstats(scene, numcbrt, numcbrt, numcbrt, numsucceeded); 
 
     if (scene->verbosemode && scene->mynode == 0) {
       char t[256]; /* msgtxt */
       numobj = countobj(scene->objgroup.boundedobj);
       sprintf(t, "Scene contains %d non-gridded objects\n", numobj);
-      rt_ui_message(MSG_0, t);
+      rt_scene_ui_message(scene, MSG_0, t);
     } 
 
     /* add this grid to the bounded object list removing the objects */
@@ -279,7 +255,7 @@ int engrid_scene(scenedef * scene, int boundthresh) {
 }
 
 
-static int engrid_objlist(grid * g, object ** list) {
+static int engrid_objlist(scenedef * scene, grid * g, object ** list) {
   object * cur, * next, **prev;
   int numsucceeded = 0;
 
@@ -292,7 +268,7 @@ static int engrid_objlist(grid * g, object ** list) {
   while (cur != NULL) {
     next = cur->nextobj;
 
-    if (engrid_object(g, cur, 1)) {
+    if (engrid_object(scene, g, cur, 1)) {
       *prev = next;
       numsucceeded++;
     } else {
@@ -340,12 +316,12 @@ static int engrid_cell(scenedef * scene, int boundthresh, grid * gold, gridindex
     if (zs < 1) zs = 1;
 
     g = (grid *) newgrid(scene, xs, ys, zs, gmin, gmax);
-    numsucceeded = engrid_objectlist(g, list);
+    numsucceeded = engrid_objectlist(scene, g, list);
 
     if (scene->verbosemode && scene->mynode == 0)
-      gridstats(xs, ys, zs, numsucceeded); 
+      gridstats(scene, xs, ys, zs, numsucceeded); 
 
-    newobj = (objectlist *) malloc(sizeof(objectlist));    
+    newobj = (objectlist *) scene_alloc(scene, sizeof(objectlist));
     newobj->obj = (object *) g;
     newobj->next = *list;
     *list = newobj;
@@ -357,7 +333,8 @@ static int engrid_cell(scenedef * scene, int boundthresh, grid * gold, gridindex
   return 1;
 }
 
-static int engrid_objectlist(grid * g, objectlist ** list) {
+/* list entries for engridded objects are dropped, they go with the arena */
+static int engrid_objectlist(scenedef * scene, grid * g, objectlist ** list) {
   objectlist * cur, * next, **prev;
   int numsucceeded = 0; 
 
@@ -370,9 +347,8 @@ static int engrid_objectlist(grid * g, objectlist ** list) {
   while (cur != NULL) {
     next = cur->next;
 
-    if (engrid_object(g, cur->obj, 0)) {
+    if (engrid_object(scene, g, cur->obj, 0)) {
       *prev = next;
-      free(cur);
       numsucceeded++;
     } else {
       prev = &cur->next;
@@ -385,7 +361,7 @@ static int engrid_objectlist(grid * g, objectlist ** list) {
 }
 
 
-static int engrid_object(grid * g, object * obj, int addtolist) {
+static int engrid_object(scenedef * scene, grid * g, object * obj, int addtolist) {
   vector omin, omax; 
   gridindex low, high;
   int x, y, z, zindex, yindex, voxindex;
@@ -428,7 +404,7 @@ static int engrid_object(grid * g, object * obj, int addtolist) {
       yindex = y * g->xsize;
       for (x=low.x; x<=high.x; x++) {
         voxindex = x + yindex + zindex; 
-        tmp = (objectlist *) malloc(sizeof(objectlist));
+        tmp = (objectlist *) scene_alloc(scene, sizeof(objectlist));
         tmp->next = g->cells[voxindex];
         tmp->obj = obj;
         g->cells[voxindex] = tmp;
@@ -466,6 +442,162 @@ static int pos2grid(grid * g, vector * pos, gridindex * index) {
 }
 
 
+/*
+ * Allocate the mailbox for one worker thread, either an array with an
+ * entry per object, or a hashed table of constant size, depending on
+ * the scene's mailbox mode and size.
+ */
+void grid_mbox_alloc(const scenedef * scene, unsigned long ** mbox,
+                     mboxentry ** hashmbox) {
+  *mbox = NULL;
+  *hashmbox = NULL;
+
+#if !defined(DISABLEMBOX)
+  /* the sizes of these arrays are padded to avoid cache aliasing */
+  /* and false sharing between threads.                           */
+  if (scene->mboxmode == RT_MBOX_HASHED ||
+      (scene->mboxmode == RT_MBOX_AUTO && 
+       scene->objgroup.numobjects > MBOX_AUTOLIMIT)) {
+    *hashmbox = (mboxentry *) calloc(sizeof(mboxentry)*MBOX_HASHSIZE + 32, 1);
+  } else {
+    *mbox = (unsigned long *) 
+      calloc(sizeof(unsigned long)*scene->objgroup.numobjects + 32, 1);
+  }
+#endif
+}
+
+
+/* clear a thread's mailbox, when its ray serial numbers start over */
+void grid_mbox_clear(const scenedef * scene, unsigned long * mbox,
+                     mboxentry * hashmbox) {
+  if (mbox != NULL)
+    memset(mbox, 0, sizeof(unsigned long)*scene->objgroup.numobjects);
+  if (hashmbox != NULL)
+    memset(hashmbox, 0, sizeof(mboxentry)*MBOX_HASHSIZE);
+}
+
+
+/* call a function for each grid in a list of objects, and their subgrids */
+static void grid_walk(object * list, void (* fn)(scenedef *, grid *, int),
+                      scenedef * scene, int node) {
+  object * cur;
+
+  for (cur = list; cur != NULL; cur = cur->nextobj) {
+    if (cur->methods == &grid_methods) {
+      fn(scene, (grid *) cur, node);
+      grid_walk(((grid *) cur)->objects, fn, scene, node);
+    }
+  }
+}
+
+
+static void grid_numa_initone(scenedef * scene, grid * g, int node) {
+  g->nodecells = (objectlist ***) 
+    calloc(scene->numanodes, sizeof(objectlist **));
+}
+
+
+/*
+ * Copy a grid's cells and their object lists into one block, which is 
+ * allocated and filled by a thread running on the given NUMA node, so 
+ * that the pages are placed on that node's memory.
+ */
+static void grid_numa_replicateone(scenedef * scene, grid * g, int node) {
+  int i, numcells, numentries;
+  objectlist ** cells, * entry, * cur, ** prev;
+
+  if (g->nodecells == NULL || g->nodecells[node] != NULL)
+    return;
+
+  numcells = g->xsize * g->ysize * g->zsize;
+  numentries = 0;
+  for (i=0; i<numcells; i++) {
+    for (cur = g->cells[i]; cur != NULL; cur = cur->next)
+      numentries++;
+  }
+
+  cells = (objectlist **) malloc(numcells * sizeof(objectlist *) +
+                                 numentries * sizeof(objectlist));
+  if (cells == NULL)
+    return; /* this node just uses the original cells */
+
+  entry = (objectlist *) (cells + numcells);
+  for (i=0; i<numcells; i++) {
+    prev = &cells[i];
+    for (cur = g->cells[i]; cur != NULL; cur = cur->next) {
+      entry->obj = cur->obj;
+      *prev = entry;
+      prev = &entry->next;
+      entry++;
+    }
+    *prev = NULL;
+  }
+
+  g->nodecells[node] = cells;
+}
+
+
+static void grid_numa_freeone(scenedef * scene, grid * g, int node) {
+  int i;
+
+  if (g->nodecells == NULL)
+    return;
+
+  for (i=0; i<scene->numanodes; i++) {
+    if (g->nodecells[i] != NULL)
+      free(g->nodecells[i]);
+  }
+  free(g->nodecells);
+  g->nodecells = NULL;
+}
+
+
+/* make room for per-node copies of all grids, filled in by the threads */
+void grid_numa_init(scenedef * scene, int numnodes) {
+  scene->numanodes = numnodes;
+  grid_walk(scene->objgroup.boundedobj, grid_numa_initone, scene, 0);
+}
+
+
+/* copy all grids for one NUMA node, called by a thread on that node */
+void grid_numa_replicate(scenedef * scene, int node) {
+  grid_walk(scene->objgroup.boundedobj, grid_numa_replicateone, scene, node);
+}
+
+
+void grid_numa_free(scenedef * scene) {
+  if (scene->numanodes == 0)
+    return;
+  grid_walk(scene->objgroup.boundedobj, grid_numa_freeone, scene, 0);
+  scene->numanodes = 0;
+}
+
+
+#if !defined(DISABLEMBOX)
+/*
+ * Check whether an object still needs testing against the current ray, and
+ * mark it as tested.  A hashed mailbox slot only remembers the last object
+ * that mapped to it, so a collision costs a redundant test, never a miss.
+ */
+static int mbox_untested(unsigned long * mbox, mboxentry * hashmbox,
+                         unsigned long id, unsigned long serial) {
+  if (hashmbox != NULL) {
+    mboxentry * slot = &hashmbox[id & (MBOX_HASHSIZE - 1)];
+    if (slot->serial == serial && slot->id == id)
+      return 0;
+    slot->serial = serial;
+    slot->id = id;
+    return 1;
+  }
+
+  if (mbox[id] == serial)
+    return 0;
+  mbox[id] = serial;
+  return 1;
+}
+#endif
+
+
 /* the real thing */
 static void grid_intersect(const grid * g, ray * ry) {
   flt tnear, tfar;
@@ -475,8 +607,10 @@ static void grid_intersect(const grid * g, ray * ry) {
   unsigned long serial;
 #if !defined(DISABLEMBOX)
   unsigned long * mbox;
+  mboxentry * hashmbox;
 #endif
-  objectlist * cur;
+  objectlist * cur, ** cells;
+  rt_render_stats * stats = ry->stats;
 
   if (ry->flags & RT_RAY_FINISHED)
     return;
@@ -487,9 +621,16 @@ static void grid_intersect(const grid * g, ray * ry) {
   if (ry->maxdist < tnear)
     return;
   
+  /* use this thread's NUMA node copy of the cells, if there is one */
+  cells = g->cells;
+  if (ry->numanode >= 0 && g->nodecells != NULL && 
+      g->nodecells[ry->numanode] != NULL)
+    cells = g->nodecells[ry->numanode];
+
   serial=ry->serial;
 #if !defined(DISABLEMBOX)
   mbox=ry->mbox;
+  hashmbox=ry->hashmbox;
 #endif
 
   /* find the entry point in the grid from the near hit */ 
@@ -568,14 +709,19 @@ static void grid_intersect(const grid * g, ray * ry) {
 
   /* Unrolled while loop by one... */
   /* Test all objects in the current cell for intersection */
-  cur = g->cells[voxindex];
+  cur = cells[voxindex];
+  if (stats != NULL) 
+    stats->gridcells++;
   while (cur != NULL) {
 #if !defined(DISABLEMBOX)
-    if (mbox[cur->obj->id] != serial) {
-      mbox[cur->obj->id] = serial; 
+    if (mbox_untested(mbox, hashmbox, cur->obj->id, serial)) {
+      RT_STAT_TEST(ry, cur->obj);
       cur->obj->methods->intersect(cur->obj, ry);
+    } else if (stats != NULL) {
+      stats->mailboxrejects++;
     }
 #else
+    RT_STAT_TEST(ry, cur->obj);
     cur->obj->methods->intersect(cur->obj, ry);
 #endif
     cur = cur->next;
@@ -607,14 +753,19 @@ static void grid_intersect(const grid * g, ray * ry) {
     }
 
     /* Test all objects in the current cell for intersection */
-    cur = g->cells[voxindex];
+    cur = cells[voxindex];
+    if (stats != NULL) 
+      stats->gridcells++;
     while (cur != NULL) {
 #if !defined(DISABLEMBOX)
-      if (mbox[cur->obj->id] != serial) {
-        mbox[cur->obj->id] = serial; 
+      if (mbox_untested(mbox, hashmbox, cur->obj->id, serial)) {
+        RT_STAT_TEST(ry, cur->obj);
         cur->obj->methods->intersect(cur->obj, ry);
+      } else if (stats != NULL) {
+        stats->mailboxrejects++;
       }
 #else
+      RT_STAT_TEST(ry, cur->obj);
       cur->obj->methods->intersect(cur->obj, ry);
 #endif
       cur = cur->next;
@@ -624,6 +775,16 @@ static void grid_intersect(const grid * g, ray * ry) {
 
 
 
+/*
+ * Test a ray against the bounding box of a grid object on its own, 
+ * without traversing the grid, for the intersection microbenchmarks.
+ */
+int grid_bounds_test(const object * obj, const ray * ry, 
+                     flt * hitnear, flt * hitfar) {
+  return grid_bounds_intersect((const grid *) obj, ry, hitnear, hitfar);
+}
+
+
 static int grid_bounds_intersect(const grid * g, const ray * ry, flt *hitnear, flt *hitfar) {
   flt a, tx1, tx2, ty1, ty2, tz1, tz2;
   flt tnear, tfar;
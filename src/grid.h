@@ -8,6 +8,15 @@
 int engrid_scene(scenedef * scene, int boundthresh);
 object * newgrid(scenedef * scene, int xsize, int ysize, int zsize, 
                  vector min, vector max);
+int grid_bounds_test(const object * obj, const ray * ry, 
+                     flt * hitnear, flt * hitfar);
+void grid_mbox_alloc(const scenedef * scene, unsigned long ** mbox,
+                     mboxentry ** hashmbox);
+void grid_mbox_clear(const scenedef * scene, unsigned long * mbox,
+                     mboxentry * hashmbox);
+void grid_numa_init(scenedef * scene, int numnodes);
+void grid_numa_replicate(scenedef * scene, int node);
+void grid_numa_free(scenedef * scene);
 
 #ifdef GRID_PRIVATE
 
@@ -26,6 +35,7 @@ typedef struct {
   vector voxsize;      /**< the size of a grid cell/voxel */
   object * objects;    /**< all objects contained in the grid */
   objectlist ** cells; /**< the grid cells themselves */
+  objectlist *** nodecells; /**< copies of the cells per NUMA node, or NULL */
 } grid;
 
 typedef struct {
@@ -49,16 +59,15 @@ typedef struct {
 #define z2voxel(g,z)            (((z) - g->min.z) / g->voxsize.z)
 
 
-static void gridstats(int xs, int ys, int zs, int numobj);
+static void gridstats(scenedef *, int xs, int ys, int zs, int numobj);
 static int grid_bbox(void * obj, vector * min, vector * max);
-static void grid_free(void * v);
 
 static int cellbound(const grid *g, const gridindex *index, vector * cmin, vector * cmax);
 
-static int engrid_objlist(grid * g, object ** list);
-static int engrid_object(grid * g, object * obj, int addtolist);
+static int engrid_objlist(scenedef *, grid * g, object ** list);
+static int engrid_object(scenedef *, grid * g, object * obj, int addtolist);
 
-static int engrid_objectlist(grid * g, objectlist ** list);
+static int engrid_objectlist(scenedef *, grid * g, objectlist ** list);
 static int engrid_cell(scenedef *, int, grid *, gridindex *);
 
 static int pos2grid(grid * g, vector * pos, gridindex * index);
@@ -20,6 +20,7 @@
 #include "imageio.h"
 #include "ppm.h"     /* 24-bit and 48-bit PPM files */
 #include "psd.h"     /* 24-bit and 48-bit Photoshop files */
+#include "exrfile.h" /* 48-bit half-float OpenEXR files */
 #include "tgafile.h" /* 24-bit Truevision Targa files */
 #include "jpeg.h"    /* JPEG files */
 #include "pngfile.h" /* PNG files  */
@@ -60,8 +61,14 @@ int readimage(rawimage * img) {
   yres=1;
   zres=1;
 
+  img->mapaddr = NULL;
+  img->maplen = 0;
+
   if (strstr(name, ".ppm")) { 
-    rc = readppm(name, &xres, &yres, &imgdata);
+    /* map uncompressed PPM pixels straight from the file when possible */
+    rc = mapppm(name, &xres, &yres, &imgdata, &img->mapaddr, &img->maplen);
+    if (rc != IMAGENOERR)
+      rc = readppm(name, &xres, &yres, &imgdata);
   } else if (strstr(name, ".tga")) {
     rc = readtga(name, &xres, &yres, &imgdata);
   } else if (strstr(name, ".jpg")) {
@@ -241,6 +248,59 @@ unsigned char * image_crop_rgb24(int xres, int yres, unsigned char *img,
 }
 
 
+/*
+ * Map per-pixel costs to colors running from blue through cyan, green,
+ * and yellow to red, on a log scale so that a few very expensive pixels
+ * don't wash out the rest of the image.
+ */
+unsigned char * image_rgb24_from_costmap(int xres, int yres, 
+                                         const unsigned int *cost,
+                                         unsigned int *maxcost, 
+                                         double *meancost) {
+  unsigned char *img;
+  double sum, scale;
+  unsigned int maxc;
+  int i, sz;
+
+  sz = xres * yres;
+  img = (unsigned char *) malloc(sz * 3);
+  if (img == NULL)
+    return NULL;
+
+  maxc = 0;
+  sum = 0.0;
+  for (i=0; i<sz; i++) {
+    if (cost[i] > maxc)
+      maxc = cost[i];
+    sum += cost[i];
+  }
+  *maxcost = maxc;
+  *meancost = (sz > 0) ? sum / sz : 0.0;
+
+  scale = (maxc > 0) ? 1.0 / log(1.0 + maxc) : 0.0;
+  for (i=0; i<sz; i++) {
+    float t = (float) (4.0 * log(1.0 + cost[i]) * scale);
+    float R, G, B;
+
+    if (t < 1.0f) {          /* blue to cyan    */
+      R = 0.0f; G = t;        B = 1.0f;
+    } else if (t < 2.0f) {   /* cyan to green   */
+      R = 0.0f; G = 1.0f;     B = 2.0f - t;
+    } else if (t < 3.0f) {   /* green to yellow */
+      R = t - 2.0f; G = 1.0f; B = 0.0f;
+    } else {                 /* yellow to red   */
+      R = 1.0f; G = (t < 4.0f) ? 4.0f - t : 0.0f; B = 0.0f;
+    }
+
+    img[i*3    ] = (unsigned char) (R * 255.0f);
+    img[i*3 + 1] = (unsigned char) (G * 255.0f);
+    img[i*3 + 2] = (unsigned char) (B * 255.0f);
+  }
+
+  return img;
+}
+
+
 unsigned char * image_rgb48be_from_rgb96f(int xres, int yres, float *fimg) { 
   int x, y, R, G, B;
   unsigned char *img = (unsigned char *) malloc(xres * yres * 6);
@@ -398,6 +458,12 @@ int writeimage(char * name, int xres, int yres, void *img,
         free(imgbuf);
         return rc;   
 
+      case RT_FORMAT_PFM:
+        return writepfm(name, xres, yres, (float *) img);
+
+      case RT_FORMAT_EXR:
+        return writeexr(name, xres, yres, (float *) img);
+
       default:
         printf("Unsupported image format combination\n");
         return IMAGEUNSUP;
@@ -406,3 +472,132 @@ int writeimage(char * name, int xres, int yres, void *img,
 }
 
 
+
+
+/*
+ * Image files written a band of rows at a time, for tiled rendering of
+ * images too large to hold in memory.  Only the uncompressed formats with
+ * a fixed layout can be written this way, so other formats are written
+ * as the closest one of those.  When resuming, an existing file is opened
+ * and only the bands that are written again are changed.
+ */
+typedef struct {
+  int xres;
+  int imgbufferformat;
+  int fileformat;
+  void * file;
+} imagebands;
+
+int imagebands_format(int xres, int yres, int imgbufferformat, int fileformat) {
+  int hdr = (imgbufferformat == RT_IMAGE_BUFFER_RGB96F);
+
+  switch (fileformat) {
+    case RT_FORMAT_TARGA:
+      /* the Targa header only has 16 bits for the image size */
+      if (xres <= 65535 && yres <= 65535)
+        return RT_FORMAT_TARGA;
+      return RT_FORMAT_PPM;
+
+    case RT_FORMAT_PPM48:
+    case RT_FORMAT_PSD48:
+      return (hdr) ? RT_FORMAT_PPM48 : RT_FORMAT_PPM;
+
+    case RT_FORMAT_PFM:
+    case RT_FORMAT_EXR:
+      return (hdr) ? RT_FORMAT_PFM : RT_FORMAT_PPM;
+
+    default:
+      return RT_FORMAT_PPM;
+  }
+}
+
+void * openimagebands(char * name, int xres, int yres, 
+                      int imgbufferformat, int fileformat, int resume) {
+  imagebands * ib;
+
+  /* there's nothing to resume if the file isn't there */
+  if (resume) {
+    FILE * fp = fopen(name, "r+b");
+    if (fp == NULL)
+      return NULL;
+    fclose(fp);
+  }
+
+  ib = (imagebands *) malloc(sizeof(imagebands));
+  if (ib == NULL)
+    return NULL;
+
+  ib->xres = xres;
+  ib->imgbufferformat = imgbufferformat;
+  ib->fileformat = imagebands_format(xres, yres, imgbufferformat, fileformat);
+
+  if (ib->fileformat == RT_FORMAT_TARGA) {
+    ib->file = NULL;
+    if (resume || createtgafile(name, xres, yres) == IMAGENOERR)
+      ib->file = opentgafile(name);
+  } else {
+    ib->file = openppmbands(name, xres, yres, ib->fileformat, resume);
+  }
+
+  if (ib->file == NULL) {
+    free(ib);
+    return NULL;
+  }
+
+  return ib;
+}
+
+/*
+ * Write a band of rows from an image buffer, where starty is the index
+ * of the band's first row in the image, counting from 0 at the bottom.
+ */
+int writeimageband(void * voidhandle, int starty, int numrows, void * img) {
+  imagebands * ib = (imagebands *) voidhandle;
+  unsigned char * imgbuf = (unsigned char *) img;
+  int rc = IMAGENOERR;
+
+  if (ib->imgbufferformat == RT_IMAGE_BUFFER_RGB96F) {
+    if (ib->fileformat == RT_FORMAT_PPM48)
+      imgbuf = image_rgb48be_from_rgb96f(ib->xres, numrows, (float *) img);
+    else if (ib->fileformat != RT_FORMAT_PFM)
+      imgbuf = image_rgb24_from_rgb96f(ib->xres, numrows, (float *) img);
+    if (imgbuf == NULL)
+      return IMAGEALLOCERR;
+  }
+
+  if (ib->fileformat == RT_FORMAT_TARGA)
+    rc = writetgaregion(ib->file, 1, starty + 1, ib->xres, starty + numrows, 
+                        imgbuf);
+  else
+    rc = writeppmband(ib->file, starty, numrows, imgbuf);
+
+  if (imgbuf != (unsigned char *) img)
+    free(imgbuf);
+
+  return rc;
+}
+
+/*
+ * Make sure the bands written so far are in the file, not just buffered.
+ */
+int flushimagebands(void * voidhandle) {
+  imagebands * ib = (imagebands *) voidhandle;
+
+  if (ib->fileformat == RT_FORMAT_TARGA)
+    return flushtgafile(ib->file);
+
+  return flushppmbands(ib->file);
+}
+
+int closeimagebands(void * voidhandle) {
+  imagebands * ib = (imagebands *) voidhandle;
+  int rc = IMAGENOERR;
+
+  if (ib->fileformat == RT_FORMAT_TARGA)
+    rc = closetgafile(ib->file);
+  else
+    rc = closeppmbands(ib->file);
+  free(ib);
+
+  return rc;
+}
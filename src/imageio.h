@@ -18,6 +18,12 @@
 int readimage(rawimage *);
 int writeimage(char * name, int xres, int yres, 
                void *imgdata, int imgbufferformat, int fileformat);
+int imagebands_format(int xres, int yres, int imgbufferformat, int fileformat);
+void * openimagebands(char * name, int xres, int yres, 
+                      int imgbufferformat, int fileformat, int resume);
+int writeimageband(void * voidhandle, int starty, int numrows, void * img);
+int flushimagebands(void * voidhandle);
+int closeimagebands(void * voidhandle);
 void minmax_rgb96f(int xres, int yres, const float *fimg, 
                    float *min, float *max);
 void normalize_rgb96f(int xres, int yres, float *fimg);
@@ -28,3 +34,7 @@ float * image_crop_rgb96f(int xres, int yres, float *fimg,
                           int szx, int szy, int sx, int sy);
 unsigned char * image_crop_rgb24(int xres, int yres, unsigned char *img,
                                  int szx, int szy, int sx, int sy);
+unsigned char * image_rgb24_from_costmap(int xres, int yres, 
+                                         const unsigned int *cost,
+                                         unsigned int *maxcost, 
+                                         double *meancost);
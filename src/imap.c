@@ -9,106 +9,328 @@
 #include <string.h>
 #include <math.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>  /* SSE2 intrinsics for the decimation filter */
+#endif
+
 #define TACHYON_INTERNAL 1
 #include "tachyon.h"
 #include "imap.h"
+#include "brick.h"
 #include "util.h"
 #include "parallel.h"
+#include "threads.h"
 #include "imageio.h"
 #include "ui.h"
 
-/* XXX globals that must be eliminated! */
-rawimage * imagelist[MAXIMGS];
-int numimages;
+/* decimate in parallel only when the output level is at least this big */
+#define MIP_PARALLEL_MINPIXELS (256 * 256)
+#define MIP_ROWS_PER_TILE      16
 
-void ResetImages(void) {
-  int i;
-  numimages=0;
-  for (i=0; i<MAXIMGS; i++) {
-    imagelist[i]=NULL;
+/*
+ * Image caches.  Each scene keeps a table of the images its textures 
+ * use, indexed by a hash of the image name, so an image map used by 
+ * many textures is loaded and MIP mapped once, and scenes never share
+ * image state.  Images defined with rt_define_teximage_rgb24(), which 
+ * doesn't take a scene, go into a process wide table that is searched
+ * when a scene's own table doesn't have an image, and which is emptied
+ * when the last scene is deleted.  Tables are kept at most half full.
+ */
+#define IMGCACHE_MINSIZE 64
+
+typedef struct {
+  rt_mutex_t lock;          /* serializes threads using the cache     */
+  int size;                 /* number of slots, a power of two        */
+  int count;                /* number of images in the table          */
+  rawimage ** imgs;         /* images, or NULL                        */
+  unsigned int * hashes;    /* hash of each image's name              */
+  list * retired;           /* redefined images, maybe still in use   */
+  int users;                /* live scenes, for the process table     */
+} imagecache;
+
+static imagecache * defimages = NULL;  /* images defined without a scene */
+
+/* FNV-1a hash of an image name */
+static unsigned int name_hash(const char * name) {
+  unsigned int h = 2166136261U;
+
+  while (*name != '\0') {
+    h ^= (unsigned char) *name++;
+    h *= 16777619U;
   }
+
+  return h;
 }
 
-void FreeImages(void) {
-  int i; 
-  for (i=0; i<numimages; i++) {
-    DeallocateImage(imagelist[i]);
+/* FNV-1a hash of image contents, never 0, which marks file images */
+static unsigned int data_hash(const unsigned char * data, size_t len) {
+  unsigned int h = 2166136261U;
+  size_t i;
+
+  for (i=0; i<len; i++) {
+    h ^= data[i];
+    h *= 16777619U;
   }
-  ResetImages();
+
+  return (h != 0) ? h : 1;
 }
 
-void LoadRawImage(rawimage * image) {
-  if (!image->loaded) {
-    readimage(image);
-    image->loaded=1;
+void * NewImageCache(void) {
+  imagecache * c;
+
+  c = (imagecache *) calloc(1, sizeof(imagecache));
+  if (c == NULL)
+    return NULL;
+
+  c->size = IMGCACHE_MINSIZE;
+  c->imgs = (rawimage **) calloc(c->size, sizeof(rawimage *));
+  c->hashes = (unsigned int *) calloc(c->size, sizeof(unsigned int));
+  if (c->imgs == NULL || c->hashes == NULL) {
+    free(c->imgs);
+    free(c->hashes);
+    free(c);
+    return NULL;
   }
+  rt_mutex_init(&c->lock);
+
+  return c;
 }
 
-rawimage * AllocateImageRGB24(const char * filename, int xs, int ys, int zs, unsigned char * rgb) {
-  rawimage * newimage = NULL;
-  int i, len, intable;
-
-  intable=0;
-  if (numimages!=0) {
-    for (i=0; i<numimages; i++) {
-      if (!strcmp(filename, imagelist[i]->name)) {
-        newimage=imagelist[i];
-        intable=1;
-      }
+/* free all images in a cache, leaving it empty */
+static void cache_clear(imagecache * c) {
+  list * cur, * next;
+  int i;
+
+  for (i=0; i<c->size; i++) {
+    if (c->imgs[i] != NULL) {
+      DeallocateImage(c->imgs[i]);
+      c->imgs[i] = NULL;
     }
   }
+  c->count = 0;
+
+  cur = c->retired;
+  while (cur != NULL) {
+    next = cur->next;
+    DeallocateImage((rawimage *) cur->item);
+    free(cur);
+    cur = next;
+  }
+  c->retired = NULL;
+}
 
-  if (!intable) {
-    newimage=malloc(sizeof(rawimage));
-    newimage->loaded=1;
-    newimage->xres=xs;
-    newimage->yres=ys;
-    newimage->zres=zs;
-    newimage->bpp=3;
-    newimage->data=rgb;
-    len=strlen(filename);
-    if (len > 80) 
-      return NULL;
-    strcpy(newimage->name, filename);
+void FreeImageCache(void * voidcache) {
+  imagecache * c = (imagecache *) voidcache;
+
+  if (c == NULL)
+    return;
 
-    imagelist[numimages]=newimage;  /* add new one to the table       */ 
-    numimages++;                    /* increment the number of images */
+  cache_clear(c);
+  rt_mutex_destroy(&c->lock);
+  free(c->imgs);
+  free(c->hashes);
+  free(c);
+}
+
+/* find the slot holding the named image, or the empty slot for it */
+static int cache_slot(const imagecache * c, const char * name, unsigned int h) {
+  int mask = c->size - 1;
+  int i = h & mask;
+
+  while (c->imgs[i] != NULL) {
+    if (c->hashes[i] == h && !strcmp(c->imgs[i]->name, name))
+      break;
+    i = (i + 1) & mask;
   }
- 
-  return newimage;
+
+  return i;
 }
 
-rawimage * AllocateImageFile(const char * filename) { 
-  rawimage * newimage = NULL;
-  int i, len, intable;
-
-  intable=0;
-  if (numimages!=0) {
-    for (i=0; i<numimages; i++) {
-      if (!strcmp(filename, imagelist[i]->name)) {
-        newimage=imagelist[i];
-        intable=1;
-      }
+/* double the table size, returns 0 if out of memory */
+static int cache_grow(imagecache * c) {
+  rawimage ** oldimgs = c->imgs;
+  unsigned int * oldhashes = c->hashes;
+  int oldsize = c->size;
+  int i;
+
+  c->imgs = (rawimage **) calloc(oldsize * 2, sizeof(rawimage *));
+  c->hashes = (unsigned int *) calloc(oldsize * 2, sizeof(unsigned int));
+  if (c->imgs == NULL || c->hashes == NULL) {
+    free(c->imgs);
+    free(c->hashes);
+    c->imgs = oldimgs;
+    c->hashes = oldhashes;
+    return 0;
+  }
+  c->size = oldsize * 2;
+
+  for (i=0; i<oldsize; i++) {
+    if (oldimgs[i] != NULL) {
+      int slot = cache_slot(c, oldimgs[i]->name, oldhashes[i]);
+      c->imgs[slot] = oldimgs[i];
+      c->hashes[slot] = oldhashes[i];
     }
   }
 
-  if (!intable) {
-    newimage=malloc(sizeof(rawimage));
-    newimage->loaded=0;
-    newimage->xres=0;
-    newimage->yres=0;
-    newimage->zres=0;
-    newimage->bpp=0;
-    newimage->data=NULL;
-    len=strlen(filename);
-    if (len > 80) 
+  free(oldimgs);
+  free(oldhashes);
+
+  return 1;
+}
+
+/* add an image that isn't in the table yet, returns 0 if out of memory */
+static int cache_insert(imagecache * c, rawimage * img, unsigned int h) {
+  int slot;
+
+  if ((c->count + 1) * 2 > c->size && !cache_grow(c))
+    return 0;
+
+  slot = cache_slot(c, img->name, h);
+  c->imgs[slot] = img;
+  c->hashes[slot] = h;
+  c->count++;
+
+  return 1;
+}
+
+/* replace the image in a slot, keeping the old one until the cache goes */
+static int cache_replace(imagecache * c, int slot, rawimage * img) {
+  list * lst;
+
+  lst = (list *) malloc(sizeof(list));
+  if (lst == NULL)
+    return 0;
+
+  lst->item = c->imgs[slot];
+  lst->next = c->retired;
+  c->retired = lst;
+  c->imgs[slot] = img;
+
+  return 1;
+}
+
+static rawimage * new_named_image(const char * name) {
+  rawimage * newimage;
+
+  newimage = (rawimage *) calloc(1, sizeof(rawimage));
+  if (newimage == NULL)
+    return NULL;
+
+  newimage->name = (char *) malloc(strlen(name) + 1);
+  if (newimage->name == NULL) {
+    free(newimage);
+    return NULL;
+  }
+  strcpy(newimage->name, name);
+
+  return newimage;
+}
+
+/* create the process wide table for images defined without a scene */
+void InitImages(void) {
+  if (defimages == NULL)
+    defimages = (imagecache *) NewImageCache();
+}
+
+void FreeImages(void) {
+  FreeImageCache(defimages);
+  defimages = NULL;
+}
+
+/* called when a scene is created */
+void RetainImages(void) {
+  InitImages();
+  if (defimages == NULL)
+    return;
+
+  rt_mutex_lock(&defimages->lock);
+  defimages->users++;
+  rt_mutex_unlock(&defimages->lock);
+}
+
+/* 
+ * Called when a scene is destroyed.  Images defined without a scene are
+ * freed along with the last scene that could have used them.
+ */
+void ReleaseImages(void) {
+  if (defimages == NULL)
+    return;
+
+  rt_mutex_lock(&defimages->lock);
+  defimages->users--;
+  if (defimages->users <= 0) {
+    defimages->users = 0;
+    cache_clear(defimages);
+  }
+  rt_mutex_unlock(&defimages->lock);
+}
+
+void LoadRawImage(rawimage * image) {
+  if (!image->loaded) {
+    readimage(image);
+    image->loaded=1;
+  }
+}
+
+/*
+ * Define an image from an RGB buffer, which then belongs to the cache.
+ * A NULL cache selects the process wide table.  Redefining an image 
+ * with identical contents keeps the existing one, while new contents 
+ * replace it for textures created from then on.
+ */
+rawimage * AllocateImageRGB24(void * voidcache, const char * filename, 
+                              int xs, int ys, int zs, unsigned char * rgb) {
+  imagecache * c = (imagecache *) voidcache;
+  rawimage * oldimage, * newimage;
+  unsigned int h, dh;
+  int slot, rc;
+
+  if (c == NULL) {
+    InitImages();
+    c = defimages;
+    if (c == NULL)
       return NULL;
-    strcpy(newimage->name, filename);
+  }
 
-    imagelist[numimages]=newimage;  /* add new one to the table       */ 
-    numimages++;                    /* increment the number of images */
+  h = name_hash(filename);
+  dh = data_hash(rgb, ((size_t) xs) * ys * zs * 3);
+
+  rt_mutex_lock(&c->lock);
+  slot = cache_slot(c, filename, h);
+  oldimage = c->imgs[slot];
+  if (oldimage != NULL && oldimage->datahash == dh &&
+      oldimage->xres == xs && oldimage->yres == ys && oldimage->zres == zs) {
+    if (oldimage->data != rgb)
+      free(rgb);  /* an identical copy, which we own */
+    rt_mutex_unlock(&c->lock);
+    return oldimage;
   }
- 
+
+  newimage = new_named_image(filename);
+  if (newimage == NULL) {
+    rt_mutex_unlock(&c->lock);
+    return NULL;
+  }
+  newimage->loaded=1;
+  newimage->xres=xs;
+  newimage->yres=ys;
+  newimage->zres=zs;
+  newimage->bpp=3;
+  newimage->data=rgb;
+  newimage->datahash=dh;
+
+  if (oldimage != NULL)
+    rc = cache_replace(c, slot, newimage);
+  else
+    rc = cache_insert(c, newimage, h);
+  rt_mutex_unlock(&c->lock);
+
+  if (!rc) {
+    newimage->data=NULL;  /* leave the buffer with the caller */
+    DeallocateImage(newimage);
+    return NULL;
+  }
+
   return newimage;
 }
 
@@ -123,6 +345,13 @@ rawimage * NewImage(int x, int y, int z) {
   newimage->yres=y;
   newimage->zres=z;
   newimage->bpp=0;
+  newimage->name=NULL;
+  newimage->datahash=0;
+  newimage->mip=NULL;
+  newimage->mapaddr=NULL;
+  newimage->maplen=0;
+  newimage->voxoffs=NULL;
+  newimage->voxdata=NULL;
   newimage->data=malloc(x*y*z*3);
   if (newimage->data == NULL) {
     free(newimage);
@@ -133,17 +362,33 @@ rawimage * NewImage(int x, int y, int z) {
 }
 
 void DeallocateImage(rawimage * image) {
+  if (image->mip != NULL) {
+    image->mip->cached=0;
+    FreeMIPMap(image->mip);
+    image->mip=NULL;
+  }
   image->loaded=0;
-  free(image->data);
+  free(image->voxoffs);
+  if (image->voxdata != image->data)
+    free(image->voxdata);
+  if (image->mapaddr != NULL)
+    rt_munmap(image->mapaddr, image->maplen);
+  else
+    free(image->data);
   image->data=NULL;
+  free(image->name);
   free(image);
 }
 
 void FreeMIPMap(mipmap * mip) {
   int i;
 
-  /* don't free the original image here, FreeImages() will */
-  /* get it when all else is completed.                    */
+  /* cached MIP maps belong to their base image, and are freed with it */
+  if (mip->cached)
+    return;
+
+  /* don't free the original image here, the image cache */
+  /* will get it when all else is completed.               */
   for (i=1; i<mip->levels; i++) {
     DeallocateImage(mip->images[i]);
   } 
@@ -151,27 +396,149 @@ void FreeMIPMap(mipmap * mip) {
   free(mip);
 }
 
-mipmap * LoadMIPMap(const char * filename, int maxlevels) {
-  rawimage * img;
+/* MIP map an image, reusing the pyramid cached with it if possible */
+static mipmap * image_mipmap(rawimage * img, int maxlevels, int numthreads) {
   mipmap * mip;
 
-  img = AllocateImageFile(filename);
-  if (img == NULL)
-    return NULL;
-
   LoadRawImage(img);
 
-  mip = CreateMIPMap(img, maxlevels); 
-  if (mip == NULL) {
-    DeallocateImage(img);
-    free(mip);
+  if (img->mip != NULL && img->mip->maxlevels == maxlevels)
+    return img->mip;
+
+  /* the image stays in its cache, which frees it */
+  mip = CreateMIPMap(img, maxlevels, numthreads); 
+  if (mip == NULL) 
     return NULL;
+
+  if (img->mip == NULL) {
+    mip->cached=1;
+    img->mip=mip;
   }
 
   return mip;
 }
 
-rawimage * DecimateImage(const rawimage * image) {
+/*
+ * Return a MIP map for the named image, looking in the scene's image 
+ * cache and then the process wide table, and otherwise loading the
+ * image file into the scene's cache.  New pyramids are built with up to
+ * numthreads threads.
+ */
+mipmap * LoadMIPMap(void * voidcache, const char * filename, int maxlevels,
+                    int numthreads) {
+  imagecache * c = (imagecache *) voidcache;
+  rawimage * img;
+  mipmap * mip = NULL;
+  unsigned int h;
+  int slot;
+
+  h = name_hash(filename);
+
+  rt_mutex_lock(&c->lock);
+  slot = cache_slot(c, filename, h);
+  img = c->imgs[slot];
+
+  if (img == NULL && defimages != NULL) {
+    int dslot;
+
+    rt_mutex_lock(&defimages->lock);
+    dslot = cache_slot(defimages, filename, h);
+    if (defimages->imgs[dslot] != NULL)
+      mip = image_mipmap(defimages->imgs[dslot], maxlevels, numthreads);
+    rt_mutex_unlock(&defimages->lock);
+
+    if (mip != NULL) {
+      rt_mutex_unlock(&c->lock);
+      return mip;
+    }
+  }
+
+  if (img == NULL) {
+    img = new_named_image(filename);
+    if (img != NULL && !cache_insert(c, img, h)) {
+      DeallocateImage(img);
+      img = NULL;
+    }
+  }
+
+  if (img != NULL)
+    mip = image_mipmap(img, maxlevels, numthreads);
+  rt_mutex_unlock(&c->lock);
+
+  return mip;
+}
+
+typedef struct {
+  const rawimage * src;   /**< image to decimate           */
+  rawimage * dst;         /**< half resolution destination */
+} decimate_parms;
+
+/*
+ * 2x2 box filter a range of destination rows.  The two source rows are 
+ * first summed vertically into 16-bit values, 16 bytes at a time with SSE2,
+ * and then adjacent pixels are summed and divided by 4.
+ */
+static void decimate_rows(const decimate_parms * parms, int ystart, int yend) {
+  const rawimage * src = parms->src;
+  rawimage * dst = parms->dst;
+  int srcrowsz = src->xres * 3;
+  int sumsz = dst->xres * 6;     /* bytes of source row that get used */
+  unsigned short * vsum;
+  int x, y, i;
+
+  vsum = (unsigned short *) malloc(sumsz * sizeof(unsigned short));
+  if (vsum == NULL)
+    return;
+
+  for (y=ystart; y<yend; y++) {
+    const unsigned char * row0 = src->data + ((size_t) srcrowsz) * (2*y);
+    const unsigned char * row1 = row0 + srcrowsz;
+    unsigned char * out = dst->data + ((size_t) dst->xres * 3) * y;
+
+    i=0;
+#if defined(__SSE2__)
+    {
+      __m128i zero = _mm_setzero_si128();
+      for (; i<(sumsz-15); i+=16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (row0 + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (row1 + i));
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), 
+                                   _mm_unpacklo_epi8(b, zero));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), 
+                                   _mm_unpackhi_epi8(b, zero));
+        _mm_storeu_si128((__m128i *) (vsum + i    ), lo);
+        _mm_storeu_si128((__m128i *) (vsum + i + 8), hi);
+      }
+    }
+#endif
+    for (; i<sumsz; i++) {
+      vsum[i] = row0[i] + row1[i];
+    }
+
+    for (x=0; x<dst->xres; x++) {
+      const unsigned short * v = vsum + x*6;
+      out[x*3    ] = (v[0] + v[3]) >> 2;
+      out[x*3 + 1] = (v[1] + v[4]) >> 2;
+      out[x*3 + 2] = (v[2] + v[5]) >> 2;
+    }
+  }
+
+  free(vsum);
+}
+
+static void * decimate_thread(void * voidparms) {
+  decimate_parms * parms;
+  rt_tasktile_t tile;
+
+  rt_threadlaunch_getdata(voidparms, (void **) &parms);
+  while (rt_threadlaunch_next_tile(voidparms, MIP_ROWS_PER_TILE, &tile) != RT_SCHED_DONE) {
+    decimate_rows(parms, tile.start, tile.end);
+  }
+
+  return NULL;
+}
+
+rawimage * DecimateImage(const rawimage * image, int numthreads) {
   rawimage * newimage;
   int x, y, addr, addr2;
 
@@ -185,31 +552,22 @@ rawimage * DecimateImage(const rawimage * image) {
 
   newimage = NewImage(x, y, 1);
 
+  if (newimage == NULL)
+    return NULL;
+
   if (image->xres > 1 && image->yres > 1) {
-    for (y=0; y<newimage->yres; y++) {
-      for (x=0; x<newimage->xres; x++) {
-        addr = (newimage->xres*y + x)*3;
-        addr2 = (image->xres*y + x)*3*2;
-        newimage->data[addr] = (int)
-          (image->data[addr2] + 
-           image->data[addr2 + 3] +
-           image->data[addr2 + image->xres*3] + 
-           image->data[addr2 + (image->xres + 1)*3]) >> 2; 
-        addr++;
-        addr2++;
-        newimage->data[addr] = (int)
-          (image->data[addr2] + 
-           image->data[addr2 + 3] +
-           image->data[addr2 + image->xres*3] + 
-           image->data[addr2 + (image->xres + 1)*3]) >> 2; 
-        addr++;
-        addr2++;
-        newimage->data[addr] = (int)
-          (image->data[addr2] + 
-           image->data[addr2 + 3] +
-           image->data[addr2 + image->xres*3] + 
-           image->data[addr2 + (image->xres + 1)*3]) >> 2; 
-      }
+    decimate_parms parms;
+    parms.src = image;
+    parms.dst = newimage;
+
+    if (numthreads > 1 && 
+        newimage->xres * newimage->yres >= MIP_PARALLEL_MINPIXELS) {
+      rt_tasktile_t tile;
+      tile.start = 0;
+      tile.end = newimage->yres;
+      rt_threadlaunch(numthreads, &parms, decimate_thread, &tile);
+    } else {
+      decimate_rows(&parms, 0, newimage->yres);
     }
   }
   else if (image->xres == 1) {
@@ -254,7 +612,7 @@ rawimage * DecimateImage(const rawimage * image) {
   return newimage;
 }
 
-mipmap * CreateMIPMap(rawimage * image, int maxlevels) {
+mipmap * CreateMIPMap(rawimage * image, int maxlevels, int numthreads) {
   mipmap * mip;
   int xlevels, ylevels, zlevels, i; 
   
@@ -264,6 +622,8 @@ mipmap * CreateMIPMap(rawimage * image, int maxlevels) {
   mip = (mipmap *) malloc(sizeof(mipmap));
   if (mip == NULL)
     return NULL;
+  mip->maxlevels = maxlevels;
+  mip->cached = 0;
 
   xlevels = 0;  
   i = abs(image->xres);
@@ -320,7 +680,24 @@ mipmap * CreateMIPMap(rawimage * image, int maxlevels) {
 
   mip->images[0] = image;
   for (i=1; i<mip->levels; i++) {
-    mip->images[i] = DecimateImage(mip->images[i - 1]);
+    mip->images[i] = DecimateImage(mip->images[i - 1], numthreads);
+    if (mip->images[i] == NULL) {
+      mip->levels = i;  /* out of memory, stop at the last good level */
+      break;
+    }
+  }
+
+  /* 
+   * Volumetric samplers address every level through voxel offset tables.
+   * Any image can be used as a volume texture, including 2-D images and
+   * the placeholder used when an image file fails to load.
+   */
+  for (i=0; i<mip->levels; i++) {
+    if (mip->images[i]->voxoffs == NULL &&
+        VolImageLayout(mip->images[i], RT_VOLUME_LAYOUT_LINEAR)) {
+      FreeMIPMap(mip);
+      return NULL;
+    }
   }
 
   return mip;
@@ -409,11 +786,50 @@ color ImageMap(const rawimage * image, flt u, flt v) {
 } 
 
 
+/*
+ * Set the voxel storage layout used when sampling a volumetric image.
+ * The linear layout samples the original image data in place, while other
+ * layouts sample from a reordered copy of it.
+ */
+int VolImageLayout(rawimage * img, int layout) {
+  size_t * offs;
+  unsigned char * vox;
+
+  /* nothing to do if the image already uses the requested layout */
+  if (img->voxoffs != NULL && 
+      (img->voxdata == img->data) == (layout == RT_VOLUME_LAYOUT_LINEAR))
+    return 0;
+
+  offs = voxel_offsets(img->xres, img->yres, img->zres, 3, layout);
+  if (offs == NULL) 
+    return -1;
+
+  if (layout == RT_VOLUME_LAYOUT_LINEAR) {
+    vox = img->data;
+  } else {
+    vox = voxel_relayout(img->xres, img->yres, img->zres, 3, offs, layout, 
+                         img->data);
+    if (vox == NULL) {
+      free(offs);
+      return -1;
+    }
+  }
+
+  free(img->voxoffs);
+  if (img->voxdata != img->data)
+    free(img->voxdata);
+  img->voxoffs = offs;
+  img->voxdata = vox;
+
+  return 0;
+}
+
+
 color VolImageMapNearest(const rawimage * img, flt u, flt v, flt w) {
   color col;
   flt x, y, z;
   int ix, iy, iz;
-  int addr;
+  const unsigned char * ptr;
 
   x = (img->xres - 1.0) * u;  /* floating point X location */
   ix = (int) x;
@@ -422,10 +838,11 @@ color VolImageMapNearest(const rawimage * img, flt u, flt v, flt w) {
   z = (img->zres - 1.0) * w;  /* floating point Z location */
   iz = (int) z;
 
-  addr = ((iz * img->xres * img->yres) + (iy * img->xres) + ix) * 3; 
-  col.r = img->data[addr    ];
-  col.g = img->data[addr + 1];
-  col.b = img->data[addr + 2];
+  ptr = img->voxdata + VOXEL_ADDR(img->voxoffs, img->xres, img->yres, 
+                                  ix, iy, iz);
+  col.r = ptr[0];
+  col.g = ptr[1];
+  col.b = ptr[2];
  
   return col; 
 }
@@ -435,31 +852,33 @@ color VolImageMapTrilinear(const rawimage * img, flt u, flt v, flt w) {
   color col, colL, colU, colll, colul, colLL, colUL;
   flt x, y, z, px, py, pz;
   int ix, iy, iz, nx, ny, nz;
-  unsigned char *llptr, *ulptr, *LLptr, *ULptr;
-  int addr;
+  const unsigned char *llptr, *ulptr, *LLptr, *ULptr;
+  const size_t *xoffs = img->voxoffs;
+  const size_t *yoffs = xoffs + img->xres;
+  const size_t *zoffs = yoffs + img->yres;
 
   /*
    *  Perform trilinear interpolation between 8 closest pixels.
+   *  Voxel addresses are the sum of per-axis offsets, so the distance
+   *  to the next voxel along each axis is the same for all 8 of them.
    */
-  nx = (img->xres > 1) ? 3 : 0;
   x = (img->xres - 1.0) * u;  /* floating point X location */
   ix = (int) x;               /* integer X location        */
   px = x - ix;                /* fractional X location     */
+  nx = (ix < img->xres - 1) ? (int) (xoffs[ix + 1] - xoffs[ix]) : 0;
 
-  ny = (img->yres > 1) ? (img->xres * 3) : 0;
   y = (img->yres - 1.0) * v;  /* floating point Y location */
   iy = (int) y;               /* integer Y location        */
   py = y - iy;                /* fractional Y location     */
+  ny = (iy < img->yres - 1) ? (int) (yoffs[iy + 1] - yoffs[iy]) : 0;
 
-  nz = (img->zres > 1) ? (img->xres * img->yres * 3) : 0;
   z = (img->zres - 1.0) * w;  /* floating point Z location */
   iz = (int) z;               /* integer Z location        */
   pz = z - iz;                /* fractional Z location     */
-
-  addr = ((img->xres*img->yres * iz) + (img->xres * iy) + ix) * 3; 
+  nz = (iz < img->zres - 1) ? (int) (zoffs[iz + 1] - zoffs[iz]) : 0;
 
   /* pointer to the lower left lower pixel (Y  ) */
-  llptr = img->data + addr;
+  llptr = img->voxdata + xoffs[ix] + yoffs[iy] + zoffs[iz];
 
   /* pointer to the lower left upper pixel (Y+1) */
   ulptr = llptr + ny;
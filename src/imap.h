@@ -5,18 +5,22 @@
  */
 
 void       ResetImage(void);
+void *     NewImageCache(void);
+void       FreeImageCache(void *);
 void       LoadRawImage(rawimage *);
-rawimage * AllocateImageRGB24(const char *, int, int, int, unsigned char *);
-rawimage * AllocateImageFile(const char *);
+rawimage * AllocateImageRGB24(void *, const char *, int, int, int, unsigned char *);
 void       DeallocateImage(rawimage *);
-void       ResetImages(void);
+void       InitImages(void);
 void       FreeImages(void);
-rawimage * DecimateImage(const rawimage *);
-mipmap *   LoadMIPMap(const char *, int maxlevels);
-mipmap *   CreateMIPMap(rawimage *, int);
+void       RetainImages(void);
+void       ReleaseImages(void);
+rawimage * DecimateImage(const rawimage *, int);
+mipmap *   LoadMIPMap(void *, const char *, int maxlevels, int numthreads);
+mipmap *   CreateMIPMap(rawimage *, int, int);
 void       FreeMIPMap(mipmap * mip);
 color      MIPMap(const mipmap *, flt, flt, flt);
 color      ImageMap(const rawimage *, flt, flt);
+int        VolImageLayout(rawimage *, int layout);
 color      VolImageMapNearest(const rawimage *, flt, flt, flt);
 color      VolImageMapTrilinear(const rawimage *, flt, flt, flt);
 color      VolMIPMap(const mipmap *, flt, flt, flt, flt);
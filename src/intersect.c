@@ -13,6 +13,8 @@
 #include "tachyon.h"
 #include "intersect.h"
 #include "macros.h"
+#include "threads.h"
+#include "arena.h"
 
 #if 0 && defined(__INTEL_COMPILER) && defined(__MIC__)
 /* compiler intrinsics for prefetching */
@@ -27,16 +29,288 @@ unsigned int max_objectid(scenedef * scene) {
   return scene->objgroup.numobjects;
 }
 
-void free_objects(object * start) {
-  object * cur;
-  object * next;
 
-  cur=start; 
-  while (cur != NULL) { 
-    next=cur->nextobj;
-    cur->methods->freeobj(cur);
-    cur=next;
+/*
+ * Concurrent scene construction.  Objects and textures created through
+ * the API are not added to the scene directly, but to one of several
+ * staging areas chosen by the calling thread's ID, so that many threads
+ * can add geometry to the same scene while rarely contending for a lock.
+ * The staged lists are merged into the scene at rendercheck() time, and
+ * objects are given their IDs then.  A thread always uses the same 
+ * staging area, so a scene built by a single thread comes out exactly as
+ * if the objects had been added to the scene lists one at a time.
+ *
+ * Each area also has an arena that the object constructors and the grid
+ * builder allocate from, so that deleting a scene takes a handful of 
+ * free() calls rather than one per object.  Objects that do their own
+ * allocation are recorded in a per-area list when they are staged, and
+ * are freed individually.
+ */
+#define STAGE_SLOTS     64    /* number of staging areas, a power of two */
+#define STAGE_SLOTBITS  6     /* log2 of STAGE_SLOTS                     */
+
+typedef struct {
+  rt_mutex_t lock;         /* serializes threads sharing this area   */
+  unsigned int seq;        /* creation order of objects in this area */
+  object * boundedobj;     /* staged bounded objects, newest first   */
+  object * unboundedobj;   /* staged unbounded objects, newest first */
+  list * texlist;          /* staged textures                        */
+  list * heapobj;          /* objects not allocated from the arena   */
+  void * arena;            /* memory for objects created here        */
+  char pad[64];            /* keep areas on separate cache lines     */
+} objstage;
+
+typedef struct {
+  rt_mutex_t lock;         /* guards the scene light list            */
+  objstage area[STAGE_SLOTS];
+} scenestage;
+
+void * new_scenestage(void) {
+  scenestage * st;
+  int i;
+
+  st = (scenestage *) calloc(1, sizeof(scenestage));
+  if (st == NULL)
+    return NULL;
+
+  rt_mutex_init(&st->lock);
+  for (i=0; i<STAGE_SLOTS; i++) {
+    rt_mutex_init(&st->area[i].lock);
+    st->area[i].arena = new_arena();
+  }
+
+  return st;
+}
+
+void free_scenestage(void * voidst) {
+  scenestage * st = (scenestage *) voidst;
+  int i;
+
+  if (st == NULL)
+    return;
+
+  for (i=0; i<STAGE_SLOTS; i++) {
+    objstage * sa = &st->area[i];
+    list * cur;
+
+    /* list entries live in the arena, so free the objects first */
+    for (cur = sa->heapobj; cur != NULL; cur = cur->next) {
+      object * obj = (object *) cur->item;
+      obj->methods->freeobj(obj);
+    }
+
+    free_arena(sa->arena);
+    rt_mutex_destroy(&sa->lock);
+  }
+  rt_mutex_destroy(&st->lock);
+  free(st);
+}
+
+/* 
+ * Pick the staging area for the calling thread.  Thread IDs are often
+ * addresses of per-thread data, a large power of two apart, so they are
+ * run through a multiplicative hash to spread them over all areas.
+ */
+static objstage * stage_area(scenedef * scene) {
+  scenestage * st = (scenestage *) scene->stage;
+  unsigned long tid = rt_thread_self_id();
+  unsigned int h;
+
+  h = (unsigned int) (tid ^ ((tid >> 16) >> 16));
+  h = (h * 2654435761U) >> (32 - STAGE_SLOTBITS);
+  return &st->area[h & (STAGE_SLOTS - 1)];
+}
+
+/* allocate memory that is freed along with the scene */
+void * scene_alloc(scenedef * scene, size_t size) {
+  objstage * sa = stage_area(scene);
+  void * p;
+
+  rt_mutex_lock(&sa->lock);
+  p = arena_alloc(sa->arena, size);
+  rt_mutex_unlock(&sa->lock);
+
+  return p;
+}
+
+/* total bytes of scene memory reserved, and handed out to objects */
+void scene_memstats(scenedef * scene, size_t * allocated, size_t * used) {
+  scenestage * st = (scenestage *) scene->stage;
+  int i;
+
+  *allocated = 0;
+  *used = 0;
+  for (i=0; i<STAGE_SLOTS; i++) {
+    size_t a, u;
+    rt_mutex_lock(&st->area[i].lock);
+    arena_stats(st->area[i].arena, &a, &u);
+    rt_mutex_unlock(&st->area[i].lock);
+    *allocated += a;
+    *used += u;
+  }
+}
+
+void stage_object(scenedef * scene, object * obj, int unbounded) {
+  objstage * sa = stage_area(scene);
+
+  rt_mutex_lock(&sa->lock);
+  if (obj->methods->freeobj != arena_nofree) {
+    list * lst = (list *) arena_alloc(sa->arena, sizeof(list));
+    lst->item = obj;
+    lst->next = sa->heapobj;
+    sa->heapobj = lst;
+  }
+  obj->id = sa->seq++;  /* real ID is assigned when merged */
+  if (unbounded) {
+    obj->nextobj = sa->unboundedobj;
+    sa->unboundedobj = obj;
+  } else {
+    obj->nextobj = sa->boundedobj;
+    sa->boundedobj = obj;
+  }
+  rt_mutex_unlock(&sa->lock);
+}
+
+void stage_texture(scenedef * scene, void * tex) {
+  objstage * sa = stage_area(scene);
+  list * lst;
+
+  lst = (list *) malloc(sizeof(list));
+  lst->item = tex;
+
+  rt_mutex_lock(&sa->lock);
+  lst->next = sa->texlist;
+  sa->texlist = lst;
+  rt_mutex_unlock(&sa->lock);
+}
+
+/*
+ * Remove a texture staged by the calling thread, returning nonzero if 
+ * it was found.  Textures are normally unstaged right after they were
+ * created, so they are found at the head of the list.
+ */
+int unstage_texture(scenedef * scene, void * tex) {
+  objstage * sa = stage_area(scene);
+  list ** prev;
+  int found = 0;
+
+  rt_mutex_lock(&sa->lock);
+  for (prev = &sa->texlist; *prev != NULL; prev = &(*prev)->next) {
+    if ((*prev)->item == tex) {
+      list * lst = *prev;
+      *prev = lst->next;
+      free(lst);
+      found = 1;
+      break;
+    }
   }
+  rt_mutex_unlock(&sa->lock);
+
+  return found;
+}
+
+/*
+ * Lights are few, and the order of the light list determines the order
+ * in which light contributions are summed during shading, so they go
+ * straight into the scene light list rather than being staged.
+ */
+void stage_light(scenedef * scene, void * li) {
+  scenestage * st = (scenestage *) scene->stage;
+  list * lst;
+
+  lst = (list *) malloc(sizeof(list));
+  lst->item = li;
+
+  rt_mutex_lock(&st->lock);
+  lst->next = scene->lightlist;
+  scene->lightlist = lst;
+  scene->numlights++;
+  rt_mutex_unlock(&st->lock);
+}
+
+/* appends obj to the list given by its first and last entries */
+static void append_object(object ** first, object ** last, object * obj) {
+  obj->nextobj = NULL;
+  if (*last == NULL)
+    *first = obj;
+  else
+    (*last)->nextobj = obj;
+  *last = obj;
+}
+
+/*
+ * Move all staged objects and textures into the scene, ahead of the
+ * objects already there, numbering objects in creation order.  Each 
+ * area's bounded and unbounded lists are merged newest first, so the
+ * IDs are assigned from the top down.  Returns nonzero if any objects
+ * were merged.  Must not be called while other threads are still 
+ * adding objects to the scene.
+ */
+int merge_staged_objects(scenedef * scene) {
+  scenestage * st = (scenestage *) scene->stage;
+  object * first[2], * last[2];
+  unsigned int count, id;
+  int i;
+
+  if (st == NULL)
+    return 0;
+
+  count = 0;
+  for (i=0; i<STAGE_SLOTS; i++) {
+    objstage * sa = &st->area[i];
+
+    /* hand textures over, their order doesn't matter */
+    while (sa->texlist != NULL) {
+      list * lst = sa->texlist;
+      sa->texlist = lst->next;
+      lst->next = scene->texlist;
+      scene->texlist = lst;
+    }
+
+    count += sa->seq;
+  }
+
+  if (count == 0)
+    return 0;
+
+  id = scene->objgroup.numobjects + count;
+  scene->objgroup.numobjects = id;
+  first[0] = first[1] = NULL;
+  last[0] = last[1] = NULL;
+
+  for (i=0; i<STAGE_SLOTS; i++) {
+    objstage * sa = &st->area[i];
+
+    while (sa->boundedobj != NULL || sa->unboundedobj != NULL) {
+      object * obj;
+
+      if (sa->unboundedobj == NULL || (sa->boundedobj != NULL &&
+          sa->boundedobj->id > sa->unboundedobj->id)) {
+        obj = sa->boundedobj;
+        sa->boundedobj = obj->nextobj;
+        obj->id = --id;
+        append_object(&first[0], &last[0], obj);
+      } else {
+        obj = sa->unboundedobj;
+        sa->unboundedobj = obj->nextobj;
+        obj->id = --id;
+        append_object(&first[1], &last[1], obj);
+      }
+    }
+
+    sa->seq = 0;
+  }
+
+  if (first[0] != NULL) {
+    last[0]->nextobj = scene->objgroup.boundedobj;
+    scene->objgroup.boundedobj = first[0];
+  }
+  if (first[1] != NULL) {
+    last[1]->nextobj = scene->objgroup.unboundedobj;
+    scene->objgroup.unboundedobj = first[1];
+  }
+
+  return 1;
 }
 
 
@@ -53,6 +327,7 @@ void intersect_objects(ray * ry) {
 #if 0 && defined(__INTEL_COMPILER) && defined(__MIC__)
     _mm_prefetch(cur->nextobj, _MM_HINT_T0); /* load into all caches */
 #endif
+    RT_STAT_TEST(ry, cur);
     cur->methods->intersect(cur, ry); 
   }
 
@@ -63,6 +338,7 @@ void intersect_objects(ray * ry) {
 #if 0 && defined(__INTEL_COMPILER) && defined(__MIC__)
     _mm_prefetch(cur->nextobj, _MM_HINT_T0); /* load into all caches */
 #endif
+    RT_STAT_TEST(ry, cur);
     cur->methods->intersect(cur, ry); 
   }
 
@@ -72,6 +348,7 @@ void intersect_objects(ray * ry) {
 /* Only keeps closest intersection, no clipping, no CSG */
 void add_regular_intersection(flt t, const object * obj, ray * ry) {
   if (t > EPSILON) {
+    RT_STAT_HIT(ry, obj);
     /* if we hit something before maxdist update maxdist */
     if (t < ry->maxdist) {
       ry->maxdist = t;
@@ -85,6 +362,7 @@ void add_regular_intersection(flt t, const object * obj, ray * ry) {
 /* Only keeps closest intersection, also handles clipping, no CSG */
 void add_clipped_intersection(flt t, const object * obj, ray * ry) {
   if (t > EPSILON) {
+    RT_STAT_HIT(ry, obj);
     /* if we hit something before maxdist update maxdist */
     if (t < ry->maxdist) {
 
@@ -126,6 +404,7 @@ int closest_intersection(flt * t, object const ** obj, ray * ry) {
 /* Only meant for shadow rays, unsafe for anything else */
 void add_shadow_intersection(flt t, const object * obj, ray * ry) {
   if (t > EPSILON) {
+    RT_STAT_HIT(ry, obj);
     /* if we hit something before maxdist update maxdist */
     if (t < ry->maxdist) {
       /* if this object doesn't cast a shadow, and we aren't  */
@@ -150,6 +429,7 @@ void add_shadow_intersection(flt t, const object * obj, ray * ry) {
 /* Only meant for clipped shadow rays, unsafe for anything else */
 void add_clipped_shadow_intersection(flt t, const object * obj, ray * ry) {
   if (t > EPSILON) {
+    RT_STAT_HIT(ry, obj);
     /* if we hit something before maxdist update maxdist */
     if (t < ry->maxdist) {
       /* if this object doesn't cast a shadow, and we aren't  */
@@ -6,7 +6,15 @@
  */
 
 unsigned int new_objectid(scenedef *);
-void free_objects(object *);
+void * new_scenestage(void);
+void free_scenestage(void *);
+void * scene_alloc(scenedef *, size_t);
+void scene_memstats(scenedef *, size_t *, size_t *);
+void stage_object(scenedef *, object *, int);
+void stage_texture(scenedef *, void *);
+int unstage_texture(scenedef *, void *);
+void stage_light(scenedef *, void *);
+int merge_staged_objects(scenedef *);
 void intersect_objects(ray *);
 
 void add_clipped_intersection(flt, const object *, ray *);
@@ -23,7 +23,8 @@ static object_methods light_methods = {
   (void (*)(const void *, void *))(light_intersect),
   (void (*)(const void *, const void *, const void *, void *))(light_normal),
   light_bbox, 
-  free 
+  free,
+  RT_STATS_LIGHT
 };
 
 /* special routine to free directional lights which are */
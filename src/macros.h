@@ -28,3 +28,19 @@ c.z = (a.z - b.z);		\
  c->y = (a->z * b->x) - (a->x * b->z);			\
  c->z = (a->x * b->y) - (a->y * b->x);			\
 
+
+/* count an event in the statistics of the ray's thread, if enabled */
+#define RT_STAT_INC(ry, field)				\
+ do { if ((ry)->stats != NULL) (ry)->stats->field++; } while (0)
+
+/* count an intersection test of an object, and arm its hit counter */
+#define RT_STAT_TEST(ry, obj)					\
+ do { if ((ry)->stats != NULL) {				\
+   (ry)->stats->tests[(obj)->methods->stattype]++;		\
+   (ry)->stathit = 0; } } while (0)
+
+/* count a hit once per test, however many roots the object reports */
+#define RT_STAT_HIT(ry, obj)					\
+ do { if ((ry)->stats != NULL && !(ry)->stathit) {		\
+   (ry)->stats->hits[(obj)->methods->stattype]++;		\
+   (ry)->stathit = 1; } } while (0)
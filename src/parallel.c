@@ -18,6 +18,7 @@
 #include "tgafile.h"
 #include "util.h"
 #include "threads.h"
+#include "render.h"
 
 #if !defined(_MSC_VER)
 #include <unistd.h>
@@ -76,6 +77,40 @@ void rt_barrier_sync(void) {
 #endif
 }
 
+void rt_broadcast_ints(int * data, int count) {
+  /* if sequential, node 0 already has the values */
+#ifdef MPI
+  MPI_Bcast(data, count, MPI_INT, 0, MPI_COMM_WORLD);
+#endif
+}
+
+void rt_sum_ulonglongs(unsigned long long * data, int count) {
+  /* if sequential, node 0 already has the totals */
+#ifdef MPI
+#if defined(USE_MPI_IN_PLACE)
+  if (rt_mynode() == 0)
+    MPI_Reduce(MPI_IN_PLACE, data, count, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 
+               0, MPI_COMM_WORLD);
+  else 
+    MPI_Reduce(data, NULL, count, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 
+               0, MPI_COMM_WORLD);
+#else
+  unsigned long long * sums = NULL;
+
+  if (rt_mynode() == 0)
+    sums = (unsigned long long *) malloc(count * sizeof(unsigned long long));
+
+  MPI_Reduce(data, sums, count, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 
+             0, MPI_COMM_WORLD);
+
+  if (sums != NULL) {
+    memcpy(data, sums, count * sizeof(unsigned long long));
+    free(sums);
+  }
+#endif
+#endif
+}
+
 int rt_getcpuinfo(nodeinfo **nodes) {
   int numnodes = rt_numnodes();
   int mynode = rt_mynode();
@@ -191,7 +226,7 @@ void rt_free_reqbuf(void * voidhandle) {
 
 void * rt_init_scanlinereceives(scenedef * scene) {
 #ifdef MPI
-  int i, addr;
+  int y, addr, len, startx, stopx, starty, stopy;
   pardata * p;
 
   p = (pardata *) rt_allocate_reqbuf(scene->vres);
@@ -201,27 +236,34 @@ void * rt_init_scanlinereceives(scenedef * scene) {
   p->count = 0;
   p->haveinited = 1;
 
+  /* only the rows of the crop window are rendered and exchanged, each */
+  /* row is assigned to a node round-robin starting at the first one  */
+  render_region(scene, &startx, &stopx, &starty, &stopy);
+  len = (stopx - startx + 1) * 3;
+
   if (scene->imgbufformat == RT_IMAGE_BUFFER_RGB24) {
     /* 24-bit RGB packed pixel format */
     unsigned char *imgbuf = (unsigned char *) scene->img;
 
     if (p->mynode == 0) {
-      for (i=0; i<scene->vres; i++) {
-        if (i % p->nodes != p->mynode) {
-          addr = i * scene->hres * 3;
-          MPI_Recv_init(&imgbuf[addr], scene->hres * 3, MPI_BYTE, 
-                    i % p->nodes, i+1, MPI_COMM_WORLD, &p->requests[p->count]);
+      for (y=starty; y<=stopy; y++) {
+        if ((y - starty) % p->nodes != p->mynode) {
+          addr = ((y - 1 - scene->imgystart) * scene->imgxres + 
+                  (startx - 1 - scene->imgxstart)) * 3;
+          MPI_Recv_init(&imgbuf[addr], len, MPI_BYTE, (y - starty) % p->nodes,
+                        y, MPI_COMM_WORLD, &p->requests[p->count]);
           p->count++; /* count of received rows */
         } else {
           p->totalrows++; /* count of our own rows */
         }
       }
     } else {
-      for (i=0; i<scene->vres; i++) {
-        if (i % p->nodes == p->mynode) {
-          addr = i * scene->hres * 3;
-          MPI_Send_init(&imgbuf[addr], scene->hres * 3, MPI_BYTE, 
-                    0, i+1, MPI_COMM_WORLD, &p->requests[p->count]);
+      for (y=starty; y<=stopy; y++) {
+        if ((y - starty) % p->nodes == p->mynode) {
+          addr = ((y - 1 - scene->imgystart) * scene->imgxres + 
+                  (startx - 1 - scene->imgxstart)) * 3;
+          MPI_Send_init(&imgbuf[addr], len, MPI_BYTE, 
+                        0, y, MPI_COMM_WORLD, &p->requests[p->count]);
           p->count++; /* count of sent rows */
           p->totalrows++; /* count of sent rows */
         }
@@ -232,22 +274,24 @@ void * rt_init_scanlinereceives(scenedef * scene) {
     float *imgbuf = (float *) scene->img;
 
     if (p->mynode == 0) {
-      for (i=0; i<scene->vres; i++) {
-        if (i % p->nodes != p->mynode) {
-          addr = i * scene->hres * 3;
-          MPI_Recv_init(&imgbuf[addr], scene->hres * 3, MPI_FLOAT, 
-                    i % p->nodes, i+1, MPI_COMM_WORLD, &p->requests[p->count]);
+      for (y=starty; y<=stopy; y++) {
+        if ((y - starty) % p->nodes != p->mynode) {
+          addr = ((y - 1 - scene->imgystart) * scene->imgxres + 
+                  (startx - 1 - scene->imgxstart)) * 3;
+          MPI_Recv_init(&imgbuf[addr], len, MPI_FLOAT, (y - starty) % p->nodes,
+                        y, MPI_COMM_WORLD, &p->requests[p->count]);
           p->count++; /* count of received rows */
         } else {
           p->totalrows++; /* count of our own rows */
         }
       }
     } else {
-      for (i=0; i<scene->vres; i++) {
-        if (i % p->nodes == p->mynode) {
-          addr = i * scene->hres * 3;
-          MPI_Send_init(&imgbuf[addr], scene->hres * 3, MPI_FLOAT,
-                    0, i+1, MPI_COMM_WORLD, &p->requests[p->count]);
+      for (y=starty; y<=stopy; y++) {
+        if ((y - starty) % p->nodes == p->mynode) {
+          addr = ((y - 1 - scene->imgystart) * scene->imgxres + 
+                  (startx - 1 - scene->imgxstart)) * 3;
+          MPI_Send_init(&imgbuf[addr], len, MPI_FLOAT,
+                        0, y, MPI_COMM_WORLD, &p->requests[p->count]);
           p->count++; /* count of sent rows */
           p->totalrows++; /* count of sent rows */
         }
@@ -12,6 +12,8 @@ int rt_mynode(void);
 int rt_numnodes(void);
 int rt_getcpuinfo(nodeinfo **);
 void rt_barrier_sync(void);
+void rt_broadcast_ints(int * data, int count);
+void rt_sum_ulonglongs(unsigned long long * data, int count);
 
 void * rt_allocate_reqbuf(int count);
 void rt_free_reqbuf(void * voidhandle);
@@ -15,6 +15,7 @@
 #include "vector.h"
 #include "intersect.h"
 #include "util.h"
+#include "arena.h"
 
 #define PLANE_PRIVATE
 #include "plane.h"
@@ -23,13 +24,14 @@ static object_methods plane_methods = {
   (void (*)(const void *, void *))(plane_intersect),
   (void (*)(const void *, const void *, const void *, void *))(plane_normal),
   plane_bbox, 
-  free 
+  arena_nofree,
+  RT_STATS_PLANE
 };
 
-object * newplane(void * tex, vector ctr, vector norm) {
+object * newplane(scenedef * scene, void * tex, vector ctr, vector norm) {
   plane * p;
   
-  p=(plane *) malloc(sizeof(plane));
+  p=(plane *) scene_alloc(scene, sizeof(plane));
   memset(p, 0, sizeof(plane));
   p->methods = &plane_methods;
 
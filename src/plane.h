@@ -5,7 +5,7 @@
  */
 
  
-object * newplane(void * tex, vector ctr, vector norm);
+object * newplane(scenedef * scene, void * tex, vector ctr, vector norm);
 
 #ifdef PLANE_PRIVATE
 typedef struct {
@@ -35,21 +35,13 @@ static int getint(FILE * dfile) {
   return i;
 }
 
-int readppm(const char * name, int * xres, int * yres, unsigned char **imgdata) {
+static int readppmheader(FILE * ifp, int * xres, int * yres) {
   char data[256];  
-  FILE * ifp;
-  int i, bytesread, cnt;
-  int datasize;
- 
-  ifp=fopen(name, "r");  
-  if (ifp==NULL) {
-    return IMAGEBADFILE; /* couldn't open the file */
-  }
+  int i, cnt;
 
   cnt = fscanf(ifp, "%s", data);
  
   if (cnt != 1 || strcmp(data, "P6")) {
-    fclose(ifp);
     return IMAGEUNSUP; /* not a format we support */
   }
 
@@ -59,10 +51,28 @@ int readppm(const char * name, int * xres, int * yres, unsigned char **imgdata)
 
   /* eat the newline */ 
   if (fread(&i, 1, 1, ifp) != 1) {
-    fclose(ifp);
     return IMAGEUNSUP; /* not a format we support */
   }
 
+  return IMAGENOERR;
+}
+
+int readppm(const char * name, int * xres, int * yres, unsigned char **imgdata) {
+  FILE * ifp;
+  int rc, bytesread;
+  int datasize;
+ 
+  ifp=fopen(name, "r");  
+  if (ifp==NULL) {
+    return IMAGEBADFILE; /* couldn't open the file */
+  }
+
+  rc = readppmheader(ifp, xres, yres);
+  if (rc != IMAGENOERR) {
+    fclose(ifp);
+    return rc;
+  }
+
   datasize = 3 * (*xres) * (*yres);
 
   *imgdata=malloc(datasize); 
@@ -78,6 +88,46 @@ int readppm(const char * name, int * xres, int * yres, unsigned char **imgdata)
 }
 
 
+/*
+ * Map the pixel data of a P6 PPM file directly from the file rather than 
+ * copying it into the heap.  PPM pixels are already stored as packed RGB
+ * bytes, so the image data simply points into the file mapping, and is
+ * paged in on demand.
+ */
+int mapppm(const char * name, int * xres, int * yres, unsigned char **imgdata,
+           void **mapaddr, size_t *maplen) {
+  FILE * ifp;
+  long dataofs;
+  int rc;
+
+  ifp=fopen(name, "r");  
+  if (ifp==NULL) {
+    return IMAGEBADFILE; /* couldn't open the file */
+  }
+
+  rc = readppmheader(ifp, xres, yres);
+  dataofs = ftell(ifp);
+  fclose(ifp);
+  if (rc != IMAGENOERR)
+    return rc;
+
+  *mapaddr = rt_mmap_readonly(name, maplen);
+  if (*mapaddr == NULL) 
+    return IMAGEBADFILE;
+
+  if (dataofs < 0 || 
+      *maplen < (size_t) dataofs + 3L * (*xres) * (*yres)) {
+    rt_munmap(*mapaddr, *maplen);
+    *mapaddr = NULL;
+    return IMAGEREADERR;
+  }
+
+  *imgdata = ((unsigned char *) *mapaddr) + dataofs;
+
+  return IMAGENOERR;
+}
+
+
 int writeppm(const char *name, int xres, int yres, unsigned char *imgdata) {
   FILE * ofp;
   int y, xbytes;
@@ -130,3 +180,151 @@ int writeppm48(const char *name, int xres, int yres, unsigned char *imgdata) {
 }
 
 
+/*
+ * Portable FloatMap (PFM) files store rows bottom-to-top in the same 
+ * order as the Tachyon framebuffer, with native byte order indicated by
+ * the sign of the scale factor, so the float image is written as-is.
+ */
+int writepfm(const char *name, int xres, int yres, const float *fimg) {
+  FILE * ofp;
+  int y, xfloats;
+  union { int i; char c[sizeof(int)]; } endiantest;
+
+  endiantest.i = 1;
+  xfloats = 3*xres;
+
+  ofp=fopen(name, "wb");
+  if (ofp==NULL)
+    return IMAGEBADFILE;
+
+  fprintf(ofp, "PF\n");
+  fprintf(ofp, "%d %d\n", xres, yres);
+  fprintf(ofp, "%s\n", (endiantest.c[0] == 1) ? "-1.0" : "1.0"); /* byte order */
+
+  for (y=0; y<yres; y++) {
+    if (fwrite(&fimg[y*xfloats], sizeof(float), xfloats, ofp) != xfloats) {
+      fclose(ofp);
+      return IMAGEWRITEERR;
+    } 
+  }
+
+  fclose(ofp);
+  return IMAGENOERR;
+}
+
+
+/*
+ * PPM and PFM files written a band of rows at a time, for tiled rendering
+ * of images too large to hold in memory.  The pixel data follows a short
+ * header, so each band is written at its own offset in the file, in 
+ * whatever order the bands are finished.  A file can also be reopened to
+ * resume writing it, keeping the bands that are already there.
+ */
+typedef struct {
+  FILE * ofp;
+  int yres;
+  int fileformat;
+  long rowbytes;      /**< bytes per row of pixels in the file */
+  long dataoffset;    /**< file offset of the first row        */
+} ppmbands;
+
+void * openppmbands(const char *name, int xres, int yres, int fileformat,
+                    int resume) {
+  ppmbands * pb;
+  union { int i; char c[sizeof(int)]; } endiantest;
+
+  pb = (ppmbands *) malloc(sizeof(ppmbands));
+  if (pb == NULL)
+    return NULL;
+
+  /* the header is the same when resuming, so it's just written again */
+  pb->ofp=fopen(name, (resume) ? "r+b" : "wb");
+  if (pb->ofp==NULL) {
+    free(pb);
+    return NULL;
+  }
+
+  pb->yres = yres;
+  pb->fileformat = fileformat;
+  switch (fileformat) {
+    case RT_FORMAT_PPM48:
+      fprintf(pb->ofp, "P6\n");
+      fprintf(pb->ofp, "%d %d\n", xres, yres);
+      fprintf(pb->ofp, "65535\n"); /* maxval */
+      pb->rowbytes = 6L*xres;
+      break;
+
+    case RT_FORMAT_PFM:
+      endiantest.i = 1;
+      fprintf(pb->ofp, "PF\n");
+      fprintf(pb->ofp, "%d %d\n", xres, yres);
+      fprintf(pb->ofp, "%s\n", (endiantest.c[0] == 1) ? "-1.0" : "1.0"); /* byte order */
+      pb->rowbytes = 3L*xres*sizeof(float);
+      break;
+
+    default:
+      pb->fileformat = RT_FORMAT_PPM;
+      fprintf(pb->ofp, "P6\n");
+      fprintf(pb->ofp, "%d %d\n", xres, yres);
+      fprintf(pb->ofp, "255\n"); /* maxval */
+      pb->rowbytes = 3L*xres;
+      break;
+  }
+  pb->dataoffset = ftell(pb->ofp);
+
+  return pb;
+}
+
+
+/*
+ * Write a band of rows in framebuffer order, from the bottom up, where
+ * starty is the first row's index in the image, counting from 0 at the
+ * bottom.  The rows are 24-bit or 48-bit pixels for PPM files, and 
+ * floats for PFM files.
+ */
+int writeppmband(void * voidhandle, int starty, int numrows, 
+                 const void * rowdata) {
+  ppmbands * pb = (ppmbands *) voidhandle;
+  const unsigned char * rows = (const unsigned char *) rowdata;
+  int y;
+
+  if (pb->fileformat == RT_FORMAT_PFM) {
+    /* PFM rows are stored bottom-to-top, like the framebuffer */
+    if (fseek(pb->ofp, pb->dataoffset + pb->rowbytes * starty, SEEK_SET))
+      return IMAGEWRITEERR;
+
+    if (fwrite(rows, pb->rowbytes, numrows, pb->ofp) != (size_t) numrows)
+      return IMAGEWRITEERR;
+  } else {
+    /* PPM rows are stored top-to-bottom, so the band is flipped */
+    if (fseek(pb->ofp, pb->dataoffset + 
+              pb->rowbytes * (pb->yres - starty - numrows), SEEK_SET))
+      return IMAGEWRITEERR;
+
+    for (y=numrows-1; y>=0; y--) {
+      if (fwrite(&rows[y * pb->rowbytes], 1, pb->rowbytes, pb->ofp) != 
+          (size_t) pb->rowbytes)
+        return IMAGEWRITEERR;
+    }
+  }
+
+  return IMAGENOERR;
+}
+
+
+int flushppmbands(void * voidhandle) {
+  ppmbands * pb = (ppmbands *) voidhandle;
+
+  return (fflush(pb->ofp) == 0) ? IMAGENOERR : IMAGEWRITEERR;
+}
+
+
+int closeppmbands(void * voidhandle) {
+  ppmbands * pb = (ppmbands *) voidhandle;
+  int rc;
+
+  rc = (fclose(pb->ofp) == 0) ? IMAGENOERR : IMAGEWRITEERR;
+  free(pb);
+
+  return rc;
+}
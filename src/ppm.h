@@ -9,6 +9,15 @@
    at this point, probably choke on things like the # comments.. */
 
 int readppm(const char *name, int *xres, int *yres, unsigned char **imgdata);
+int mapppm(const char *name, int *xres, int *yres, unsigned char **imgdata,
+           void **mapaddr, size_t *maplen);
 int writeppm(const char *name, int xres, int yres, unsigned char *imgdata);
 int writeppm48(const char *name, int xres, int yres, unsigned char *imgdata);
+int writepfm(const char *name, int xres, int yres, const float *fimg);
 
+void * openppmbands(const char *name, int xres, int yres, int fileformat,
+                    int resume);
+int writeppmband(void * voidhandle, int starty, int numrows, 
+                 const void * rowdata);
+int flushppmbands(void * voidhandle);
+int closeppmbands(void * voidhandle);
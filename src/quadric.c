@@ -25,7 +25,8 @@ static object_methods quadric_methods = {
   (void (*)(const void *, void *))(quadric_intersect),
   (void (*)(const void *, const void *, const void *, void *))(quadric_normal),
   quadric_bbox, 
-  free 
+  free,
+  RT_STATS_QUADRIC
 };
  
 quadric * newquadric(void) {
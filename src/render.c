@@ -20,9 +20,11 @@
 #include "util.h"
 #include "shade.h"
 #include "ui.h"
+#include "checkpoint.h"
 #include "grid.h"
 #include "camera.h"
 #include "intersect.h"
+#include "texture.h"
 
 /*
  * Determine which shader to use based on the list of capabilities
@@ -49,8 +51,36 @@ static void rt_autoshader(scenedef * scene) {
  * the only actions they can take are to render the scene 
  * or to terminate be returning to the master.
  */
+/*
+ * Touch the image pixels a thread renders, so that with first-touch page
+ * placement the pages of its rows come from its own NUMA node's memory.
+ */
+static void firsttouch_rows(const thr_parms * parms) {
+  scenedef * scene = parms->scene;
+  unsigned char * img = (unsigned char *) scene->img;
+  size_t psize, rowsize;
+  int x, y;
+
+  if (img == NULL)
+    return;
+
+  if (scene->imgbufformat == RT_IMAGE_BUFFER_RGB96F)
+    psize = 3 * sizeof(float);
+  else
+    psize = 3;
+  rowsize = psize * scene->imgxres;
+
+  for (y=parms->starty; y<=parms->stopy; y+=parms->yinc) {
+    for (x=parms->startx; x<=parms->stopx; x+=parms->xinc) 
+      memset(img + rowsize * (y - 1 - scene->imgystart) + 
+             psize * (x - 1 - scene->imgxstart), 0, psize);
+  }
+}
+
+
 void * thread_worker(void * voidparms) {
   thr_parms * parms = (thr_parms *) voidparms;
+  int touched = 0;
 
 #if defined(USECPUAFFINITY)
   /* Optionally set CPU affinity mask for each thread */
@@ -71,13 +101,66 @@ void * thread_worker(void * voidparms) {
   }
 #endif
 
+  /* In the NUMA modes, pin the thread to its CPU before it touches its */
+  /* rows, and copy the grids if it is the first thread on its node.    */
+  /* The caller waits for this at the barrier before the first frame.   */
+  if (parms->cpu >= 0) {
+    rt_thread_set_self_cpuaffinity(parms->cpu);
+    if (parms->numaleader)
+      grid_numa_replicate(parms->scene, parms->numanode);
+  }
+
   while (rt_thread_barrier(parms->runbar, 0)) {
+    /* the rows are touched once the caller has set up the first frame */
+    /* or band, so they're the rows this thread really renders         */
+    if (parms->cpu >= 0 && !touched) {
+      firsttouch_rows(parms);
+      touched = 1;
+    }
     thread_trace(parms);
   }
   return NULL;
 }
 
 
+/*
+ * Divide the pixels of the current render region among the threads.
+ * This is redone for each band of a tiled image, while the threads
+ * wait on the barrier.
+ */
+static void assign_render_rows(scenedef * scene) {
+  thr_parms * parms = (thr_parms *) scene->threadparms;
+  int startx, stopx, starty, stopy;
+  int thr;
+
+  /* only the pixels in the crop window are rendered */
+  render_region(scene, &startx, &stopx, &starty, &stopy);
+
+  for (thr=0; thr<scene->numthreads; thr++) {
+    /* For a threads-only build (or MPI nodes == 1), we distribute  */
+    /* work round-robin by scanlines.  For MPI-only builds, we also */
+    /* distribute by scanlines.  For mixed MPI+threads builds, we   */
+    /* distribute work to nodes by scanline, and to the threads     */
+    /* within a node on a pixel-by-pixel basis.                     */
+    if (scene->nodes == 1) {
+      parms[thr].startx = startx;
+      parms[thr].stopx  = stopx;
+      parms[thr].xinc   = 1;
+      parms[thr].starty = starty + thr;
+      parms[thr].stopy  = stopy;
+      parms[thr].yinc   = scene->numthreads;
+    } else {
+      parms[thr].startx = startx + thr;
+      parms[thr].stopx  = stopx;
+      parms[thr].xinc   = scene->numthreads;
+      parms[thr].starty = starty + scene->mynode;
+      parms[thr].stopy  = stopy;
+      parms[thr].yinc   = scene->nodes;
+    }
+  }
+}
+
+
 /* 
  * Create the pool of rendering threads, initialize all of the
  * state variables they need, and start them waiting on the barrier.
@@ -91,6 +174,8 @@ void create_render_threads(scenedef * scene) {
   rt_atomic_int_t * rowbars;
   rt_atomic_int_t * rowsdone;
 #endif
+  int * cpulist = NULL;
+  int numcpus = 0, numnodes = 0, numpinned = 0;
   int thr;
 
   /* allocate and initialize thread parameter buffers */
@@ -110,43 +195,48 @@ void create_render_threads(scenedef * scene) {
   rt_atomic_int_init(rowsdone, 0);
 #endif
 
+  if (scene->numamode != RT_NUMA_OFF) {
+    cpulist = rt_cpu_affinitylist(&numcpus);
+    if (cpulist != NULL && numcpus < 1) {
+      free(cpulist);
+      cpulist = NULL;
+    }
+  }
+
   for (thr=0; thr<scene->numthreads; thr++) {
     parms[thr].tid=thr;
     parms[thr].nthr=scene->numthreads;
     parms[thr].scene=scene;
 
-    /* the sizes of these arrays are padded to avoid cache aliasing */
-    /* and false sharing between threads.                           */
-    parms[thr].local_mbox = 
-#if !defined(DISABLEMBOX)
-      (unsigned long *) calloc(sizeof(unsigned long)*scene->objgroup.numobjects + 32, 1);
-#else
-      NULL;
-#endif
+    grid_mbox_alloc(scene, &parms[thr].local_mbox, &parms[thr].local_hashmbox);
 
     parms[thr].serialno = 1;
     parms[thr].runbar = bar;
-
-    /* For a threads-only build (or MPI nodes == 1), we distribute  */
-    /* work round-robin by scanlines.  For MPI-only builds, we also */
-    /* distribute by scanlines.  For mixed MPI+threads builds, we   */
-    /* distribute work to nodes by scanline, and to the threads     */
-    /* within a node on a pixel-by-pixel basis.                     */
-    if (scene->nodes == 1) {
-      parms[thr].startx = 1;
-      parms[thr].stopx  = scene->hres;
-      parms[thr].xinc   = 1;
-      parms[thr].starty = thr + 1;
-      parms[thr].stopy  = scene->vres;
-      parms[thr].yinc   = scene->numthreads;
-    } else {
-      parms[thr].startx = thr + 1;
-      parms[thr].stopx  = scene->hres;
-      parms[thr].xinc   = scene->numthreads;
-      parms[thr].starty = scene->mynode + 1;
-      parms[thr].stopy  = scene->vres;
-      parms[thr].yinc   = scene->nodes;
+    memset(&parms[thr].stats, 0, sizeof(rt_render_stats));
+
+    /* in the NUMA modes, all but the calling thread are pinned to CPUs, */
+    /* starting after the first one, which is left to the caller.        */
+    parms[thr].cpu = -1;
+    parms[thr].numanode = -1;
+    parms[thr].numaleader = 0;
+    if (cpulist != NULL && thr > 0) {
+      int other;
+
+      parms[thr].cpu = cpulist[thr % numcpus];
+      parms[thr].numanode = rt_cpu_numa_node(parms[thr].cpu);
+      if (parms[thr].numanode < 0)
+        parms[thr].numanode = 0; /* unknown, assume a single node */
+      if (parms[thr].numanode >= numnodes)
+        numnodes = parms[thr].numanode + 1;
+
+      parms[thr].numaleader = 1;
+      for (other=1; other<thr; other++) {
+        if (parms[other].numanode == parms[thr].numanode)
+          parms[thr].numaleader = 0;
+      }
+      numpinned++;
     }
+
 #if defined(MPI) && defined(THR)
     parms[thr].numrowbars = numrowbars;
     parms[thr].rowbars = rowbars;
@@ -154,8 +244,28 @@ void create_render_threads(scenedef * scene) {
 #endif
   }
 
+  if (cpulist != NULL) {
+    free(cpulist);
+
+    /* the first thread on each node copies the grids for it */
+    if (scene->numamode == RT_NUMA_REPLICATE && numnodes > 0)
+      grid_numa_init(scene, numnodes);
+
+    if (scene->verbosemode && scene->mynode == 0) {
+      char msgtxt[256];
+      sprintf(msgtxt, "Pinned %d worker threads to CPUs on %d NUMA nodes%s.",
+              numpinned, numnodes, (scene->numanodes > 0) ? 
+              ", with a copy of the grids on each" : "");
+      rt_scene_ui_message(scene, MSG_0, msgtxt);
+    }
+  } else if (scene->numamode != RT_NUMA_OFF && scene->mynode == 0) {
+    rt_scene_ui_message(scene, MSG_0, 
+                        "Warning: CPU affinity unavailable, threads not pinned.");
+  }
+
   scene->threadparms = (void *) parms;
   scene->threads = (void *) threads;
+  assign_render_rows(scene);
 
   for (thr=1; thr < scene->numthreads; thr++) 
     rt_thread_create(&threads[thr], thread_worker, (void *) (&parms[thr]));
@@ -197,6 +307,8 @@ void destroy_render_threads(scenedef * scene) {
     for (thr=0; thr < parms[0].nthr; thr++) {
       if (parms[thr].local_mbox != NULL) 
         free(parms[thr].local_mbox);
+      if (parms[thr].local_hashmbox != NULL) 
+        free(parms[thr].local_hashmbox);
     }
 
 #if defined(MPI) && defined(THR)
@@ -212,12 +324,35 @@ void destroy_render_threads(scenedef * scene) {
     free(scene->threadparms);
   }
 
+  /* the worker threads' copies of the grids go with them */
+  grid_numa_free(scene);
+
   scene->threads = NULL;
   scene->threadparms = NULL;
 }
 
 
 
+/*
+ * The part of the image that is kept, which is the crop window if
+ * cropping is on, or else the whole image.
+ */
+void render_output_window(const scenedef * scene, int * xres, int * yres, 
+                          int * xstart, int * ystart) {
+  if (scene->imgcrop.cropmode == RT_CROP_ENABLED) {
+    *xres   = scene->imgcrop.xres;
+    *yres   = scene->imgcrop.yres;
+    *xstart = scene->imgcrop.xstart;
+    *ystart = scene->imgcrop.ystart;
+  } else {
+    *xres   = scene->hres;
+    *yres   = scene->vres;
+    *xstart = 0;
+    *ystart = 0;
+  }
+}
+
+
 /*
  * Check the scene to determine whether or not any parameters that affect
  * the thread pool, the persistent message passing primitives, or other
@@ -232,7 +367,7 @@ static void rendercheck(scenedef * scene) {
     int i, totalcpus;
     flt totalspeed;
 
-    rt_ui_message(MSG_0, "CPU Information:");
+    rt_scene_ui_message(scene, MSG_0, "CPU Information:");
 
     totalspeed = 0.0;
     totalcpus = 0;
@@ -241,16 +376,33 @@ static void rendercheck(scenedef * scene) {
             "  Node %4d: %2d CPUs, CPU Speed %4.2f, Node Speed %6.2f Name: %s",
             i, scene->cpuinfo[i].numcpus, scene->cpuinfo[i].cpuspeed,
             scene->cpuinfo[i].nodespeed, scene->cpuinfo[i].machname);
-      rt_ui_message(MSG_0, msgtxt);
+      rt_scene_ui_message(scene, MSG_0, msgtxt);
 
       totalcpus += scene->cpuinfo[i].numcpus;
       totalspeed += scene->cpuinfo[i].nodespeed;
     }
 
     sprintf(msgtxt, "  Total CPUs: %d", totalcpus);
-    rt_ui_message(MSG_0, msgtxt);
+    rt_scene_ui_message(scene, MSG_0, msgtxt);
     sprintf(msgtxt, "  Total Speed: %f\n", totalspeed);
-    rt_ui_message(MSG_0, msgtxt);
+    rt_scene_ui_message(scene, MSG_0, msgtxt);
+  }
+
+  if (scene->verbosemode && scene->mynode == 0) {
+    char msgtxt[1024];
+    list * cur;
+    size_t texmem = 0;
+    int numtex = 0;
+
+    /* image and MIP map memory is not counted here */
+    for (cur = scene->texlist; cur != NULL; cur = cur->next) {
+      texmem += texture_memsize((texture *) cur->item) + sizeof(list);
+      numtex++;
+    }
+
+    sprintf(msgtxt, "Scene contains %d textures, %d shared, using %.1f KB.",
+            numtex, textable_count(scene->textable), texmem / 1024.0);
+    rt_scene_ui_message(scene, MSG_0, msgtxt);
   }
 
   rt_barrier_sync();     /* synchronize all nodes at this point             */
@@ -262,6 +414,16 @@ static void rendercheck(scenedef * scene) {
   if (scene->boundmode == RT_BOUNDING_ENABLED) 
     engrid_scene(scene, scene->boundthresh); 
 
+  if (scene->verbosemode && scene->mynode == 0) {
+    char msgtxt[1024];
+    size_t allocated, used;
+
+    scene_memstats(scene, &allocated, &used);
+    sprintf(msgtxt, "Object memory: %.1f KB allocated, %.1f KB used.",
+            allocated / 1024.0, used / 1024.0);
+    rt_scene_ui_message(scene, MSG_0, msgtxt);
+  }
+
   /* if any clipping groups exist, we have to use appropriate */
   /* intersection testing logic                               */
   if (scene->cliplist != NULL) {
@@ -274,28 +436,73 @@ static void rendercheck(scenedef * scene) {
     scene->img = NULL;
   }
 
+  /* the image buffer only holds the crop window, if cropping is on, */
+  /* pixels of the window outside of the image are left black         */
+  render_output_window(scene, &scene->imgxres, &scene->imgyres, 
+                       &scene->imgxstart, &scene->imgystart);
+
+  /* for tiled output, the buffer only holds one band of rows, which  */
+  /* starts out as the top one                                        */
+  scene->numtiles = 0;
+  scene->curtile = 0;
+  if (scene->tilerows > 0 && scene->tilerows < scene->imgyres) {
+    if (scene->img != NULL) {
+      if (scene->mynode == 0)
+        rt_scene_ui_message(scene, MSG_0, 
+          "Warning: Tiled output can't use a caller's image buffer.");
+    } else {
+      scene->numtiles = (scene->imgyres + scene->tilerows - 1) / scene->tilerows;
+      scene->imgystart += scene->imgyres - scene->tilerows;
+      scene->imgyres = scene->tilerows;
+    }
+  }
+
   /* Allocate a new image buffer if necessary */
   if (scene->img == NULL) {
+    size_t numpixels = (size_t) scene->imgxres * scene->imgyres;
+
     scene->imginternal = 1;
     if (scene->verbosemode && scene->mynode == 0) { 
-      rt_ui_message(MSG_0, "Allocating Image Buffer."); 
+      rt_scene_ui_message(scene, MSG_0, "Allocating Image Buffer."); 
     }
 
     /* allocate the image buffer accordinate to pixel format */
     if (scene->imgbufformat == RT_IMAGE_BUFFER_RGB24) {
-      scene->img = malloc(scene->hres * scene->vres * 3);
+      scene->img = calloc(numpixels * 3, 1);
     } else if (scene->imgbufformat == RT_IMAGE_BUFFER_RGB96F) {
-      scene->img = malloc(sizeof(float) * scene->hres * scene->vres * 3);
+      scene->img = calloc(numpixels * 3, sizeof(float));
     } else {
-      rt_ui_message(MSG_0, "Illegal image buffer format specifier!"); 
+      rt_scene_ui_message(scene, MSG_0, "Illegal image buffer format specifier!"); 
     }
 
     if (scene->img == NULL) {
       scene->imginternal = 0;
-      rt_ui_message(MSG_0, "Warning: Failed To Allocate Image Buffer!"); 
+      rt_scene_ui_message(scene, MSG_0, "Warning: Failed To Allocate Image Buffer!"); 
     } 
   }
 
+  /* the cost map matches the image resolution, so it is redone  */
+  /* along with the image buffer                                 */
+  if (scene->costmap != NULL) {
+    free(scene->costmap);
+    scene->costmap = NULL;
+  }
+  if (scene->costmapfile[0] != '\0' && scene->numtiles > 0) {
+    if (scene->mynode == 0)
+      rt_scene_ui_message(scene, MSG_0, 
+        "Warning: Cost maps aren't available with tiled output.");
+  } else if (scene->costmapfile[0] != '\0' && scene->nodes > 1) {
+    /* each node only knows the cost of the rows it renders */
+    if (scene->mynode == 0)
+      rt_scene_ui_message(scene, MSG_0, 
+        "Warning: Cost maps aren't available with multiple nodes.");
+  } else if (scene->costmapfile[0] != '\0') {
+    scene->costmap = (unsigned int *) 
+      calloc((size_t) scene->imgxres * scene->imgyres, sizeof(unsigned int));
+    if (scene->costmap == NULL)
+      rt_scene_ui_message(scene, MSG_0, "Warning: Failed To Allocate Cost Map!"); 
+  }
+
   /* if any threads are leftover from a previous scene, and the  */
   /* scene has changed significantly, we have to collect, and    */
   /* respawn the worker threads, since lots of things may have   */
@@ -315,16 +522,48 @@ static void rendercheck(scenedef * scene) {
   rt_timer_stop(stth); /* Preprocessing is finished, stop timing */
   runtime=rt_timer_time(stth);   
   rt_timer_destroy(stth);
+  scene->preproctime = runtime;
 
   /* Print out relevent timing info */
   if (scene->mynode == 0) {
     char msgtxt[256];
     sprintf(msgtxt, "Preprocessing Time: %10.4f seconds",runtime);
-    rt_ui_message(MSG_0, msgtxt);
+    rt_scene_ui_message(scene, MSG_0, msgtxt);
   }
 }
 
 
+/*
+ * Save the per-pixel cost of the last frame as a false color image.
+ */
+static void writecostmap(scenedef * scene) {
+  unsigned char * img;
+  unsigned int maxcost;
+  double meancost;
+  int fileformat = scene->imgfileformat;
+  char msgtxt[512];
+
+  img = image_rgb24_from_costmap(scene->imgxres, scene->imgyres, 
+                                 scene->costmap, &maxcost, &meancost);
+  if (img == NULL) {
+    rt_scene_ui_message(scene, MSG_0, "Warning: Failed To Allocate Cost Map Image!"); 
+    return;
+  }
+
+  /* HDR formats need float pixels, fall back to PPM for those */
+  if (fileformat == RT_FORMAT_PFM || fileformat == RT_FORMAT_EXR)
+    fileformat = RT_FORMAT_PPM;
+
+  writeimage(scene->costmapfile, scene->imgxres, scene->imgyres, 
+             img, RT_IMAGE_BUFFER_RGB24, fileformat);
+  free(img);
+
+  sprintf(msgtxt, "  Cost map: %.1f tests per pixel, %u at most, in %.400s", 
+          meancost, maxcost, scene->costmapfile);
+  rt_scene_ui_message(scene, MSG_0, msgtxt);
+}
+
+
 /*
  * Save the rendered image to disk.
  */
@@ -336,89 +575,149 @@ static void renderio(scenedef * scene) {
   ioth=rt_timer_create();
   rt_timer_start(ioth);
 
-  if (scene->imgbufformat == RT_IMAGE_BUFFER_RGB96F) {
+  /* HDR formats store the raw float pixel values, so they are written */
+  /* straight from the image buffer without any post-processing passes */
+  if (scene->imgfileformat == RT_FORMAT_PFM ||
+      scene->imgfileformat == RT_FORMAT_EXR) {
+    if (scene->imgbufformat != RT_IMAGE_BUFFER_RGB96F) {
+      sprintf(msgtxt, "HDR image formats require a float image buffer, "
+              "%.150s not written", scene->outfilename);
+      rt_scene_ui_message(scene, MSG_0, msgtxt);
+      rt_timer_destroy(ioth);
+      return;
+    }
+  } else if (scene->imgbufformat == RT_IMAGE_BUFFER_RGB96F) {
     if (scene->imgprocess & RT_IMAGE_NORMALIZE) {
-      normalize_rgb96f(scene->hres, scene->vres, (float *) scene->img);
-      rt_ui_message(MSG_0, "Post-processing: normalizing pixel values.");
+      normalize_rgb96f(scene->imgxres, scene->imgyres, (float *) scene->img);
+      rt_scene_ui_message(scene, MSG_0, "Post-processing: normalizing pixel values.");
     }
 
     if (scene->imgprocess & RT_IMAGE_GAMMA) {
-      gamma_rgb96f(scene->hres, scene->vres, (float *) scene->img, 
+      gamma_rgb96f(scene->imgxres, scene->imgyres, (float *) scene->img, 
                    scene->imggamma);
-      rt_ui_message(MSG_0, "Post-processing: gamma correcting pixel values.");
+      rt_scene_ui_message(scene, MSG_0, "Post-processing: gamma correcting pixel values.");
     }
   } else if (scene->imgbufformat == RT_IMAGE_BUFFER_RGB24) {
     if (scene->imgprocess & (RT_IMAGE_NORMALIZE | RT_IMAGE_GAMMA))
-      rt_ui_message(MSG_0, "Can't post-process 24-bit integer image data");
+      rt_scene_ui_message(scene, MSG_0, "Can't post-process 24-bit integer image data");
   }
 
-  /* support cropping of output images for SPECMPI benchmarks */
-  if (scene->imgcrop.cropmode == RT_CROP_DISABLED) {
-    writeimage(scene->outfilename, scene->hres, scene->vres, 
-               scene->img, scene->imgbufformat, scene->imgfileformat);
-  } else {
-    /* crop image before writing if necessary */
-    if (scene->imgbufformat == RT_IMAGE_BUFFER_RGB96F) {
-      float *imgcrop;
-      imgcrop = image_crop_rgb96f(scene->hres, scene->vres, scene->img,
-                                  scene->imgcrop.xres, scene->imgcrop.yres, 
-                                  scene->imgcrop.xstart, scene->imgcrop.ystart);
-      writeimage(scene->outfilename, scene->imgcrop.xres, scene->imgcrop.yres,
-                 imgcrop, scene->imgbufformat, scene->imgfileformat);
-      free(imgcrop);
-    } else if (scene->imgbufformat == RT_IMAGE_BUFFER_RGB24) {
-      unsigned char *imgcrop;
-      imgcrop = image_crop_rgb24(scene->hres, scene->vres, scene->img,
-                                 scene->imgcrop.xres, scene->imgcrop.yres, 
-                                 scene->imgcrop.xstart, scene->imgcrop.ystart);
-      writeimage(scene->outfilename, scene->imgcrop.xres, scene->imgcrop.yres,
-                 imgcrop, scene->imgbufformat, scene->imgfileformat);
-      free(imgcrop);
-    }
-  }
+  /* a cropped image was only rendered within the crop window, */
+  /* so the image buffer already holds just the cropped image   */
+  writeimage(scene->outfilename, scene->imgxres, scene->imgyres, 
+             scene->img, scene->imgbufformat, scene->imgfileformat);
+
+  if (scene->costmap != NULL)
+    writecostmap(scene);
 
   rt_timer_stop(ioth);
   iotime = rt_timer_time(ioth);
   rt_timer_destroy(ioth);
+  scene->iotime = iotime;
 
   sprintf(msgtxt, "    Image I/O Time: %10.4f seconds", iotime);
-  rt_ui_message(MSG_0, msgtxt);
+  rt_scene_ui_message(scene, MSG_0, msgtxt);
 }
 
 
 /*
- * Render the scene
+ * The range of pixels to render, which is the part of the crop window 
+ * that lies within the image, or the whole image if there is no cropping.
+ * Pixels are numbered from 1 like in the ray tracing loops.
  */
-void renderscene(scenedef * scene) {
-  flt runtime;
-  rt_timerhandle rtth; /* render time timer handle */
+void render_region(const scenedef * scene, int * startx, int * stopx, 
+                   int * starty, int * stopy) {
+  *startx = MYMAX(1, scene->imgxstart + 1);
+  *stopx  = MYMIN(scene->hres, scene->imgxstart + scene->imgxres);
+  *starty = MYMAX(1, scene->imgystart + 1);
+  *stopy  = MYMIN(scene->vres, scene->imgystart + scene->imgyres);
+}
 
-  /* if certain key aspects of the scene parameters have been changed */
-  /* since the last frame rendered, or when rendering the scene the   */
-  /* first time, various setup, initialization and memory allocation  */
-  /* routines need to be run in order to prepare for rendering.       */
-  if (scene->scenecheck)
-    rendercheck(scene);
 
-  if (scene->mynode == 0) 
-    rt_ui_progress(0);     /* print 0% progress at start of rendering */
+/*
+ * Add one set of ray and intersection statistics to another.
+ */
+void render_stats_add(rt_render_stats * sum, const rt_render_stats * stats) {
+  unsigned long long * s = (unsigned long long *) sum;
+  const unsigned long long * a = (const unsigned long long *) stats;
+  int i;
 
+  for (i=0; i<(int) (sizeof(rt_render_stats) / sizeof(unsigned long long)); i++)
+    s[i] += a[i];
+}
 
-  /* 
-   * Core Ray Tracing Code
-   *
-   * Ideally, as little as possible other than this code should be
-   * executed for rendering a frame.  Most if not all memory allocations
-   * should be done outside of the core code, and all setup should be
-   * done outside of here.  This will give the best speed when rendering
-   * walk-throughs and similar things.  
-   */
 
-  rtth=rt_timer_create();  /* create/init rendering timer              */
-  rt_timer_start(rtth);    /* start ray tracing timer                  */
+/*
+ * Collect the statistics of all worker threads into the scene totals,
+ * once the threads have finished a frame, or a batch of frames.
+ */
+static void merge_render_stats(scenedef * scene) {
+  thr_parms * parms = (thr_parms *) scene->threadparms;
+  int thr;
+
+  if (!scene->statsmode)
+    return;
+
+  for (thr=0; thr<parms[0].nthr; thr++) {
+    render_stats_add(&scene->stats, &parms[thr].stats);
+    memset(&parms[thr].stats, 0, sizeof(rt_render_stats));
+  }
+}
+
+
+/*
+ * Sum the statistics of all nodes into node 0's totals, once all of the 
+ * frames have been rendered.  The other nodes keep their own counts.
+ */
+static void reduce_render_stats(scenedef * scene) {
+  if (!scene->statsmode || scene->nodes < 2)
+    return;
+
+  /* the struct holds nothing but unsigned long long counters */
+  rt_sum_ulonglongs((unsigned long long *) &scene->stats, 
+                    sizeof(rt_render_stats) / sizeof(unsigned long long));
+}
 
-  camera_init(scene);      /* Initialize all aspects of camera system  */
 
+/*
+ * Print the statistics gathered for the last frame or batch of frames.
+ */
+static void report_render_stats(scenedef * scene) {
+  const rt_render_stats * st = &scene->stats;
+  char msgtxt[256];
+  int i;
+
+  sprintf(msgtxt, "  Rays: %llu primary, %llu shadow, %llu AO, "
+          "%llu reflection, %llu transmission",
+          st->primaryrays, st->shadowrays, st->aorays, 
+          st->reflectionrays, st->transmissionrays);
+  rt_scene_ui_message(scene, MSG_0, msgtxt);
+
+  sprintf(msgtxt, "  Grid cells visited: %llu, mailbox rejections: %llu",
+          st->gridcells, st->mailboxrejects);
+  rt_scene_ui_message(scene, MSG_0, msgtxt);
+
+  for (i=0; i<RT_STATS_NUMTYPES; i++) {
+    if (st->tests[i] == 0 && st->hits[i] == 0)
+      continue;
+    sprintf(msgtxt, "  %-10s %14llu tests %14llu hits %6.2f%%",
+            rt_render_stats_typename(i), st->tests[i], st->hits[i], 
+            (st->tests[i] > 0) ? (100.0 * st->hits[i]) / st->tests[i] : 0.0);
+    rt_scene_ui_message(scene, MSG_0, msgtxt);
+  }
+}
+
+
+/*
+ * Ray trace the scene's image rows with its camera as already set up,
+ * into the scene's image buffer.  This is the core of the frame rendering
+ * code, ideally as little as possible other than this code should be 
+ * executed for rendering a frame.  Most if not all memory allocations 
+ * should be done outside of the core code, and all setup should be done 
+ * outside of here.  This will give the best speed when rendering 
+ * walk-throughs and similar things.
+ */
+static void render_pass(scenedef * scene) {
 #if defined(MPI) && defined(THR)
   /* reset the rows counter for this frame */
   rt_atomic_int_set(((thr_parms *) scene->threadparms)[0].rowsdone, 0);
@@ -440,28 +739,345 @@ void renderscene(scenedef * scene) {
 #ifdef MPI
   rt_waitscanlines(scene->parbuf);  /* wait for all scanlines to recv/send  */
 #endif
+}
+
+/* Ray trace one frame with the scene's own camera */
+static void render_frame(scenedef * scene) {
+  camera_init(scene);      /* Initialize all aspects of camera system  */
+  render_pass(scene);
+}
+
+
+/*
+ * Create the output file of a tiled image, which is written one band of
+ * rows at a time as they are rendered.  Only node 0 writes the image.
+ * When resuming from firsttile, the existing file is opened instead, 
+ * keeping the bands that are already in it, or if it can't be, the 
+ * image is started over from the first band.
+ */
+static void * open_tiled_output(scenedef * scene, int * firsttile) {
+  void * imgfile;
+  char msgtxt[2048];
+  int outxres, outyres, outxstart, outystart, fileformat;
+
+  render_output_window(scene, &outxres, &outyres, &outxstart, &outystart);
+  fileformat = imagebands_format(outxres, outyres, 
+                                 scene->imgbufformat, scene->imgfileformat);
+
+  if (*firsttile > 0) {
+    imgfile = openimagebands(scene->outfilename, outxres, outyres, 
+                             scene->imgbufformat, fileformat, 1);
+    if (imgfile != NULL) {
+      sprintf(msgtxt, "Resuming %.1900s from band %d of %d.", 
+              scene->outfilename, *firsttile + 1, scene->numtiles);
+      rt_scene_ui_message(scene, MSG_0, msgtxt);
+      return imgfile;
+    }
+  }
+  *firsttile = 0;
+
+  if (scene->verbosemode) {
+    sprintf(msgtxt, "Rendering %d bands of %d rows.", 
+            scene->numtiles, scene->tilerows);
+    rt_scene_ui_message(scene, MSG_0, msgtxt);
+  }
+  if (fileformat != scene->imgfileformat) {
+    sprintf(msgtxt, "Tiled output only writes Targa, PPM, and PFM files, "
+            "writing a %s file instead.", 
+            (fileformat == RT_FORMAT_PFM) ? "PFM" : "PPM");
+    rt_scene_ui_message(scene, MSG_0, msgtxt);
+  }
+  if (scene->imgprocess & RT_IMAGE_NORMALIZE)
+    rt_scene_ui_message(scene, MSG_0, "Can't normalize the pixel values of tiled images");
+
+  imgfile = openimagebands(scene->outfilename, outxres, outyres, 
+                           scene->imgbufformat, fileformat, 0);
+  if (imgfile == NULL) {
+    sprintf(msgtxt, "Cannot create %.1900s for output!", scene->outfilename);
+    rt_scene_ui_message(scene, MSG_0, msgtxt);
+  }
+
+  return imgfile;
+}
+
+
+/*
+ * Render a tiled image one band of rows at a time, from the top of the
+ * image down, writing each band to the output file when it's finished.
+ * Every node renders its rows of each band, and node 0 writes them out.
+ * Rendering starts at firsttile, when the bands above it are already in
+ * the file.  Returns the time spent writing the image.
+ */
+static flt render_tiles(scenedef * scene, void * imgfile, int firsttile) {
+  rt_timerhandle ioth; /* I/O timer handle */
+  char msgtxt[2048];
+  size_t bandsz;
+  flt iotime = 0.0;
+  int outxres, outyres, outxstart, outystart, fileformat, tile;
+
+  render_output_window(scene, &outxres, &outyres, &outxstart, &outystart);
+  fileformat = imagebands_format(outxres, outyres, 
+                                 scene->imgbufformat, scene->imgfileformat);
+
+  bandsz = (size_t) scene->imgxres * scene->tilerows * 3;
+  if (scene->imgbufformat == RT_IMAGE_BUFFER_RGB96F)
+    bandsz *= sizeof(float);
+
+  /* the camera is set up once, since camera_init() renormalizes its */
+  /* vectors, and doing that for each band would shift them slightly */
+  camera_init(scene);
+
+  ioth=rt_timer_create();
+  for (tile=firsttile; tile<scene->numtiles; tile++) {
+    int rows = MYMIN(scene->tilerows, outyres - tile * scene->tilerows);
+
+    /* the bands go down from the top of the image, in file order */
+    scene->curtile = tile;
+    scene->imgyres = rows;
+    scene->imgystart = outystart + outyres - tile * scene->tilerows - rows;
+
+    /* the band buffer is reused, pixels outside the image stay black. */
+    /* The first band is left to the worker threads, which may place   */
+    /* its pages on their NUMA nodes, like an untiled frame's buffer.  */
+    if (scene->img != NULL && tile > firsttile)
+      memset(scene->img, 0, bandsz);
+
+    assign_render_rows(scene);
+    rt_delete_scanlinereceives(scene->parbuf);
+    scene->parbuf = rt_init_scanlinereceives(scene);
+
+    render_pass(scene);
+
+    if (imgfile != NULL) {
+      rt_timer_start(ioth);
+      if (scene->imgbufformat == RT_IMAGE_BUFFER_RGB96F &&
+          (scene->imgprocess & RT_IMAGE_GAMMA) && fileformat != RT_FORMAT_PFM)
+        gamma_rgb96f(scene->imgxres, rows, (float *) scene->img, 
+                     scene->imggamma);
+
+      if (writeimageband(imgfile, scene->imgystart - outystart, rows, 
+                         scene->img) != IMAGENOERR) {
+        sprintf(msgtxt, "Warning: Failed to write image %.1900s", 
+                scene->outfilename);
+        rt_scene_ui_message(scene, MSG_0, msgtxt);
+        closeimagebands(imgfile);
+        imgfile = NULL;
+      } else {
+        checkpoint_save(scene, scene->ckptframe, tile + 1, imgfile);
+      }
+      rt_timer_stop(ioth);
+      iotime += rt_timer_time(ioth);
+    }
+  }
+  rt_timer_destroy(ioth);
+
+  if (imgfile != NULL)
+    closeimagebands(imgfile);
+
+  return iotime;
+}
+
+
+/*
+ * Render the scene
+ */
+void renderscene(scenedef * scene) {
+  flt runtime;
+  rt_timerhandle rtth; /* render time timer handle */
+  void * imgfile = NULL;
+  int firsttile;
+
+  /* if certain key aspects of the scene parameters have been changed */
+  /* since the last frame rendered, or when rendering the scene the   */
+  /* first time, various setup, initialization and memory allocation  */
+  /* routines need to be run in order to prepare for rendering.       */
+  /* Objects staged by the scene construction API are merged first.   */
+  if (merge_staged_objects(scene))
+    scene->scenecheck = 1;
+
+  scene->preproctime = 0.0;
+  scene->iotime = 0.0;
+  if (scene->scenecheck)
+    rendercheck(scene);
+
+  /* an interrupted render picks up where it left off, which node 0 */
+  /* works out from the checkpoint, and tells the other nodes       */
+  firsttile = checkpoint_resume(scene);
+  if (firsttile > 0 && !scene->writeimagefile)
+    firsttile = 0;
+
+  /* tiled images are written out band by band as they're rendered */
+  if (scene->numtiles > 0 && scene->writeimagefile && scene->mynode == 0 &&
+      firsttile != CKPT_FRAMEDONE)
+    imgfile = open_tiled_output(scene, &firsttile);
+
+  if (scene->ckptfile[0] != '\0')
+    rt_broadcast_ints(&firsttile, 1);
+
+  if (firsttile == CKPT_FRAMEDONE) {
+    if (scene->mynode == 0) {
+      char msgtxt[256];
+      sprintf(msgtxt, "Frame %d was finished by an earlier run, skipping it.",
+              scene->ckptframe);
+      rt_scene_ui_message(scene, MSG_0, msgtxt);
+    }
+    scene->ckptframe++;
+    return;
+  }
+
+  if (scene->mynode == 0) 
+    rt_scene_ui_progress(scene, 0);     /* print 0% progress at start of rendering */
+
+  memset(&scene->stats, 0, sizeof(rt_render_stats));
+
+  rtth=rt_timer_create();  /* create/init rendering timer              */
+  rt_timer_start(rtth);    /* start ray tracing timer                  */
+
+  if (scene->numtiles > 0)
+    scene->iotime = render_tiles(scene, imgfile, firsttile);
+  else
+    render_frame(scene);
 
   rt_timer_stop(rtth);              /* stop timer for ray tracing runtime   */
-  runtime=rt_timer_time(rtth);
+  runtime=rt_timer_time(rtth) - scene->iotime; /* without band writes */
   rt_timer_destroy(rtth);
+  scene->tracetime = runtime;
+
+  merge_render_stats(scene);
+  reduce_render_stats(scene);
 
   /*
-   * End of Core Ray Tracing Code
-   *
    * Anything after here should be UI, tear-down, or reset code 
-   *
    */
 
   if (scene->mynode == 0) {
     char msgtxt[256];
 
-    rt_ui_progress(100); /* print 100% progress when finished rendering */
+    rt_scene_ui_progress(scene, 100); /* print 100% progress when finished rendering */
 
     sprintf(msgtxt, "\n  Ray Tracing Time: %10.4f seconds", runtime);
-    rt_ui_message(MSG_0, msgtxt);
+    rt_scene_ui_message(scene, MSG_0, msgtxt);
+
+    if (scene->statsmode)
+      report_render_stats(scene);
  
-    if (scene->writeimagefile) 
+    if (scene->numtiles > 0) {
+      /* the bands were written as they were finished */
+      if (scene->writeimagefile) {
+        sprintf(msgtxt, "    Image I/O Time: %10.4f seconds", scene->iotime);
+        rt_scene_ui_message(scene, MSG_0, msgtxt);
+      }
+    } else if (scene->writeimagefile) {
       renderio(scene);
+    }
+
+    /* the image is written, so the frame doesn't need rendering again */
+    checkpoint_save(scene, scene->ckptframe + 1, 0, NULL);
   }
+  scene->ckptframe++;
 } /* end of renderscene() */
 
+
+/*
+ * Render a batch of camera keyframes into caller supplied image buffers.
+ * Only the camera changes between frames, so the scene is checked once,
+ * and the worker threads are woken up once for the whole batch.  They
+ * set up the camera for each frame themselves and don't wait for each 
+ * other between frames.  Message passing runs exchange scanlines for
+ * each frame, so they render the frames one at a time instead.
+ */
+void renderscene_keyframes(scenedef * scene, int numframes, 
+                           const rt_camera_keyframe * keys, void ** images) {
+  flt runtime;
+  rt_timerhandle rtth; /* render time timer handle */
+  vector center, viewvec, upvec;
+  const rt_camera_keyframe * last;
+
+  if (numframes < 1)
+    return;
+
+  if (merge_staged_objects(scene))
+    scene->scenecheck = 1;
+
+  scene->preproctime = 0.0;
+  scene->iotime = 0.0;
+  if (scene->scenecheck)
+    rendercheck(scene);
+
+  /* the frames go to caller buffers, which can't be done in bands */
+  if (scene->numtiles > 0) {
+    if (scene->mynode == 0)
+      rt_scene_ui_message(scene, MSG_0, 
+        "Keyframe batches can't be rendered with tiled output.");
+    return;
+  }
+
+  if (scene->mynode == 0) 
+    rt_scene_ui_progress(scene, 0);     /* print 0% progress at start of rendering */
+
+  memset(&scene->stats, 0, sizeof(rt_render_stats));
+
+  rtth=rt_timer_create();  /* create/init rendering timer              */
+  rt_timer_start(rtth);    /* start ray tracing timer                  */
+
+  if (scene->nodes == 1) {
+    scene->keyframes = keys;
+    scene->keyimages = images;
+    scene->numkeyframes = numframes;
+
+#ifdef THR
+    /* wake up the child threads once for all of the frames */
+    rt_thread_barrier(((thr_parms *) scene->threadparms)[0].runbar, 1);
+#endif
+
+    thread_trace(&((thr_parms *) scene->threadparms)[0]);
+    merge_render_stats(scene);
+
+    scene->keyframes = NULL;
+    scene->keyimages = NULL;
+    scene->numkeyframes = 0;
+  } else {
+    size_t imgsz = (size_t) scene->imgxres * scene->imgyres * 3;
+    int frame;
+
+    if (scene->imgbufformat == RT_IMAGE_BUFFER_RGB96F)
+      imgsz *= sizeof(float);
+
+    for (frame=0; frame<numframes; frame++) {
+      camera_keyframe(scene, &keys[frame], &scene->camera);
+      render_frame(scene);
+      merge_render_stats(scene);
+      if (scene->img != NULL && images[frame] != NULL)
+        memcpy(images[frame], scene->img, imgsz);
+    }
+    reduce_render_stats(scene);
+  }
+
+  rt_timer_stop(rtth);              /* stop timer for ray tracing runtime   */
+  runtime=rt_timer_time(rtth);
+  rt_timer_destroy(rtth);
+  scene->tracetime = runtime;
+
+  /* leave the scene camera at the last keyframe */
+  last = &keys[numframes - 1];
+  center.x  = last->center[0];  center.y  = last->center[1];  center.z  = last->center[2];
+  viewvec.x = last->viewdir[0]; viewvec.y = last->viewdir[1]; viewvec.z = last->viewdir[2];
+  upvec.x   = last->updir[0];   upvec.y   = last->updir[1];   upvec.z   = last->updir[2];
+  cameraposition(&scene->camera, center, viewvec, upvec);
+  if (last->zoom > 0.0f)
+    camerazoom(&scene->camera, last->zoom);
+
+  if (scene->mynode == 0) {
+    char msgtxt[256];
+
+    rt_scene_ui_progress(scene, 100); /* print 100% progress when finished rendering */
+
+    sprintf(msgtxt, "\n  Ray Tracing Time: %10.4f seconds for %d frames, %.2f FPS", 
+            runtime, numframes, (runtime > 0.0) ? numframes / runtime : 0.0);
+    rt_scene_ui_message(scene, MSG_0, msgtxt);
+
+    if (scene->statsmode)
+      report_render_stats(scene);
+  }
+}
+
@@ -6,5 +6,11 @@
 
 void create_render_threads(scenedef * scene);
 void destroy_render_threads(scenedef * scene);
+void render_stats_add(rt_render_stats * sum, const rt_render_stats * stats);
+void render_region(const scenedef * scene, int * startx, int * stopx, 
+                   int * starty, int * stopy);
+void render_output_window(const scenedef * scene, int * xres, int * yres, 
+                          int * xstart, int * ystart);
 void renderscene(scenedef *); 
+void renderscene_keyframes(scenedef *, int, const rt_camera_keyframe *, void **);
 
@@ -15,6 +15,7 @@
 #include "vector.h"
 #include "intersect.h"
 #include "util.h"
+#include "arena.h"
 
 #define RING_PRIVATE
 #include "ring.h"
@@ -23,13 +24,14 @@ static object_methods ring_methods = {
   (void (*)(const void *, void *))(ring_intersect),
   (void (*)(const void *, const void *, const void *, void *))(ring_normal),
   ring_bbox, 
-  free 
+  arena_nofree,
+  RT_STATS_RING
 };
 
-object * newring(void * tex, vector ctr, vector norm, flt inrad, flt outrad) {
+object * newring(scenedef * scene, void * tex, vector ctr, vector norm, flt inrad, flt outrad) {
   ring * r;
   
-  r=(ring *) malloc(sizeof(ring));
+  r=(ring *) scene_alloc(scene, sizeof(ring));
   memset(r, 0, sizeof(ring));
   r->methods = &ring_methods;
 
@@ -4,7 +4,7 @@
  *  $Id: ring.h,v 1.11 2011/02/05 08:10:11 johns Exp $
  */
 
-object * newring(void * tex, vector ctr, vector norm, flt in, flt out);
+object * newring(scenedef * scene, void * tex, vector ctr, vector norm, flt in, flt out);
 
 #ifdef RING_PRIVATE 
 typedef struct {
@@ -290,7 +290,10 @@ color full_shader(ray * incident) {
     }
     shadowray.serial = incident->serial + 1; /* track ray serial number */
     shadowray.mbox = incident->mbox;
+    shadowray.hashmbox = incident->hashmbox;
+    shadowray.numanode = incident->numanode;
     shadowray.scene = incident->scene;
+    shadowray.stats = incident->stats;
 
     while (cur != NULL) {              /* loop for light contributions */
       light * li=(light *) cur->item;  /* set li=to the current light  */
@@ -304,6 +307,7 @@ color full_shader(ray * incident) {
         shadowray.maxdist = shadevars.Llen;
         shadowray.flags = RT_RAY_SHADOW;
         shadowray.serial++;
+        RT_STAT_INC(&shadowray, shadowrays);
         intersect_objects(&shadowray); /* trace the shadow ray */
 
         if (!shadow_intersection(&shadowray)) {
@@ -434,7 +438,10 @@ color shade_ambient_occlusion(ray * incident, const shadedata * shadevars) {
     ambray.add_intersection = add_shadow_intersection;
   }
   ambray.mbox = incident->mbox; 
+  ambray.hashmbox = incident->hashmbox;
+  ambray.numanode = incident->numanode;
   ambray.scene=incident->scene;         /* global scenedef info */
+  ambray.stats=incident->stats;         /* thread's statistics */
 
   for (i=0; i<incident->scene->ambocc.numsamples; i++) {
     float dir[3];
@@ -457,6 +464,7 @@ color shade_ambient_occlusion(ray * incident, const shadedata * shadevars) {
       ambray.d.z = -ambray.d.z;
     }
 
+    RT_STAT_INC(&ambray, aorays);
     intersect_objects(&ambray); /* trace the shadow ray */
 
     /* if no objects were hit, add an ambient contribution */
@@ -506,11 +514,15 @@ color shade_reflection(ray * incident, const shadedata * shadevars, flt specular
   specray.flags = RT_RAY_REGULAR;        /* infinite ray, to start with */
   specray.serial = incident->serial + 1; /* next serial number */
   specray.mbox = incident->mbox; 
+  specray.hashmbox = incident->hashmbox;
+  specray.numanode = incident->numanode;
   specray.scene=incident->scene;         /* global scenedef info */
+  specray.stats=incident->stats;         /* thread's statistics */
   specray.randval=incident->randval;     /* random number seed */
   specray.frng=incident->frng;           /* 32-bit FP RNG handle */
 
   /* inlined code from trace() to eliminate one level of recursion */
+  RT_STAT_INC(&specray, reflectionrays);
   intersect_objects(&specray);           /* trace specular reflection ray */
   col=specray.scene->shader(&specray);
 
@@ -543,11 +555,15 @@ color shade_transmission(ray * incident, const shadedata * shadevars, flt trans)
   transray.flags = RT_RAY_REGULAR;        /* infinite ray, to start with */
   transray.serial = incident->serial + 1; /* update serial number */
   transray.mbox = incident->mbox;
+  transray.hashmbox = incident->hashmbox;
+  transray.numanode = incident->numanode;
   transray.scene=incident->scene;         /* global scenedef info */
+  transray.stats=incident->stats;         /* thread's statistics */
   transray.randval=incident->randval;     /* random number seed */
   transray.frng=incident->frng;           /* 32-bit FP RNG handle */
 
   /* inlined code from trace() to eliminate one level of recursion */
+  RT_STAT_INC(&transray, transmissionrays);
   intersect_objects(&transray);           /* trace transmission ray */
   col=transray.scene->shader(&transray);
 
@@ -672,13 +688,12 @@ color fog_color(const ray * incident, color col, flt t) {
   struct fogdata_t * fog = &incident->scene->fog;
   float fogcoord = t; /* radial fog by default */
 
-  if (fog->type == RT_FOG_OPENGL) {
+  /* use the Z-depth for primary rays, radial distance otherwise */
+  if (fog->type == RT_FOG_OPENGL && (incident->flags & RT_RAY_PRIMARY)) {
     /* Compute planar fog (e.g. to match OpenGL) by projecting t value onto  */
     /* the camera view direction vector to yield a planar a depth value.     */
-    flt hitz = VDot(&incident->d, &incident->scene->camera.viewvec) * t;
-
-    /* use the Z-depth for primary rays, radial distance otherwise */
-    fogcoord = (incident->flags & RT_RAY_PRIMARY) ? hitz : t;
+    /* Only primary rays carry the camera they came from.                    */
+    fogcoord = VDot(&incident->d, &incident->camera->viewvec) * t;
   }
 
   return incident->scene->fog.fog_fctn(fog, col, fogcoord);
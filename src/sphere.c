@@ -15,6 +15,7 @@
 #include "vector.h"
 #include "intersect.h"
 #include "util.h"
+#include "arena.h"
 
 #define SPHERE_PRIVATE
 #include "sphere.h"
@@ -23,13 +24,14 @@ static object_methods sphere_methods = {
   (void (*)(const void *, void *))(sphere_intersect),
   (void (*)(const void *, const void *, const void *, void *))(sphere_normal),
   sphere_bbox, 
-  free 
+  arena_nofree,
+  RT_STATS_SPHERE
 };
 
-object * newsphere(void * tex, vector ctr, flt rad) {
+object * newsphere(scenedef * scene, void * tex, vector ctr, flt rad) {
   sphere * s;
   
-  s=(sphere *) malloc(sizeof(sphere));
+  s=(sphere *) scene_alloc(scene, sizeof(sphere));
   memset(s, 0, sizeof(sphere));
   s->methods = &sphere_methods;
 
@@ -4,7 +4,7 @@
  *  $Id: sphere.h,v 1.13 2011/02/05 08:10:11 johns Exp $
  */
 
-object * newsphere(void *, vector, flt);
+object * newsphere(scenedef *, void *, vector, flt);
 
 #ifdef SPHERE_PRIVATE
 
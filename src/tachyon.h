@@ -89,6 +89,17 @@ void rt_set_ui_message(void (* func) (int, char *));
 /** Set function pointer for user interface progress callbacks.  */
 void rt_set_ui_progress(void (* func) (int));
 
+/**
+ * Set user interface callbacks for one scene, which receive messages 
+ * and progress from rendering that scene in place of the callbacks set
+ * by rt_set_ui_message() and rt_set_ui_progress().  Each callback gets
+ * the data pointer as its first argument.  NULL callbacks select the
+ * process wide ones.
+ */
+void rt_scene_ui_callbacks(SceneHandle, 
+                           void (* message)(void *, int, char *),
+                           void (* progress)(void *, int), void * data);
+
 /**
  * Initialize ray tracing library, must be first Tachyon API called.
  * Takes pointer to argument count, and pointer to argument array
@@ -107,7 +118,12 @@ int rt_initialize(int *, char ***);
  */ 
 void rt_finalize(void); 
 
-/** Allocate, initialize, and return a handle for a new scene.  */
+/**
+ * Allocate, initialize, and return a handle for a new scene.  
+ * Objects, textures, and lights may be added to a scene by several
+ * threads at once, provided that no thread renders or changes other
+ * scene parameters at the same time.
+ */
 SceneHandle rt_newscene(void); 
 
 /** Destroy and deallocate the specified scene.  */
@@ -116,6 +132,27 @@ void rt_deletescene(SceneHandle);
 /** Render the current scene.  */
 void rt_renderscene(SceneHandle);
 
+/** Camera position for one frame of rt_renderscene_keyframes(). */
+typedef struct {
+  float center[3];   /**< camera center                              */
+  float viewdir[3];  /**< view direction                             */
+  float updir[3];    /**< up direction                               */
+  float zoom;        /**< zoom factor, 0 keeps the scene's zoom      */
+} rt_camera_keyframe;
+
+/**
+ * Render a batch of frames of an otherwise unchanged scene, one for 
+ * each camera keyframe, back to back.  Frame i is stored in images[i], 
+ * which the caller allocates to hold a full frame in the scene's image
+ * buffer format, see rt_rawimage_rgb24() and rt_rawimage_rgb96f().
+ * No image files are written, and no memory is allocated per frame.
+ * Worker threads move on to the next frame as soon as they finish their
+ * rows of the current one, rather than waiting for each other between
+ * frames.  The scene camera is left at the last keyframe.
+ */
+void rt_renderscene_keyframes(SceneHandle, int numframes, 
+                              const rt_camera_keyframe * keys, void ** images);
+
 /** Set the filename for the output image for the specified scene.  */
 void rt_outputfile(SceneHandle, const char * outname); 
 
@@ -135,6 +172,13 @@ void rt_outputfile(SceneHandle, const char * outname);
 #define RT_FORMAT_PPM48                 6  /**< 48-bit NetPBM PPM file     */
 #define RT_FORMAT_PSD48                 7  /**< 48-bit Photoshop PSD file  */
 
+/*
+ * Floating point high dynamic range image formats, written directly from
+ * the RGB96F image buffer without clamping, normalization, or gamma
+ */
+#define RT_FORMAT_PFM                   8  /**< 96-bit float PFM file      */
+#define RT_FORMAT_EXR                   9  /**< 48-bit half-float OpenEXR  */
+
 /** Set the format of the output image(s).  */
 void rt_outputformat(SceneHandle, int format);
 
@@ -163,14 +207,56 @@ void rt_get_aspectratio(SceneHandle voidscene, float *aspectratio);
 #define RT_CROP_ENABLED                 1  /**< Image cropping enabled      */
 
 /** 
- * Crop the output image to the specified size, 
- * intended only for use in SPECMPI benchmarking.
+ * Crop the output image to the specified size, starting at the given
+ * pixel offset in the full image.  Only the pixels in the crop window
+ * are rendered, and the image buffer, including one passed in with
+ * rt_rawimage_rgb24() or rt_rawimage_rgb96f(), only holds the crop
+ * window.  The camera is the same as for the full image.
  */
 void rt_crop_output(SceneHandle, int hres, int vres, int lx, int ly);
 
 /** Disable output image cropping.  */
 void rt_crop_disable(SceneHandle);
 
+/**
+ * Render the image in bands of the given number of rows, writing each
+ * band to the output file as soon as it is finished, so that only one
+ * band is kept in memory.  This is meant for images too large to hold
+ * in memory, and works along with cropping.  Bands are written to Targa,
+ * PPM, 48-bit PPM, or PFM files, other formats fall back to the closest
+ * of these.  Image normalization and cost maps need the whole image, so
+ * they aren't available, and neither are buffers from rt_rawimage_rgb24()
+ * or rt_rawimage_rgb96f().  Zero rows, the default, renders the image in
+ * one piece.
+ */
+void rt_tiled_output(SceneHandle, int rows);
+
+/**
+ * Save the progress of long renders to a small checkpoint file, at most
+ * once every interval seconds, so that a render that gets interrupted 
+ * can pick up where it left off when it is run again with the same
+ * checkpoint file.  Tiled images record the bands already written to the
+ * output file, and series of frames record the frames already finished.
+ * An empty filename, the default, turns checkpoints off.
+ */
+void rt_checkpoint(SceneHandle, const char * filename, float interval);
+
+/**
+ * The number of frames of a series finished by earlier runs, according
+ * to the checkpoint file, which the caller can skip.  The same on all
+ * nodes, and zero if there's nothing to resume.
+ */
+int rt_checkpoint_frames(SceneHandle);
+
+/**
+ * Set the index of the next frame rendered in a series, for checkpoints.
+ * Frames count up from zero on their own with each render.
+ */
+void rt_checkpoint_set_frame(SceneHandle, int frame);
+
+/** Remove the checkpoint file once all of the frames are finished.  */
+void rt_checkpoint_finish(SceneHandle);
+
 /** Sets the maximum number of supersamples to take for any pixel.  */
 void rt_aa_maxsamples(SceneHandle, int maxsamples);
 
@@ -180,6 +266,96 @@ void rt_aa_maxsamples(SceneHandle, int maxsamples);
  */
 void rt_verbose(SceneHandle, int v);
 
+/*
+ * Object types counted separately by the render statistics
+ */
+#define RT_STATS_OTHER      0  /**< objects of any other type              */
+#define RT_STATS_SPHERE     1  /**< spheres                                */
+#define RT_STATS_TRIANGLE   2  /**< flat shaded triangles                  */
+#define RT_STATS_STRI       3  /**< smooth shaded and vertex colored tris  */
+#define RT_STATS_CYLINDER   4  /**< infinite cylinders                     */
+#define RT_STATS_FCYLINDER  5  /**< finite cylinders                       */
+#define RT_STATS_RING       6  /**< rings                                  */
+#define RT_STATS_PLANE      7  /**< planes                                 */
+#define RT_STATS_QUADRIC    8  /**< quadrics                               */
+#define RT_STATS_BOX        9  /**< boxes                                  */
+#define RT_STATS_VOLUME    10  /**< scalar and extended volumes            */
+#define RT_STATS_LIGHT     11  /**< visible light sources                  */
+#define RT_STATS_GRID      12  /**< grids of the spatial subdivision       */
+#define RT_STATS_NUMTYPES  13
+
+/** Ray and intersection statistics for a rendered frame */
+typedef struct {
+  unsigned long long primaryrays;      /**< camera rays, incl. AA samples */
+  unsigned long long shadowrays;       /**< direct light shadow rays      */
+  unsigned long long aorays;           /**< ambient occlusion rays        */
+  unsigned long long reflectionrays;   /**< specular reflection rays      */
+  unsigned long long transmissionrays; /**< transmission rays             */
+  unsigned long long gridcells;        /**< grid cells visited            */
+  unsigned long long mailboxrejects;   /**< tests skipped by the mailbox  */
+  unsigned long long tests[RT_STATS_NUMTYPES]; /**< tests by object type */
+  unsigned long long hits[RT_STATS_NUMTYPES];  /**< tests finding a hit   */
+} rt_render_stats;
+
+/**
+ * Enables or disables the collection of ray and intersection statistics
+ * (a zero value means off, non-zero means on).  Statistics are kept per 
+ * thread and merged at the end of each frame, and are printed along with
+ * the ray tracing time when enabled.
+ */
+void rt_render_stats_mode(SceneHandle, int onoff);
+
+/**
+ * Get the statistics for the last rt_renderscene() call, or for the whole
+ * batch of frames from the last rt_renderscene_keyframes() call.  The 
+ * counts are all zero unless statistics were enabled for that rendering.
+ * With MPI, node 0 gets the totals of all nodes, and the other nodes get
+ * the counts for the rows they rendered themselves.
+ */
+void rt_get_render_stats(SceneHandle, rt_render_stats * stats);
+
+/** Return a printable name for an RT_STATS_xxx object type. */
+const char * rt_render_stats_typename(int type);
+
+/**
+ * Get the times in seconds spent by the last rt_renderscene() or 
+ * rt_renderscene_keyframes() call preprocessing the scene, ray tracing, 
+ * and writing the output image.  The preprocessing time is zero if the 
+ * scene didn't need it, and the I/O time if no image file was written.
+ */
+void rt_get_render_times(SceneHandle, double * preproc, double * trace,
+                         double * io);
+
+/**
+ * Record the cost of each pixel, as the number of intersection tests and
+ * grid cells visited by all of the rays it spawned, and write it to the
+ * named file as a false color image after rendering, in the same format
+ * as the output image.  Cheap pixels are blue, and the most expensive
+ * ones red, on a logarithmic scale.  An empty filename turns it off.
+ * Only rt_renderscene() records cost maps, keyframe batches do not, and
+ * neither do tiled images or runs on more than one node.
+ */
+void rt_render_costmap(SceneHandle, const char * filename);
+
+/*
+ * Grid mailbox modes, the mailbox keeps a ray from being tested against
+ * the same object again when the object spans several grid cells
+ */
+#define RT_MBOX_AUTO    0  /**< arrays for small scenes, hashed for large  */
+#define RT_MBOX_ARRAY   1  /**< per-thread array with an entry per object  */
+#define RT_MBOX_HASHED  2  /**< small fixed size per-thread hashed table   */
+
+/**
+ * Select the grid mailbox scheme.  Array mailboxes use one unsigned long
+ * per object in every thread, which adds up to gigabytes for scenes with
+ * tens of millions of objects.  Hashed mailboxes use a small constant size
+ * table per thread instead, where a collision merely costs a redundant
+ * intersection test, so the rendered images are the same either way.
+ * The default, RT_MBOX_AUTO, switches to hashed mailboxes for scenes with
+ * more than MBOX_AUTOLIMIT objects.
+ */
+void rt_mailbox_mode(SceneHandle, int mode);
+
 /*
  * Surface normal and winding order fixup mode constants used
  * to optionally auto-correct triangles with interpolate normals
@@ -229,6 +405,28 @@ void rt_rawimage_rgb96f(SceneHandle, float *rawimage);
 /** Explicitly set the number of worker threads Tachyon will use.  */
 void rt_set_numthreads(SceneHandle, int);
 
+/** Return the number of worker threads Tachyon will use for the scene. */
+int rt_get_numthreads(SceneHandle);
+
+/*
+ * NUMA modes, for placing worker threads and their data on hosts
+ * with several memory controllers
+ */
+#define RT_NUMA_OFF        0  /**< threads float, the OS places data   */
+#define RT_NUMA_PIN        1  /**< pin threads, first-touch their rows */
+#define RT_NUMA_REPLICATE  2  /**< also copy the grids to each node    */
+
+/**
+ * Set the NUMA mode.  RT_NUMA_PIN pins each worker thread to one of the
+ * CPUs the process may run on, and has each thread touch the image rows
+ * it renders before the first frame, so their pages land on its node.
+ * RT_NUMA_REPLICATE also gives each NUMA node its own copy of the grid
+ * cells, built by a thread on that node, so grid traversal doesn't cross
+ * the interconnect.  The objects themselves are still shared.  The
+ * calling thread, which also renders, is never pinned.
+ */
+void rt_numa_mode(SceneHandle, int mode);
+
 /** Set the background color of the specified scene.  */
 void rt_background(SceneHandle, apicolor);
 
@@ -473,23 +671,46 @@ void * rt_texture(SceneHandle, apitexture *);
  * Defines a named 1-D, 2-D, or 3-D texture image with a 
  * 24-bit RGB image buffer, without any file references.
  * This allows an application to send Tachyon images for texture mapping
- * without having to touch the filesystem.
+ * without having to touch the filesystem.  Tachyon takes ownership of
+ * the buffer.  Images defined this way are visible to every scene, and 
+ * are freed when the last scene using them is deleted.
  */
 void rt_define_teximage_rgb24(const char *name, int xsize, int ysize, int zsize,
                               unsigned char *rgb24data);
 
+/**
+ * Defines a named texture image like rt_define_teximage_rgb24(), which
+ * is only visible to the given scene, and is freed with it.  Redefining
+ * a name with new contents affects textures created afterwards.
+ */
+void rt_scene_define_teximage_rgb24(SceneHandle, const char *name, 
+                                    int xsize, int ysize, int zsize,
+                                    unsigned char *rgb24data);
+
 /** 
  * Do not use this unless you know what you're doing, this is a 
  * short-term workaround until new object types have been created.
+ * The copy belongs to the scene, and is freed by rt_deletescene().
  */
 void * rt_texture_copy_standard(SceneHandle, void *oldtex);
 
 /** 
- * Do not use this unless you know what you're doing, this is a 
- * short-term workaround until new object types have been created.
+ * Return a texture for vertex colored triangles with the surface 
+ * properties of oldtex.  The texture is shared by all callers asking for
+ * the same properties, and belongs to the scene.  rt_vcstri() does this
+ * itself, so calling this first only saves a lookup per triangle.
  */
 void * rt_texture_copy_vcstri(SceneHandle, void *oldtex);
 
+/**
+ * Return a texture shared by every caller asking for one with identical
+ * parameters, in place of tex.  If an identical texture already exists,
+ * tex is destroyed, so it must not be used after this call.  Shared 
+ * textures must not be modified with rt_tex_phong() and friends, so 
+ * this should be called once a texture has been completely set up.
+ */
+void * rt_texture_intern(SceneHandle, void *tex);
+
 
 /*****************************/
 /* Shading and lighting APIs */
@@ -714,6 +935,21 @@ void rt_scalarvol(SceneHandle, void *tex,
                   int xsize, int ysize, int zsize, 
                   const char *filename, void *invol); 
 
+/*
+ * Parameter values for rt_volume_layout()
+ */
+#define RT_VOLUME_LAYOUT_LINEAR  0  /**< flat arrays, X varies fastest     */
+#define RT_VOLUME_LAYOUT_BRICKED 1  /**< 8^3 voxel bricks, Morton ordered  */
+
+/**
+ * Select the in-memory voxel storage layout used for scalar volumes and
+ * volumetric image maps created after this call.  The bricked layout 
+ * keeps nearby voxels close in memory along every axis, which speeds up
+ * rays that don't travel along X, at the cost of a conversion pass at 
+ * load time and of no longer sharing memory mapped volume files.
+ */
+void rt_volume_layout(SceneHandle, int layout);
+
 
 /** Define an axis-aligned height field.  */
 void rt_heightfield(SceneHandle, void *tex, apivector center, 
@@ -772,14 +1008,6 @@ void rt_quadsphere(SceneHandle, void *tex, apivector center, flt rad);
 #define BOUNDTHRESH 16          /**< spatial subdiv. object count threshold */
 
 
-/* 
- * Maximum internal table sizes 
- * Use prime numbers for best memory system performance
- * (helps avoid cache aliasing..)
- */
-#define MAXIMGS   39            /**< maxiumum number of distinct images   */
-
-
 /* 
  * Ray flags 
  *
@@ -853,20 +1081,30 @@ typedef apivector vector;
 typedef apicolor color;
 
 
+struct mipmap_t;
+
 typedef struct {         /**< Raw 24 bit RGB image structure */
   int loaded;            /**< image memory residence flag    */
   int xres;              /**< image X axis size              */
   int yres;              /**< image Y axis size              */
   int zres;              /**< image Z axis size              */
   int bpp;               /**< image bits per pixel           */
-  char name[96];         /**< image filename (with path)     */
+  char * name;           /**< image filename (with path)     */
   unsigned char * data;  /**< pointer to raw byte image data */
+  void * mapaddr;        /**< file mapping backing data, if any */
+  size_t maplen;         /**< length of the file mapping        */
+  size_t * voxoffs;      /**< voxel offset tables for volumes   */
+  unsigned char * voxdata; /**< voxel data, in voxoffs layout   */
+  unsigned int datahash; /**< contents hash, 0 for image files */
+  struct mipmap_t * mip; /**< cached MIP map pyramid, if any */
 } rawimage;
 
 
-typedef struct {
+typedef struct mipmap_t {
   int levels;
   rawimage ** images;
+  int maxlevels;         /**< level limit it was created with */
+  int cached;            /**< owned by the base image's cache */
 } mipmap;
 
 
@@ -878,6 +1116,13 @@ typedef struct {         /**< Scalar Volume Data */
   flt opacity;		 /**< opacity per unit length           */
   char name[96];         /**< Volume data filename              */
   unsigned char * data;  /**< pointer to raw byte volume data   */
+  void * mapaddr;        /**< file mapping backing data, if any */
+  size_t maplen;         /**< length of the file mapping        */
+  size_t * voxoffs;      /**< voxel offset tables for data      */
+  int cellxres;          /**< macrocell grid X axis size        */
+  int cellyres;          /**< macrocell grid Y axis size        */
+  int cellzres;          /**< macrocell grid Z axis size        */
+  unsigned char * cellmax; /**< max voxel value in each macrocell */
 } scalarvol;
 
 
@@ -932,12 +1177,9 @@ typedef struct {
   void * obj;         /**< object ptr, hack for vol shaders */
 } standard_texture;
 
+/* vertex colors are stored in the vcstri objects, not their texture */
 typedef struct {
   RT_TEXTURE_HEAD
-  void * obj;         /**< object ptr, hack for vcstri for now */
-  color c0;           /**< color for vertex 0 */
-  color c1;           /**< color for vertex 1 */
-  color c2;           /**< color for vertex 2 */
 } vcstri_texture;
 
 
@@ -949,6 +1191,7 @@ typedef struct {
   void (* normal)(const void *, const void *, const void *, void *); /**< normal function ptr    */
   int (* bbox)(void *, vector *, vector *);      /**< return the object bbox */
   void (* freeobj)(void *);                      /**< free the object        */
+  int stattype;                                  /**< RT_STATS_xxx type      */
 } object_methods;
 
 
@@ -1073,6 +1316,17 @@ typedef struct {
   int imgbufformat;          /**< pixel format for image buffer           */
   int imgfileformat;         /**< output format for final image           */
   cropinfo imgcrop;          /**< image output cropping for SPEC MPI      */
+  int imgxres;               /**< image buffer width, crop window or hres */
+  int imgyres;               /**< image buffer height, crop or vres       */
+  int imgxstart;             /**< full image column of the buffer's left  */
+  int imgystart;             /**< full image row of the buffer's first row*/
+  int tilerows;              /**< rows per band for tiled output, or 0    */
+  int numtiles;              /**< bands in the image, 0 if not tiled      */
+  int curtile;               /**< band being rendered, for progress       */
+  char ckptfile[256];        /**< checkpoint filename, empty if off       */
+  float ckptinterval;        /**< seconds between checkpoints             */
+  int ckptframe;             /**< frame of a series being rendered        */
+  rt_timerhandle ckpttimer;  /**< time since the last checkpoint          */
   int numthreads;            /**< user controlled number of threads       */
   int nodes;                 /**< number of distributed memory nodes      */
   int mynode;                /**< my distributed memory node number       */
@@ -1087,7 +1341,10 @@ typedef struct {
   int verbosemode;           /**< verbose reporting flag                  */
   int boundmode;             /**< automatic spatial subdivision flag      */
   int boundthresh;           /**< threshold number of subobjects          */
+  int volumelayout;          /**< voxel storage layout for volumes        */
   list * texlist;            /**< linked list of texture objects          */
+  void * textable;           /**< shared textures, hashed by parameters   */
+  void * imgcache;           /**< image maps used by the scene's textures */
   list * cliplist;           /**< linked list of clipping plane groups    */
   unsigned int flags;        /**< scene feature requirement flags         */
   camdef camera;             /**< camera definition                       */
@@ -1098,6 +1355,7 @@ typedef struct {
   color (* bgtexfunc)(const struct ray_t * incident); /**< background texturing function ptr  */
   fogdata fog;               /**< fog parameters                          */
   displist objgroup;         /**< objects in the scene                    */
+  void * stage;              /**< objects staged by the scene API         */
   list * lightlist;          /**< linked list of lights in the scene      */
   flt light_scale;           /**< global scaling factor for direct lights */
   int numlights;             /**< number of lights in the scene           */
@@ -1108,9 +1366,46 @@ typedef struct {
   void * threadparms;        /**< thread parameters                       */
   clip_group * curclipgroup; /**< current clipping group, during parsing  */
   int normalfixupmode;       /**< normal/winding order fixup for stri     */
+  void (* ui_message)(void *, int, char *); /**< scene message callback   */
+  void (* ui_progress)(void *, int);        /**< scene progress callback  */
+  void * ui_data;            /**< passed to the scene's callbacks         */
+  const rt_camera_keyframe * keyframes; /**< keyframes being rendered     */
+  void ** keyimages;         /**< image buffers for each keyframe         */
+  int numkeyframes;          /**< number of keyframes, 0 for one frame    */
+  int statsmode;             /**< collect ray and intersection statistics */
+  rt_render_stats stats;     /**< statistics merged from all threads      */
+  double preproctime;        /**< preprocessing time of the last render   */
+  double tracetime;          /**< ray tracing time of the last render     */
+  double iotime;             /**< image output time of the last render    */
+  char costmapfile[256];     /**< cost map image filename, empty if off   */
+  unsigned int * costmap;    /**< per-pixel cost of the last frame        */
+  int mboxmode;              /**< grid mailbox scheme, RT_MBOX_xxx        */
+  int numamode;              /**< thread and data placement, RT_NUMA_xxx  */
+  int numanodes;             /**< NUMA nodes with grid copies, 0 if none  */
 } scenedef;
 
 
+/*
+ * Hashed mailboxes are direct-mapped by object id, the table size must be
+ * a power of two.  Objects that are close together in a scene tend to have
+ * nearby ids, so they don't evict each other during a ray's traversal.
+ */
+#if !defined(MBOX_HASHSIZE)
+#define MBOX_HASHSIZE  4096      /**< hashed mailbox entries per thread   */
+#endif
+#if (MBOX_HASHSIZE < 1) || (MBOX_HASHSIZE & (MBOX_HASHSIZE - 1))
+#error MBOX_HASHSIZE must be a power of two
+#endif
+#if !defined(MBOX_AUTOLIMIT)
+#define MBOX_AUTOLIMIT 1048576   /**< largest scene using mailbox arrays  */
+#endif
+
+typedef struct {
+  unsigned long serial;  /**< serial number of the last ray tested          */
+  unsigned long id;      /**< object that ray was tested against            */
+} mboxentry;
+
+
 typedef struct ray_t {
   vector o;              /**< origin of the ray X,Y,Z                        */
   vector d;              /**< normalized direction of the ray                */
@@ -1123,8 +1418,13 @@ typedef struct ray_t {
   unsigned int flags;    /**< ray flags, any special treatment needed etc    */
   unsigned long serial;  /**< serial number of the ray                       */
   unsigned long * mbox;  /**< mailbox array for optimizing intersections     */
+  mboxentry * hashmbox;  /**< hashed mailbox, used instead of mbox if set    */
   scenedef * scene;      /**< pointer to the scene, for global parms such as */
                          /**< background colors etc                          */
+  const camdef * camera; /**< camera that generated a primary ray            */
+  rt_render_stats * stats; /**< thread's statistics, NULL if not collected   */
+  int stathit;           /**< current test's hit is counted in stats        */
+  int numanode;          /**< NUMA node for grid replicas, -1 for none      */
   unsigned int randval;  /**< random number seed                             */
   rng_frand_handle frng; /**< 32-bit FP random number generator handle       */
 } ray;
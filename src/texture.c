@@ -18,6 +18,8 @@
 #include "vector.h"
 #include "box.h"
 #include "util.h"
+#include "threads.h"
+#include "triangle.h"
 
 static texture_methods normal_methods = {
   free
@@ -69,6 +71,279 @@ printf("XXX Doh, unrecognized image map type!\n");
 }
 
 
+/*
+ * Texture interning.  Textures with identical parameters can be shared
+ * by any number of objects, so each scene keeps a hash table of shared
+ * textures, and the API hands out an existing texture in place of a new
+ * one whenever all of the parameters match.  Only standard and vertex
+ * color textures are shared, and image mapped textures only when their
+ * MIP map is owned by the image cache, since freeing a texture frees 
+ * any other MIP map it refers to.
+ */
+#define TEXKEY_MAXLEN 512
+
+typedef struct {
+  rt_mutex_t lock;           /* serializes threads creating textures */
+  int size;                  /* number of slots, a power of two      */
+  int count;                 /* number of shared textures            */
+  texture ** texs;           /* shared textures, or NULL             */
+  unsigned int * hashes;     /* hash of each shared texture          */
+} textable;
+
+#define TEXKEY_ADD(key, len, field) \
+  memcpy((key) + (len), &(field), sizeof(field)); (len) += sizeof(field);
+
+/* serialize the parameters that identify a texture, 0 if not shareable */
+static int texture_key(const texture * tex, unsigned char * key) {
+  int len = 0;
+
+  if (tex->methods == &standard_methods) {
+    const standard_texture * stex = (const standard_texture *) tex;
+    if (stex->img != NULL && !((mipmap *) stex->img)->cached)
+      return 0;
+  } else if (tex->methods != &vcstri_methods) {
+    return 0;
+  }
+
+  TEXKEY_ADD(key, len, tex->texfunc);
+  TEXKEY_ADD(key, len, tex->methods);
+  TEXKEY_ADD(key, len, tex->flags);
+  TEXKEY_ADD(key, len, tex->ambient);
+  TEXKEY_ADD(key, len, tex->diffuse);
+  TEXKEY_ADD(key, len, tex->phong);
+  TEXKEY_ADD(key, len, tex->phongexp);
+  TEXKEY_ADD(key, len, tex->phongtype);
+  TEXKEY_ADD(key, len, tex->specular);
+  TEXKEY_ADD(key, len, tex->opacity);
+  TEXKEY_ADD(key, len, tex->transmode);
+  TEXKEY_ADD(key, len, tex->outline);
+  TEXKEY_ADD(key, len, tex->outlinewidth);
+
+  if (tex->methods == &standard_methods) {
+    const standard_texture * stex = (const standard_texture *) tex;
+    TEXKEY_ADD(key, len, stex->col);
+    TEXKEY_ADD(key, len, stex->ctr);
+    TEXKEY_ADD(key, len, stex->rot);
+    TEXKEY_ADD(key, len, stex->scale);
+    TEXKEY_ADD(key, len, stex->uaxs);
+    TEXKEY_ADD(key, len, stex->vaxs);
+    TEXKEY_ADD(key, len, stex->waxs);
+    TEXKEY_ADD(key, len, stex->img);
+  }
+
+  return len;
+}
+
+/* FNV-1a hash of a texture key */
+static unsigned int texkey_hash(const unsigned char * key, int len) {
+  unsigned int h = 2166136261U;
+  int i;
+
+  for (i=0; i<len; i++) {
+    h ^= key[i];
+    h *= 16777619U;
+  }
+
+  return h;
+}
+
+/* find the slot holding a texture matching key, or the empty slot for it */
+static int textable_slot(const textable * tbl, const unsigned char * key,
+                         int len, unsigned int h) {
+  unsigned char tkey[TEXKEY_MAXLEN];
+  int i = h & (tbl->size - 1);
+
+  while (tbl->texs[i] != NULL) {
+    if (tbl->hashes[i] == h && texture_key(tbl->texs[i], tkey) == len &&
+        !memcmp(tkey, key, len))
+      break;
+    i = (i + 1) & (tbl->size - 1);
+  }
+
+  return i;
+}
+
+/* add tex to the table, which must not already hold a match for it */
+static int textable_insert(textable * tbl, texture * tex, unsigned int h) {
+  int i;
+
+  /* keep the table at most half full */
+  if (2 * (tbl->count + 1) > tbl->size) {
+    texture ** oldtexs = tbl->texs;
+    unsigned int * oldhashes = tbl->hashes;
+    int oldsize = tbl->size;
+    int newsize = (oldsize > 0) ? 2 * oldsize : 256;
+    texture ** texs = (texture **) calloc(newsize, sizeof(texture *));
+    unsigned int * hashes = (unsigned int *) calloc(newsize, sizeof(unsigned int));
+
+    if (texs == NULL || hashes == NULL) {
+      free(texs);
+      free(hashes);
+      return -1;
+    }
+
+    tbl->texs = texs;
+    tbl->hashes = hashes;
+    tbl->size = newsize;
+    for (i=0; i<oldsize; i++) {
+      if (oldtexs[i] != NULL) {
+        int j = oldhashes[i] & (newsize - 1);
+        while (texs[j] != NULL)
+          j = (j + 1) & (newsize - 1);
+        texs[j] = oldtexs[i];
+        hashes[j] = oldhashes[i];
+      }
+    }
+    free(oldtexs);
+    free(oldhashes);
+  }
+
+  i = h & (tbl->size - 1);
+  while (tbl->texs[i] != NULL)
+    i = (i + 1) & (tbl->size - 1);
+  tbl->texs[i] = tex;
+  tbl->hashes[i] = h;
+  tbl->count++;
+
+  return 0;
+}
+
+void * new_textable(void) {
+  textable * tbl;
+
+  tbl = (textable *) calloc(1, sizeof(textable));
+  if (tbl != NULL)
+    rt_mutex_init(&tbl->lock);
+
+  return tbl;
+}
+
+/* frees the table only, the textures belong to the scene texture list */
+void free_textable(void * voidtbl) {
+  textable * tbl = (textable *) voidtbl;
+
+  if (tbl == NULL)
+    return;
+
+  rt_mutex_destroy(&tbl->lock);
+  free(tbl->texs);
+  free(tbl->hashes);
+  free(tbl);
+}
+
+/*
+ * Return the shared texture with the same parameters as tex, adding
+ * tex to the table if there isn't one yet.  Textures that can't be 
+ * shared are returned as-is.
+ */
+texture * textable_intern(void * voidtbl, texture * tex) {
+  textable * tbl = (textable *) voidtbl;
+  unsigned char key[TEXKEY_MAXLEN];
+  texture * shared = tex;
+  unsigned int h;
+  int len, i;
+
+  if (tbl == NULL || (len = texture_key(tex, key)) == 0)
+    return tex;
+  h = texkey_hash(key, len);
+
+  rt_mutex_lock(&tbl->lock);
+  if (tbl->size > 0 && tbl->texs[i = textable_slot(tbl, key, len, h)] != NULL)
+    shared = tbl->texs[i];
+  else 
+    textable_insert(tbl, tex, h);
+  rt_mutex_unlock(&tbl->lock);
+
+  return shared;
+}
+
+/*
+ * Return the shared vertex color triangle texture with the surface
+ * parameters of tex.  If a new texture had to be created, *created is
+ * set, and the caller must add it to the scene texture list.
+ */
+texture * textable_intern_vcstri(void * voidtbl, const texture * tex, 
+                                 int * created) {
+  textable * tbl = (textable *) voidtbl;
+  unsigned char key[TEXKEY_MAXLEN];
+  vcstri_texture vtex;
+  texture * shared;
+  unsigned int h;
+  int len, i;
+
+  memset(&vtex, 0, sizeof(vtex));
+  vtex.texfunc = (color(*)(const void *, const void *, void *))(vcstri_color);
+  vtex.methods = &vcstri_methods;
+  vtex.flags = tex->flags;
+  vtex.ambient = tex->ambient;
+  vtex.diffuse = tex->diffuse;
+  vtex.phong = tex->phong;
+  vtex.phongexp = tex->phongexp;
+  vtex.phongtype = tex->phongtype;
+  vtex.specular = tex->specular;
+  vtex.opacity = tex->opacity;
+  vtex.transmode = tex->transmode;
+  vtex.outline = tex->outline;
+  vtex.outlinewidth = tex->outlinewidth;
+
+  len = texture_key((texture *) &vtex, key);
+  h = texkey_hash(key, len);
+  *created = 0;
+
+  rt_mutex_lock(&tbl->lock);
+  if (tbl->size > 0 && tbl->texs[i = textable_slot(tbl, key, len, h)] != NULL) {
+    shared = tbl->texs[i];
+  } else {
+    shared = new_vcstri_texture();
+    memcpy(shared, &vtex, sizeof(vtex));
+    textable_insert(tbl, shared, h);
+    *created = 1;
+  }
+  rt_mutex_unlock(&tbl->lock);
+
+  return shared;
+}
+
+/* returns nonzero if tex is one of the shared textures in the table */
+int textable_isshared(void * voidtbl, const texture * tex) {
+  textable * tbl = (textable *) voidtbl;
+  unsigned char key[TEXKEY_MAXLEN];
+  unsigned int h;
+  int len, shared = 0;
+
+  if (tbl == NULL || (len = texture_key(tex, key)) == 0)
+    return 0;
+  h = texkey_hash(key, len);
+
+  rt_mutex_lock(&tbl->lock);
+  if (tbl->size > 0)
+    shared = (tbl->texs[textable_slot(tbl, key, len, h)] == tex);
+  rt_mutex_unlock(&tbl->lock);
+
+  return shared;
+}
+
+/* number of shared textures in the table */
+int textable_count(void * voidtbl) {
+  textable * tbl = (textable *) voidtbl;
+  return (tbl != NULL) ? tbl->count : 0;
+}
+
+/* returns nonzero if tex is a vertex color triangle texture */
+int texture_isvcstri(const texture * tex) {
+  return (tex->methods == &vcstri_methods);
+}
+
+/* memory used by a texture, not counting images and MIP maps */
+size_t texture_memsize(const texture * tex) {
+  if (tex->methods == &standard_methods)
+    return sizeof(standard_texture);
+  if (tex->methods == &vcstri_methods)
+    return sizeof(vcstri_texture);
+  return sizeof(texture);
+}
+
+
 /* standard solid background texture */
 color solid_background_texture(const ray *ry) {
   return ry->scene->bgtex.background;
@@ -382,13 +657,23 @@ color wood_texture(const vector * hit, const texture * tx, const ray * ry) {
 
 
 
+/*
+ * The noise lattice is computed once, and is only read afterwards, so
+ * all scenes share it.  Noise() reads one plane past the end of the 
+ * lattice for points in its last cells, which the extra plane of zeros 
+ * keeps inside the array.
+ */
 #define NMAX 28
-short int NoiseMatrix[NMAX][NMAX][NMAX];
+static short int NoiseMatrix[NMAX+1][NMAX][NMAX];
+static int noiseinitted = 0;
 
 void InitNoise(void) {
   byte x,y,z,i,j,k;
   unsigned int rndval = 1234567; /* pathetic random number seed */
 
+  if (noiseinitted)
+    return;
+
   for (x=0; x<NMAX; x++) {
     for (y=0; y<NMAX; y++) {
       for (z=0; z<NMAX; z++) {
@@ -407,6 +692,8 @@ void InitNoise(void) {
       }
     }
   }
+
+  noiseinitted = 1;
 }
 
 int Noise(flt x, flt y, flt z) {
@@ -513,10 +800,18 @@ color gnoise_texture(const vector * hit, const texture * tx, const ray * ry) {
 
 void InitTextures(void) {
   InitNoise();
-  ResetImages();
+  InitImages();
 }
 
 void FreeTextures(void) {
   FreeImages();
 }
 
+void RetainTextures(void) {
+  RetainImages();
+}
+
+void ReleaseTextures(void) {
+  ReleaseImages();
+}
+
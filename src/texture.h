@@ -27,9 +27,20 @@ color       gnoise_texture(const vector *, const texture *, const ray *);
 int Noise(flt, flt, flt);
 void InitTextures(void);
 void FreeTextures(void);
+void RetainTextures(void);
+void ReleaseTextures(void);
 
 texture * new_texture(void);
 texture * new_standard_texture(void);
 texture * new_vcstri_texture(void);
 void free_standard_texture(void * voidtex);
 
+void * new_textable(void);
+void free_textable(void *);
+texture * textable_intern(void *, texture *);
+texture * textable_intern_vcstri(void *, const texture *, int *);
+int textable_isshared(void *, const texture *);
+int textable_count(void *);
+int texture_isvcstri(const texture *);
+size_t texture_memsize(const texture *);
+
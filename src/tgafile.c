@@ -23,10 +23,10 @@ typedef struct {
 } tgahandle;
 
 int createtgafile(char *name, unsigned short width, unsigned short height) {
-  int filesize;
+  long filesize;
   FILE * ofp;
 
-  filesize = 3*width*height + 18 - 10;
+  filesize = 3L*width*height + 18 - 10;
   
   if (name==NULL) {
     return IMAGEWRITEERR;
@@ -90,33 +90,31 @@ void * opentgafile(char * filename) {
   return tga;
 } 
 
-void writetgaregion(void * voidhandle, int startx, int starty, 
-                    int stopx, int stopy, unsigned char * buffer) {
-  int x, y, totalx, totaly, xbytes, widthbytes, regionstart;
+int writetgaregion(void * voidhandle, int startx, int starty, 
+                   int stopx, int stopy, unsigned char * buffer) {
+  int x, y, totalx, totaly, xbytes, numbytes;
+  long widthbytes, regionstart, filepos;
   unsigned char * bufpos;
-  int filepos, numbytes;
   tgahandle * tga = (tgahandle *) voidhandle;
   unsigned char * fixbuf; 
 
   totalx = stopx - startx + 1;
   totaly = stopy - starty + 1;
   xbytes = totalx*3;
-  widthbytes = tga->width*3;
+  widthbytes = tga->width*3L;
   fixbuf = (unsigned char *) malloc(xbytes);
   if (fixbuf == NULL) {
     rt_ui_message(MSG_ERR, "writetgaregion: failed memory allocation!\n");
-    return;
+    return IMAGEALLOCERR;
   }
  
-  regionstart = 18 + (startx-1)*3 + widthbytes*(tga->height-starty-totaly+1);
+  regionstart = 18 + (startx-1)*3L + widthbytes*(tga->height-starty-totaly+1);
   if (totalx == tga->width) {
     filepos=regionstart;
-    if (filepos >= 18) {
-      fseek(tga->ofp, filepos, 0); 
-    } else {
+    if (filepos < 18 || fseek(tga->ofp, filepos, 0)) {
       rt_ui_message(MSG_ERR, "writetgaregion: file ptr out of range!!!\n");
       free(fixbuf);
-      return;  /* don't try to continue */
+      return IMAGEWRITEERR;  /* don't try to continue */
     }
 
     for (y=0; y<totaly; y++) {
@@ -132,7 +130,7 @@ void writetgaregion(void * voidhandle, int startx, int starty,
         sprintf(msgtxt, "File write problem, %d bytes written.", numbytes);  
         rt_ui_message(MSG_ERR, msgtxt);
         free(fixbuf);
-        return;  /* don't try to continue */
+        return IMAGEWRITEERR;  /* don't try to continue */
       }
     }
   } else {
@@ -140,9 +138,7 @@ void writetgaregion(void * voidhandle, int startx, int starty,
       bufpos=buffer + xbytes*(totaly-y-1);
       filepos=regionstart + widthbytes*y;
 
-      if (filepos >= 18) {
-        fseek(tga->ofp, filepos, 0); 
-  
+      if (filepos >= 18 && fseek(tga->ofp, filepos, 0) == 0) {
         for (x=0; x<xbytes; x+=3) {
           fixbuf[x    ] = bufpos[x + 2];
           fixbuf[x + 1] = bufpos[x + 1];
@@ -155,24 +151,35 @@ void writetgaregion(void * voidhandle, int startx, int starty,
           sprintf(msgtxt, "File write problem, %d bytes written.", numbytes);  
           rt_ui_message(MSG_ERR, msgtxt);
           free(fixbuf);
-          return;  /* don't try to continue */
+          return IMAGEWRITEERR;  /* don't try to continue */
         }
       } else {
         rt_ui_message(MSG_ERR, "writetgaregion: file ptr out of range!!!\n");
         free(fixbuf);
-        return;  /* don't try to continue */
+        return IMAGEWRITEERR;  /* don't try to continue */
       }
     }
   }
 
   free(fixbuf);
+
+  return IMAGENOERR;
 }
 
-void closetgafile(void * voidhandle) {
+int flushtgafile(void * voidhandle) {
   tgahandle * tga = (tgahandle *) voidhandle;
 
-  fclose(tga->ofp);
+  return (fflush(tga->ofp) == 0) ? IMAGENOERR : IMAGEWRITEERR;
+}
+
+int closetgafile(void * voidhandle) {
+  tgahandle * tga = (tgahandle *) voidhandle;
+  int rc;
+
+  rc = (fclose(tga->ofp) == 0) ? IMAGENOERR : IMAGEWRITEERR;
   free(tga);  
+
+  return rc;
 }
 
 int readtga(char * name, int * xres, int * yres, unsigned char **imgdata) {
@@ -264,8 +271,9 @@ int writetga(char * name, int xres, int yres, unsigned char *imgdata) {
     if (outfile == NULL) 
       return IMAGEWRITEERR;
 
-    writetgaregion(outfile, 1, 1, xres, yres, imgdata);
-    closetgafile(outfile);
+    rc = writetgaregion(outfile, 1, 1, xres, yres, imgdata);
+    if (closetgafile(outfile) != IMAGENOERR && rc == IMAGENOERR)
+      rc = IMAGEWRITEERR;
   }
 
   return rc;
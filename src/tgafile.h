@@ -7,7 +7,8 @@
 /* declare other functions */
 int createtgafile(char *, unsigned short, unsigned short);
 void * opentgafile(char *);
-void writetgaregion(void *, int, int, int, int, unsigned char *);
-void closetgafile(void *);
+int writetgaregion(void *, int, int, int, int, unsigned char *);
+int flushtgafile(void *);
+int closetgafile(void *);
 int readtga(char * name, int * xres, int * yres, unsigned char **imgdata);
 int writetga(char * name, int xres, int yres, unsigned char *imgdata);
@@ -37,19 +37,19 @@
      sed -e 's/THRUSE/WKFUSE/g' /tmp/tmp1 >! /tmp/WKFThreads.h
  */
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
 /**
  * If compiling on Linux, enable the GNU CPU affinity functions in both
- * libc and the libpthreads
+ * libc and the libpthreads, this has to come before any system header
  */
 #if defined(__linux)
 #define _GNU_SOURCE 1
 #include <sched.h>
 #endif
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "threads.h"
 
 #ifdef _MSC_VER
@@ -287,6 +287,27 @@ int * rt_cpu_affinitylist(int *cpuaffinitycount) {
 }
 
 
+int rt_cpu_numa_node(int cpu) {
+  int node=-1; /* unknown by default */
+
+#if defined(__linux)
+  /* Linux lists the NUMA node of each CPU as a link in sysfs */
+  char path[128];
+  int i;
+
+  for (i=0; i<RT_MAX_NUMA_NODES; i++) {
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/node%d", cpu, i);
+    if (access(path, F_OK) == 0) {
+      node = i;
+      break;
+    }
+  }
+#endif
+
+  return node;
+}
+
+
 int rt_thread_set_self_cpuaffinity(int cpu) {
   int status=-1; /* unsupported by default */
 
@@ -433,6 +454,28 @@ int rt_thread_join(rt_thread_t thr, void ** stat) {
 }  
 
 
+unsigned long rt_thread_self_id(void) {
+  unsigned long id=0;
+
+#ifdef THR
+#ifdef _MSC_VER
+  id = (unsigned long) GetCurrentThreadId();
+#endif /* _MSC_VER */
+
+#ifdef USEPOSIXTHREADS
+  /* pthread_t is an integer or a pointer on all supported platforms */
+  id = (unsigned long) pthread_self();
+#endif /* USEPOSIXTHREADS */
+
+#ifdef USEUITHREADS
+  id = (unsigned long) thr_self();
+#endif /* USEUITHREADS */
+#endif /* THR */
+
+  return id;
+}
+
+
 /*
  * Mutexes
  */
@@ -155,6 +155,12 @@ int rt_thread_numprocessors(void);
 /** query CPU affinity of the calling process (if allowed by host system) */
 int * rt_cpu_affinitylist(int *cpuaffinitycount);
 
+/** largest number of NUMA nodes rt_cpu_numa_node() looks for */
+#define RT_MAX_NUMA_NODES 64
+
+/** query the NUMA node of a CPU, or -1 if unknown */
+int rt_cpu_numa_node(int cpu);
+
 /** set the CPU affinity of the current thread (if allowed by host system) */
 int rt_thread_set_self_cpuaffinity(int cpu);
 
@@ -171,6 +177,9 @@ int rt_thread_create(rt_thread_t *, void * fctn(void *), void *);
 /** join (wait for completion of, and merge with) a thread */
 int rt_thread_join(rt_thread_t, void **);
 
+/** return a number identifying the calling thread */
+unsigned long rt_thread_self_id(void);
+
 
 /*
  * Mutex management
@@ -22,6 +22,8 @@
 #include "intersect.h"
 #include "ui.h"
 #include "trace.h"
+#include "render.h"
+#include "grid.h"
 #if defined(_OPENMP)
 #include <omp.h>
 #endif
@@ -173,29 +175,38 @@ int node_finish_row_sendrecvs(int my_tid, thr_parms * t, scenedef *scene, int *s
 #endif /* MPI */
 
 
-void * thread_trace(thr_parms * t) {
-#if defined(_OPENMP)
-#pragma omp parallel default( none ) firstprivate(t)
-{
-#endif
-  unsigned long * local_mbox = NULL;
-  scenedef * scene;
+/*
+ * The cost of the rays traced so far, counted in intersection tests
+ * and grid cells visited, used to fill in the per-pixel cost map.
+ */
+static unsigned long long raycost(const rt_render_stats * stats) {
+  unsigned long long cost = stats->gridcells;
+  int i;
+
+  for (i=0; i<RT_STATS_NUMTYPES; i++)
+    cost += stats->tests[i];
+
+  return cost;
+}
+
+
+/*
+ * Render this thread's share of the pixels of one frame into the image
+ * buffer, in the scene's image buffer format, using the camera attached
+ * to the primary ray.  Progress is reported for
+ * frame 'frame' of 'numframes'.  If 'costmap' is non-NULL, the cost of
+ * each pixel is stored there, which requires the primary ray to carry
+ * a statistics block.
+ */
+static void trace_frame(thr_parms * t, int my_tid, ray * primary, 
+                        void * imgbuf, unsigned int * costmap, 
+                        int frame, int numframes, int * sentrows) {
+  scenedef * scene = t->scene;
   color col;
-  ray primary;
-  int x, y, do_ui, hskip;
-  int startx, stopx, xinc, starty, stopy, yinc, hsize, vres;
+  unsigned long long cost = 0;
+  int x, y, do_ui, hskip, imgxres, imgxstart, imgystart;
+  int startx, stopx, xinc, starty, stopy, yinc, hsize, numrows;
   rng_frand_handle cachefrng; /* Hold cached FP RNG state */
-#if defined(MPI)
-  int sentrows = 0;  /* no rows sent yet */
-#endif
-
-#if defined(_OPENMP)
-  int my_tid = omp_get_thread_num(); /* get OpenMP thread ID */
-  unsigned long my_serialno = 1; /* XXX should restore previous serialno */
-#else
-  int my_tid = t->tid;
-  unsigned long my_serialno = t->serialno;
-#endif
 
   /*
    * Copy all of the frequently used parameters into local variables.
@@ -209,59 +220,18 @@ void * thread_trace(thr_parms * t) {
   stopy  = t->stopy;
   yinc   = t->yinc;
  
-  scene  = t->scene;
-  hsize  = scene->hres*3;
-  vres   = scene->vres;
+  /* the image buffer may only hold the crop window of the full image */
+  imgxres   = scene->imgxres;
+  imgxstart = scene->imgxstart;
+  imgystart = scene->imgystart;
+  hsize  = imgxres*3;
+  numrows = stopy - starty + 1; /* rows in the region, for progress */
   hskip  = xinc * 3;
   do_ui = (scene->mynode == 0 && my_tid == 0);
 
-#if !defined(DISABLEMBOX)
-   /* allocate mailbox array per thread... */
-#if defined(_OPENMP)
-  local_mbox = (unsigned long *)calloc(sizeof(unsigned long)*scene->objgroup.numobjects, 1);
-#else
-  if (t->local_mbox == NULL)  
-    local_mbox = (unsigned long *)calloc(sizeof(unsigned long)*scene->objgroup.numobjects, 1);
-  else 
-    local_mbox = t->local_mbox;
-#endif
-#else
-  local_mbox = NULL; /* mailboxes are disabled */
-#endif
-
-  /*
-   * When compiled on platforms with a 64-bit long, ray serial numbers won't 
-   * wraparound in _anyone's_ lifetime, so there's no need to even check....
-   * On lesser-bit platforms, we're not quite so lucky, so we have to check.
-   * We use a sizeof() check so that we can eliminate the LP64 macro tests
-   * and eventually simplify the Makefiles.
-   */
-  if (sizeof(unsigned long) < 8) {
-    /* 
-     * If we are getting close to integer wraparound on the    
-     * ray serial numbers, we need to re-clear the mailbox     
-     * array(s).  Each thread maintains its own serial numbers 
-     * so only those threads that are getting hit hard will    
-     * need to re-clear their mailbox arrays.  In all likelihood,
-     * the threads will tend to hit their counter limits at about
-     * the same time though.
-     */
-    if (local_mbox != NULL) {
-      /* reset counters if serial exceeds 1/8th largest possible ulong */
-      if (my_serialno > (((unsigned long) 1) << ((sizeof(unsigned long) * 8) - 3))) {
-        memset(local_mbox, 0, sizeof(unsigned long)*scene->objgroup.numobjects);
-        my_serialno = 1;
-      }
-    }
-  }
-
-  /* setup the thread-specific properties of the primary ray(s) */
-  camray_init(scene, &primary, my_serialno, local_mbox, 
-              rng_seed_from_tid_nodeid(my_tid, scene->mynode));
-
   /* copy the RNG state to cause increased coherence among */
   /* AO sample rays, significantly reducing granulation    */
-  cachefrng = primary.frng;
+  cachefrng = primary->frng;
 
   /* 
    * Render the image in either RGB24 or RGB96F format
@@ -269,16 +239,26 @@ void * thread_trace(thr_parms * t) {
   if (scene->imgbufformat == RT_IMAGE_BUFFER_RGB24) {
     /* 24-bit unsigned char RGB, RT_IMAGE_BUFFER_RGB24 */
     int addr, R,G,B;
-    unsigned char *img = (unsigned char *) scene->img;
+    unsigned char *img = (unsigned char *) imgbuf;
 
 #if defined(_OPENMP)
 #pragma omp for schedule(runtime)
 #endif
     for (y=starty; y<=stopy; y+=yinc) {
-      addr = hsize * (y - 1) + (3 * (startx - 1));    /* row address */
+      addr = hsize * (y - 1 - imgystart) + (3 * (startx - 1 - imgxstart)); /* row address */
       for (x=startx; x<=stopx; x+=xinc,addr+=hskip) {
-        primary.frng = cachefrng; /* each pixel uses the same AO RNG seed */
-        col=scene->camera.cam_ray(&primary, x, y);    /* generate ray */ 
+        primary->frng = cachefrng; /* each pixel uses the same AO RNG seed */
+#if defined(RT_RNG_USE_COUNTER)
+        /* the jitter depends on the pixel, not on the thread rendering it */
+        primary->randval = rng_seed_from_pixel(x, y);
+        primary->o = primary->camera->center; /* undo the last DOF jitter */
+#endif
+        if (costmap != NULL)
+          cost = raycost(primary->stats);
+        col=primary->camera->cam_ray(primary, x, y);  /* generate ray */ 
+        if (costmap != NULL)
+          costmap[imgxres*(y-1-imgystart) + (x-1-imgxstart)] = 
+            (unsigned int) (raycost(primary->stats) - cost);
 
         R = (int) (col.r * 255.0f); /* quantize float to integer */
         G = (int) (col.g * 255.0f); /* quantize float to integer */
@@ -297,48 +277,174 @@ void * thread_trace(thr_parms * t) {
         img[addr + 2] = (byte) B;   /* Store final pixel to the image buffer */
       } /* end of x-loop */
 
-      if (do_ui && !((y-1) % 16)) {
-        rt_ui_progress((100 * y) / vres);  /* call progress meter callback */
+      if (do_ui && !((y-starty) % 16)) {
+        /* call progress meter callback */
+        rt_scene_ui_progress(scene, (100 * (frame*numrows + y - starty + 1)) / 
+                                    (numframes*numrows));
       } 
 
 #if defined(MPI)
       /* Ensure all threads have completed this row, then send it */
-      node_row_sendrecv(my_tid, t, scene, &sentrows, y);
+      node_row_sendrecv(my_tid, t, scene, sentrows, y);
 #endif
     }        /* end y-loop */
   } else {   /* end of RGB24 loop */
     /* 96-bit float RGB, RT_IMAGE_BUFFER_RGB96F */
     int addr;
-    float *img = (float *) scene->img;
+    float *img = (float *) imgbuf;
 
 #if defined(_OPENMP)
 #pragma omp for schedule(runtime)
 #endif
     for (y=starty; y<=stopy; y+=yinc) {
-      addr = hsize * (y - 1) + (3 * (startx - 1));    /* row address */
+      addr = hsize * (y - 1 - imgystart) + (3 * (startx - 1 - imgxstart)); /* row address */
       for (x=startx; x<=stopx; x+=xinc,addr+=hskip) {
-        primary.frng = cachefrng; /* each pixel uses the same AO RNG seed */
-        col=scene->camera.cam_ray(&primary, x, y);    /* generate ray */ 
+        primary->frng = cachefrng; /* each pixel uses the same AO RNG seed */
+#if defined(RT_RNG_USE_COUNTER)
+        /* the jitter depends on the pixel, not on the thread rendering it */
+        primary->randval = rng_seed_from_pixel(x, y);
+        primary->o = primary->camera->center; /* undo the last DOF jitter */
+#endif
+        if (costmap != NULL)
+          cost = raycost(primary->stats);
+        col=primary->camera->cam_ray(primary, x, y);  /* generate ray */ 
+        if (costmap != NULL)
+          costmap[imgxres*(y-1-imgystart) + (x-1-imgxstart)] = 
+            (unsigned int) (raycost(primary->stats) - cost);
         img[addr    ] = col.r;   /* Store final pixel to the image buffer */
         img[addr + 1] = col.g;   /* Store final pixel to the image buffer */
         img[addr + 2] = col.b;   /* Store final pixel to the image buffer */
       } /* end of x-loop */
 
-      if (do_ui && !((y-1) % 16)) {
-        rt_ui_progress((100 * y) / vres);  /* call progress meter callback */
+      if (do_ui && !((y-starty) % 16)) {
+        /* call progress meter callback */
+        rt_scene_ui_progress(scene, (100 * (frame*numrows + y - starty + 1)) / 
+                                    (numframes*numrows));
       } 
 
 #if defined(MPI)
       /* Ensure all threads have completed this row, then send it */
-      node_row_sendrecv(my_tid, t, scene, &sentrows, y);
+      node_row_sendrecv(my_tid, t, scene, sentrows, y);
 #endif
     }        /* end y-loop */
   }          /* end of RGB96F loop */
+}
+
+
+void * thread_trace(thr_parms * t) {
+#if defined(_OPENMP)
+#pragma omp parallel default( none ) firstprivate(t)
+{
+#endif
+  unsigned long * local_mbox = NULL;
+  mboxentry * local_hashmbox = NULL;
+  scenedef * scene;
+  ray primary;
+  rt_render_stats stats; /* this thread's statistics for the frame(s) */
+  int sentrows = 0;  /* no rows sent yet */
+
+#if defined(_OPENMP)
+  int my_tid = omp_get_thread_num(); /* get OpenMP thread ID */
+  unsigned long my_serialno = 1; /* XXX should restore previous serialno */
+#else
+  int my_tid = t->tid;
+  unsigned long my_serialno = t->serialno;
+#endif
+
+  scene  = t->scene;
+
+   /* allocate mailbox per thread, unless mailboxes are disabled... */
+#if defined(_OPENMP)
+  grid_mbox_alloc(scene, &local_mbox, &local_hashmbox);
+#else
+  if (t->local_mbox == NULL && t->local_hashmbox == NULL) {
+    grid_mbox_alloc(scene, &local_mbox, &local_hashmbox);
+  } else {
+    local_mbox = t->local_mbox;
+    local_hashmbox = t->local_hashmbox;
+  }
+#endif
+
+  /*
+   * When compiled on platforms with a 64-bit long, ray serial numbers won't 
+   * wraparound in _anyone's_ lifetime, so there's no need to even check....
+   * On lesser-bit platforms, we're not quite so lucky, so we have to check.
+   * We use a sizeof() check so that we can eliminate the LP64 macro tests
+   * and eventually simplify the Makefiles.
+   */
+  if (sizeof(unsigned long) < 8) {
+    /* 
+     * If we are getting close to integer wraparound on the    
+     * ray serial numbers, we need to re-clear the mailbox     
+     * array(s).  Each thread maintains its own serial numbers 
+     * so only those threads that are getting hit hard will    
+     * need to re-clear their mailbox arrays.  In all likelihood,
+     * the threads will tend to hit their counter limits at about
+     * the same time though.
+     */
+    if (local_mbox != NULL || local_hashmbox != NULL) {
+      /* reset counters if serial exceeds 1/8th largest possible ulong */
+      if (my_serialno > (((unsigned long) 1) << ((sizeof(unsigned long) * 8) - 3))) {
+        grid_mbox_clear(scene, local_mbox, local_hashmbox);
+        my_serialno = 1;
+      }
+    }
+  }
+
+  /* statistics are counted on the stack and handed over at the end, */
+  /* the cost map is computed from them even if they aren't wanted    */
+  if (scene->statsmode || scene->costmap != NULL)
+    memset(&stats, 0, sizeof(stats));
+
+  if (scene->keyframes == NULL) {
+    /* setup the thread-specific properties of the primary ray(s) */
+    camray_init(scene, &scene->camera, &primary, my_serialno, 
+                local_mbox, local_hashmbox,
+                rng_seed_from_tid_nodeid(my_tid, scene->mynode));
+    if (scene->statsmode || scene->costmap != NULL)
+      primary.stats = &stats;
+    primary.numanode = t->numanode;
+
+    /* the bands of a tiled image count as frames for progress */
+    trace_frame(t, my_tid, &primary, scene->img, scene->costmap, 
+                scene->curtile, MYMAX(1, scene->numtiles), &sentrows);
+    my_serialno = primary.serial + 1;
+  } else {
+    /*
+     * Render a batch of camera keyframes.  Each thread sets up its own
+     * copy of the camera for each frame, so there's no need to wait for
+     * the other threads between frames, and the last rows of one frame
+     * overlap with the first rows of the next.
+     */
+    camdef cam;
+    int frame;
+
+    for (frame=0; frame<scene->numkeyframes; frame++) {
+      camera_keyframe(scene, &scene->keyframes[frame], &cam);
+
+      /* reseed the RNGs so each frame matches a separately rendered one */
+      camray_init(scene, &cam, &primary, my_serialno, 
+                  local_mbox, local_hashmbox,
+                  rng_seed_from_tid_nodeid(my_tid, scene->mynode));
+      if (scene->statsmode)
+        primary.stats = &stats;
+      primary.numanode = t->numanode;
+
+      trace_frame(t, my_tid, &primary, scene->keyimages[frame], NULL,
+                  frame, scene->numkeyframes, &sentrows);
+      my_serialno = primary.serial + 1;
+    }
+  }
 
   /* 
    * Image has been rendered into the buffer in the appropriate pixel format
    */
-  my_serialno = primary.serial + 1;
+  if (scene->statsmode) {
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+    render_stats_add(&t->stats, &stats);
+  }
 
 #if defined(_OPENMP)
   /* XXX The OpenMP code needs to find a way to save serialno for next */
@@ -348,17 +454,21 @@ void * thread_trace(thr_parms * t) {
   /* XXX until we save/restore serial numbers, we have to clear the */
   /* mailbox before the next rendering pass */
   if (sizeof(unsigned long) < 8) {
-    memset(local_mbox, 0, sizeof(unsigned long)*scene->objgroup.numobjects);
+    grid_mbox_clear(scene, local_mbox, local_hashmbox);
   }
 
   if (local_mbox != NULL)
     free(local_mbox);
+  if (local_hashmbox != NULL)
+    free(local_hashmbox);
 #else
   t->serialno = my_serialno; /* save our serialno for next launch */
 
-  if (t->local_mbox == NULL) {
+  if (t->local_mbox == NULL && t->local_hashmbox == NULL) {
     if (local_mbox != NULL)
       free(local_mbox);
+    if (local_hashmbox != NULL)
+      free(local_hashmbox);
   }
 #endif
 
@@ -9,6 +9,7 @@ typedef struct {
   int nthr;                   /**< total number of worker threads */
   scenedef * scene;           /**< scene handle                   */
   unsigned long * local_mbox; /**< grid acceleration mailbox structure */
+  mboxentry * local_hashmbox; /**< hashed mailbox, if used instead   */
   unsigned long serialno;     /**< ray mailbox test serial number */
   int startx;                 /**< starting X pixel index         */
   int stopx;                  /**< ending X pixel index           */
@@ -17,6 +18,10 @@ typedef struct {
   int stopy;                  /**< ending Y pixel index           */
   int yinc;                   /**< Y pixel stride                 */
   rt_barrier_t * runbar;      /**< Sleeping thread pool barrier   */
+  rt_render_stats stats;      /**< statistics for the current frame */
+  int cpu;                    /**< CPU the thread is pinned to, or -1 */
+  int numanode;               /**< NUMA node of that CPU, or -1   */
+  int numaleader;             /**< copies the grids for its node  */
 #if defined(MPI) && defined(THR)
   int numrowbars;             /**< Number of row barriers         */
   rt_atomic_int_t * rowbars;  /**< Per-row atomic int barriers    */
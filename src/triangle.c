@@ -15,6 +15,7 @@
 #include "macros.h"
 #include "intersect.h"
 #include "util.h"
+#include "arena.h"
 
 #define TRIANGLE_PRIVATE
 #include "triangle.h"
@@ -23,31 +24,35 @@ static object_methods tri_methods = {
   (void (*)(const void *, void *))(tri_intersect),
   (void (*)(const void *, const void *, const void *, void *))(tri_normal),
   tri_bbox, 
-  free 
+  arena_nofree,
+  RT_STATS_TRIANGLE
 };
 
 static object_methods stri_methods = {
   (void (*)(const void *, void *))(tri_intersect),
   (void (*)(const void *, const void *, const void *, void *))(stri_normal),
   tri_bbox, 
-  free 
+  arena_nofree,
+  RT_STATS_STRI
 };
 
 static object_methods stri_methods_reverse = {
   (void (*)(const void *, void *))(tri_intersect),
   (void (*)(const void *, const void *, const void *, void *))(stri_normal_reverse),
   tri_bbox, 
-  free 
+  arena_nofree,
+  RT_STATS_STRI
 };
 
 static object_methods stri_methods_guess = {
   (void (*)(const void *, void *))(tri_intersect),
   (void (*)(const void *, const void *, const void *, void *))(stri_normal_guess),
   tri_bbox, 
-  free 
+  arena_nofree,
+  RT_STATS_STRI
 };
 
-object * newtri(void * tex, vector v0, vector v1, vector v2) {
+object * newtri(scenedef * scene, void * tex, vector v0, vector v1, vector v2) {
   tri * t;
   vector edge1, edge2, edge3;
 
@@ -60,7 +65,7 @@ object * newtri(void * tex, vector v0, vector v1, vector v2) {
       (VLength(&edge2) >= EPSILON) && 
       (VLength(&edge3) >= EPSILON)) {
 
-    t=(tri *) malloc(sizeof(tri));
+    t=(tri *) scene_alloc(scene, sizeof(tri));
 
     t->nextobj = NULL;
     t->methods = &tri_methods;
@@ -77,8 +82,9 @@ object * newtri(void * tex, vector v0, vector v1, vector v2) {
 }
 
 
-object * newstri(void * tex, vector v0, vector v1, vector v2,
-                           vector n0, vector n1, vector n2) {
+object * newstri(scenedef * scene, void * tex, 
+                 vector v0, vector v1, vector v2,
+                 vector n0, vector n1, vector n2) {
   stri * t;
   vector edge1, edge2, edge3;
 
@@ -91,7 +97,7 @@ object * newstri(void * tex, vector v0, vector v1, vector v2,
       (VLength(&edge2) >= EPSILON) &&
       (VLength(&edge3) >= EPSILON)) {
 
-    t=(stri *) malloc(sizeof(stri));
+    t=(stri *) scene_alloc(scene, sizeof(stri));
 
     t->nextobj = NULL;
     t->methods = &stri_methods;
@@ -134,12 +140,12 @@ void stri_normal_fixup(object *otri, int mode) {
 }
 
 
-object * newvcstri(void * voidtex, vector v0, vector v1, vector v2,
+object * newvcstri(scenedef * scene, void * voidtex, 
+                   vector v0, vector v1, vector v2,
                    vector n0, vector n1, vector n2,
                    color c0, color c1, color c2) {
   vcstri * t;
   vector edge1, edge2, edge3;
-  vcstri_texture * tex = (vcstri_texture *) voidtex; 
 
   VSub(&v1, &v0, &edge1);
   VSub(&v2, &v0, &edge2);
@@ -150,7 +156,7 @@ object * newvcstri(void * voidtex, vector v0, vector v1, vector v2,
       (VLength(&edge2) >= EPSILON) &&
       (VLength(&edge3) >= EPSILON)) {
 
-    t=(vcstri *) malloc(sizeof(vcstri));
+    t=(vcstri *) scene_alloc(scene, sizeof(vcstri));
 
     t->nextobj = NULL;
     t->methods = &stri_methods;
@@ -162,12 +168,12 @@ object * newvcstri(void * voidtex, vector v0, vector v1, vector v2,
     t->n1 = n1;
     t->n2 = n2;
 
-    tex->c0 = c0;
-    tex->c1 = c1;
-    tex->c2 = c2;
-    tex->obj = t; /* XXX hack to let the texture function get c0c1c2 data */
-    tex->texfunc = (color(*)(const void *, const void *, void *))(vcstri_color);
-    t->tex = (texture *) tex;
+    /* vertex colors are kept in the triangle, so that the texture, */
+    /* which must use vcstri_color(), can be shared by many of them */
+    t->c0 = c0;
+    t->c1 = c1;
+    t->c2 = c2;
+    t->tex = (texture *) voidtex;
 
     return (object *) t;
   }
@@ -354,8 +360,8 @@ static void stri_normal(const stri * trn, const vector * hit, const ray * incide
 
 
 color vcstri_color(const vector * hit, const texture * tx, const ray * incident) {
-  vcstri_texture * tex = (vcstri_texture *) tx;
-  const vcstri * trn = (vcstri *) tex->obj;
+  /* the texture is shared, the triangle is the closest intersection */
+  const vcstri * trn = (const vcstri *) incident->intstruct.closest.obj;
   flt U, V, W, lensqr;
   vector P, tmp, norm;
   color col;
@@ -373,9 +379,9 @@ color vcstri_color(const vector * hit, const texture * tx, const ray * incident)
 
   W = 1.0 - (U + V);
 
-  col.r = W*tex->c0.r + U*tex->c1.r + V*tex->c2.r;
-  col.g = W*tex->c0.g + U*tex->c1.g + V*tex->c2.g;
-  col.b = W*tex->c0.b + U*tex->c1.b + V*tex->c2.b;
+  col.r = W*trn->c0.r + U*trn->c1.r + V*trn->c2.r;
+  col.g = W*trn->c0.g + U*trn->c1.g + V*trn->c2.g;
+  col.b = W*trn->c0.b + U*trn->c1.b + V*trn->c2.b;
 
   return col;
 }
@@ -4,11 +4,12 @@
  *  $Id: triangle.h,v 1.21 2011/02/05 08:10:11 johns Exp $
  */
 
-object * newtri(void *, vector, vector, vector);
-object * newstri(void *, vector, vector, vector, vector, vector, vector);
+object * newtri(scenedef *, void *, vector, vector, vector);
+object * newstri(scenedef *, void *, vector, vector, vector, 
+                 vector, vector, vector);
 void stri_normal_fixup(object *, int mode);
-object * newvcstri(void *, vector, vector, vector, vector, vector, vector,
-                   color, color, color);
+object * newvcstri(scenedef *, void *, vector, vector, vector, 
+                   vector, vector, vector, color, color, color);
 void vcstri_normal_fixup(object *, int mode);
 color vcstri_color(const vector * hit, const texture * tex, const ray * incident);
 
@@ -27,6 +27,15 @@ void rt_set_ui_progress(void (* func) (int)) {
   rt_static_ui_progress = func;
 }
 
+void rt_scene_ui_callbacks(SceneHandle voidscene, 
+                           void (* message)(void *, int, char *),
+                           void (* progress)(void *, int), void * data) {
+  scenedef * scene = (scenedef *) voidscene;
+  scene->ui_message = message;
+  scene->ui_progress = progress;
+  scene->ui_data = data;
+}
+
 void rt_ui_message(int level, char * msg) {
   if (rt_static_ui_message != NULL) 
     rt_static_ui_message(level, msg);
@@ -44,6 +53,25 @@ int rt_ui_checkaction(void) {
     return 0;
 }
 
+/* 
+ * Messages and progress for a particular scene go to the scene's own
+ * callbacks if it has any, so that concurrently rendered scenes can 
+ * report separately, and to the process wide callbacks otherwise.
+ */
+void rt_scene_ui_message(scenedef * scene, int level, char * msg) {
+  if (scene->ui_message != NULL)
+    scene->ui_message(scene->ui_data, level, msg);
+  else
+    rt_ui_message(level, msg);
+}
+
+void rt_scene_ui_progress(scenedef * scene, int percent) {
+  if (scene->ui_progress != NULL)
+    scene->ui_progress(scene->ui_data, percent);
+  else
+    rt_ui_progress(percent);
+}
+
 
 
 
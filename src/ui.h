@@ -17,4 +17,6 @@
 void rt_ui_message(int, char *);
 void rt_ui_progress(int);
 int  rt_ui_checkaction(void);
+void rt_scene_ui_message(scenedef *, int, char *);
+void rt_scene_ui_progress(scenedef *, int);
 
@@ -13,6 +13,12 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#if !defined(DISABLEMMAP) && !defined(_MSC_VER) && !defined(WIN32)
+#define USEMMAP 1
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 #define TACHYON_INTERNAL 1
 #include "tachyon.h"
 #include "macros.h"
@@ -231,6 +237,49 @@ double rt_timer_timenow(rt_timerhandle v) {
 
 
 
+/*
+ * Read-only memory mapping of large data files such as volumes and
+ * uncompressed image maps.  The mapping is shared, so pages are only
+ * read in from disk on first access, and all processes on a node that
+ * map the same file (e.g. MPI ranks) share the same physical pages.
+ * Returns NULL if the file can't be mapped, in which case callers fall
+ * back to reading the file into a heap buffer.
+ */
+void * rt_mmap_readonly(const char *filename, size_t *len) {
+#if defined(USEMMAP)
+  struct stat st;
+  void * addr;
+  int fd;
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return NULL;
+  }
+
+  addr = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); /* the mapping holds its own reference to the file */
+  if (addr == MAP_FAILED)
+    return NULL;
+
+  *len = (size_t) st.st_size;
+  return addr;
+#else
+  return NULL;
+#endif
+}
+
+void rt_munmap(void *addr, size_t len) {
+#if defined(USEMMAP)
+  if (addr != NULL)
+    munmap(addr, len);
+#endif
+}
+
+
 /*
  * Code for machines with deficient libc's etc.
  */
@@ -352,7 +401,37 @@ unsigned int rt_rand(unsigned int * idum) {
  *
  */
 
-#if defined(RT_RNG_USE_QUICK_AND_DIRTY)
+/*
+ * PCG-style integer hash [Jarzynski and Olano 2020], a permuted 32-bit
+ * LCG step, used by the counter-based RNG and for hashing pixel seeds
+ */
+static unsigned int rng_hash(unsigned int v) {
+  unsigned int state = v * 747796405u + 2891336453u;
+  unsigned int word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+#if defined(RT_RNG_USE_COUNTER)
+
+/*
+ * Counter-based RNG, the n-th number of a stream is a pure function of
+ * the stream key and n, so the handle is just the key and a counter,
+ * and a sequence doesn't depend on anything that happened before it.
+ */
+void rng_urand_init(rng_urand_handle *rngh) {
+  rng_urand_seed(rngh, 31337);
+}
+
+void rng_urand_seed(rng_urand_handle *rngh, unsigned int seed) {
+  rngh->key = rng_hash(seed);
+  rngh->counter = 0;
+}
+
+unsigned int rng_urand(rng_urand_handle *rngh) {
+  return rng_hash(rngh->key + rng_hash(rngh->counter++));
+}
+
+#elif defined(RT_RNG_USE_QUICK_AND_DIRTY)
 
 unsigned int rng_urand(rng_urand_handle *rngh) {
 #if defined(_CRAYT3E)
@@ -588,6 +667,14 @@ unsigned int rng_seed_from_tid_nodeid(int tid, int node) {
   return seedbuf[tid % 11] + node * 31337;
 }
 
+/*
+ * seed for the per-pixel jitter sequences in the counter-based RNG mode,
+ * it is always odd since rt_rand() is a multiplicative LCG
+ */
+unsigned int rng_seed_from_pixel(int x, int y) {
+  return rng_hash(rng_hash((unsigned int) x) + (unsigned int) y) | 1;
+}
+
 /* calculate a pair of pixel jitter offset values */
 /* that range from -0.5 to 0.5                    */
 void jitter_offset2f(unsigned int *pval, float *xy) {
@@ -33,13 +33,28 @@ void rt_timer_stop(rt_timerhandle);      /* stop a timer                   */
 double rt_timer_time(rt_timerhandle);    /* report elapsed time in seconds */
 double rt_timer_timenow(rt_timerhandle); /* report elapsed time in seconds */
 
+void * rt_mmap_readonly(const char *, size_t *); /* map a file read-only */
+void rt_munmap(void *, size_t);          /* unmap a file mapping           */
+
 #define RT_RAND_MAX 4294967296.0         /* Max random value from rt_rand  */
 unsigned int rt_rand(unsigned int *);    /* thread-safe 32-bit RNG         */
 
-/* select the RNG to use as the basis for all of the floating point work */
+/* select the RNG to use as the basis for all of the floating point work, */
+/* RT_RNG_USE_COUNTER can also be selected in Make-config                 */
+#if !defined(RT_RNG_USE_COUNTER)
 #define RT_RNG_USE_KISS93               1
+#endif
+
+#if defined(RT_RNG_USE_COUNTER)
+
+/* Counter-based, each number is a hash of the stream key and its index */
+typedef struct {
+  unsigned int key;       /* stream key */
+  unsigned int counter;   /* index of the next number in the stream */
+} rng_urand_handle;
+#define RT_RNG_MAX 4294967296.0       /* max urand value: 2^32 */
 
-#if defined(RT_RNG_USE_QUICK_AND_DIRTY)
+#elif defined(RT_RNG_USE_QUICK_AND_DIRTY)
 
 /* Quick and Dirty RNG */
 typedef struct {
@@ -104,6 +119,9 @@ void rng_drand_seed(rng_frand_handle *rngh, unsigned int seed);
 /* routine to help create seeds for parallel runs */
 unsigned int rng_seed_from_tid_nodeid(int tid, int node);
 
+/* seed that only depends on the pixel, for the counter-based RNG mode */
+unsigned int rng_seed_from_pixel(int x, int y);
+
 void jitter_offset2f(unsigned int *pval, float *xy);
 void jitter_disc2f(unsigned int *pval, float *xy);
 void jitter_sphere3f(rng_frand_handle *rngh, float *dir);
@@ -23,6 +23,11 @@
 #include "ui.h"
 #include "shade.h"
 #include "texture.h"
+#include "brick.h"
+
+#define VOL_CELL_SHIFT 3                    /**< 8x8x8 voxel macrocells  */
+#define VOL_CELL_SIZE  (1 << VOL_CELL_SHIFT)
+#define VOL_CELL_EPS   0.01                 /**< cell boundary guard band */
 
 int scalarvol_bbox(void * obj, vector * min, vector * max) {
   box * b = (box *) obj;
@@ -38,13 +43,14 @@ static object_methods scalarvol_methods = {
   (void (*)(void *, void *))(box_intersect),
   (void (*)(void *, void *, void *, void *))(box_normal),
   scalarvol_bbox, 
-  free 
+  free,
+  RT_STATS_VOLUME
 };
 #endif
 
 void * newscalarvol(void * voidtex, vector min, vector max, 
                     int xs, int ys, int zs, const char * fname, 
-                    scalarvol * invol) {
+                    scalarvol * invol, int layout) {
   standard_texture * tx, * tex;
   scalarvol * vol;
 
@@ -58,6 +64,10 @@ void * newscalarvol(void * voidtex, vector min, vector max,
     vol=malloc(sizeof(scalarvol));
     vol->loaded=0;
     vol->data=NULL;
+    vol->mapaddr=NULL;
+    vol->maplen=0;
+    vol->cellmax=NULL;
+    vol->voxoffs=NULL;
   } else {
     vol=invol;
   }
@@ -96,7 +106,7 @@ void * newscalarvol(void * voidtex, vector min, vector max,
   /* Force load of volume data so that we don't have to do mutex locks */
   /* inside the rendering threads                                      */
   if (!vol->loaded) {
-    LoadVol(vol);
+    LoadVol(vol, layout);
   }
 
   /* check if loading succeeded */
@@ -140,13 +150,32 @@ color VoxelColor(flt scalar) {
   return col;
 } 
 
+/*
+ * Return the ray parameter at which a ray with continuous voxel coordinate
+ * o + d*t along one axis leaves macrocell c, if that is sooner than tmin.
+ * The cell bounds are pulled in slightly, so that roundoff can never cause
+ * a ray to skip a sample that actually lies in a neighboring cell.
+ */
+static flt macrocell_exit(flt o, flt d, int c, flt tmin) {
+  flt t;
+
+  if (d > 0.0) 
+    t = (((c + 1) << VOL_CELL_SHIFT) - VOL_CELL_EPS - o) / d;
+  else if (d < 0.0) 
+    t = ((c << VOL_CELL_SHIFT) + VOL_CELL_EPS - o) / d;
+  else 
+    return tmin;
+
+  return (t < tmin) ? t : tmin;
+}
+
 color scalar_volume_texture(const vector * hit, const texture * tx, ray * ry) {
   color col, col2;
   box * bx;
   flt a, tx1, tx2, ty1, ty2, tz1, tz2;
   flt tnear, tfar;
   flt t, tdist, dt, sum, tt; 
-  vector pnt, bln;
+  vector pnt, bln, vo, vd;
   scalarvol * vol;
   flt scalar, transval; 
   int x, y, z;
@@ -224,6 +253,14 @@ color scalar_volume_texture(const vector * hit, const texture * tx, ray * ry) {
   dt=SQRT(bln.x*bln.x + bln.y*bln.y + bln.z*bln.z) / tdist; 
   sum=0.0;
 
+  /* ray position in continuous voxel coordinates, for macrocell skipping */
+  vo.x = (vol->xres - 1.5) * ((ry->o.x - bx->min.x) / bln.x) + 0.5;
+  vo.y = (vol->yres - 1.5) * ((ry->o.y - bx->min.y) / bln.y) + 0.5;
+  vo.z = (vol->zres - 1.5) * ((ry->o.z - bx->min.z) / bln.z) + 0.5;
+  vd.x = (vol->xres - 1.5) * ry->d.x / bln.x;
+  vd.y = (vol->yres - 1.5) * ry->d.y / bln.y;
+  vd.z = (vol->zres - 1.5) * ry->d.z / bln.z;
+
   for (t=tnear; t<=tfar; t+=dt) {
     pnt.x=((ry->o.x + (ry->d.x * t)) - bx->min.x) / bln.x;
     pnt.y=((ry->o.y + (ry->d.y * t)) - bx->min.y) / bln.y;
@@ -232,8 +269,26 @@ color scalar_volume_texture(const vector * hit, const texture * tx, ray * ry) {
     x=(int) ((vol->xres - 1.5) * pnt.x + 0.5);
     y=(int) ((vol->yres - 1.5) * pnt.y + 0.5);
     z=(int) ((vol->zres - 1.5) * pnt.z + 0.5);
+
+    /* empty macrocells contribute nothing, so step over all of the  */
+    /* samples that fall inside them, landing on the last such one   */
+    if (vol->cellmax != NULL) {
+      int cx = x >> VOL_CELL_SHIFT;
+      int cy = y >> VOL_CELL_SHIFT;
+      int cz = z >> VOL_CELL_SHIFT;
+
+      if (vol->cellmax[(cz*vol->cellyres + cy)*vol->cellxres + cx] == 0) {
+        flt texit = FHUGE;
+        texit = macrocell_exit(vo.x, vd.x, cx, texit); 
+        texit = macrocell_exit(vo.y, vd.y, cy, texit); 
+        texit = macrocell_exit(vo.z, vd.z, cz, texit); 
+        if (texit > t) 
+          t += dt * ((int) ((texit - t) / dt));
+        continue;
+      }
+    }
    
-    ptr = vol->data + ((vol->xres * vol->yres * z) + (vol->xres * y) + x);
+    ptr = vol->data + VOXEL_ADDR(vol->voxoffs, vol->xres, vol->yres, x, y, z);
    
     scalar = (flt) ((flt) 1.0 * ((int) ptr[0])) / 255.0;
 
@@ -251,6 +306,7 @@ color scalar_volume_texture(const vector * hit, const texture * tx, ray * ry) {
     }  
     else { 
       sum=1.0;
+      break; /* opacity has saturated, nothing further can contribute */
     }
   }
 
@@ -272,8 +328,111 @@ color scalar_volume_texture(const vector * hit, const texture * tx, ray * ry) {
   return col;
 }
 
-void LoadVol(scalarvol * vol) { 
+/*
+ * Build a coarse grid of macrocells holding the maximum voxel value within
+ * each block of voxels.  Rays skip straight across macrocells whose voxels
+ * are all zero, since they can't contribute any color or opacity.
+ */
+static void build_macrocells(scalarvol * vol) {
+  int x, y, z, cx, cy, cz;
+  const unsigned char * row;
+  unsigned char * cells;
+
+  vol->cellxres = (vol->xres + VOL_CELL_SIZE - 1) >> VOL_CELL_SHIFT;
+  vol->cellyres = (vol->yres + VOL_CELL_SIZE - 1) >> VOL_CELL_SHIFT;
+  vol->cellzres = (vol->zres + VOL_CELL_SIZE - 1) >> VOL_CELL_SHIFT;
+  vol->cellmax = (unsigned char *) calloc(1, (size_t) vol->cellxres * 
+                                             vol->cellyres * vol->cellzres);
+  if (vol->cellmax == NULL) 
+    return; /* render without empty space skipping */
+
+  for (z=0; z<vol->zres; z++) {
+    cz = z >> VOL_CELL_SHIFT;
+    for (y=0; y<vol->yres; y++) {
+      cy = y >> VOL_CELL_SHIFT;
+      row = vol->data + ((size_t) vol->xres * vol->yres * z) + 
+                        ((size_t) vol->xres * y);
+      cells = vol->cellmax + (cz*vol->cellyres + cy)*vol->cellxres;
+      for (x=0; x<vol->xres; x++) {
+        cx = x >> VOL_CELL_SHIFT;
+        if (row[x] > cells[cx])
+          cells[cx] = row[x];
+      }
+    }
+  }
+}
+
+/*
+ * Prepare freshly loaded linear voxel data for rendering, building the
+ * macrocell grid, and converting the voxels to the requested layout.
+ */
+static void setup_voxels(scalarvol * vol, int layout) {
+  unsigned char * vox;
+
+  build_macrocells(vol);
+
+  vol->voxoffs = voxel_offsets(vol->xres, vol->yres, vol->zres, 1, layout);
+  if (vol->voxoffs == NULL) {
+    rt_ui_message(MSG_ERR, "Can't allocate volume offset tables");
+    vol->loaded=0;
+    return;
+  }
+
+  if (layout == RT_VOLUME_LAYOUT_LINEAR)
+    return;
+
+  vox = voxel_relayout(vol->xres, vol->yres, vol->zres, 1, vol->voxoffs, 
+                       layout, vol->data);
+  if (vox == NULL) {
+    /* keep rendering from the linear data if we run out of memory */
+    free(vol->voxoffs);
+    vol->voxoffs = voxel_offsets(vol->xres, vol->yres, vol->zres, 1, 
+                                 RT_VOLUME_LAYOUT_LINEAR);
+    if (vol->voxoffs == NULL) 
+      vol->loaded=0;
+    return;
+  }
+
+  /* the linear copy is no longer needed */
+  if (vol->mapaddr != NULL) {
+    rt_munmap(vol->mapaddr, vol->maplen);
+    vol->mapaddr = NULL;
+    vol->maplen = 0;
+  } else {
+    free(vol->data);
+  }
+  vol->data = vox;
+}
+
+void LoadVol(scalarvol * vol, int layout) { 
   FILE * dfile;
+  size_t volsize = (size_t) vol->xres * vol->yres * vol->zres;
+
+  vol->cellmax = NULL;
+  vol->voxoffs = NULL;
+
+  /* Map the raw voxel data directly from the file if we can, so that */
+  /* it is paged in on demand and shared among processes on the node  */
+  vol->mapaddr = rt_mmap_readonly(vol->name, &vol->maplen);
+  if (vol->mapaddr != NULL) {
+    if (vol->maplen >= volsize) {
+      if (rt_mynode()==0) {
+        char msgtxt[2048];
+        sprintf(msgtxt, "Mapping %dx%dx%d volume set from %s",
+	    vol->xres, vol->yres, vol->zres, vol->name);
+        rt_ui_message(MSG_0, msgtxt);
+      } 
+      vol->data = (unsigned char *) vol->mapaddr;
+      vol->loaded=1;
+      setup_voxels(vol, layout);
+      return;
+    }
+
+    /* file is too short, let the regular loader report the error */
+    rt_munmap(vol->mapaddr, vol->maplen);
+    vol->mapaddr = NULL;
+    vol->maplen = 0;
+  }
  
   dfile=fopen(vol->name, "r");
   if (dfile==NULL) {
@@ -289,9 +448,9 @@ void LoadVol(scalarvol * vol) {
 	vol->xres, vol->yres, vol->zres, vol->name);
     rt_ui_message(MSG_0, msgtxt);
   } 
-  vol->data = malloc(vol->xres * vol->yres * vol->zres);
+  vol->data = malloc(volsize);
 
-  if (fread(vol->data, (vol->xres * vol->yres * vol->zres), 1, dfile) == 1) {
+  if (fread(vol->data, volsize, 1, dfile) == 1) {
     vol->loaded=1;
   } else {
     char msgtxt[2048];
@@ -300,6 +459,9 @@ void LoadVol(scalarvol * vol) {
   }
 
   fclose(dfile);
+
+  if (vol->loaded)
+    setup_voxels(vol, layout);
 }
 
 
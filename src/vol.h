@@ -6,8 +6,8 @@
 
 void * newscalarvol(void * intex, vector min, vector max, 
                     int xs, int ys, int zs, 
-                    const char * fname, scalarvol * invol);
+                    const char * fname, scalarvol * invol, int layout);
 
-void  LoadVol(scalarvol *);
+void  LoadVol(scalarvol *, int layout);
 color scalar_volume_texture(const vector *, const texture *, ray *);
 